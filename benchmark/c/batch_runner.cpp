@@ -0,0 +1,609 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+// batch_runner generates an output for every prompt of a JSONL file and writes them to another JSONL file, in the
+// same order. It is built for throughput on large offline jobs, so the work runs as a pipeline of three stages:
+//
+//   scheduler: reads a window of prompts, tokenizes them on several threads and splits the window into batches of
+//              similar length prompts (OgaBatchPlan) to keep the padding low
+//   generator: runs each batch through the model (the calling thread)
+//   writer:    decodes the outputs and writes them in input order as soon as all earlier prompts are written
+//
+// The stages are connected by bounded queues, so the next window is tokenized and the previous batches are decoded
+// while the model runs, and memory stays bounded however large the input file is.
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "ort_genai.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::string model_path;
+  std::string input_path;
+  std::string output_path;
+  size_t max_batch_size{8};
+  size_t max_batch_tokens{0};
+  size_t max_new_tokens{256};
+  size_t window_size{512};
+  size_t num_tokenizer_threads{std::max(1u, std::thread::hardware_concurrency())};
+  bool verbose{};
+};
+
+[[noreturn]] void PrintHelpAndExit(const char* program_name, int exit_code) {
+  const Options defaults{};
+
+  std::ostringstream s;
+
+  s << "Usage: " << program_name << " -i <model path> --input <prompts.jsonl> --output <outputs.jsonl> <other options>\n"
+    << "  Options:\n"
+    << "    -i,--input_folder <path>\n"
+    << "      Path to the ONNX model directory, compatible with onnxruntime-genai.\n"
+    << "    --input <path>\n"
+    << "      JSONL file with one prompt per line, either a JSON string or an object with a \"prompt\" string.\n"
+    << "    --output <path>\n"
+    << "      JSONL file the outputs are written to, one object per prompt in input order.\n"
+    << "    -b,--max_batch_size <number>\n"
+    << "      Most prompts generated together in one batch. Default: " << defaults.max_batch_size << "\n"
+    << "    --max_batch_tokens <number>\n"
+    << "      Most prompt tokens in one batch once padded, 0 for no limit. Default: " << defaults.max_batch_tokens << "\n"
+    << "    -g,--max_new_tokens <number>\n"
+    << "      Most tokens generated for each prompt. Default: " << defaults.max_new_tokens << "\n"
+    << "    --window <number>\n"
+    << "      Number of prompts sorted into batches together. Larger windows pad less but hold more in memory.\n"
+    << "      Default: " << defaults.window_size << "\n"
+    << "    -t,--tokenizer_threads <number>\n"
+    << "      Number of threads tokenizing the prompts. Default: number of hardware threads\n"
+    << "    -v,--verbose\n"
+    << "      Show more informational output.\n"
+    << "    -h,--help\n"
+    << "      Show this help message and exit.\n";
+
+  std::cerr << s.str();
+  std::exit(exit_code);
+}
+
+template <typename T>
+T ParseNumber(std::string_view s) {
+  T n;
+  const auto *s_begin = s.data(), *s_end = s.data() + s.size();
+  const auto [ptr, ec] = std::from_chars(s_begin, s_end, n);
+  if (ec != std::errc{} || ptr != s_end) {
+    throw std::runtime_error(std::string{"Failed to parse option value as number: "}.append(s));
+  }
+  return n;
+}
+
+Options ParseOptionsFromCommandLine(int argc, const char* const* argv) {
+  const char* const program_name = argc > 0 ? argv[0] : "batch_runner";
+  try {
+    Options opts{};
+
+    auto next_arg = [argc, argv](int& idx) {
+      if (idx + 1 >= argc) {
+        throw std::runtime_error("Option value not provided.");
+      }
+      return std::string_view{argv[++idx]};
+    };
+
+    for (int i = 1; i < argc; ++i) {
+      std::string_view arg{argv[i]};
+
+      if (arg == "-i" || arg == "--input_folder") {
+        opts.model_path = next_arg(i);
+      } else if (arg == "--input") {
+        opts.input_path = next_arg(i);
+      } else if (arg == "--output") {
+        opts.output_path = next_arg(i);
+      } else if (arg == "-b" || arg == "--max_batch_size") {
+        opts.max_batch_size = ParseNumber<size_t>(next_arg(i));
+      } else if (arg == "--max_batch_tokens") {
+        opts.max_batch_tokens = ParseNumber<size_t>(next_arg(i));
+      } else if (arg == "-g" || arg == "--max_new_tokens") {
+        opts.max_new_tokens = ParseNumber<size_t>(next_arg(i));
+      } else if (arg == "--window") {
+        opts.window_size = ParseNumber<size_t>(next_arg(i));
+      } else if (arg == "-t" || arg == "--tokenizer_threads") {
+        opts.num_tokenizer_threads = ParseNumber<size_t>(next_arg(i));
+      } else if (arg == "-v" || arg == "--verbose") {
+        opts.verbose = true;
+      } else if (arg == "-h" || arg == "--help") {
+        PrintHelpAndExit(program_name, 0);
+      } else {
+        throw std::runtime_error(std::string{"Unknown option: "}.append(arg));
+      }
+    }
+
+    if (opts.model_path.empty() || opts.input_path.empty() || opts.output_path.empty()) {
+      throw std::runtime_error("The model directory, input file and output file must be provided.");
+    }
+    if (opts.max_batch_size < 1 || opts.window_size < 1 || opts.num_tokenizer_threads < 1) {
+      throw std::runtime_error("Batch size, window and tokenizer threads must be at least 1.");
+    }
+
+    return opts;
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << "\n";
+    PrintHelpAndExit(program_name, 1);
+  }
+}
+
+// Minimal JSON support for the input and output lines, a JSON library is not part of this build
+
+void SkipWhitespace(std::string_view text, size_t& pos) {
+  while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r' || text[pos] == '\n'))
+    pos++;
+}
+
+void AppendUtf8(std::string& out, uint32_t code_point) {
+  if (code_point < 0x80) {
+    out += static_cast<char>(code_point);
+  } else if (code_point < 0x800) {
+    out += static_cast<char>(0xC0 | (code_point >> 6));
+    out += static_cast<char>(0x80 | (code_point & 0x3F));
+  } else if (code_point < 0x10000) {
+    out += static_cast<char>(0xE0 | (code_point >> 12));
+    out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (code_point & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (code_point >> 18));
+    out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (code_point & 0x3F));
+  }
+}
+
+uint32_t ParseHex4(std::string_view text, size_t& pos) {
+  if (pos + 4 > text.size())
+    throw std::runtime_error("Truncated \\u escape");
+  uint32_t value;
+  const auto [ptr, ec] = std::from_chars(text.data() + pos, text.data() + pos + 4, value, 16);
+  if (ec != std::errc{} || ptr != text.data() + pos + 4)
+    throw std::runtime_error("Invalid \\u escape");
+  pos += 4;
+  return value;
+}
+
+// Parses the JSON string starting at the quote at text[pos], leaves pos after the closing quote
+std::string ParseString(std::string_view text, size_t& pos) {
+  if (pos >= text.size() || text[pos] != '"')
+    throw std::runtime_error("Expected a string");
+  pos++;
+
+  std::string out;
+  while (pos < text.size() && text[pos] != '"') {
+    char c = text[pos++];
+    if (c != '\\') {
+      out += c;
+      continue;
+    }
+    if (pos >= text.size())
+      break;
+    switch (char escape = text[pos++]) {
+      case '"':
+      case '\\':
+      case '/':
+        out += escape;
+        break;
+      case 'b':
+        out += '\b';
+        break;
+      case 'f':
+        out += '\f';
+        break;
+      case 'n':
+        out += '\n';
+        break;
+      case 'r':
+        out += '\r';
+        break;
+      case 't':
+        out += '\t';
+        break;
+      case 'u': {
+        uint32_t code_point = ParseHex4(text, pos);
+        // A high surrogate is followed by the low surrogate of the same character
+        if (code_point >= 0xD800 && code_point < 0xDC00 && text.substr(pos, 2) == "\\u") {
+          pos += 2;
+          code_point = 0x10000 + ((code_point - 0xD800) << 10) + (ParseHex4(text, pos) - 0xDC00);
+        }
+        AppendUtf8(out, code_point);
+        break;
+      }
+      default:
+        throw std::runtime_error("Invalid escape in string");
+    }
+  }
+  if (pos >= text.size())
+    throw std::runtime_error("Unterminated string");
+  pos++;
+  return out;
+}
+
+// Skips the JSON value at text[pos] whatever its type
+void SkipValue(std::string_view text, size_t& pos) {
+  int depth = 0;
+  while (pos < text.size()) {
+    char c = text[pos];
+    if (c == '"') {
+      ParseString(text, pos);
+      continue;
+    }
+    if (c == '{' || c == '[') {
+      depth++;
+    } else if (c == '}' || c == ']') {
+      if (depth == 0)
+        return;
+      depth--;
+    } else if (c == ',' && depth == 0) {
+      return;
+    }
+    pos++;
+  }
+}
+
+// A line is either a JSON string or an object with a "prompt" string
+std::string ParsePrompt(std::string_view line) {
+  size_t pos = 0;
+  SkipWhitespace(line, pos);
+  if (pos < line.size() && line[pos] == '"')
+    return ParseString(line, pos);
+
+  if (pos >= line.size() || line[pos] != '{')
+    throw std::runtime_error("Expected a JSON string or object");
+  pos++;
+  while (true) {
+    SkipWhitespace(line, pos);
+    auto key = ParseString(line, pos);
+    SkipWhitespace(line, pos);
+    if (pos >= line.size() || line[pos] != ':')
+      throw std::runtime_error("Expected ':' after an object key");
+    pos++;
+    SkipWhitespace(line, pos);
+    if (key == "prompt")
+      return ParseString(line, pos);
+    SkipValue(line, pos);
+    if (pos >= line.size() || line[pos] != ',')
+      throw std::runtime_error("Object has no \"prompt\" string");
+    pos++;
+  }
+}
+
+void AppendEscaped(std::string& out, std::string_view text) {
+  out += '"';
+  for (char c : text) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buffer[8];
+          std::snprintf(buffer, sizeof(buffer), "\\u%04x", static_cast<unsigned>(c));
+          out += buffer;
+        } else {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+}
+
+// Queue between two pipeline stages. Push blocks while the queue is full so a fast stage can't run far ahead of a
+// slow one, and Pop returns nothing once the queue is closed and empty.
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity) : capacity_{capacity} {}
+
+  void Push(T item) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    not_full_.wait(lock, [&] { return items_.size() < capacity_ || closed_; });
+    if (closed_)
+      return;
+    items_.push(std::move(item));
+    not_empty_.notify_one();
+  }
+
+  std::optional<T> Pop() {
+    std::unique_lock<std::mutex> lock{mutex_};
+    not_empty_.wait(lock, [&] { return !items_.empty() || closed_; });
+    if (items_.empty())
+      return std::nullopt;
+    T item = std::move(items_.front());
+    items_.pop();
+    not_full_.notify_one();
+    return item;
+  }
+
+  void Close() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+ private:
+  const size_t capacity_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_, not_full_;
+  std::queue<T> items_;
+  bool closed_{};
+};
+
+struct Batch {
+  std::vector<size_t> prompt_indices;  // Index in the input file of each row
+  std::vector<size_t> prompt_lengths;
+  std::unique_ptr<OgaSequences> sequences;
+};
+
+struct BatchResult {
+  std::vector<size_t> prompt_indices;
+  std::vector<size_t> prompt_lengths;
+  std::vector<std::vector<int32_t>> outputs;  // Generated tokens of each row
+};
+
+struct Counters {
+  size_t prompts{};
+  size_t batches{};
+  size_t prompt_tokens{};
+  size_t padded_prompt_tokens{};
+  size_t generated_tokens{};
+};
+
+// Tokenizes the prompts of a window on several threads, each one taking every num_threads-th prompt
+std::vector<std::vector<int32_t>> TokenizeWindow(const OgaTokenizer& tokenizer, const std::vector<std::string>& prompts,
+                                                 size_t num_threads) {
+  std::vector<std::vector<int32_t>> tokens(prompts.size());
+  std::vector<std::exception_ptr> errors(num_threads);
+  std::vector<std::thread> threads;
+  for (size_t thread_index = 0; thread_index < num_threads; thread_index++) {
+    threads.emplace_back([&, thread_index] {
+      try {
+        for (size_t i = thread_index; i < prompts.size(); i += num_threads) {
+          auto sequences = OgaSequences::Create();
+          tokenizer.Encode(prompts[i].c_str(), *sequences);
+          tokens[i].assign(sequences->SequenceData(0), sequences->SequenceData(0) + sequences->SequenceCount(0));
+        }
+      } catch (...) {
+        errors[thread_index] = std::current_exception();
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  for (auto& error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+  return tokens;
+}
+
+// Scheduler stage: reads the input a window at a time and queues the planned batches of every window
+void ScheduleBatches(const Options& opts, const OgaTokenizer& tokenizer, BoundedQueue<Batch>& batches,
+                     Counters& counters) {
+  std::ifstream input{opts.input_path};
+  if (!input) {
+    throw std::runtime_error("Failed to read file: " + opts.input_path);
+  }
+
+  size_t next_prompt_index = 0;
+  std::string line;
+  while (input) {
+    std::vector<std::string> prompts;
+    while (prompts.size() < opts.window_size && std::getline(input, line)) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos)
+        continue;
+      try {
+        prompts.push_back(ParsePrompt(line));
+      } catch (const std::exception& e) {
+        throw std::runtime_error("Prompt " + std::to_string(next_prompt_index + prompts.size()) + ": " + e.what());
+      }
+    }
+    if (prompts.empty())
+      break;
+
+    auto tokens = TokenizeWindow(tokenizer, prompts, std::min(opts.num_tokenizer_threads, prompts.size()));
+    auto sequences = OgaSequences::Create();
+    for (auto& prompt_tokens : tokens)
+      sequences->Append(prompt_tokens.data(), prompt_tokens.size());
+
+    auto plan = OgaBatchPlan::Create(*sequences, opts.max_batch_size, opts.max_batch_tokens);
+    for (size_t batch_index = 0; batch_index < plan->BatchCount(); batch_index++) {
+      Batch batch;
+      size_t longest = 0;
+      const auto* indices = plan->BatchIndices(batch_index);
+      for (size_t row = 0; row < plan->BatchSize(batch_index); row++) {
+        const auto index = indices[row];
+        batch.prompt_indices.push_back(next_prompt_index + index);
+        batch.prompt_lengths.push_back(tokens[index].size());
+        longest = std::max(longest, tokens[index].size());
+        counters.prompt_tokens += tokens[index].size();
+      }
+      counters.padded_prompt_tokens += longest * batch.prompt_lengths.size();
+      batch.sequences = plan->GetBatchSequences(*sequences, batch_index);
+      batches.Push(std::move(batch));
+    }
+
+    next_prompt_index += prompts.size();
+    if (opts.verbose)
+      std::cout << "Scheduled " << next_prompt_index << " prompts\n";
+  }
+  counters.prompts = next_prompt_index;
+}
+
+// Generator stage: runs one batch through the model
+BatchResult GenerateBatch(const Options& opts, const OgaModel& model, Batch& batch) {
+  const size_t batch_size = batch.prompt_lengths.size();
+  const size_t longest = *std::max_element(batch.prompt_lengths.begin(), batch.prompt_lengths.end());
+
+  auto params = OgaGeneratorParams::Create(model);
+  params->SetSearchOption("batch_size", static_cast<double>(batch_size));
+  params->SetSearchOption("max_length", static_cast<double>(longest + opts.max_new_tokens));
+
+  auto generator = OgaGenerator::Create(model, *params);
+  generator->AppendTokenSequences(*batch.sequences);
+  while (!generator->IsDone()) {
+    generator->GenerateNextToken();
+  }
+
+  // The prompts are padded to the longest one, so every row's output starts after it. Rows that finished early are
+  // filled with pad tokens, which are special tokens and decode to nothing.
+  BatchResult result{std::move(batch.prompt_indices), std::move(batch.prompt_lengths), {}};
+  for (size_t row = 0; row < batch_size; row++) {
+    const auto* data = generator->GetSequenceData(row);
+    const auto count = generator->GetSequenceCount(row);
+    result.outputs.emplace_back(data + std::min(longest, count), data + count);
+  }
+  return result;
+}
+
+// Writer stage: decodes the outputs and writes them in input order
+void WriteResults(const Options& opts, const OgaTokenizer& tokenizer, BoundedQueue<BatchResult>& results,
+                  Counters& counters) {
+  std::ofstream output{opts.output_path};
+  if (!output) {
+    throw std::runtime_error("Failed to write file: " + opts.output_path);
+  }
+
+  // Lines of the outputs that are done while an earlier prompt is still being generated
+  std::map<size_t, std::string> pending;
+  size_t next_prompt_index = 0;
+
+  while (auto result = results.Pop()) {
+    for (size_t row = 0; row < result->outputs.size(); row++) {
+      const auto& tokens = result->outputs[row];
+      const std::string text{tokenizer.Decode(tokens.data(), tokens.size())};
+      counters.generated_tokens += tokens.size();
+
+      std::string line = "{\"index\": " + std::to_string(result->prompt_indices[row]) +
+                         ", \"prompt_tokens\": " + std::to_string(result->prompt_lengths[row]) +
+                         ", \"output\": ";
+      AppendEscaped(line, text);
+      line += "}\n";
+      pending.emplace(result->prompt_indices[row], std::move(line));
+    }
+
+    for (auto it = pending.begin(); it != pending.end() && it->first == next_prompt_index; it = pending.erase(it)) {
+      output << it->second;
+      next_prompt_index++;
+    }
+    output.flush();
+  }
+
+  if (!pending.empty()) {
+    throw std::runtime_error("Outputs are missing for some prompts");
+  }
+}
+
+void RunBatches(const Options& opts) {
+  auto model = OgaModel::Create(opts.model_path.c_str());
+  auto tokenizer = OgaTokenizer::Create(*model);
+
+  // Enough queued batches to keep the model busy while the next window is tokenized
+  BoundedQueue<Batch> batches{std::max<size_t>(2, opts.window_size / opts.max_batch_size)};
+  BoundedQueue<BatchResult> results{4};
+  Counters counters;
+  std::exception_ptr scheduler_error, writer_error;
+
+  const auto start = Clock::now();
+
+  std::thread scheduler{[&] {
+    try {
+      ScheduleBatches(opts, *tokenizer, batches, counters);
+    } catch (...) {
+      scheduler_error = std::current_exception();
+    }
+    batches.Close();
+  }};
+
+  std::thread writer{[&] {
+    try {
+      WriteResults(opts, *tokenizer, results, counters);
+    } catch (...) {
+      writer_error = std::current_exception();
+      // Unblock the other stages, nothing more can be written
+      batches.Close();
+      results.Close();
+    }
+  }};
+
+  std::exception_ptr generator_error;
+  try {
+    while (auto batch = batches.Pop()) {
+      results.Push(GenerateBatch(opts, *model, *batch));
+      counters.batches++;
+    }
+  } catch (...) {
+    generator_error = std::current_exception();
+    batches.Close();
+  }
+  results.Close();
+
+  scheduler.join();
+  writer.join();
+  for (auto& error : {generator_error, scheduler_error, writer_error}) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  using SecondsFp = std::chrono::duration<float>;
+  const auto elapsed = SecondsFp{Clock::now() - start}.count();
+  std::cout << "Prompts: " << counters.prompts
+            << "\nBatches: " << counters.batches
+            << "\nPrompt tokens: " << counters.prompt_tokens
+            << " (" << counters.padded_prompt_tokens << " once padded)"
+            << "\nGenerated tokens: " << counters.generated_tokens
+            << " (including the padding of rows that finished early)"
+            << "\nTime (s): " << elapsed
+            << "\nPrompts/s: " << counters.prompts / elapsed
+            << "\nGenerated tokens/s: " << counters.generated_tokens / elapsed
+            << "\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  OgaHandle handle;
+  try {
+    const auto opts = ParseOptionsFromCommandLine(argc, argv);
+    RunBatches(opts);
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "Exception: " << e.what() << "\n";
+    return 1;
+  }
+}
@@ -19,4 +19,4 @@ option(TEST_PHI2 "Enable tests for Phi2" OFF)
 option(ENABLE_MODEL_BENCHMARK "Build model benchmark program" ON)
 
 # diagnostics
-option(ENABLE_TRACING "Enable recording of tracing data" OFF)
+option(ENABLE_TRACING "Record tracing data from startup, it can also be switched at runtime" OFF)
@@ -14,6 +14,7 @@
 #include <psapi.h>
 #endif
 
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <iostream>
@@ -169,6 +170,7 @@ std::string SLMEngine::format_prompt(
 }
 
 SLMEngine::~SLMEngine() {
+  stop_batching();
   m_onnx_model.reset();
   m_tokenizer.reset();
   m_tokenizer_stream.reset();
@@ -431,6 +433,16 @@ std::string SLMEngine::complete(const char* user_prompt) {
                       .count();
 
   m_llm_output_dbg_stream << response << endl;
+  return make_response(input_parameters, formatted_prompt, std::move(response),
+                       kpi, status);
+}
+
+std::string SLMEngine::make_response(
+    const InputDecoder::InputParams& input_parameters,
+    const std::string& formatted_prompt,
+    std::string response,
+    const RuntimePerf& kpi,
+    const Status& status) {
   // We need to remove the stop token from the response
   for (const auto& stop_token : input_parameters.StopTokens) {
     auto stop_token_pos = response.find(stop_token);
@@ -479,11 +491,316 @@ std::string SLMEngine::complete(const char* user_prompt) {
 
   output_json["kpi"] = kpi_json;
 
-  json response_message;
-  response_message["response"] = output_json;
   return output_json.dump();
 }
 
+void SLMEngine::start_batching(const BatchingOptions& options) {
+  std::lock_guard<std::mutex> lock(m_queue_mutex);
+  if (m_batching_started) {
+    return;
+  }
+  m_batching_options = options;
+  if (m_batching_options.MaxBatchSize == 0) {
+    m_batching_options.MaxBatchSize = 1;
+  }
+  m_stop_batching = false;
+  m_batching_started = true;
+  m_batching_thread = std::thread(&SLMEngine::batching_loop, this);
+}
+
+void SLMEngine::stop_batching() {
+  {
+    std::lock_guard<std::mutex> lock(m_queue_mutex);
+    if (!m_batching_started) {
+      return;
+    }
+    m_stop_batching = true;
+  }
+  m_queue_cv.notify_all();
+  m_batching_thread.join();
+
+  std::lock_guard<std::mutex> lock(m_queue_mutex);
+  for (auto& request : m_queue) {
+    request->result.set_value(make_response(
+        request->input_params, request->formatted_prompt, "", RuntimePerf(),
+        Status{false, "SLM Engine stopped before the request was served"}));
+  }
+  m_queue.clear();
+  m_batching_started = false;
+}
+
+std::future<std::string> SLMEngine::complete_async(
+    const char* user_prompt, StreamCallback stream_callback) {
+  auto request = std::make_unique<QueuedRequest>();
+  auto result = request->result.get_future();
+
+  SLMEngine::Status status;
+  if (!m_input_decoder->decode(user_prompt, request->input_params)) {
+    cout << RED << "Error decoding input message: " << user_prompt << CLEAR
+         << endl;
+    status = Status{false,
+                    "Error decoding input message: " + string(user_prompt)};
+  } else {
+    const auto& input_parameters = request->input_params;
+    request->formatted_prompt = format_input(input_parameters);
+    request->generation_options.MaxGeneratedTokens = input_parameters.MaxGeneratedTokens;
+    request->generation_options.Temperature = input_parameters.Temperature;
+    request->generation_options.TopK = input_parameters.TopK;
+    request->generation_options.TopP = input_parameters.TopP;
+    request->stream_callback = std::move(stream_callback);
+    request->arrival_time = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(m_queue_mutex);
+    if (!m_batching_started || m_stop_batching) {
+      status = Status{false, "Batching is not started"};
+    } else if (m_queue.size() >= m_batching_options.MaxQueuedRequests) {
+      // Backpressure: reject instead of letting the queue grow without bound
+      status = Status{false, "Request queue is full"};
+    } else {
+      m_queue.push_back(std::move(request));
+      lock.unlock();
+      m_queue_cv.notify_one();
+      return result;
+    }
+  }
+
+  request->result.set_value(make_response(
+      request->input_params, request->formatted_prompt, "", RuntimePerf(),
+      status));
+  return result;
+}
+
+namespace {
+bool SameGenerationOptions(const SLMEngine::GenerationOptions& first,
+                           const SLMEngine::GenerationOptions& second) {
+  return first.MaxGeneratedTokens == second.MaxGeneratedTokens &&
+         first.TopK == second.TopK && first.TopP == second.TopP &&
+         first.Temperature == second.Temperature;
+}
+}  // namespace
+
+bool SLMEngine::can_batch(const QueuedRequest& first,
+                          const QueuedRequest& second) const {
+  // The adapter is active for the whole generator
+  if (first.input_params.LoRAAdapterName !=
+      second.input_params.LoRAAdapterName) {
+    return false;
+  }
+  return m_supports_row_search_options ||
+         SameGenerationOptions(first.generation_options,
+                               second.generation_options);
+}
+
+void SLMEngine::batching_loop() {
+  while (true) {
+    std::vector<std::unique_ptr<QueuedRequest>> batch;
+    {
+      std::unique_lock<std::mutex> lock(m_queue_mutex);
+      m_queue_cv.wait(lock, [this] {
+        return m_stop_batching || !m_queue.empty();
+      });
+      if (m_stop_batching) {
+        return;
+      }
+
+      // Give the requests arriving shortly after the oldest one a chance to
+      // join its batch. Requests that queued up while the previous batch was
+      // generating are past their window already and start right away.
+      auto batch_deadline =
+          m_queue.front()->arrival_time +
+          std::chrono::milliseconds(m_batching_options.BatchWindowMs);
+      m_queue_cv.wait_until(lock, batch_deadline, [this] {
+        return m_stop_batching ||
+               m_queue.size() >= m_batching_options.MaxBatchSize;
+      });
+      if (m_stop_batching) {
+        return;
+      }
+
+      // The oldest request always goes first, then the ones that can share
+      // its generator in the order they arrived
+      batch.push_back(std::move(m_queue.front()));
+      m_queue.pop_front();
+      for (auto it = m_queue.begin();
+           it != m_queue.end() &&
+           batch.size() < m_batching_options.MaxBatchSize;) {
+        if (can_batch(*batch.front(), **it)) {
+          batch.push_back(std::move(*it));
+          it = m_queue.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+
+    generate_batch(batch);
+  }
+}
+
+void SLMEngine::generate_batch(
+    std::vector<std::unique_ptr<QueuedRequest>>& batch) {
+  const auto batch_size = batch.size();
+  const auto& adapter_name = batch.front()->input_params.LoRAAdapterName;
+  const auto& generation_options = batch.front()->generation_options;
+
+  // The batch max_length covers the longest request, each row stops at its own
+  uint32_t max_length = 0;
+  bool same_options = true;
+  for (const auto& request : batch) {
+    max_length = std::max(max_length, request->generation_options.MaxGeneratedTokens);
+    same_options = same_options && SameGenerationOptions(generation_options,
+                                                         request->generation_options);
+  }
+
+  std::vector<std::string> responses(batch_size);
+  std::vector<uint32_t> prompt_token_counts(batch_size, 0);
+  std::vector<uint32_t> generated_token_counts(batch_size, 0);
+  std::vector<bool> finished(batch_size, false);
+  auto first_token_time = std::chrono::steady_clock::now();
+  uint32_t generation_time = 0;
+  SLMEngine::Status status{true, "Generation successful"};
+
+  if (m_verbose) {
+    cout << BLUE << "Generating batch of " << batch_size << " requests"
+         << CLEAR << endl;
+  }
+
+  try {
+    if (!adapter_name.empty() && !m_adapters) {
+      throw std::runtime_error("Adapter not found: " + adapter_name);
+    }
+
+    auto generator_params = OgaGeneratorParams::Create(*m_onnx_model);
+    generator_params->SetSearchOption("batch_size", static_cast<double>(batch_size));
+    generator_params->SetSearchOption("max_length", max_length);
+    generator_params->SetSearchOption("temperature", generation_options.Temperature);
+    generator_params->SetSearchOption("top_k", generation_options.TopK);
+    generator_params->SetSearchOption("top_p", generation_options.TopP);
+    if (!same_options) {
+      // can_batch() only mixes options when the search supports them per row
+      for (size_t i = 0; i < batch_size; i++) {
+        const auto& row_options = batch[i]->generation_options;
+        generator_params->SetRowSearchOption(i, "max_length", row_options.MaxGeneratedTokens);
+        generator_params->SetRowSearchOption(i, "temperature", row_options.Temperature);
+        generator_params->SetRowSearchOption(i, "top_k", row_options.TopK);
+        generator_params->SetRowSearchOption(i, "top_p", row_options.TopP);
+      }
+    }
+
+    auto generator = OgaGenerator::Create(*m_onnx_model, *generator_params);
+    if (!adapter_name.empty()) {
+      generator->SetActiveAdapter(*m_adapters, adapter_name.c_str());
+    }
+
+    // Each row decodes its own tokens, so each needs its own stream
+    auto sequences = OgaSequences::Create();
+    std::vector<std::unique_ptr<OgaTokenizerStream>> tokenizer_streams;
+    for (size_t i = 0; i < batch_size; i++) {
+      m_tokenizer->Encode(batch[i]->formatted_prompt.c_str(), *sequences);
+      prompt_token_counts[i] = sequences->SequenceCount(i);
+      tokenizer_streams.push_back(OgaTokenizerStream::Create(*m_tokenizer));
+    }
+
+    // The prompts are padded to the longest one and prefilled together
+    generator->AppendTokenSequences(*sequences);
+
+    bool is_first_token = true;
+    while (!generator->IsDone()) {
+      generator->GenerateNextToken();
+      if (is_first_token) {
+        is_first_token = false;
+        first_token_time = std::chrono::steady_clock::now();
+      }
+
+      auto next_tokens = generator->GetNextTokens();
+      size_t finished_count = 0;
+      for (size_t i = 0; i < batch_size; i++) {
+        if (!finished[i] &&
+            std::find(m_eos_token_ids.begin(), m_eos_token_ids.end(),
+                      next_tokens[i]) != m_eos_token_ids.end()) {
+          finished[i] = true;
+        }
+        if (finished[i]) {
+          finished_count++;
+          continue;
+        }
+
+        generated_token_counts[i]++;
+        std::string next_string_piece = tokenizer_streams[i]->Decode(next_tokens[i]);
+        responses[i] += next_string_piece;
+
+        // Everything after a stop token is cut from the response, so the row
+        // is done as soon as one shows up
+        for (const auto& stop_token : batch[i]->input_params.StopTokens) {
+          if (responses[i].find(stop_token) != std::string::npos) {
+            finished[i] = true;
+            break;
+          }
+        }
+
+        if (!finished[i] && batch[i]->stream_callback &&
+            !batch[i]->stream_callback(next_string_piece)) {
+          finished[i] = true;
+        }
+
+        // A row reaching its own max_length gets padding from now on
+        if (generator->GetSequenceCount(i) >=
+            batch[i]->generation_options.MaxGeneratedTokens) {
+          finished[i] = true;
+        }
+        if (finished[i]) {
+          finished_count++;
+        }
+      }
+
+      // The generator keeps going until every row is done, stop early once
+      // every request has its answer
+      if (finished_count == batch_size) {
+        break;
+      }
+    }
+    generation_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - first_token_time)
+                          .count();
+  } catch (const std::exception& e) {
+    cout << RED << "Error generating batch: " << e.what() << CLEAR << endl;
+    status = Status{false, e.what()};
+  }
+
+  auto batch_end = std::chrono::steady_clock::now();
+  auto memory_used = GetMemoryUsage();
+  for (size_t i = 0; i < batch_size; i++) {
+    auto& request = *batch[i];
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_llm_input_dbg_stream << request.formatted_prompt << endl;
+      m_llm_output_dbg_stream << responses[i] << endl;
+    }
+
+    RuntimePerf kpi;
+    kpi.PromptTokenCount = prompt_token_counts[i];
+    kpi.TimeToFirstToken =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            first_token_time - request.arrival_time)
+            .count();
+    kpi.GeneratedTokenCount = generated_token_counts[i];
+    if (generation_time > 0) {
+      kpi.TokenRate = kpi.GeneratedTokenCount * 1000 / generation_time;
+    }
+    if (kpi.GeneratedTokenCount > 0) {
+      kpi.GenerationTimePerToken = generation_time / kpi.GeneratedTokenCount;
+    }
+    kpi.TotalTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        batch_end - request.arrival_time)
+                        .count();
+    kpi.CurrentMemoryUsed = memory_used;
+
+    request.result.set_value(make_response(
+        request.input_params, request.formatted_prompt,
+        std::move(responses[i]), kpi, status));
+  }
+}
+
 // Use a Dictionary to store various types of prompt formatting
 // LLama3.2 and Phi3 have different prompt formats
 // Llama3.2 format described here:
@@ -563,11 +880,29 @@ bool SLMEngine::load_model(const char* model_path) {
   }
 
   m_onnx_model = OgaModel::Create(model_path);
+  m_supports_row_search_options =
+      std::string(m_onnx_model->GetDeviceType()) == "CPU";
   m_tokenizer = OgaTokenizer::Create(*m_onnx_model);
   m_tokenizer_stream = OgaTokenizerStream::Create(*m_tokenizer);
   // m_generator_params = OgaGeneratorParams::Create(*m_onnx_model);
   // m_sequences = OgaSequences::Create();
 
+  // The batched generation needs the end of sequence tokens to tell when each
+  // row of the batch is done
+  std::ifstream genai_config_file(m_model_path + "/genai_config.json");
+  if (genai_config_file.is_open()) {
+    auto genai_config = json::parse(genai_config_file, nullptr, false);
+    if (!genai_config.is_discarded() && genai_config.contains("model") &&
+        genai_config["model"].contains("eos_token_id")) {
+      const auto& eos_token_id = genai_config["model"]["eos_token_id"];
+      if (eos_token_id.is_array()) {
+        m_eos_token_ids = eos_token_id.get<std::vector<int32_t>>();
+      } else {
+        m_eos_token_ids.push_back(eos_token_id.get<int32_t>());
+      }
+    }
+  }
+
   m_input_decoder = InputDecoder::CreateDecoder("openai");
   if (m_input_decoder == nullptr) {
     cout << "Error!" << endl;
@@ -1,12 +1,16 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <string>
-#include <functional>
+#include <thread>
 
 #if defined(_WIN32) || defined(_WIN64)
 #include <string.h>
@@ -190,6 +194,49 @@ class SLM_ENGINE_EXPORT SLMEngine {
   /// works
   std::string complete(const char* prompt);
 
+  /// @brief Options of the request queue used by complete_async()
+  /// @param MaxBatchSize Most requests that are generated together in one batch
+  /// @param BatchWindowMs How long the first request of a batch waits for more
+  /// requests to arrive before the batch starts (milliseconds)
+  /// @param MaxQueuedRequests Most requests waiting in the queue. Requests
+  /// arriving when the queue is full are rejected right away
+  struct BatchingOptions {
+    uint32_t MaxBatchSize;
+    uint32_t BatchWindowMs;
+    uint32_t MaxQueuedRequests;
+    explicit BatchingOptions() {
+      MaxBatchSize = 4;
+      BatchWindowMs = 20;
+      MaxQueuedRequests = 64;
+    }
+  };
+
+  /// @brief Callback called with each piece of the response as it is
+  /// generated. Returning false stops the generation for that request.
+  using StreamCallback = std::function<bool(const std::string& piece)>;
+
+  /// @brief Starts the thread that serves the requests queued by
+  /// complete_async()
+  /// @param options Batching options to use
+  ///
+  /// Requests that arrive within the batch window and ask for the same LoRA
+  /// adapter and generation options are generated together in one batch.
+  void start_batching(const BatchingOptions& options);
+
+  /// @brief Stops the batching thread. The requests still waiting in the queue
+  /// are completed with an error response.
+  void stop_batching();
+
+  /// @brief Queues a request to be generated in a batch with other requests
+  /// @param prompt User prompt in the same format as complete()
+  /// @param stream_callback Optional callback called with each piece of the
+  /// response as it is generated, from the batching thread
+  /// @return Future holding the same response JSON string as complete(). When
+  /// the queue is full or start_batching() was not called, the future holds an
+  /// error response immediately.
+  std::future<std::string> complete_async(
+      const char* prompt, StreamCallback stream_callback = nullptr);
+
   /// @brief Struct to hold the runtime performance metrics of the SLM Engine
   /// @param PromptTokenCount Number of tokens in the prompt
   /// @param TimeToFirstToken Time taken to generate the first token (milliseconds)
@@ -298,6 +345,44 @@ class SLM_ENGINE_EXPORT SLMEngine {
   /// @return Complete prompt to be fed to the LLM
   std::string format_input(const InputDecoder::InputParams& input_params);
 
+  /// @brief Builds the response JSON string returned by complete()
+  /// @param input_params Decoded input parameters of the request
+  /// @param formatted_prompt Prompt given to the LLM
+  /// @param response Generated response, stop tokens are removed from it
+  /// @param kpi Runtime performance metrics of the request
+  /// @param status Status of the generation
+  /// @return Response JSON object as a string
+  std::string make_response(
+      const InputDecoder::InputParams& input_params,
+      const std::string& formatted_prompt,
+      std::string response,
+      const RuntimePerf& kpi,
+      const Status& status);
+
+  /// @brief Request waiting in the queue of complete_async()
+  struct QueuedRequest {
+    InputDecoder::InputParams input_params;
+    std::string formatted_prompt;
+    GenerationOptions generation_options;
+    StreamCallback stream_callback;
+    std::promise<std::string> result;
+    std::chrono::steady_clock::time_point arrival_time;
+  };
+
+  /// @brief Returns true when both requests can be generated in the same batch.
+  /// They need the same LoRA adapter. Their generation options may differ
+  /// when the model runs on the CPU, where each row gets its own search
+  /// options, otherwise they must match.
+  bool can_batch(const QueuedRequest& first, const QueuedRequest& second) const;
+
+  /// @brief Loop of the batching thread, forms batches from the queue
+  void batching_loop();
+
+  /// @brief Generates a batch of requests with one OgaGenerator and fulfills
+  /// their promises
+  /// @param batch Requests accepted together by can_batch()
+  void generate_batch(std::vector<std::unique_ptr<QueuedRequest>>& batch);
+
   // Define the Model related prompts
   struct PromptFormat {
     std::string prefix;
@@ -363,8 +448,23 @@ class SLM_ENGINE_EXPORT SLMEngine {
   std::ofstream m_llm_input_dbg_stream;
   std::ofstream m_llm_output_dbg_stream;
 
+  // Token ids that end the response of a row, read from genai_config.json
+  std::vector<int32_t> m_eos_token_ids;
+
+  // Per row search options are only supported by the CPU search
+  bool m_supports_row_search_options{false};
+
   // Need a scoped mutex to ensure only one complete() call at a time
   std::mutex m_mutex;
+
+  // Request queue of complete_async(), served by m_batching_thread
+  BatchingOptions m_batching_options;
+  std::mutex m_queue_mutex;
+  std::condition_variable m_queue_cv;
+  std::deque<std::unique_ptr<QueuedRequest>> m_queue;
+  bool m_batching_started{false};
+  bool m_stop_batching{false};
+  std::thread m_batching_thread;
 };
 }  // namespace slm_engine
 }  // namespace microsoft
@@ -7,6 +7,7 @@
 #include <string>
 #include <fstream>
 #include <filesystem>
+#include <future>
 #include <vector>
 
 #define MAGENTA "\033[35;1m"
@@ -198,6 +199,54 @@ TEST(SLMEngineTest, TestGeneration) {
   }
 }
 
+TEST(SLMEngineTest, TestBatchedGeneration) {
+  ASSERT_TRUE(MODEL_FILE_PATH != nullptr) << "MODEL_FILE_PATH is not set";
+
+  auto slm_engine = microsoft::slm_engine::SLMEngine::Create(
+      MODEL_FILE_PATH, false);
+  ASSERT_NE(slm_engine, nullptr);
+
+  SLMEngine::BatchingOptions batching_options;
+  batching_options.MaxBatchSize = 4;
+  batching_options.BatchWindowMs = 100;
+  slm_engine->start_batching(batching_options);
+
+  // Queue every prompt at once so that they are generated in batches. The
+  // requests ask for different options, which a CPU batch mixes per row.
+  std::vector<std::future<std::string>> results;
+  std::vector<std::string> streamed(std::size(TEST_PROMPTS));
+  for (size_t i = 0; i < std::size(TEST_PROMPTS); i++) {
+    nlohmann::json request;
+    request["messages"] = {
+        {{"role", "system"}, {"content", TEST_PROMPTS[i].system_prompt}},
+        {{"role", "user"}, {"content", TEST_PROMPTS[i].user_prompt}}};
+    request["max_tokens"] = i % 2 == 0 ? 250 : 300;
+    request["temperature"] = i % 2 == 0 ? 0.000000001f : 0.00000001f;
+    request["stop"] = {"\n"};
+    results.push_back(slm_engine->complete_async(
+        request.dump().c_str(), [&streamed, i](const std::string& piece) {
+          streamed[i] += piece;
+          return true;
+        }));
+  }
+
+  for (size_t i = 0; i < std::size(TEST_PROMPTS); i++) {
+    auto output_json = nlohmann::json::parse(results[i].get());
+    ASSERT_EQ(output_json["status"], "success") << output_json.dump();
+
+    auto response = trim(output_json["choices"][0]["message"]["content"].get<std::string>());
+    cout << "Response: " << response << endl;
+    cout << "Expected: " << TEST_PROMPTS[i].expected_answer << endl;
+    EXPECT_STREQ(response.c_str(), TEST_PROMPTS[i].expected_answer.c_str())
+        << "Test failed for prompt: " << TEST_PROMPTS[i].user_prompt;
+    // The piece holding the stop token is not streamed, so the streamed text
+    // is the start of the response
+    EXPECT_EQ(response.find(trim(streamed[i])), 0) << streamed[i];
+  }
+
+  slm_engine->stop_batching();
+}
+
 const char* TEST_INPUT_FILE = getenv("TEST_INPUT_FILE");
 
 TEST(SLMEngineTest, CaptureMemoryUsage) {
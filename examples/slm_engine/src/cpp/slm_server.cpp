@@ -1,7 +1,11 @@
 #include <argparse/argparse.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <regex>
 #include <sstream>
@@ -28,8 +32,56 @@ using json = nlohmann::json;
 
 using namespace std;
 
+// Prints the KPIs of a completed request
+void print_kpi(const json& output_json) {
+  if (output_json["status"] != "success") {
+    cout << RED << "Error: " << output_json["message"] << CLEAR << "\n";
+    flush(cout);
+    return;
+  }
+  cout << "Prompt Tokens: "
+       << output_json["kpi"]["prompt_toks"] << " "
+       << "TTFT: " << MAGENTA_BOLD
+       << output_json["kpi"]["ttft"].template get<float>() /
+              1000.0f
+       << " sec " << CLEAR << "Generated: "
+       << output_json["kpi"]["generated_toks"] << " "
+       << "Token Rate: " << MAGENTA_BOLD
+       << output_json["kpi"]["tok_rate"] << CLEAR << " "
+       << "Time: "
+       << output_json["kpi"]["total_time"]
+                  .template get<float>() /
+              1000.0f
+       << " sec "
+       << "Memory: " << MAGENTA_BOLD
+       << output_json["kpi"]["memory_usage"] << CLEAR << " MB"
+       << "\n";
+  flush(cout);
+}
+
+// Status code for a completed request, a full request queue is reported as
+// 503 so that clients back off and retry
+int http_status(const json& output_json) {
+  if (output_json["status"] != "success" &&
+      output_json["message"] == "Request queue is full") {
+    return 503;
+  }
+  return 200;
+}
+
+// Pieces of a streamed response handed from the batching thread of the engine
+// to the HTTP thread writing the response
+struct StreamedResponse {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::string> pieces;
+  std::atomic<bool> cancelled{false};
+  std::future<std::string> result;
+};
+
 int run_server(const string& model_path,
-               int port_number, bool verbose) {
+               int port_number, bool verbose,
+               const microsoft::slm_engine::SLMEngine::BatchingOptions& batching_options) {
   // Create the SLM
   auto slm_engine = microsoft::slm_engine::SLMEngine::Create(
       model_path.c_str(), verbose);
@@ -38,6 +90,9 @@ int run_server(const string& model_path,
     return -1;
   }
 
+  // Requests arriving together are generated together in batches
+  slm_engine->start_batching(batching_options);
+
   httplib::Server svr;
 
   svr.Get("/", [&](const httplib::Request& req, httplib::Response& res) {
@@ -59,34 +114,83 @@ int run_server(const string& model_path,
   // POST /completions endpoint
   svr.Post("/completions", [&](const httplib::Request& req,
                                httplib::Response& res) {
-    auto response = slm_engine->complete(req.body.c_str());
-    // Get the KPIs
-    json output_json = json::parse(response);
-    cout << "Prompt Tokens: "
-         << output_json["kpi"]["prompt_toks"] << " "
-         << "TTFT: " << MAGENTA_BOLD
-         << output_json["kpi"]["ttft"].template get<float>() /
-                1000.0f
-         << " sec " << CLEAR << "Generated: "
-         << output_json["kpi"]["generated_toks"] << " "
-         << "Token Rate: " << MAGENTA_BOLD
-         << output_json["kpi"]["tok_rate"] << CLEAR << " "
-         << "Time: "
-         << output_json["kpi"]["total_time"]
-                    .template get<float>() /
-                1000.0f
-         << " sec "
-         << "Memory: " << MAGENTA_BOLD
-         << output_json["kpi"]["memory_usage"] << CLEAR << " MB"
-         << "\n";
-    flush(cout);
+    auto request_json = json::parse(req.body, nullptr, false);
+    bool stream = request_json.is_object() &&
+                  request_json.value("stream", false);
+
+    if (!stream) {
+      auto response = slm_engine->complete_async(req.body.c_str()).get();
+      json output_json = json::parse(response);
+      print_kpi(output_json);
+
+      res.status = http_status(output_json);
+      res.set_content(response, "application/json");
+      return;
+    }
+
+    // Streamed response: each generated piece is sent as a server sent event
+    // as soon as it is generated, followed by the complete response
+    auto streamed = std::make_shared<StreamedResponse>();
+    streamed->result = slm_engine->complete_async(
+        req.body.c_str(), [streamed](const std::string& piece) {
+          {
+            std::lock_guard<std::mutex> lock(streamed->mutex);
+            streamed->pieces.push_back(piece);
+          }
+          streamed->cv.notify_one();
+          // Stop generating for clients that went away
+          return !streamed->cancelled.load();
+        });
 
     res.status = 200;
-    res.set_content(response, "application/json");
+    res.set_chunked_content_provider(
+        "text/event-stream",
+        [streamed](size_t, httplib::DataSink& sink) {
+          while (true) {
+            // The result is ready only after the last piece was pushed, so
+            // check for it before taking the pieces
+            bool done = streamed->result.wait_for(std::chrono::seconds(0)) ==
+                        std::future_status::ready;
+            std::deque<std::string> pieces;
+            {
+              std::unique_lock<std::mutex> lock(streamed->mutex);
+              if (!done) {
+                streamed->cv.wait_for(lock, std::chrono::milliseconds(50), [&] {
+                  return !streamed->pieces.empty();
+                });
+              }
+              pieces.swap(streamed->pieces);
+            }
+
+            for (const auto& piece : pieces) {
+              json event = {{"content", piece}};
+              auto data = "data: " + event.dump() + "\n\n";
+              if (!sink.write(data.data(), data.size())) {
+                streamed->cancelled = true;
+                return false;
+              }
+            }
+
+            if (done) {
+              auto response = streamed->result.get();
+              print_kpi(json::parse(response));
+              auto data = "data: " + response + "\n\n";
+              sink.write(data.data(), data.size());
+              sink.done();
+              return true;
+            }
+          }
+        },
+        [streamed](bool success) {
+          if (!success) {
+            streamed->cancelled = true;
+          }
+        });
   });
 
   cout << MAGENTA_BOLD << "Starting server on port: " << port_number << CLEAR << endl;
   svr.listen("0.0.0.0", port_number);
+  slm_engine->stop_batching();
   return 0;
 }
 
@@ -105,6 +209,25 @@ int main(int argc, char** argv) {
       .help("HTTP Port Number to use (default 8080)")
       .store_into(port_number);
 
+  int max_batch_size = 4;
+  program.add_argument("--max_batch_size")
+      .help("Most requests generated together in one batch (default 4)")
+      .store_into(max_batch_size);
+
+  int batch_window_ms = 20;
+  program.add_argument("--batch_window_ms")
+      .help(
+          "Milliseconds a request waits for others to join its batch "
+          "(default 20)")
+      .store_into(batch_window_ms);
+
+  int max_queued_requests = 64;
+  program.add_argument("--max_queued_requests")
+      .help(
+          "Most requests waiting to be served, more are rejected with HTTP "
+          "503 (default 64)")
+      .store_into(max_queued_requests);
+
   program.add_argument("-v", "--verbose")
       .default_value(false)
       .implicit_value(true)
@@ -131,6 +254,11 @@ int main(int argc, char** argv) {
     verbose = true;
   }
 
-  run_server(model_path, port_number, verbose);
+  microsoft::slm_engine::SLMEngine::BatchingOptions batching_options;
+  batching_options.MaxBatchSize = max_batch_size;
+  batching_options.BatchWindowMs = batch_window_ms;
+  batching_options.MaxQueuedRequests = max_queued_requests;
+
+  run_server(model_path, port_number, verbose, batching_options);
   OgaShutdown();
 }
\ No newline at end of file
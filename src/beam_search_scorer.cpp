@@ -16,7 +16,7 @@ void BeamHypotheses::Init(float length_penalty, std::span<HypothesisScore> beams
   done_ = false;
 }
 
-void BeamHypotheses::Add(std::span<int32_t> hypothesis, float sum_logprobs) {
+void BeamHypotheses::Add(std::span<int32_t> hypothesis, float sum_logprobs, int32_t logprob_head) {
   auto length = hypothesis.size();
   float const score = sum_logprobs / std::pow(static_cast<float>(length), length_penalty_);
 
@@ -35,7 +35,7 @@ void BeamHypotheses::Add(std::span<int32_t> hypothesis, float sum_logprobs) {
     beams_[index] = beams_[index - 1];
   }
 
-  beams_[index] = HypothesisScore{hypothesis, score};
+  beams_[index] = HypothesisScore{hypothesis, score, logprob_head};
 }
 
 bool BeamHypotheses::CanImprove(float best_sum_logprobs, int current_length) const {
@@ -65,8 +65,8 @@ BeamSearchScorer::BeamSearchScorer(const GeneratorParams& parameters)
   next_beam_tokens_ = parameters.p_device->Allocate<int32_t>(batch_beam_size);
   next_beam_indices_ = parameters.p_device->Allocate<int32_t>(batch_beam_size);
 
-  // Space to store intermediate sequence
-  size_t const per_beam = (max_length_ * (max_length_ + 1)) / 2;
+  // Space to store intermediate sequence, plus a token per step for hypotheses that keep their stop sequence
+  size_t const per_beam = (max_length_ * (max_length_ + 1)) / 2 + max_length_;
   hypothesis_buffer_ = device.Allocate<int32_t>(batch_beam_size * per_beam);
 
   memset(next_beam_scores_.Span().data(), 0, next_beam_scores_.Span().size_bytes());
@@ -84,7 +84,9 @@ BeamSearchScorer::BeamSearchScorer(const GeneratorParams& parameters)
 void BeamSearchScorer::Process(Sequences& sequences,
                                std::span<const float> next_scores,
                                std::span<const int32_t> next_tokens,
-                               std::span<const int32_t> next_indices) {
+                               std::span<const int32_t> next_indices,
+                               std::span<const uint8_t> next_stops,
+                               std::span<const int32_t> next_logprob_heads) {
   // Sequences shape is (batch_size * num_beams, total_sequence_length)
   // It contains word ID of whole sequence generated so far.
   // It is different from subgraph input_ids, which only need one word when past state is not empty.
@@ -121,20 +123,23 @@ void BeamSearchScorer::Process(Sequences& sequences,
       int32_t const next_index = next_indices[batch * top_k + j];
 
       int const batch_beam_idx = static_cast<int>(batch * num_beams_) + next_index;
-      // Add to generated hypotheses if end of sentence.
-      if (contains(eos_token_id_, next_token)) {
+      // Add to generated hypotheses if end of sentence (EOS or a completed stop sequence).
+      const bool is_stop = !next_stops.empty() && next_stops[batch * top_k + j];
+      if (is_stop || contains(eos_token_id_, next_token)) {
         bool const is_beam_token_worse_than_top_num_beams = (j >= num_beams_);
         if (is_beam_token_worse_than_top_num_beams) {
           continue;
         }
 
-        // Clone the sequence and append to buffer.
+        // Clone the sequence and append to buffer. A stop sequence stays in the hypothesis, EOS does not.
         std::span<const int32_t> src = sequences.GetSequence(batch_beam_idx).Span();
-        auto clone = hypothesis_buffer_.Span().subspan(hypothesis_buffer_used_, src.size());
+        auto clone = hypothesis_buffer_.Span().subspan(hypothesis_buffer_used_, src.size() + (is_stop ? 1 : 0));
         hypothesis_buffer_used_ += clone.size();
 
-        copy(cpu_span{src}, cpu_span{clone});
-        beam_hyp.Add(clone, next_score);
+        copy(cpu_span{src}, cpu_span{clone.subspan(0, src.size())});
+        if (is_stop)
+          clone.back() = next_token;
+        beam_hyp.Add(clone, next_score, next_logprob_heads.empty() ? -1 : next_logprob_heads[batch * top_k + j]);
       } else {
         // Add next predicted token since it is not eos_token.
         next_beam_scores[batch * num_beams_ + beam_idx] = next_score;
@@ -171,7 +176,8 @@ void BeamSearchScorer::Process(Sequences& sequences,
 }
 
 void BeamSearchScorer::Finalize(Sequences& sequences,
-                                size_t num_return_sequences) {
+                                size_t num_return_sequences,
+                                const LogProbRecords* logprob_records) {
   auto next_beam_scores = next_beam_scores_.Span();
 
   // Finalize all open beam hypotheses and add to generated hypotheses.
@@ -190,7 +196,7 @@ void BeamSearchScorer::Finalize(Sequences& sequences,
       auto clone = hypothesis_buffer_.Span().subspan(hypothesis_buffer_used_, src.size());
       hypothesis_buffer_used_ += clone.size();
       copy(cpu_span{src}, cpu_span{clone});
-      beam_hyp.Add(clone, final_score);
+      beam_hyp.Add(clone, final_score, logprob_records ? logprob_records->GetHead(batch_beam_index) : -1);
     }
   }
 }
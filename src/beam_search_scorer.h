@@ -5,9 +5,12 @@
 // The implementation is based on huggingface transformers generation_beam_search.py
 namespace Generators {
 
+struct LogProbRecords;
+
 struct HypothesisScore {
   std::span<int32_t> hypothesis;
   float score;
+  int32_t logprob_head;  // The latest LogProbRecords record of the hypothesis, -1 if logprobs are not recorded
 };
 
 struct BeamHypotheses {
@@ -15,12 +18,13 @@ struct BeamHypotheses {
   void Init(float length_penalty, std::span<HypothesisScore> beams);
 
   // Add a new hypothesis
-  void Add(std::span<int32_t> hypothesis, float sum_logprobs);
+  void Add(std::span<int32_t> hypothesis, float sum_logprobs, int32_t logprob_head);
 
   // Return true if this beats the worst score in the hypothesis
   bool CanImprove(float best_sum_logprobs, int current_length) const;
 
   std::span<int32_t> GetHypothesis(size_t index) const { return beams_[index].hypothesis; }
+  int32_t GetHypothesisLogProbHead(size_t index) const { return beams_[index].logprob_head; }
 
   // TODO(aciddelgado): Methods to get all hypotheses and scores
 
@@ -33,13 +37,20 @@ struct BeamHypotheses {
 struct BeamSearchScorer {
   BeamSearchScorer(const GeneratorParams& parameters);
 
+  // next_stops flags the candidates completing a stop sequence, which end a hypothesis like EOS but keep their token.
+  // next_logprob_heads are the logprob records kept by the hypothesis a candidate ends. Both are empty when unused.
   void Process(Sequences& sequences,
                std::span<const float> next_scores,
                std::span<const int32_t> next_tokens,
-               std::span<const int32_t> next_indices);
+               std::span<const int32_t> next_indices,
+               std::span<const uint8_t> next_stops,
+               std::span<const int32_t> next_logprob_heads);
+
+  // logprob_records is null when logprobs are not recorded, else hypotheses keep the records of their beam
 
   void Finalize(Sequences& sequences,
-                size_t num_return_sequences);
+                size_t num_return_sequences,
+                const LogProbRecords* logprob_records);
 
   bool IsDone() const { return not_done_count_ == 0; }
 
@@ -47,6 +58,7 @@ struct BeamSearchScorer {
   DeviceSpan<int32_t> GetNextTokens() { return next_beam_tokens_; }
   DeviceSpan<int32_t> GetNextIndices() { return next_beam_indices_; }
   DeviceSpan<int32_t> GetBeamHypotheses(size_t batch_id, size_t beam_id);
+  int32_t GetBeamHypothesisLogProbHead(size_t batch_id, size_t beam_id) const { return beam_hyps_[batch_id].GetHypothesisLogProbHead(beam_id); }
 
  private:
   int batch_size_;
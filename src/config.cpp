@@ -3,6 +3,7 @@
 // Modifications Copyright(C) 2024-2025 Advanced Micro Devices, Inc. All rights reserved.
 #include "generators.h"
 #include "runtime_settings.h"
+#include "model_data.h"
 #include "json.h"
 #include <fstream>
 #include <sstream>
@@ -367,6 +368,8 @@ struct SlidingWindow_Element : JSON::Element {
       v_->alignment = JSON::Get<std::string_view>(value);
     } else if (name == "slide_key_value_cache") {
       v_->slide_key_value_cache = JSON::Get<bool>(value);
+    } else if (name == "ring_buffer") {
+      v_->ring_buffer = JSON::Get<bool>(value);
     } else
       throw JSON::unknown_value_error{};
   }
@@ -389,6 +392,8 @@ struct Encoder_Element : JSON::Element {
       v_.num_hidden_layers = static_cast<int>(JSON::Get<double>(value));
     } else if (name == "head_size") {
       v_.head_size = static_cast<int>(JSON::Get<double>(value));
+    } else if (name == "static_io") {
+      v_.static_io = JSON::Get<bool>(value);
     } else
       throw JSON::unknown_value_error{};
   }
@@ -503,6 +508,12 @@ struct Vision_Element : JSON::Element {
       v_.config_filename = JSON::Get<std::string_view>(value);
     } else if (name == "adapter_filename") {
       v_.adapter_filename = JSON::Get<std::string_view>(value);
+    } else if (name == "feature_cache_bytes") {
+      v_.feature_cache_bytes = static_cast<size_t>(JSON::Get<double>(value));
+    } else if (name == "parallel_batches") {
+      v_.parallel_batches = static_cast<int>(JSON::Get<double>(value));
+      if (v_.parallel_batches < 1)
+        throw std::runtime_error("vision.parallel_batches must be at least 1");
     } else
       throw JSON::unknown_value_error{};
   }
@@ -652,6 +663,15 @@ struct Model_Element : JSON::Element {
       v_.vocab_size = static_cast<int>(JSON::Get<double>(value));
     } else if (name == "context_length") {
       v_.context_length = static_cast<int>(JSON::Get<double>(value));
+    } else if (name == "session_creation_threads") {
+      const auto threads = JSON::Get<double>(value);
+      if (threads < 0 || threads > 1024 || threads != static_cast<int>(threads))
+        throw std::runtime_error("model.session_creation_threads must be a whole number from 0 to 1024");
+      v_.session_creation_threads = static_cast<int>(threads);
+    } else if (name == "concurrent_encoders") {
+      v_.concurrent_encoders = JSON::Get<bool>(value);
+    } else if (name == "share_initializers") {
+      v_.share_initializers = JSON::Get<bool>(value);
     } else if (name == "pad_token_id") {
       v_.pad_token_id = static_cast<int>(JSON::Get<double>(value));
     } else if (name == "eos_token_id") {
@@ -739,6 +759,10 @@ struct Search_Element : JSON::Element {
       v_.past_present_share_buffer = JSON::Get<bool>(value);
     } else if (name == "early_stopping") {
       v_.early_stopping = JSON::Get<bool>(value);
+    } else if (name == "logprobs") {
+      v_.logprobs = JSON::Get<bool>(value);
+    } else if (name == "top_logprobs") {
+      v_.top_logprobs = static_cast<int>(JSON::Get<double>(value));
     } else
       throw JSON::unknown_value_error{};
   }
@@ -828,6 +852,47 @@ bool IsMultiProfileEnabled(const Config::SessionOptions& session_options) {
   return false;
 }
 
+struct Warmup_Element : JSON::Element {
+  explicit Warmup_Element(Config::Warmup& v) : v_{v} {}
+
+  void OnValue(std::string_view name, JSON::Value value) override {
+    if (name == "enabled") {
+      v_.enabled = JSON::Get<bool>(value);
+    } else if (name == "prompt_length") {
+      v_.prompt_length = static_cast<int>(JSON::Get<double>(value));
+    } else if (name == "decode_length") {
+      v_.decode_length = static_cast<int>(JSON::Get<double>(value));
+    } else
+      throw JSON::unknown_value_error{};
+  }
+
+  Element& OnArray(std::string_view name) override {
+    if (name == "batch_sizes") {
+      v_.batch_sizes.clear();  // An overlay replaces the list rather than adding to it
+      return batch_sizes_;
+    }
+    throw JSON::unknown_value_error{};
+  }
+
+ private:
+  Config::Warmup& v_;
+  Int_Array_Element batch_sizes_{v_.batch_sizes};
+};
+
+struct CpuAllocatorPool_Element : JSON::Element {
+  explicit CpuAllocatorPool_Element(Config::CpuAllocatorPool& v) : v_{v} {}
+
+  void OnValue(std::string_view name, JSON::Value value) override {
+    if (name == "enabled") {
+      v_.enabled = JSON::Get<bool>(value);
+    } else
+      throw JSON::unknown_value_error{};
+  }
+
+ private:
+  Config::CpuAllocatorPool& v_;
+};
+
 struct Root_Element : JSON::Element {
   explicit Root_Element(Config& config) : config_{config} {}
 
@@ -841,12 +906,20 @@ struct Root_Element : JSON::Element {
     if (name == "search") {
       return search_element_;
     }
+    if (name == "warmup") {
+      return warmup_element_;
+    }
+    if (name == "cpu_allocator_pool") {
+      return cpu_allocator_pool_element_;
+    }
     throw JSON::unknown_value_error{};
   }
 
   Config& config_;
   Model_Element model_element_{config_.model};
   Search_Element search_element_{config_.search};
+  Warmup_Element warmup_element_{config_.warmup};
+  CpuAllocatorPool_Element cpu_allocator_pool_element_{config_.cpu_allocator_pool};
 };
 
 struct RootObject_Element : JSON::Element {
@@ -860,22 +933,29 @@ struct RootObject_Element : JSON::Element {
 };
 
 void ParseConfig(const fs::path& filename, std::string_view json_overlay, Config& config) {
-  std::ifstream file = filename.open(std::ios::binary | std::ios::ate);
-  if (!file.is_open()) {
-    throw std::runtime_error("Error opening " + filename.string());
-  }
-  std::streamsize const size = file.tellg();
-  file.seekg(0, std::ios::beg);
+  std::vector<char> buffer;
+  std::string_view json;
+  if (auto* data = config.model_data ? config.model_data->Find("genai_config.json") : nullptr) {
+    json = {reinterpret_cast<const char*>(data->data()), data->size()};
+  } else {
+    std::ifstream file = filename.open(std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+      throw std::runtime_error("Error opening " + filename.string());
+    }
+    std::streamsize const size = file.tellg();
+    file.seekg(0, std::ios::beg);
 
-  std::vector<char> buffer(size);
-  if (!file.read(buffer.data(), size)) {
-    throw std::runtime_error("Error reading " + filename.string());
+    buffer.resize(size);
+    if (!file.read(buffer.data(), size)) {
+      throw std::runtime_error("Error reading " + filename.string());
+    }
+    json = {buffer.data(), buffer.size()};
   }
 
   Root_Element root{config};
   RootObject_Element root_object{root};
   try {
-    JSON::Parse(root_object, std::string_view(buffer.data(), buffer.size()));
+    JSON::Parse(root_object, json);
   } catch (const std::exception& message) {
     std::ostringstream oss;
     oss << "Error encountered while parsing '" << filename.string() << "' " << message.what();
@@ -899,7 +979,8 @@ void OverlayConfig(Config& config, std::string_view json) {
   JSON::Parse(element, json);
 }
 
-Config::Config(const fs::path& path, std::string_view json_overlay) : config_path{path} {
+Config::Config(const fs::path& path, std::string_view json_overlay, std::shared_ptr<const ModelData> model_data)
+    : config_path{path}, model_data{std::move(model_data)} {
   ParseConfig(path / "genai_config.json", json_overlay, *this);
 
   if (model.context_length == 0)
@@ -7,10 +7,12 @@
 namespace Generators {
 
 struct RuntimeSettings;
+struct ModelData;
 
 struct Config {
   Config() = default;
-  Config(const fs::path& path, std::string_view json_overlay);
+  // Files found in model_data (genai_config.json included) are read from memory, the others from the config directory
+  Config(const fs::path& path, std::string_view json_overlay, std::shared_ptr<const ModelData> model_data = {});
 
   struct Defaults {
     // Decoder names
@@ -54,7 +56,8 @@ struct Config {
     static constexpr std::string_view EncoderAttentionMaskName = "encoder_attention_mask";
   };
 
-  fs::path config_path;  // Path of the config directory
+  fs::path config_path;                         // Path of the config directory
+  std::shared_ptr<const ModelData> model_data;  // Model files held in memory, null when every file is on disk
 
   using NamedString = std::pair<std::string, std::string>;
   struct ProviderOptions {
@@ -97,6 +100,9 @@ struct Config {
     int decoder_start_token_id{};   // If an encoder-decoder model starts decoding with a different token than bos, the id of that token.
     int vocab_size{};
     int context_length{};
+    int session_creation_threads{1};  // Sessions of a multi-session model created at once, 1 creates them one after another, 0 uses one thread per core.
+    bool concurrent_encoders{};       // Run the vision and speech models (and the vision.parallel_batches runs) of a prompt at the same time, only on the CPU.
+    bool share_initializers{};        // Load the weights of a model file once for every session of it on the CPU, for replicas of the same model. Costs an extra read of each file.
 
     // For models like whisper
     struct Encoder {
@@ -137,6 +143,8 @@ struct Config {
       std::string filename;
       std::string config_filename{"processor_config.json"};
       std::optional<std::string> adapter_filename{};
+      size_t feature_cache_bytes{};  // Budget of the cache of image features from earlier requests, 0 disables it
+      int parallel_batches{1};       // Concurrent vision model runs the images of a prompt are split into, only with model.concurrent_encoders
 
       struct Inputs {
         std::string pixel_values{Defaults::PixelValuesName};
@@ -176,11 +184,14 @@ struct Config {
       int num_hidden_layers{};
       int head_size{};
 
+      bool static_io{};  // CPU only: decode steps reuse tensors allocated once and bound once. Needs search.past_present_share_buffer
+
       struct SlidingWindow {               // Sliding window parameters for models that process input prompt in chunks
         int window_size{};                 // The size of the window to slide over the input prompt
         int pad_value{};                   // The key-value cache padding value to use for the sliding window for inactive tokens
         std::string alignment{"right"};    // The alignment of the window, either "left" or "right"
         bool slide_key_value_cache{true};  // Whether to slide the key-value cache along with the input prompt
+        bool ring_buffer{};                // Whether the key-value cache is written in place as a ring buffer instead of being shifted
       };
       std::optional<SlidingWindow> sliding_window;
 
@@ -250,8 +261,26 @@ struct Config {
     float length_penalty{1.0f};        // Exponential penalty to the length that is used with beam-based generation. length_penalty > 0.0 promotes longer sequences, while length_penalty < 0.0 encourages shorter sequences.
     bool past_present_share_buffer{};  // The past/present kv tensors are shared and allocated once to max_length (cuda only)
     int random_seed{-1};               // -1 = Seed with random device, otherwise use value to seed RNG
+    bool logprobs{};                   // Record the log probability of every generated token (cpu search only)
+    int top_logprobs{};                // Also record this many most likely candidates for every generated token (implies logprobs)
   } search;
 
+  // Runs synthetic prompts through a new model before CreateModel returns, so kernel selection, arena growth and other
+  // lazy initialization happen at load time instead of during the first request
+  struct Warmup {
+    bool enabled{};
+    std::vector<int> batch_sizes;  // One warm-up run per batch size, 1 when empty
+    int prompt_length{128};        // Tokens in each prompt (the prefill shape)
+    int decode_length{8};          // Tokens generated after the prompt (the decode shape)
+  } warmup;
+
+  // Keeps freed CPU tensor blocks for reuse while this model is alive, instead of returning them to the system
+  // allocator. The cache is shared by every model enabling it and is released when the last of them is destroyed,
+  // or on demand with OgaTrimCpuAllocatorPool.
+  struct CpuAllocatorPool {
+    bool enabled{};
+  } cpu_allocator_pool;
+
   void AddMapping(const std::string& nominal_name, const std::string& graph_name);
   // Returns graph name and true if the nominal name is found in the mapping
   // otherwise returns the nominal name and false
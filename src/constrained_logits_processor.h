@@ -25,6 +25,8 @@ struct ConstrainedLogitsProcessor {
   // ProcessLogits applies token-level masking to the logits
   // Based on the masks which are derived from constraints, it sets the logits to -inf for invalid tokens
   virtual void ProcessLogits(DeviceSpan<float> logits) = 0;
+  // GetMask returns the allowed tokens bitmask of every batch row (bit set = allowed), for callers masking the scores row by row
+  virtual std::vector<std::vector<uint32_t>> GetMask() = 0;
   // Reset is used to reset the masks and the constrains of the logits processor and then recompute the mask, used after rewinding
   virtual void Reset() = 0;
   // ResetWithoutCompute is used to reset the masks and constraints for logits processor without computing the mask for chat
@@ -44,7 +46,7 @@ struct GuidanceLogitsProcessor : public ConstrainedLogitsProcessor {
   void Reset() override;
   void ResetWithoutCompute() override;
   // GetMask is used to get the logits mask
-  std::vector<std::vector<uint32_t>> GetMask();
+  std::vector<std::vector<uint32_t>> GetMask() override;
   // tokenize_partial is used to tokenize the input tokens with special prefix, this will get stable
   // token ids.
   static std::vector<int32_t> tokenize_partial(const Tokenizer* tokenizer, const size_t prefix_len,
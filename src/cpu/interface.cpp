@@ -72,8 +72,7 @@ struct CpuInterface : DeviceInterface {
     if (input_type == Ort::TypeToTensorType<float> && output_type == Ort::TypeToTensorType<Ort::Float16_t>) {
       auto* fp32 = static_cast<float*>(input_data);
       auto* fp16 = static_cast<uint16_t*>(output_data);
-      for (size_t i = 0; i < element_count; i++)
-        fp16[i] = FastFloat32ToFloat16(fp32[i]);
+      FastFloat32ToFloat16(std::span<const float>{fp32, element_count}, std::span<uint16_t>{fp16, element_count});
     } else if (input_type == Ort::TypeToTensorType<Ort::Float16_t> && output_type == Ort::TypeToTensorType<float>) {
       auto* fp16 = static_cast<uint16_t*>(input_data);
       auto* fp32 = static_cast<float*>(output_data);
@@ -0,0 +1,113 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "../generators.h"
+#include "pooled_allocator.h"
+
+namespace Generators {
+
+namespace {
+
+// Every block starts with a header holding its size class, so Release knows where to return it.
+// The header is as large as the alignment the ORT CPU allocator guarantees so the returned pointer keeps it.
+constexpr size_t header_size = 64;
+constexpr size_t unpooled = PooledAllocator::size_class_count_;
+
+size_t SizeClass(size_t size) {
+  size_t size_class = 0;
+  for (size_t block_size = PooledAllocator::min_block_size_; block_size < size; block_size <<= 1)
+    size_class++;
+  return size_class;
+}
+
+size_t SizeClassBytes(size_t size_class) {
+  return PooledAllocator::min_block_size_ << size_class;
+}
+
+}  // namespace
+
+PooledAllocator::PooledAllocator(OrtAllocator& allocator, size_t max_cached_bytes)
+    : OrtAllocator{}, allocator_{allocator}, max_cached_bytes_{max_cached_bytes} {
+  version = ORT_API_VERSION;
+  OrtAllocator::Alloc = [](OrtAllocator* this_, size_t size) { return static_cast<PooledAllocator*>(this_)->Allocate(size); };
+  OrtAllocator::Free = [](OrtAllocator* this_, void* p) { static_cast<PooledAllocator*>(this_)->Release(p); };
+  OrtAllocator::Info = [](const OrtAllocator* this_) {
+    auto& allocator = static_cast<const PooledAllocator*>(this_)->allocator_;
+    return allocator.Info(&allocator);
+  };
+}
+
+PooledAllocator::~PooledAllocator() {
+  Trim();
+}
+
+void* PooledAllocator::Allocate(size_t size) {
+  auto size_class = SizeClass(size);
+  if (size_class < size_class_count_) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto& free_blocks = free_blocks_[size_class];
+    if (!free_blocks.empty()) {
+      auto* block = free_blocks.back();
+      free_blocks.pop_back();
+      cached_bytes_ -= SizeClassBytes(size_class);
+      return static_cast<uint8_t*>(block) + header_size;
+    }
+  }
+
+  auto block_size = size_class < size_class_count_ ? SizeClassBytes(size_class) : size;
+  auto* block = static_cast<uint8_t*>(allocator_.Alloc(&allocator_, header_size + block_size));
+  if (!block)
+    throw std::bad_alloc();
+  block[0] = static_cast<uint8_t>(std::min(size_class, unpooled));
+  return block + header_size;
+}
+
+void PooledAllocator::Release(void* p) {
+  if (!p)
+    return;
+
+  auto* block = static_cast<uint8_t*>(p) - header_size;
+  size_t size_class = block[0];
+  if (size_class < size_class_count_) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (user_count_ != 0 && cached_bytes_ + SizeClassBytes(size_class) <= max_cached_bytes_) {
+      free_blocks_[size_class].push_back(block);
+      cached_bytes_ += SizeClassBytes(size_class);
+      return;
+    }
+  }
+  allocator_.Free(&allocator_, block);
+}
+
+void PooledAllocator::AddUser() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  user_count_++;
+}
+
+void PooledAllocator::RemoveUser() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (user_count_ == 0)
+      throw std::runtime_error("PooledAllocator::RemoveUser called without a matching AddUser");
+    if (--user_count_ != 0)
+      return;
+  }
+  Trim();
+}
+
+void PooledAllocator::Trim() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  for (auto& free_blocks : free_blocks_) {
+    for (auto* block : free_blocks)
+      allocator_.Free(&allocator_, block);
+    free_blocks.clear();
+  }
+  cached_bytes_ = 0;
+}
+
+size_t PooledAllocator::GetCachedBytes() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return cached_bytes_;
+}
+
+}  // namespace Generators
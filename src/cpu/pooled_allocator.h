@@ -0,0 +1,46 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include <mutex>
+
+namespace Generators {
+
+// CPU allocator that keeps freed blocks in power of two size classes and hands them out again, so the tensors that
+// are recreated on every step (input ids, position ids, attention mask, logits, kv cache presents) reuse the same
+// memory instead of going back to the system allocator each time. Blocks larger than the biggest size class and
+// blocks that would grow the cache past its limit are passed straight through to the wrapped allocator.
+//
+// Caching is opt-in: freed blocks are only kept while some user (a model whose genai_config enables
+// cpu_allocator_pool) holds the pool, otherwise they go straight back to the wrapped allocator.
+struct PooledAllocator : OrtAllocator {
+  static constexpr size_t min_block_size_ = 256;
+  static constexpr size_t size_class_count_ = 17;  // 256 bytes to 16MB
+  static constexpr size_t default_max_cached_bytes_ = 256 * 1024 * 1024;
+
+  PooledAllocator(OrtAllocator& allocator, size_t max_cached_bytes = default_max_cached_bytes_);
+  ~PooledAllocator();  // Releases the cached blocks, blocks still in use must be freed before this
+
+  Ort::Allocator& GetAllocator() { return *static_cast<Ort::Allocator*>(static_cast<OrtAllocator*>(this)); }
+
+  void* Allocate(size_t size);
+  void Release(void* p);
+
+  // Freed blocks are cached while the pool has at least one user, removing the last user trims the cache
+  void AddUser();
+  void RemoveUser();
+
+  void Trim();  // Releases every cached block back to the wrapped allocator
+  size_t GetCachedBytes();
+
+ private:
+  OrtAllocator& allocator_;
+  const size_t max_cached_bytes_;
+
+  std::mutex mutex_;
+  std::array<std::vector<void*>, size_class_count_> free_blocks_;
+  size_t cached_bytes_{};
+  size_t user_count_{};
+};
+
+}  // namespace Generators
@@ -129,6 +129,12 @@ struct CudaInterfaceImplBase : DeviceInterface {
     return true;
   }
 
+  bool LaunchTokenLogProbs(const float* logits, const int32_t* target_tokens, int position_count, int vocab_size, int top_n,
+                           float* logprobs, int32_t* top_ids, float* top_logprobs) override {
+    cuda::LaunchTokenLogProbs(logits, target_tokens, position_count, vocab_size, top_n, logprobs, top_ids, top_logprobs, GetStream());
+    return true;
+  }
+
   bool UpdatePositionIds(void* position_ids, int batch_beam_size, int total_length, int new_kv_length, ONNXTensorElementDataType type) override {
     if (type == Ort::TypeToTensorType<int32_t>)
       cuda::Launch_UpdatePositionIds(static_cast<int32_t*>(position_ids), batch_beam_size, total_length, new_kv_length, GetStream());
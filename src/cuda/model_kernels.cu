@@ -1,9 +1,11 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
+#include <cub/cub.cuh>
 #include <cuda_fp16.h>
 #include <cuda_runtime.h>
 #include <stdint.h>
+#include <climits>
 #include <limits>
 #include <assert.h>
 #include <stdio.h>
@@ -98,6 +100,91 @@ void LaunchAddLogitsMask(float* batch_logits, int batch_beam_size, int vocab_siz
   AddLogitsMask<<<num_blocks, block_size, 0, stream>>>(batch_logits, batch_beam_size, vocab_size, logits_mask);
 }
 
+namespace {
+
+constexpr int kTokenLogProbsBlockSize = 256;
+
+struct Candidate {
+  float value;
+  int index;
+};
+
+// Orders candidates by value, ties by the lower index
+__device__ bool IsBetter(const Candidate& a, const Candidate& b) {
+  return a.value > b.value || (a.value == b.value && a.index < b.index);
+}
+
+struct BetterCandidate {
+  __device__ Candidate operator()(const Candidate& a, const Candidate& b) const { return IsBetter(b, a) ? b : a; }
+};
+
+// One block per row of logits
+__global__ void TokenLogProbsKernel(const float* logits, const int32_t* target_tokens, int vocab_size, int top_n,
+                                    float* logprobs, int32_t* top_ids, float* top_logprobs) {
+  using FloatReduce = cub::BlockReduce<float, kTokenLogProbsBlockSize>;
+  using CandidateReduce = cub::BlockReduce<Candidate, kTokenLogProbsBlockSize>;
+  __shared__ union {
+    typename FloatReduce::TempStorage values;
+    typename CandidateReduce::TempStorage candidates;
+  } temp_storage;
+  __shared__ float shared_value;
+  __shared__ Candidate shared_candidate;
+
+  const int position = blockIdx.x;
+  const int32_t target = target_tokens[position];
+  if (target < 0)
+    return;
+  const float* row = logits + static_cast<size_t>(position) * vocab_size;
+
+  float max_value = -INFINITY;
+  for (int i = threadIdx.x; i < vocab_size; i += blockDim.x)
+    max_value = fmaxf(max_value, row[i]);
+  max_value = FloatReduce(temp_storage.values).Reduce(max_value, cub::Max());
+  if (threadIdx.x == 0)
+    shared_value = max_value;
+  __syncthreads();
+  max_value = shared_value;
+
+  float sum = 0.0f;
+  for (int i = threadIdx.x; i < vocab_size; i += blockDim.x)
+    sum += expf(row[i] - max_value);
+  sum = FloatReduce(temp_storage.values).Sum(sum);
+  __syncthreads();
+  if (threadIdx.x == 0)
+    shared_value = max_value + logf(sum);
+  __syncthreads();
+  const float log_sum_exp = shared_value;
+  if (threadIdx.x == 0)
+    logprobs[position] = row[target] - log_sum_exp;
+
+  // top_n is small, so each pass picks the best candidate ordered after the previous pick
+  Candidate previous{INFINITY, -1};
+  for (int k = 0; k < top_n; k++) {
+    Candidate best{-INFINITY, INT_MAX};
+    for (int i = threadIdx.x; i < vocab_size; i += blockDim.x) {
+      const Candidate candidate{row[i], i};
+      if (IsBetter(previous, candidate) && IsBetter(candidate, best))
+        best = candidate;
+    }
+    best = CandidateReduce(temp_storage.candidates).Reduce(best, BetterCandidate());
+    if (threadIdx.x == 0) {
+      shared_candidate = best;
+      top_ids[position * top_n + k] = best.index;
+      top_logprobs[position * top_n + k] = best.value - log_sum_exp;
+    }
+    __syncthreads();
+    previous = shared_candidate;
+  }
+}
+
+}  // namespace
+
+void LaunchTokenLogProbs(const float* logits, const int32_t* target_tokens, int position_count, int vocab_size, int top_n,
+                         float* logprobs, int32_t* top_ids, float* top_logprobs, cudaStream_t stream) {
+  TokenLogProbsKernel<<<position_count, kTokenLogProbsBlockSize, 0, stream>>>(logits, target_tokens, vocab_size, top_n,
+                                                                              logprobs, top_ids, top_logprobs);
+}
+
 __global__ void ConvertFp16ToFp32(const half* src, float* dst, int count) {
   int idx = threadIdx.x + blockIdx.x * blockDim.x;
   if (idx < count)
@@ -5,6 +5,7 @@
 #include "interface.h"
 #include "search.h"
 #include "search_cuda.h"
+#include "constrained_logits_processor.h"
 #include "beam_search_scorer_cuda.cuh"
 #include "beam_search_scorer_cuda.h"
 #include "beam_search_topk.h"
@@ -249,6 +250,13 @@ void GreedySearch_Cuda::RewindTo(size_t index) {
   sequences_.RewindTo(index);
 }
 
+void Search_Cuda::ApplyLogitsProcessors(ConstrainedLogitsProcessor* guidance) {
+  if (guidance)
+    guidance->ProcessLogits(GetLogits());
+  ApplyMinLength(params_->search.min_length);
+  ApplyRepetitionPenalty(params_->search.repetition_penalty);
+}
+
 void Search_Cuda::ApplyMinLength(int min_length) {
   if (sequences_.GetSequenceLength() >= min_length)
     return;
@@ -23,8 +23,9 @@ struct Search_Cuda : Search {
   DeviceSpan<float> GetLogits() const override;
   void SetLogits(DeviceSpan<float> logits) override;
 
-  void ApplyMinLength(int min_length) override;
-  void ApplyRepetitionPenalty(float penalty) override;
+  void ApplyLogitsProcessors(ConstrainedLogitsProcessor* guidance) override;
+  void ApplyMinLength(int min_length);
+  void ApplyRepetitionPenalty(float penalty);
 
   std::span<float> GetScores(int batch_beam_index);
   std::span<float> GetScores();
@@ -19,6 +19,9 @@
 
 #include <sys/stat.h>
 
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
 #include <string>
 #include <fstream>
 
@@ -98,6 +101,43 @@ class path {
 #endif  // _WIN32
   }
 
+  // The absolute path, with symbolic links resolved but on Windows. The path as is when it can't be resolved.
+  path canonical() const {
+#ifdef _WIN32
+    std::unique_ptr<wchar_t, decltype(&std::free)> full_path{_wfullpath(nullptr, wpath_.c_str(), 0), &std::free};
+    if (!full_path)
+      return *this;
+    const int length = WideCharToMultiByte(CP_UTF8, 0, full_path.get(), -1, nullptr, 0, nullptr, nullptr);
+    if (length <= 0)
+      return *this;
+    std::string result(static_cast<size_t>(length), '\0');
+    WideCharToMultiByte(CP_UTF8, 0, full_path.get(), -1, result.data(), length, nullptr, nullptr);
+    result.resize(static_cast<size_t>(length - 1));
+    return result;
+#else
+    std::unique_ptr<char, decltype(&std::free)> full_path{realpath(path_.c_str(), nullptr), &std::free};
+    if (!full_path)
+      return *this;
+    return std::string{full_path.get()};
+#endif  // _WIN32
+  }
+
+  // The size and the last modification time of the file, false if it doesn't exist
+  bool file_status(uint64_t& size, int64_t& modified_time) const {
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_wstat64(wpath_.c_str(), &info) != 0)
+      return false;
+#else
+    struct stat info;
+    if (stat(path_.c_str(), &info) != 0)
+      return false;
+#endif  // _WIN32
+    size = static_cast<uint64_t>(info.st_size);
+    modified_time = static_cast<int64_t>(info.st_mtime);
+    return true;
+  }
+
   bool exists() const {
 #ifdef _WIN32
     const int ret = GetFileAttributesW(wpath_.c_str());
@@ -10,6 +10,7 @@
 #include "search.h"
 #include "tracing.h"
 #include "cpu/interface.h"
+#include "cpu/pooled_allocator.h"
 #include "cuda/interface.h"
 #include "dml/interface.h"
 #include "qnn/interface.h"
@@ -58,10 +59,19 @@ OrtGlobals::OrtGlobals()
   Ort::Allocator& allocator_cpu{Ort::Allocator::GetWithDefaultOptions()};
   env_->CreateAndRegisterAllocator(allocator_cpu.GetInfo(), *arena_config);
 
+  // Tensors that are recreated every step can reuse pooled blocks instead of going back to the system allocator. The
+  // pool only caches blocks while a model that enables cpu_allocator_pool in its config is alive.
+  bool disable_allocator_pool = false;
+  GetEnv("ORTGENAI_DISABLE_CPU_ALLOCATOR_POOL", disable_allocator_pool);
+  if (!disable_allocator_pool)
+    allocator_cpu_pool_ = std::make_unique<PooledAllocator>(allocator_cpu);
+
   // Init the CPU device (special case because it always exists, and its allocator is special
-  GetDeviceInterface(DeviceType::CPU)->InitOrt(*Ort::api, allocator_cpu);
+  GetDeviceInterface(DeviceType::CPU)->InitOrt(*Ort::api, allocator_cpu_pool_ ? allocator_cpu_pool_->GetAllocator() : allocator_cpu);
 }
 
+OrtGlobals::~OrtGlobals() = default;
+
 // Ensure Shutdown() has been called before process exit
 struct EnsureShutdown {
   ~EnsureShutdown() {
@@ -90,7 +100,8 @@ void Shutdown() {
     std::cerr << "    Please see the documentation for the API being used to ensure proper cleanup." << std::endl;
   }
 
-  GetOrtGlobals().reset();  // Delete now because on process exit is too late
+  DefaultTracerInstance().Shutdown();  // Writes the rest of the trace while the writer thread can still be joined
+  GetOrtGlobals().reset();             // Delete now because on process exit is too late
 }
 
 OrtEnv& GetOrtEnv() {
@@ -253,6 +264,7 @@ GeneratorParams::GeneratorParams(const Config& config)
 GeneratorParams::GeneratorParams(const Model& model)
     : config{*model.config_.get()},
       use_graph_capture{IsGraphCaptureEnabled(model.config_->model.decoder.session_options)},
+      use_static_io{model.config_->model.decoder.static_io && model.p_device_inputs_->GetType() == DeviceType::CPU},
       use_multi_profile{IsMultiProfileEnabled(model.config_->model.decoder.session_options)},
       p_device{model.p_device_inputs_} {
   if (use_graph_capture) {
@@ -286,6 +298,90 @@ void GeneratorParams::SetGuidance(std::string_view type, std::string_view data)
   guidance_data = data;
 }
 
+namespace {
+
+constexpr std::array<std::string_view, 8> row_search_option_names{
+    "do_sample", "top_k", "top_p", "temperature", "repetition_penalty", "min_length", "max_length", "random_seed"};
+
+void CheckRowSearchOption(std::string_view name) {
+  if (!contains(row_search_option_names, name))
+    throw std::runtime_error("Search option can not be set per row: " + std::string(name));
+}
+
+}  // namespace
+
+void GeneratorParams::SetRowSearchNumber(size_t row, std::string_view name, double value) {
+  CheckRowSearchOption(name);
+  Config::Search validated{search};
+  SetSearchNumber(validated, name, value);
+  row_search_options.push_back({row, std::string(name), value});
+}
+
+void GeneratorParams::SetRowSearchBool(size_t row, std::string_view name, bool value) {
+  CheckRowSearchOption(name);
+  Config::Search validated{search};
+  SetSearchBool(validated, name, value);
+  row_search_options.push_back({row, std::string(name), value});
+}
+
+std::vector<Config::Search> GeneratorParams::GetRowSearch() const {
+  std::vector<Config::Search> row_search(search.batch_size, search);
+  for (const auto& option : row_search_options) {
+    if (option.row >= row_search.size())
+      throw std::runtime_error("Search option " + option.name + " was set for row " + std::to_string(option.row) + " but batch_size is " + std::to_string(search.batch_size));
+    if (std::holds_alternative<bool>(option.value))
+      SetSearchBool(row_search[option.row], option.name, std::get<bool>(option.value));
+    else
+      SetSearchNumber(row_search[option.row], option.name, std::get<double>(option.value));
+  }
+
+  for (size_t row = 0; row < row_search.size(); row++) {
+    auto& row_max_length = row_search[row].max_length;
+    if (row_max_length == 0)
+      row_max_length = search.max_length;
+    else if (row_max_length > search.max_length)
+      throw std::runtime_error("max_length of row " + std::to_string(row) + " (" + std::to_string(row_max_length) + ") cannot be greater than the batch max_length (" + std::to_string(search.max_length) + ")");
+  }
+  return row_search;
+}
+
+void GeneratorParams::AddStopSequence(std::span<const int32_t> tokens) {
+  if (tokens.empty())
+    throw std::runtime_error("Stop sequences cannot be empty");
+  stop_sequences.emplace_back(tokens.begin(), tokens.end());
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double Seconds(Clock::duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+std::atomic<int64_t> g_generator_count{};  // Generators alive, traced as a counter
+
+}  // namespace
+
+std::vector<std::pair<const char*, double>> GeneratorMetrics::GetValues() const {
+  return {
+      {"prompt_token_count", static_cast<double>(prompt_token_count)},
+      {"generated_token_count", static_cast<double>(generated_token_count)},
+      {"step_count", static_cast<double>(step_count)},
+      {"model_run_count", static_cast<double>(model_run_count)},
+      {"kv_cache_bytes", static_cast<double>(kv_cache_bytes)},
+      {"time_to_first_token", time_to_first_token},
+      {"prefill_time", prefill_time},
+      {"decode_time", decode_time},
+      {"model_run_time", model_run_time},
+      {"search_time", search_time},
+      {"max_token_latency", max_token_latency},
+      {"average_token_latency", step_count ? decode_time / step_count : 0.0},
+      {"prefill_tokens_per_second", prefill_time > 0 ? prompt_token_count / prefill_time : 0.0},
+      {"tokens_per_second", decode_time > 0 ? generated_token_count / decode_time : 0.0},
+  };
+}
+
 std::unique_ptr<Generator> CreateGenerator(const Model& model, const GeneratorParams& params) {
   return std::make_unique<Generator>(model, params);
 }
@@ -307,6 +403,10 @@ Generator::Generator(const Model& model, const GeneratorParams& params) : model_
     throw std::runtime_error("vocab_size must be 1 or greater, is " + std::to_string(params.config.model.vocab_size));
 
   search_ = CreateSearch(params);
+  if (!params.stop_sequences.empty() && !search_->SupportsStopSequences())
+    throw std::runtime_error("Stop sequences are only supported by the CPU search");
+  if (!params.row_search_options.empty() && !search_->SupportsRowSearchOptions())
+    throw std::runtime_error("Per row search options are only supported by the CPU greedy search");
   state_ = model.CreateState(search_->GetSequenceLengths(), params);  // Search sequence lengths set when creating state
 
   guidance_logits_processor_ = CreateGuidanceLogitsProcessor(*state_);  // Could be nullptr if use_guidance (constrained decoding) is not used
@@ -314,11 +414,28 @@ Generator::Generator(const Model& model, const GeneratorParams& params) : model_
   if (!params.aux_input_ids.empty() && params.aux_input_ids.data() != nullptr) {
     AuxAppendTokens(params.aux_input_ids);
   }
+
+  static std::atomic<uint64_t> next_trace_id{};
+  trace_id_ = next_trace_id++;
+  DefaultTracerInstance().BeginAsync("Generator", trace_id_);
+  DefaultTracerInstance().Counter("Generators", static_cast<double>(++g_generator_count));
+}
+
+Generator::~Generator() {
+  if (generate_future_.valid()) {
+    state_->SetTerminate();
+    generate_future_.wait();
+  }
+
+  DefaultTracerInstance().EndAsync("Generator", trace_id_);
+  DefaultTracerInstance().Counter("Generators", static_cast<double>(--g_generator_count));
 }
 
 DeviceSpan<int32_t> Generator::AllocateInputIdsOnDevice(cpu_span<const int32_t> input_ids) {
   size_t padded_input_ids_size = input_ids.size();
-  if (model_->config_->model.decoder.sliding_window.has_value()) {
+  // Tokens appended after the prompt are processed one at a time, so only the prompt needs padding
+  const bool pad_to_window = model_->config_->model.decoder.sliding_window.has_value() && search_->GetSequenceLength() == 0;
+  if (pad_to_window) {
     // If the model has a sliding window, pad the input_ids to the next multiple of the window size
     // so that the input_ids can be divided into window size chunks.
     const auto window_size = model_->config_->model.decoder.sliding_window->window_size;
@@ -329,7 +446,7 @@ DeviceSpan<int32_t> Generator::AllocateInputIdsOnDevice(cpu_span<const int32_t>
   auto cpu_span = input_ids_device.CpuSpan();
   auto padding_begin = cpu_span.begin();
   auto data_end = cpu_span.end();
-  if (model_->config_->model.decoder.sliding_window.has_value() && model_->config_->model.decoder.sliding_window->alignment == "left") {
+  if (pad_to_window && model_->config_->model.decoder.sliding_window->alignment == "left") {
     padding_begin = cpu_span.begin() + input_ids.size();
     data_end = padding_begin;
   }
@@ -347,10 +464,17 @@ void Generator::AuxAppendTokens(cpu_span<const int32_t> input_ids) {
   if (search_->GetSequenceLength() != 0 && state_->params_->search.batch_size > 1)
     throw std::runtime_error("AppendTokens can only be called once for batch_size > 1. To call AppendTokens again, use RewindToLength(0)");
 
+  const auto start = Clock::now();
+  if (!first_append_time_)
+    first_append_time_ = start;
+
   auto input_ids_device = AllocateInputIdsOnDevice(input_ids);
   search_->AppendTokens(input_ids_device);
   computed_logits_ = false;
   ComputeLogits(input_ids_device);
+
+  metrics_.prompt_token_count += input_ids.size();
+  metrics_.prefill_time += Seconds(Clock::now() - start);
 }
 
 void Generator::AppendTokens(cpu_span<const int32_t> input_ids) {
@@ -374,6 +498,10 @@ void Generator::AppendTokens(cpu_span<const int32_t> input_ids) {
     throw std::runtime_error("Continuous decoding is not supported on the selected device type (" + to_string(state_->model_.p_device_kvcache_->GetType()) +
                              "). Please recreate the generator instance to avoid using continuous decoding.");
 
+  const auto start = Clock::now();
+  if (!first_append_time_)
+    first_append_time_ = start;
+
   if (last_action_ == Action::generated) {
     ComputeLogits(search_->GetNextTokens());
   }
@@ -382,6 +510,9 @@ void Generator::AppendTokens(cpu_span<const int32_t> input_ids) {
   search_->AppendTokens(input_ids_device);
   computed_logits_ = false;
   ComputeLogits(input_ids_device);
+
+  metrics_.prompt_token_count += input_ids.size();
+  metrics_.prefill_time += Seconds(Clock::now() - start);
 }
 
 void Generator::ComputeLogits(DeviceSpan<int32_t> next_tokens) {
@@ -391,7 +522,10 @@ void Generator::ComputeLogits(DeviceSpan<int32_t> next_tokens) {
     auto next_tokens_span = next_tokens.CopyDeviceToCpu();
     guidance_logits_processor_->CommitTokens(next_tokens_span);
   }
+  const auto run_start = Clock::now();
   auto logits = state_->Run(search_->GetSequenceLength(), next_tokens, search_->GetNextIndices());
+  metrics_.model_run_time += Seconds(Clock::now() - run_start);
+  metrics_.model_run_count++;
   if (g_log.enabled && g_log.model_logits) {
     auto& stream = Log("model_logits");
     DumpValues(stream, Ort::TypeToTensorType<float>, logits.CopyDeviceToCpu().data(), logits.size());
@@ -433,10 +567,49 @@ bool Generator::IsDone() const {
   return is_done;
 }
 
+bool Generator::IsRowDone(size_t batch_id) const {
+  if (batch_id >= static_cast<size_t>(search_->params_->search.batch_size))
+    throw std::runtime_error("batch_id " + std::to_string(batch_id) + " is out of range, the batch size is " + std::to_string(search_->params_->search.batch_size));
+  return !computed_logits_ && search_->IsRowDone(batch_id);
+}
+
 bool Generator::IsSessionTerminated() const {
   return state_->session_terminated_;
 }
 
+void Generator::GenerateAsync(size_t steps_per_call, std::function<bool(std::span<const int32_t> tokens, size_t step_count)> on_tokens) {
+  if (generate_future_.valid())
+    throw std::runtime_error("GenerateAsync called again before WaitForGenerate");
+  if (steps_per_call == 0)
+    throw std::runtime_error("GenerateAsync steps_per_call must be at least 1");
+
+  generate_future_ = std::async(std::launch::async, [this, steps_per_call, on_tokens = std::move(on_tokens)]() {
+    std::vector<int32_t> tokens;
+    size_t step_count = 0;
+    while (!IsSessionTerminated() && !IsDone()) {
+      GenerateNextToken();
+      auto next_tokens = search_->GetNextTokens().CopyDeviceToCpu();
+      tokens.insert(tokens.end(), next_tokens.begin(), next_tokens.end());
+      if (++step_count < steps_per_call)
+        continue;
+
+      const bool go_on = on_tokens(tokens, step_count);
+      tokens.clear();
+      step_count = 0;
+      if (!go_on)
+        return;
+    }
+    if (step_count != 0)
+      on_tokens(tokens, step_count);
+  });
+}
+
+void Generator::WaitForGenerate() {
+  if (!generate_future_.valid())
+    throw std::runtime_error("WaitForGenerate called without GenerateAsync");
+  generate_future_.get();  // Leaves the future invalid so GenerateAsync can be called again
+}
+
 void Generator::SetLogits(DeviceSpan<float> logits) {
   search_->SetLogits(logits);
   computed_logits_ = true;
@@ -444,6 +617,7 @@ void Generator::SetLogits(DeviceSpan<float> logits) {
 
 void Generator::GenerateNextToken() {
   DurationTrace trace{"Generator::GenerateNextToken"};
+  const auto start = Clock::now();
 
   ThrowErrorIfSessionTerminated(state_->session_terminated_);
   if (search_->GetSequenceLength() == 0 && !computed_logits_)
@@ -468,14 +642,31 @@ void Generator::GenerateNextToken() {
       search_->AppendTokens(next_tokens);
     ComputeLogits(next_tokens);
   }
-  if (guidance_logits_processor_) {
-    auto logits = GetLogits();
-    guidance_logits_processor_->ProcessLogits(logits);
+
+  // Rows that finished on an earlier step only get padding, so they don't count as generated tokens
+  size_t active_row_count = 0;
+  for (int row = 0; row < search_->params_->search.batch_size; row++) {
+    if (!search_->IsRowDone(row))
+      active_row_count++;
   }
+
+  const auto search_start = Clock::now();
+  SelectNextTokens();
+  const auto end = Clock::now();
+
+  const auto step_time = Seconds(end - start);
+  if (metrics_.step_count++ == 0 && first_append_time_)
+    metrics_.time_to_first_token = Seconds(end - *first_append_time_);
+  metrics_.generated_token_count += active_row_count;
+  metrics_.decode_time += step_time;
+  metrics_.search_time += Seconds(end - search_start);
+  metrics_.max_token_latency = std::max(metrics_.max_token_latency, step_time);
+}
+
+void Generator::SelectNextTokens() {
+  search_->ApplyLogitsProcessors(guidance_logits_processor_.get());
   computed_logits_ = false;
   auto& search = search_->params_->search;
-  search_->ApplyMinLength(search.min_length);
-  search_->ApplyRepetitionPenalty(search.repetition_penalty);
 
   if (g_log.enabled && g_log.generate_next_token) {
     auto& stream = Log("generate_next_token");
@@ -488,6 +679,11 @@ void Generator::GenerateNextToken() {
   }
 
   last_action_ = Action::generated;
+  if (!search_->params_->row_search_options.empty()) {
+    search_->SampleRows();
+    return;
+  }
+
   if (!search.do_sample || search.top_k == 1 || search.temperature == 0) {
     search_->SelectTop();
     return;
@@ -514,7 +710,8 @@ void Generator::GenerateNextToken() {
 }
 
 void Generator::RewindToLength(size_t new_length) {
-  if (model_->config_->model.type == "whisper" || model_->config_->model.type == "phi3v" || model_->config_->model.type == "decoder-pipeline")
+  if (model_->config_->model.type == "whisper" || model_->config_->model.type == "phi3v" ||
+      (model_->config_->model.type == "decoder-pipeline" && !model_->config_->model.decoder.sliding_window.has_value()))
     throw std::runtime_error("RewindTo is currently not supported for " + model_->config_->model.type + ".");
   if (new_length > search_->GetSequenceLength())
     throw std::runtime_error("Cannot rewind to a length greater than the current sequence length");
@@ -523,6 +720,13 @@ void Generator::RewindToLength(size_t new_length) {
   size_t batch_size = search_->params_->search.batch_size;
   if (batch_size > 1 && new_length != 0)
     throw std::runtime_error("RewindToLength must be called with new_length=0 when batch_size > 1");
+  if (const auto& sliding_window = model_->config_->model.decoder.sliding_window; sliding_window && new_length != 0) {
+    // The window only holds the last context_length - 1 tokens, check before any state is rewound
+    const auto cache_length = static_cast<size_t>(model_->config_->model.context_length - 1);
+    if (search_->GetSequenceLength() - new_length > cache_length)
+      throw std::runtime_error("Cannot rewind by " + std::to_string(search_->GetSequenceLength() - new_length) +
+                               " tokens, the sliding window only holds the last " + std::to_string(cache_length) + " tokens");
+  }
   search_->RewindTo(new_length);
   state_->RewindTo(new_length);
   if (guidance_logits_processor_) {
@@ -539,8 +743,199 @@ DeviceSpan<float> Generator::GetLogits() {
   return search_->GetLogits();
 }
 
+TokenLogProbs Generator::GetTokenLogProbs(size_t top_n) {
+  ThrowErrorIfSessionTerminated(state_->session_terminated_);
+  if (!computed_logits_ || last_action_ != Action::standard)
+    throw std::runtime_error("GetTokenLogProbs must be called right after AppendTokens, before GenerateNextToken");
+  if (state_->params_->search.num_beams != 1)
+    throw std::runtime_error("GetTokenLogProbs is not supported with beam search");
+
+  const size_t vocab_size = model_->config_->model.vocab_size;
+  if (top_n > vocab_size)
+    throw std::runtime_error("top_n (" + std::to_string(top_n) + ") cannot be greater than vocab_size (" + std::to_string(vocab_size) + ")");
+
+  const size_t batch_size = state_->params_->search.batch_size;
+  const size_t sequence_length = search_->GetSequenceLength();
+
+  // Logits::Get only trims what it hands to the search, the model output still holds every position
+  OrtValue* logits = state_->GetOutput(model_->config_->model.decoder.outputs.logits.c_str());
+  if (!logits)
+    throw std::runtime_error("GetTokenLogProbs requires the model to have a logits output");
+  auto logits_info = logits->GetTensorTypeAndShapeInfo();
+  auto logits_shape = logits_info->GetShape();
+  if (logits_shape.size() != 3 || static_cast<size_t>(logits_shape[0]) != batch_size ||
+      static_cast<size_t>(logits_shape[1]) != sequence_length || static_cast<size_t>(logits_shape[2]) != vocab_size)
+    throw std::runtime_error("GetTokenLogProbs needs the logits of every position. Append the whole sequence with a single AppendTokens call on a new generator or after RewindToLength(0)");
+
+  bool is_cpu = logits->GetTensorMemoryInfo().GetDeviceType() == OrtMemoryInfoDeviceType_CPU;
+  auto& device = is_cpu ? *GetDeviceInterface(DeviceType::CPU) : *model_->p_device_inputs_;
+  std::unique_ptr<OrtValue> logits_fp32;
+  if (logits_info->GetElementType() != Ort::TypeToTensorType<float>) {
+    Cast(*logits, logits_fp32, device, Ort::TypeToTensorType<float>);
+    logits = logits_fp32.get();
+  }
+
+  TokenLogProbs result;
+  auto logprobs = OrtValue::CreateTensor<float>(model_->allocator_cpu_, std::array<int64_t, 2>{static_cast<int64_t>(batch_size), static_cast<int64_t>(sequence_length)});
+  auto logprobs_span = std::span<float>(logprobs->GetTensorMutableData<float>(), batch_size * sequence_length);
+  std::fill(logprobs_span.begin(), logprobs_span.end(), 0.0f);
+
+  std::unique_ptr<OrtValue> top_ids, top_logprobs;
+  std::span<int32_t> top_ids_span;
+  std::span<float> top_logprobs_span;
+  if (top_n > 0) {
+    const std::array<int64_t, 3> top_shape{static_cast<int64_t>(batch_size), static_cast<int64_t>(sequence_length), static_cast<int64_t>(top_n)};
+    top_ids = OrtValue::CreateTensor<int32_t>(model_->allocator_cpu_, top_shape);
+    top_logprobs = OrtValue::CreateTensor<float>(model_->allocator_cpu_, top_shape);
+    top_ids_span = std::span<int32_t>(top_ids->GetTensorMutableData<int32_t>(), batch_size * sequence_length * top_n);
+    top_logprobs_span = std::span<float>(top_logprobs->GetTensorMutableData<float>(), top_ids_span.size());
+    std::fill(top_ids_span.begin(), top_ids_span.end(), -1);
+    std::fill(top_logprobs_span.begin(), top_logprobs_span.end(), 0.0f);
+  }
+
+  // The logits at position t-1 predict the token at position t, so every logits position gets the token it predicts
+  // as its target. A sequence runs from its first to its last token that is not padding, so its first token and the
+  // padding around a shorter sequence have nothing to score, while a pad_token_id within the sequence (like an EOS
+  // that is also the pad token) is scored like any other token.
+  const size_t position_count = batch_size * sequence_length;
+  auto targets = device.Allocate<int32_t>(position_count);
+  auto targets_cpu = targets.CpuSpan();
+  const int32_t pad_token_id = model_->config_->model.pad_token_id;
+  for (size_t b = 0; b < batch_size; b++) {
+    auto sequence = search_->GetSequence(b).CopyDeviceToCpu();
+    size_t begin = 0, end = sequence_length;
+    while (end > 0 && sequence[end - 1] == pad_token_id)
+      end--;
+    while (begin < end && sequence[begin] == pad_token_id)
+      begin++;
+    for (size_t t = 0; t < sequence_length; t++) {
+      const int32_t token = t >= begin && t + 1 < end ? sequence[t + 1] : -1;
+      targets_cpu[b * sequence_length + t] = token >= 0 && static_cast<size_t>(token) < vocab_size ? token : -1;
+    }
+  }
+
+  // The logits are reduced where they are, so a device only sends back the scores instead of [batch, seq, vocab]
+  bool scored_on_device = false;
+  if (!is_cpu) {
+    targets.CopyCpuToDevice();
+    auto device_logprobs = device.Allocate<float>(position_count);
+    DeviceSpan<int32_t> device_top_ids;
+    DeviceSpan<float> device_top_logprobs;
+    if (top_n > 0) {
+      device_top_ids = device.Allocate<int32_t>(position_count * top_n);
+      device_top_logprobs = device.Allocate<float>(position_count * top_n);
+    }
+    scored_on_device = device.LaunchTokenLogProbs(logits->GetTensorData<float>(), targets.Span().data(),
+                                                  static_cast<int>(position_count), static_cast<int>(vocab_size), static_cast<int>(top_n),
+                                                  device_logprobs.Span().data(),
+                                                  top_n > 0 ? device_top_ids.Span().data() : nullptr,
+                                                  top_n > 0 ? device_top_logprobs.Span().data() : nullptr);
+    if (scored_on_device) {
+      auto device_logprobs_cpu = device_logprobs.CopyDeviceToCpu();
+      std::span<int32_t> device_top_ids_cpu;
+      std::span<float> device_top_logprobs_cpu;
+      if (top_n > 0) {
+        device_top_ids_cpu = device_top_ids.CopyDeviceToCpu();
+        device_top_logprobs_cpu = device_top_logprobs.CopyDeviceToCpu();
+      }
+      for (size_t i = 0; i < position_count; i++) {
+        if (targets_cpu[i] < 0)
+          continue;
+        logprobs_span[i + 1] = device_logprobs_cpu[i];
+        if (top_n > 0) {
+          std::copy_n(device_top_ids_cpu.begin() + i * top_n, top_n, top_ids_span.begin() + (i + 1) * top_n);
+          std::copy_n(device_top_logprobs_cpu.begin() + i * top_n, top_n, top_logprobs_span.begin() + (i + 1) * top_n);
+        }
+      }
+    }
+  }
+
+  if (!scored_on_device) {
+    auto logits_cpu = WrapTensor<float>(device, *logits).CopyDeviceToCpu();
+    for (size_t i = 0; i < position_count; i++) {
+      const int32_t token = targets_cpu[i];
+      if (token < 0)
+        continue;
+
+      auto token_logits = logits_cpu.subspan(i * vocab_size, vocab_size);
+      const float log_sum_exp = LogSumExp(token_logits);
+      logprobs_span[i + 1] = token_logits[token] - log_sum_exp;
+      if (top_n > 0)
+        TopLogProbs(token_logits, log_sum_exp, top_ids_span.subspan((i + 1) * top_n, top_n), top_logprobs_span.subspan((i + 1) * top_n, top_n));
+    }
+  }
+
+  result.logprobs = std::make_shared<Tensor>(std::move(logprobs));
+  if (top_n > 0) {
+    result.top_ids = std::make_shared<Tensor>(std::move(top_ids));
+    result.top_logprobs = std::make_shared<Tensor>(std::move(top_logprobs));
+  }
+  return result;
+}
+
+TokenLogProbs Generator::GetSequenceLogProbs(size_t index) const {
+  const auto& records = search_->GetLogProbRecords();
+  const auto& search = search_->params_->search;
+  const size_t sequence_count = static_cast<size_t>(search.batch_size) * (search.num_beams > 1 ? search.num_return_sequences : 1);
+  if (index >= sequence_count)
+    throw std::runtime_error("GetSequenceLogProbs index (" + std::to_string(index) + ") is out of range");
+
+  // A finalized beam hypothesis can be shorter than the live beams
+  const size_t sequence_length = search_->GetSequence(index).size();
+  const int32_t head = search_->GetSequenceLogProbHead(index);
+  const auto top_n = static_cast<int64_t>(records.top_n_);
+  auto logprobs = OrtValue::CreateTensor<float>(model_->allocator_cpu_, std::array<int64_t, 2>{1, static_cast<int64_t>(sequence_length)});
+  std::span<float> logprobs_span{logprobs->GetTensorMutableData<float>(), sequence_length};
+
+  TokenLogProbs result;
+  if (top_n > 0) {
+    const std::array<int64_t, 3> top_shape{1, static_cast<int64_t>(sequence_length), top_n};
+    auto top_ids = OrtValue::CreateTensor<int32_t>(model_->allocator_cpu_, top_shape);
+    auto top_logprobs = OrtValue::CreateTensor<float>(model_->allocator_cpu_, top_shape);
+    records.Copy(head, logprobs_span, std::span<int32_t>(top_ids->GetTensorMutableData<int32_t>(), sequence_length * top_n),
+                 std::span<float>(top_logprobs->GetTensorMutableData<float>(), sequence_length * top_n));
+    result.top_ids = std::make_shared<Tensor>(std::move(top_ids));
+    result.top_logprobs = std::make_shared<Tensor>(std::move(top_logprobs));
+  } else
+    records.Copy(head, logprobs_span, {}, {});
+  result.logprobs = std::make_shared<Tensor>(std::move(logprobs));
+  return result;
+}
+
 DeviceSpan<int32_t> Generator::GetSequence(size_t index) const {
   return search_->GetSequence(index);
 }
 
+GeneratorMetrics Generator::GetMetrics() const {
+  GeneratorMetrics metrics = metrics_;
+
+  // The past key/value inputs are named after the patterns in the config, like past_key_values.%d.key
+  const auto& inputs = model_->config_->model.decoder.inputs;
+  auto is_past_name = [&](std::string_view name) {
+    for (const std::string* pattern : {&inputs.past_key_names, &inputs.past_value_names, &inputs.past_names,
+                                       &inputs.cross_past_key_names, &inputs.cross_past_value_names}) {
+      auto index = pattern->find("%d");
+      if (index == std::string::npos)
+        continue;
+      std::string_view prefix{pattern->data(), index}, suffix{pattern->data() + index + 2};
+      if (name.size() <= prefix.size() + suffix.size() || name.substr(0, prefix.size()) != prefix ||
+          name.substr(name.size() - suffix.size()) != suffix)
+        continue;
+      auto layer = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+      if (std::all_of(layer.begin(), layer.end(), [](char c) { return c >= '0' && c <= '9'; }))
+        return true;
+    }
+    return false;
+  };
+
+  for (size_t i = 0; i < state_->input_names_.size(); i++) {
+    auto* value = state_->inputs_[i];
+    if (!value || !is_past_name(state_->input_names_[i]))
+      continue;
+    auto type_info = value->GetTensorTypeAndShapeInfo();
+    metrics.kv_cache_bytes += type_info->GetElementCount() * Ort::SizeOf(type_info->GetElementType());
+  }
+  return metrics;
+}
+
 }  // namespace Generators
@@ -6,13 +6,16 @@
 #include <array>
 #include <assert.h>
 #include <atomic>
+#include <chrono>
 #include <cmath>
 #include <cstring>
 #include "filesystem.h"
 #include <functional>
+#include <future>
 #include <iostream>
 #include "span.h"
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <optional>
 #include <queue>
@@ -72,7 +75,10 @@ struct GeneratorParams : std::enable_shared_from_this<GeneratorParams>, LeakChec
 
   int max_batch_size{0};
   bool use_graph_capture{};
+  bool use_static_io{};  // model.decoder.static_io on the CPU
   bool use_multi_profile{};
+  // Decode step tensors are allocated once at their largest size and updated in place
+  bool UseStaticBuffers() const { return use_graph_capture || use_static_io; }
   int BatchBeamSize() const { return search.num_beams * search.batch_size; }
 
   DeviceInterface* p_device{};  // Scoring device (usually CPU, but can be CUDA)
@@ -99,22 +105,80 @@ struct GeneratorParams : std::enable_shared_from_this<GeneratorParams>, LeakChec
   std::string guidance_type;  // e.g. json_schema or regex
   std::string guidance_data;  // e.g. rules data in json_schema or regex
   void SetGuidance(std::string_view type, std::string_view data);
+
+  // Search options overridden for a single batch row, applied on top of search when the generator is created.
+  // Only the sampling options (do_sample, top_k, top_p, temperature, repetition_penalty, min_length, max_length,
+  // random_seed) can differ between rows.
+  struct RowSearchOption {
+    size_t row;
+    std::string name;
+    std::variant<double, bool> value;
+  };
+
+  std::vector<RowSearchOption> row_search_options;
+
+  void SetRowSearchNumber(size_t row, std::string_view name, double value);
+  void SetRowSearchBool(size_t row, std::string_view name, bool value);
+  std::vector<Config::Search> GetRowSearch() const;  // One entry per batch row
+
+  // Token sequences that finish a row when it generates them, like eos_token_id. Only supported by the CPU search.
+  std::vector<std::vector<int32_t>> stop_sequences;
+
+  void AddStopSequence(std::span<const int32_t> tokens);
+};
+
+// Log probabilities of the tokens of each sequence given the tokens before them
+struct TokenLogProbs {
+  std::shared_ptr<Tensor> logprobs;      // float32 [sequence_count, sequence_length]
+  std::shared_ptr<Tensor> top_ids;       // int32 [sequence_count, sequence_length, top_n], null when top_n is 0
+  std::shared_ptr<Tensor> top_logprobs;  // float32 [sequence_count, sequence_length, top_n], null when top_n is 0
+};
+
+// What a Generator has spent its time on, always collected. Times are in seconds and add up over every call since the
+// generator was created.
+struct GeneratorMetrics {
+  size_t prompt_token_count{};     // Tokens given to AppendTokens, all rows
+  size_t generated_token_count{};  // Tokens selected by GenerateNextToken, for rows not finished yet
+  size_t step_count{};             // GenerateNextToken calls
+  size_t model_run_count{};
+  size_t kv_cache_bytes{};       // Size of the past key/value inputs of the next model run
+  double time_to_first_token{};  // From the start of the first AppendTokens to the end of the first GenerateNextToken
+  double prefill_time{};         // In AppendTokens
+  double decode_time{};          // In GenerateNextToken
+  double model_run_time{};       // Running the model, from AppendTokens or GenerateNextToken
+  double search_time{};          // Processing the logits and selecting the next tokens
+  double max_token_latency{};    // Longest GenerateNextToken call
+
+  // Every metric by name, including the averages derived from them
+  std::vector<std::pair<const char*, double>> GetValues() const;
 };
 
 struct Generator : LeakChecked<Generator> {
   Generator(const Model& model, const GeneratorParams& params);
+  ~Generator();  // Terminates and waits for a GenerateAsync still running
 
   bool IsDone() const;
+  bool IsRowDone(size_t batch_id) const;  // Finished rows are only padded while the rest of the batch generates
   void AppendTokens(cpu_span<const int32_t> input_ids);
   void GenerateNextToken();
   void RewindToLength(size_t new_length);  // Rewind state to new_length
   DeviceSpan<float> GetLogits();
   void SetLogits(DeviceSpan<float> logits);
+  TokenLogProbs GetTokenLogProbs(size_t top_n);  // Scores the appended sequences from the logits of their single forward pass
+  TokenLogProbs GetSequenceLogProbs(size_t index) const;  // What the search recorded while selecting the tokens of a sequence
   void SetRuntimeOption(const char* key, const char* value);
   bool IsSessionTerminated() const;
 
+  // Calls GenerateNextToken on a worker thread until done, passing the next tokens of steps_per_call steps at a time to
+  // on_tokens as [step_count, batch_beam_size], the last call gets the remaining steps. Stops early when on_tokens returns
+  // false or the session is terminated. The generator must not be used until WaitForGenerate returns.
+  void GenerateAsync(size_t steps_per_call, std::function<bool(std::span<const int32_t> tokens, size_t step_count)> on_tokens);
+  void WaitForGenerate();  // Rethrows the error that stopped GenerateAsync, if any
+
   DeviceSpan<int32_t> GetSequence(size_t index) const;
 
+  GeneratorMetrics GetMetrics() const;  // Not synchronized, read it after WaitForGenerate when using GenerateAsync
+
   std::shared_ptr<const Model> model_;
   std::unique_ptr<State> state_;
   std::unique_ptr<Search> search_;
@@ -125,16 +189,28 @@ struct Generator : LeakChecked<Generator> {
   DeviceSpan<int32_t> AllocateInputIdsOnDevice(cpu_span<const int32_t> input_ids);
   void AuxAppendTokens(cpu_span<const int32_t> input_ids);
   void ComputeLogits(DeviceSpan<int32_t> next_tokens);
+  void SelectNextTokens();
   enum Action { standard,   // Default, set in any other case
                 generated,  // Set after GenerateNextToken
                 rewound };  // Set after RewindToLength
   Action last_action_{standard};
+
+  GeneratorMetrics metrics_;
+  std::optional<std::chrono::steady_clock::time_point> first_append_time_;
+
+  std::future<void> generate_future_;  // Valid from GenerateAsync until WaitForGenerate
+
+  uint64_t trace_id_{};  // Of the generator's span in the trace, from creation to destruction
 };
 
+struct PooledAllocator;
+
 struct OrtGlobals {
   OrtGlobals();
+  ~OrtGlobals();
 
   std::unique_ptr<OrtEnv> env_;
+  std::unique_ptr<PooledAllocator> allocator_cpu_pool_;  // Null when ORTGENAI_DISABLE_CPU_ALLOCATOR_POOL is set, only caches for models that enable it
 
   struct Allocator {
     std::unique_ptr<Ort::Allocator> allocator_;
@@ -160,6 +236,11 @@ std::unique_ptr<Generator> CreateGenerator(const Model& model, const GeneratorPa
 // Fallback to copy between two separate device buffers by going through CPU memory (slow unless we're the CPU device)
 void CopyThroughCpu(DeviceBuffer& dest, size_t begin_dest, DeviceBuffer& source, size_t begin_source, size_t size_in_bytes);
 
+// log(sum(exp(values))), computed relative to the max value for numerical stability
+float LogSumExp(std::span<const float> values);
+// Fills top_ids/top_logprobs with the top_ids.size() highest scoring tokens of logits, best first
+void TopLogProbs(std::span<const float> logits, float log_sum_exp, std::span<int32_t> top_ids, std::span<float> top_logprobs);
+
 float Float16ToFloat32(uint16_t v);  // v is a IEEE 752-2008 binary16 format, 1 sign bit, 5 bit exponent, 10 bit fraction
 
 }  // namespace Generators
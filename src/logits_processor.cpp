@@ -0,0 +1,73 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "generators.h"
+#include "search.h"
+#include "constrained_logits_processor.h"
+#include "logits_processor.h"
+
+namespace Generators {
+
+void LogitsProcessorChain::Add(std::unique_ptr<LogitsProcessor> processor) {
+  processors_.push_back(std::move(processor));
+}
+
+void LogitsProcessorChain::Process(std::span<float> scores, size_t row_count, size_t vocab_size) {
+  for (auto& processor : processors_)
+    processor->BeginStep();
+
+  for (size_t row = 0; row < row_count; row++) {
+    auto row_scores = scores.subspan(row * vocab_size, vocab_size);
+    for (auto& processor : processors_)
+      processor->Process(row, row_scores);
+  }
+}
+
+void MinLengthLogitsProcessor::Process(size_t row, std::span<float> scores) {
+  if (search_.GetSequenceLength() >= search_.GetRowSearch(row).min_length)
+    return;
+
+  for (auto token_id : search_.params_->config.model.eos_token_id)
+    scores[token_id] = std::numeric_limits<float>::lowest();
+}
+
+void RepetitionPenaltyLogitsProcessor::Process(size_t row, std::span<float> scores) {
+  const float penalty = search_.GetRowSearch(row).repetition_penalty;
+  if (penalty == 1.0f)
+    return;
+
+  std::span<const int32_t> const sequence = search_.sequences_.GetSequence(row).CopyDeviceToCpu();
+
+  // Find unique word IDs in sequence.
+  std::unordered_set<int32_t> unique_word_ids;
+  for (const auto& word_id : sequence) {
+    unique_word_ids.insert(word_id);
+  }
+
+  for (const int32_t word_id : unique_word_ids) {
+    float const score = scores[word_id];
+
+    // If score < 0, then repetition penalty > 1.0 has to multiplied to reduce the previous token probability,
+    // This assumes that scores are either positive (like ctrl) or negative (like GPT-2), but not a mixture.
+    scores[word_id] = (score < 0 ? score * penalty : score / penalty);
+  }
+}
+
+void GuidanceMaskLogitsProcessor::BeginStep() {
+  masks_ = guidance_.GetMask();
+}
+
+void GuidanceMaskLogitsProcessor::Process(size_t row, std::span<float> scores) {
+  // The guidance has a mask for each batch row
+  if (row >= masks_.size())
+    return;
+
+  // If the bit of a token is not set, the token is masked (i.e., its logit is set to the lowest possible value)
+  const auto& mask = masks_[row];
+  for (size_t i = 0; i < scores.size(); i++) {
+    if (!(mask[i / 32] & (1U << (i % 32))))
+      scores[i] = std::numeric_limits<float>::lowest();
+  }
+}
+
+}  // namespace Generators
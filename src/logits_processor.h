@@ -0,0 +1,62 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+namespace Generators {
+
+struct Search_Cpu;
+struct ConstrainedLogitsProcessor;
+
+// One transformation applied to the scores of each row before a token is selected
+struct LogitsProcessor {
+  virtual ~LogitsProcessor() = default;
+
+  // Called once per step before any row is processed
+  virtual void BeginStep() {}
+
+  virtual void Process(size_t row, std::span<float> scores) = 0;
+};
+
+// Applies the processors in the order they were added. The batch is walked one row at a time, so a row stays in cache
+// while every processor works on it instead of each processor making its own pass over the whole batch.
+struct LogitsProcessorChain {
+  void Add(std::unique_ptr<LogitsProcessor> processor);
+  bool Empty() const { return processors_.empty(); }
+
+  // scores is [row_count, vocab_size] on the CPU
+  void Process(std::span<float> scores, size_t row_count, size_t vocab_size);
+
+ private:
+  std::vector<std::unique_ptr<LogitsProcessor>> processors_;
+};
+
+// Suppresses the EOS tokens until a row reaches its min_length
+struct MinLengthLogitsProcessor : LogitsProcessor {
+  MinLengthLogitsProcessor(Search_Cpu& search) : search_{search} {}
+  void Process(size_t row, std::span<float> scores) override;
+
+ private:
+  Search_Cpu& search_;
+};
+
+// Penalizes the tokens that already appear in a row
+struct RepetitionPenaltyLogitsProcessor : LogitsProcessor {
+  RepetitionPenaltyLogitsProcessor(Search_Cpu& search) : search_{search} {}
+  void Process(size_t row, std::span<float> scores) override;
+
+ private:
+  Search_Cpu& search_;
+};
+
+// Masks the tokens rejected by constrained decoding (guidance)
+struct GuidanceMaskLogitsProcessor : LogitsProcessor {
+  GuidanceMaskLogitsProcessor(ConstrainedLogitsProcessor& guidance) : guidance_{guidance} {}
+  void BeginStep() override;
+  void Process(size_t row, std::span<float> scores) override;
+
+ private:
+  ConstrainedLogitsProcessor& guidance_;
+  std::vector<std::vector<uint32_t>> masks_;
+};
+
+}  // namespace Generators
@@ -0,0 +1,192 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include "generators.h"
+#include "model_data.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Generators {
+
+namespace {
+
+constexpr size_t tar_block_size = 512;
+
+// Reads a field of a tar header, which is null terminated unless it fills the field
+std::string_view TarField(const uint8_t* header, size_t offset, size_t size) {
+  auto field = reinterpret_cast<const char*>(header + offset);
+  return {field, strnlen(field, size)};
+}
+
+// The size field is octal text, or for sizes of 8 GiB and more a base-256 big endian number flagged by the high bit
+size_t TarSize(const uint8_t* header) {
+  const uint8_t* field = header + 124;
+  constexpr size_t field_size = 12;
+  uint64_t size = 0;
+  if (field[0] & 0x80) {
+    if (field[0] & 0x40)
+      throw std::runtime_error("Negative size in tar header");
+    size = field[0] & 0x3f;
+    for (size_t i = 1; i < field_size; i++) {
+      if (size >> 56)
+        throw std::runtime_error("Size in tar header is too large");
+      size = (size << 8) | field[i];
+    }
+  } else {
+    for (auto c : TarField(header, 124, field_size)) {
+      if (c == ' ')
+        continue;
+      if (c < '0' || c > '7')
+        throw std::runtime_error("Invalid size in tar header");
+      size = size * 8 + (c - '0');
+    }
+  }
+  if constexpr (sizeof(size_t) < sizeof(uint64_t)) {
+    if (size > SIZE_MAX)
+      throw std::runtime_error("Size in tar header is too large");
+  }
+  return static_cast<size_t>(size);
+}
+
+// The records of a pax extended header that apply to the next entry
+struct PaxRecords {
+  std::string path;
+  std::optional<size_t> size;  // Overrides the size field of the next header, which cannot hold large sizes
+};
+
+PaxRecords ParsePax(std::string_view records) {
+  PaxRecords pax;
+  // Each record is "<length> <key>=<value>\n", where length counts the whole record
+  while (!records.empty()) {
+    auto space = records.find(' ');
+    if (space == std::string_view::npos)
+      break;
+    auto length = static_cast<size_t>(std::stoull(std::string{records.substr(0, space)}));
+    if (length <= space + 1 || length > records.size())
+      break;
+    auto record = records.substr(space + 1, length - space - 2);  // Without the trailing newline
+    if (record.substr(0, 5) == "path=")
+      pax.path = std::string{record.substr(5)};
+    else if (record.substr(0, 5) == "size=")
+      pax.size = static_cast<size_t>(std::stoull(std::string{record.substr(5)}));
+    records.remove_prefix(length);
+  }
+  return pax;
+}
+
+std::string NormalizeName(std::string name) {
+  while (name.substr(0, 2) == "./")
+    name.erase(0, 2);
+  return name;
+}
+
+}  // namespace
+
+ModelData::~ModelData() {
+  if (!mapping_)
+    return;
+#ifdef _WIN32
+  UnmapViewOfFile(mapping_);
+  CloseHandle(mapping_handle_);
+#else
+  munmap(mapping_, mapping_size_);
+#endif
+}
+
+std::shared_ptr<ModelData> ModelData::MapArchive(const fs::path& path) {
+  auto model_data = std::make_shared<ModelData>();
+
+#ifdef _WIN32
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    throw std::runtime_error("Error opening " + path.string());
+  LARGE_INTEGER file_size{};
+  GetFileSizeEx(file, &file_size);
+  model_data->mapping_size_ = static_cast<size_t>(file_size.QuadPart);
+  if (model_data->mapping_size_ != 0) {
+    model_data->mapping_handle_ = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (model_data->mapping_handle_)
+      model_data->mapping_ = MapViewOfFile(model_data->mapping_handle_, FILE_MAP_READ, 0, 0, 0);
+  }
+  CloseHandle(file);
+#else
+  int file = open(path.c_str(), O_RDONLY);
+  if (file < 0)
+    throw std::runtime_error("Error opening " + path.string());
+  struct stat file_stat{};
+  fstat(file, &file_stat);
+  model_data->mapping_size_ = static_cast<size_t>(file_stat.st_size);
+  if (model_data->mapping_size_ != 0) {
+    auto* mapping = mmap(nullptr, model_data->mapping_size_, PROT_READ, MAP_PRIVATE, file, 0);
+    if (mapping != MAP_FAILED)
+      model_data->mapping_ = mapping;
+  }
+  close(file);
+#endif
+  if (!model_data->mapping_)
+    throw std::runtime_error("Error memory mapping " + path.string());
+
+  const auto* data = static_cast<const uint8_t*>(model_data->mapping_);
+  const auto size = model_data->mapping_size_;
+  std::string long_name;            // From a GNU long name entry or a pax header, applies to the next entry
+  std::optional<size_t> long_size;  // From a pax header, applies to the next entry
+  for (size_t offset = 0; offset + tar_block_size <= size;) {
+    const auto* header = data + offset;
+    if (std::all_of(header, header + tar_block_size, [](uint8_t c) { return c == 0; }))
+      break;  // End of archive
+
+    const auto entry_size = long_size ? *long_size : TarSize(header);
+    long_size.reset();
+    const auto entry_offset = offset + tar_block_size;
+    if (entry_size > size - entry_offset)
+      throw std::runtime_error("Truncated tar archive " + path.string());
+    offset = entry_offset + (entry_size + tar_block_size - 1) / tar_block_size * tar_block_size;
+
+    const std::string_view entry{reinterpret_cast<const char*>(data + entry_offset), entry_size};
+    switch (header[156]) {
+      case 'L':  // GNU long name
+        long_name = std::string{entry.substr(0, strnlen(entry.data(), entry.size()))};
+        continue;
+      case 'x': {  // Pax extended header
+        auto pax = ParsePax(entry);
+        long_name = std::move(pax.path);
+        long_size = pax.size;
+        continue;
+      }
+      case '0':
+      case '\0':  // Regular file
+        break;
+      default:  // Directories, links, global pax headers
+        long_name.clear();
+        continue;
+    }
+
+    std::string name = std::move(long_name);
+    long_name.clear();
+    if (name.empty()) {
+      name = std::string{TarField(header, 0, 100)};
+      if (TarField(header, 257, 5) == "ustar") {
+        auto prefix = TarField(header, 345, 155);
+        if (!prefix.empty())
+          name = std::string{prefix} + "/" + name;
+      }
+    }
+    model_data->Add(NormalizeName(std::move(name)), {data + entry_offset, entry_size});
+  }
+
+  return model_data;
+}
+
+void ModelData::Add(const std::string& name, std::span<const uint8_t> data) {
+  files_[name] = data;
+}
+
+const std::span<const uint8_t>* ModelData::Find(const std::string& name) const {
+  auto it = files_.find(name);
+  return it != files_.end() ? &it->second : nullptr;
+}
+
+}  // namespace Generators
@@ -0,0 +1,37 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+namespace Generators {
+
+// Files of a model that are held in memory instead of read from the config directory, keyed by their name relative to
+// it (like "model.onnx" or "model.onnx.data"). The files are either buffers given by the caller, which must stay valid
+// while a model created from them exists, or the entries of a memory mapped uncompressed tar archive. Nothing is
+// copied: sessions are created from the buffers and external weights are referenced in place.
+struct ModelData : std::enable_shared_from_this<ModelData>, ExternalRefCounted<ModelData> {
+  ModelData() = default;
+  ~ModelData();
+  ModelData(const ModelData&) = delete;
+  ModelData& operator=(const ModelData&) = delete;
+
+  // Maps an uncompressed (ustar, GNU or pax) tar archive, its directories and links are ignored
+  static std::shared_ptr<ModelData> MapArchive(const fs::path& path);
+
+  void Add(const std::string& name, std::span<const uint8_t> data);
+
+  const std::span<const uint8_t>* Find(const std::string& name) const;  // nullptr when the file is not in memory
+
+  const std::unordered_map<std::string, std::span<const uint8_t>>& Files() const { return files_; }
+
+ private:
+  std::unordered_map<std::string, std::span<const uint8_t>> files_;
+
+  // The archive mapping, when there is one
+  void* mapping_{};
+  size_t mapping_size_{};
+#ifdef _WIN32
+  HANDLE mapping_handle_{};
+#endif
+};
+
+}  // namespace Generators
@@ -7,9 +7,25 @@
 namespace Generators {
 
 Adapter::Adapter(const char* adapter_file_path, Ort::Allocator* allocator)
-    : adapter_{OrtLoraAdapter::Create(fs::path(adapter_file_path).c_str(), *allocator)} {}
+    : adapter_file_path_{adapter_file_path}, allocator_{allocator} {
+  Load();
+}
+
+void Adapter::Load() {
+  if (!adapter_)
+    adapter_ = OrtLoraAdapter::Create(fs::path(adapter_file_path_).c_str(), *allocator_);
+}
+
+void Adapter::Evict() {
+  if (ref_count_ > 0) {
+    throw std::runtime_error("Cannot evict an adapter that is in use.");
+  }
+
+  adapter_.reset();
+}
 
 const OrtLoraAdapter* Adapter::AcquireRef() {
+  Load();
   ref_count_++;
 
   return adapter_.get();
@@ -29,6 +45,7 @@ int32_t Adapter::RefCount() const {
 Adapters::Adapters(const Model* model) : model_{model} {}
 
 void Adapters::LoadAdapter(const char* adapter_file_path, const std::string& adapter_name) {
+  std::lock_guard<std::mutex> lock(mutex_);
   if (adapters_.find(adapter_name) != adapters_.end()) {
     throw std::runtime_error("Adapter already loaded: " + std::string{adapter_name});
   }
@@ -37,9 +54,12 @@ void Adapters::LoadAdapter(const char* adapter_file_path, const std::string& ada
                                                             model_->p_device_->GetType() == DeviceType::CUDA
                                                                 ? &model_->p_device_->GetAllocator()
                                                                 : nullptr));
+  Touch(adapter_name);
+  EvictUnusedAdapters();
 }
 
 void Adapters::UnloadAdapter(const std::string& adapter_name) {
+  std::lock_guard<std::mutex> lock(mutex_);
   auto adapter = adapters_.find(adapter_name);
   if (adapter == adapters_.end()) {
     throw std::runtime_error("Adapter not found: " + std::string{adapter_name});
@@ -49,25 +69,64 @@ void Adapters::UnloadAdapter(const std::string& adapter_name) {
     throw std::runtime_error("Adapter still in use: " + std::string{adapter_name});
   }
 
+  lru_.remove(adapter_name);
   adapters_.erase(adapter);
 }
 
 const OrtLoraAdapter* Adapters::AcquireAdapter(const std::string& adapter_name) {
+  std::lock_guard<std::mutex> lock(mutex_);
   auto adapter = adapters_.find(adapter_name);
   if (adapter == adapters_.end()) {
     throw std::runtime_error("Adapter not found: " + std::string{adapter_name});
   }
 
-  return adapter->second->AcquireRef();
+  auto* lora_adapter = adapter->second->AcquireRef();
+  Touch(adapter_name);
+  EvictUnusedAdapters();
+  return lora_adapter;
 }
 
 void Adapters::ReleaseAdapter(const std::string& adapter_name) {
+  std::lock_guard<std::mutex> lock(mutex_);
   auto adapter = adapters_.find(adapter_name);
   if (adapter == adapters_.end()) {
     throw std::runtime_error("Adapter not found: " + std::string{adapter_name});
   }
 
   adapter->second->ReleaseRef();
+  EvictUnusedAdapters();
+}
+
+void Adapters::SetMaxLoadedAdapters(size_t max_loaded_adapters) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_loaded_adapters_ = max_loaded_adapters;
+  EvictUnusedAdapters();
+}
+
+bool Adapters::IsAdapterLoaded(const std::string& adapter_name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto adapter = adapters_.find(adapter_name);
+  return adapter != adapters_.end() && adapter->second->IsResident();
+}
+
+void Adapters::Touch(const std::string& adapter_name) {
+  lru_.remove(adapter_name);
+  lru_.push_front(adapter_name);
+}
+
+void Adapters::EvictUnusedAdapters() {
+  if (max_loaded_adapters_ == 0)
+    return;
+
+  // Walk from the least recently used end, skipping adapters that are still referenced
+  for (auto it = lru_.end(); lru_.size() > max_loaded_adapters_ && it != lru_.begin();) {
+    --it;
+    auto& adapter = adapters_.at(*it);
+    if (adapter->RefCount() > 0)
+      continue;
+    adapter->Evict();
+    it = lru_.erase(it);
+  }
 }
 
 }  // namespace Generators
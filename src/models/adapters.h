@@ -2,10 +2,16 @@
 // Licensed under the MIT License.
 #pragma once
 
+#include <list>
+#include <mutex>
+
 namespace Generators {
 
 struct Model;
 
+// An adapter is registered by path and only materialized (read from disk and copied to the device) while
+// it is resident. The owning Adapters container decides when a resident adapter that is not referenced
+// by any generator can be evicted.
 struct Adapter {
   Adapter() = delete;
   Adapter(const Adapter&) = delete;
@@ -19,8 +25,16 @@ struct Adapter {
 
   int32_t RefCount() const;
 
+  bool IsResident() const { return adapter_ != nullptr; }
+
+  void Load();
+
+  void Evict();
+
  private:
   int32_t ref_count_{};
+  std::string adapter_file_path_;
+  Ort::Allocator* allocator_{};
   std::unique_ptr<OrtLoraAdapter> adapter_;
 };
 
@@ -39,8 +53,21 @@ struct Adapters : std::enable_shared_from_this<Adapters>, ExternalRefCounted<Ada
 
   void ReleaseAdapter(const std::string& adapter_name);
 
+  // Limits how many adapters are kept resident at once (0 means no limit). Adapters that are not
+  // referenced by any generator are evicted in least recently used order to honor the limit. Adapters
+  // that are in use are never evicted, so the limit can be temporarily exceeded.
+  void SetMaxLoadedAdapters(size_t max_loaded_adapters);
+
+  bool IsAdapterLoaded(const std::string& adapter_name) const;
+
  private:
+  void Touch(const std::string& adapter_name);
+  void EvictUnusedAdapters();
+
   const Model* model_;
+  mutable std::mutex mutex_;
+  size_t max_loaded_adapters_{};
+  std::list<std::string> lru_;  // Resident adapters, most recently used first
   std::unordered_map<std::string, std::unique_ptr<Adapter>> adapters_;
 };
 
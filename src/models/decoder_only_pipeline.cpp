@@ -11,10 +11,16 @@ namespace Generators {
 
 DecoderOnlyPipelineModel::DecoderOnlyPipelineModel(std::unique_ptr<Config> config, OrtEnv& ort_env)
     : Model{std::move(config)}, ort_env_{ort_env} {
-  for (const auto& model : config_->model.decoder.pipeline) {
-    sessions_.emplace_back(OrtSession::Create(ort_env, (config_->config_path / fs::path(model.filename)).c_str(),
-                                              GetSessionOptions(model.model_id)));
+  // The stages are independent models, so create their sessions concurrently
+  const auto& pipeline = config_->model.decoder.pipeline;
+  sessions_.resize(pipeline.size());
+  std::vector<std::function<void()>> create_sessions;
+  for (size_t i = 0; i < pipeline.size(); i++) {
+    create_sessions.emplace_back([&, i, session_options = GetSessionOptions(pipeline[i].model_id)] {
+      sessions_[i] = CreateSession(ort_env, pipeline[i].filename, session_options);
+    });
   }
+  CreateSessionsConcurrently(*config_, std::move(create_sessions));
 
   for (auto& session : sessions_) {
     session_info_.Add(*session);
@@ -69,9 +75,9 @@ bool IntermediatePipelineState::SupportsPrimaryDevice() const {
 DeviceSpan<float> IntermediatePipelineState::Run(int total_length, DeviceSpan<int32_t>& next_tokens,
                                                  DeviceSpan<int32_t> next_indices) {
   if (!model_.sessions_[id_]) {
-    const_cast<DecoderOnlyPipelineModel*>(&model_)->sessions_[id_] =
-        OrtSession::Create(model_.ort_env_, (model_.config_->config_path / fs::path(model_.config_->model.decoder.pipeline[id_].filename)).c_str(),
-                           model_.GetSessionOptions(model_.config_->model.decoder.pipeline[id_].model_id));
+    auto& model = const_cast<DecoderOnlyPipelineModel&>(model_);
+    model.sessions_[id_] = model.CreateSession(model.ort_env_, model.config_->model.decoder.pipeline[id_].filename,
+                                               model.GetSessionOptions(model.config_->model.decoder.pipeline[id_].model_id));
   }
   State::Run(*model_.sessions_[id_]);
   return {};
@@ -196,7 +202,8 @@ void DecoderOnlyPipelineState::RunPipeline(int total_length, DeviceSpan<int32_t>
       continue;
     }
 
-    DurationTrace trace{MakeString("DecoderOnlyPipelineState::RunPipeline[", pipeline_state->id_, "]")};
+    // The label is only built while tracing is on, this runs for every pipeline stage of every token
+    DurationTrace trace{DefaultTracerInstance().IsEnabled() ? MakeString("DecoderOnlyPipelineState::RunPipeline[", pipeline_state->id_, "]") : std::string{}};
 
     if (model_.config_->model.decoder.pipeline[pipeline_state->id_].reset_session_idx > -1) {
       if (model_.config_->model.decoder.pipeline[pipeline_state->id_].reset_session_idx >=
@@ -337,22 +344,35 @@ DeviceSpan<float> DecoderOnlyPipelineState::Run(int total_length, DeviceSpan<int
                                                 DeviceSpan<int32_t> next_indices) {
   DurationTrace trace{"DecoderOnlyPipelineState::Run"};
 
-  UpdateInputsOutputs(next_tokens, next_indices, total_length);
+  if (!first_run_ && model_.config_->model.decoder.sliding_window.has_value() && next_tokens.size() > 1) {
+    // Tokens appended after the prompt (continuous decoding, or after a rewind) are processed one at a time.
+    // Once the prompt is done the key-value cache and the position inputs are laid out for a window of one token,
+    // so running the appended tokens as a window of their own would not match those shapes. This costs one pipeline
+    // run per appended token, the prompt itself is still processed a window at a time.
+    for (size_t i = 0; i < next_tokens.size(); ++i) {
+      auto next_token = next_tokens.subspan(i, 1);
+      const int current_length = total_length - static_cast<int>(next_tokens.size() - i - 1);
+      UpdateInputsOutputs(next_token, next_indices, current_length);
+      RunPipeline(current_length, next_token, next_indices);
+    }
+  } else {
+    UpdateInputsOutputs(next_tokens, next_indices, total_length);
 
-  size_t num_chunks{1};
-  if (first_run_ && model_.config_->model.decoder.sliding_window.has_value()) {
-    int window_size = model_.config_->model.decoder.sliding_window->window_size;
-    num_chunks = (next_tokens.size() + window_size - 1) / window_size;
-  }
+    size_t num_chunks{1};
+    if (first_run_ && model_.config_->model.decoder.sliding_window.has_value()) {
+      int window_size = model_.config_->model.decoder.sliding_window->window_size;
+      num_chunks = (next_tokens.size() + window_size - 1) / window_size;
+    }
 
-  for (size_t i = 0; i < num_chunks; ++i) {
-    RunPipeline(total_length, next_tokens, next_indices);
+    for (size_t i = 0; i < num_chunks; ++i) {
+      RunPipeline(total_length, next_tokens, next_indices);
 
-    if (model_.config_->model.decoder.sliding_window.has_value() && i < num_chunks - 1) {
-      // Sliding the window over the input_ids, key_cache, and value_cache, position_ids, and attention_mask
-      input_ids_->Update(next_tokens);
-      UpdateKeyValueCache(next_indices, total_length);
-      position_inputs_->Update(next_tokens, total_length, static_cast<int>(input_ids_->GetShape()[1]));
+      if (model_.config_->model.decoder.sliding_window.has_value() && i < num_chunks - 1) {
+        // Sliding the window over the input_ids, key_cache, and value_cache, position_ids, and attention_mask
+        input_ids_->Update(next_tokens);
+        UpdateKeyValueCache(next_indices, total_length);
+        position_inputs_->Update(next_tokens, total_length, static_cast<int>(input_ids_->GetShape()[1]));
+      }
     }
   }
 
@@ -374,6 +394,37 @@ DeviceSpan<float> DecoderOnlyPipelineState::Run(int total_length, DeviceSpan<int
   return logits_.Get();
 }
 
+void DecoderOnlyPipelineState::RewindTo(size_t index) {
+  if (!model_.config_->model.decoder.sliding_window.has_value()) {
+    throw std::runtime_error("RewindTo is only supported for decoder-pipeline models with a sliding_window.");
+  }
+
+  if (key_value_cache_) {
+    // The key-value cache must hold the outputs of the last run before it is rewound. With partial updates,
+    // they are moved into the cache right after the pipeline models run, otherwise on the next update.
+    bool had_outstanding_update = false;
+    for (auto& record : partial_kv_cache_update_records_) {
+      if (record.outstanding_update.valid()) {
+        record.outstanding_update.get();
+        had_outstanding_update = true;
+      }
+    }
+    if (!had_outstanding_update && !first_run_ && index != 0) {
+      key_value_cache_->Update({}, static_cast<int>(index));
+    }
+
+    key_value_cache_->RewindTo(index);
+  }
+
+  position_inputs_->RewindTo(index);
+  input_ids_->RewindTo(index);
+
+  if (index == 0) {
+    // Process the next tokens as a new prompt, running the prompt processing pipeline models again
+    first_run_ = true;
+  }
+}
+
 void DecoderOnlyPipelineState::UpdateKeyValueCache(DeviceSpan<int32_t> beam_indices, int total_length) {
   if (key_value_cache_) {
     const bool outstanding_key_value_cache_partial_update =
@@ -50,7 +50,7 @@ void Embeddings::UpdateSequenceLength(size_t new_length) {
 
     if (mode_ == Embeddings::Mode::Input) {
       embeddings_ = OrtValue::CreateTensor(model_.p_device_->GetAllocator(), shape_, type_);
-      state_.inputs_[index_] = embeddings_.get();
+      state_.SetInput(index_, embeddings_.get());
     }
   }
 }
@@ -62,7 +62,7 @@ void Embeddings::ReuseEmbeddingsBuffer(const Embeddings& other) {
   }
 
   // Share the input embeddings OrtValue* from other with the output embedding for this.
-  state_.outputs_[index_] = other.state_.inputs_[other.index_];
+  state_.SetOutput(index_, other.state_.inputs_[other.index_]);
 }
 
 }  // namespace Generators
@@ -25,13 +25,13 @@ void ExtraOutputs::Add(const std::vector<std::string>& all_output_names) {
 
 void ExtraOutputs::Update() {
   for (size_t i = extra_outputs_start_; i < state_.output_names_.size(); ++i) {
-    state_.outputs_[i] = nullptr;
+    state_.SetOutput(i, nullptr);
   }
 }
 
 void ExtraOutputs::RegisterOutputs() {
   for (size_t i = extra_outputs_start_; i < state_.output_names_.size(); ++i) {
-    state_.outputs_[i] = (output_ortvalues_[state_.output_names_[i]] = std::unique_ptr<OrtValue>(state_.outputs_[i])).get();
+    state_.SetOutput(i, (output_ortvalues_[state_.output_names_[i]] = std::unique_ptr<OrtValue>(state_.outputs_[i])).get());
   }
 }
 
@@ -4,30 +4,30 @@
 #include "../generators.h"
 #include "model.h"
 
-#include <regex>
-
 namespace Generators {
 
 namespace {
 
+constexpr char boi_token[] = "<start_of_image>";
+constexpr char image_token[] = "<image_soft_token>";
+constexpr char eoi_token[] = "<end_of_image>";
+constexpr size_t image_seq_length = 256;
+
+// What every boi token of the prompt expands to, built once
+const std::string& FullImageSequence() {
+  static const std::string full_image_sequence = [] {
+    std::string image_tokens_expanded{};
+    for (size_t i = 0; i < image_seq_length; ++i) {
+      image_tokens_expanded += image_token;
+    }
+    return std::string("\n\n") + boi_token + image_tokens_expanded + eoi_token + std::string("\n\n");
+  }();
+  return full_image_sequence;
+}
+
 std::tuple<std::unique_ptr<OrtValue>, std::unique_ptr<OrtValue>, std::unique_ptr<OrtValue>>
 ProcessImagePrompt(const Generators::Tokenizer& tokenizer, const std::string& prompt,
-                   OrtxTensor* pixel_values, Ort::Allocator& allocator) {
-  constexpr char boi_token[] = "<start_of_image>";
-  constexpr char image_token[] = "<image_soft_token>";
-  constexpr char eoi_token[] = "<end_of_image>";
-  constexpr size_t image_seq_length = 256;
-
-  int64_t num_images{};
-  if (pixel_values) {
-    const float* pixel_values_data{};
-    const int64_t* pixel_values_shape{};
-    size_t pixel_values_num_dims;
-    CheckResult(OrtxGetTensorData(pixel_values, reinterpret_cast<const void**>(&pixel_values_data),
-                                  &pixel_values_shape, &pixel_values_num_dims));
-    num_images = pixel_values_shape[0];
-  }
-
+                   int64_t num_images, Ort::Allocator& allocator) {
   // Generate input_ids and token_type_ids
   std::string text = prompt;
   if (text.empty()) {
@@ -37,23 +37,22 @@ ProcessImagePrompt(const Generators::Tokenizer& tokenizer, const std::string& pr
     text.pop_back();
   }
 
-  // Count the number of boi tokens and make sure it matches the number of images
-  const std::regex boi_regex{std::string(boi_token)};
-  const auto boi_begin = std::sregex_iterator(text.begin(), text.end(), boi_regex);
-  const auto boi_end = std::sregex_iterator();
-  const auto boi_tokens = std::distance(boi_begin, boi_end);
+  // Expand the boi tokens, which are plain strings so no regex is needed, and make sure they match the number of images
+  const std::string_view boi{boi_token};
+  std::string expanded_text;
+  int64_t boi_tokens{};
+  size_t position = 0;
+  for (size_t found; (found = text.find(boi, position)) != std::string::npos; position = found + boi.size()) {
+    expanded_text.append(text, position, found - position);
+    expanded_text += FullImageSequence();
+    boi_tokens++;
+  }
+  expanded_text.append(text, position, std::string::npos);
   if (num_images != boi_tokens) {
     throw std::runtime_error("Prompt contained " + std::to_string(boi_tokens) + " image tokens but received " +
                              std::to_string(num_images) + " images.");
   }
-
-  std::string image_tokens_expanded{};
-  for (size_t i = 0; i < image_seq_length; ++i) {
-    image_tokens_expanded += image_token;
-  }
-  const std::string full_image_sequence = std::string("\n\n") + boi_token + image_tokens_expanded + eoi_token + std::string("\n\n");
-
-  text = std::regex_replace(text, boi_regex, full_image_sequence);
+  text = std::move(expanded_text);
 
   const std::vector<int32_t> input_ids = tokenizer.Encode(text.c_str());
 
@@ -79,9 +78,8 @@ ProcessImagePrompt(const Generators::Tokenizer& tokenizer, const std::string& pr
 }  // namespace
 
 GemmaImageProcessor::GemmaImageProcessor(Config& config, const SessionInfo& session_info)
-    : pixel_values_type_{session_info.GetInputDataType(config.model.vision.inputs.pixel_values)} {
-  const auto processor_config = (config.config_path / fs::path(config.model.vision.config_filename)).string();
-  CheckResult(OrtxCreateProcessor(processor_.ToBeAssigned(), processor_config.c_str()));
+    : image_processors_{(config.config_path / fs::path(config.model.vision.config_filename)).string()},
+      pixel_values_type_{session_info.GetInputDataType(config.model.vision.inputs.pixel_values)} {
 
   config.AddMapping(std::string(Config::Defaults::InputIdsName), config.model.embedding.inputs.input_ids);
   config.AddMapping(std::string(Config::Defaults::PixelValuesName), config.model.vision.inputs.pixel_values);
@@ -94,27 +92,24 @@ std::unique_ptr<NamedTensors> GemmaImageProcessor::Process(const Tokenizer& toke
   auto named_tensors = std::make_unique<NamedTensors>();
 
   if (!images) {
-    [[maybe_unused]] auto [input_ids, token_type_ids, num_img_tokens] = ProcessImagePrompt(tokenizer, prompt, nullptr, allocator);
+    [[maybe_unused]] auto [input_ids, token_type_ids, num_img_tokens] = ProcessImagePrompt(tokenizer, prompt, 0, allocator);
     named_tensors->emplace(Config::Defaults::InputIdsName, std::make_shared<Tensor>(std::move(input_ids)));
     return named_tensors;
   }
 
-  ort_extensions::OrtxObjectPtr<OrtxTensorResult> result;
-  CheckResult(OrtxImagePreProcess(processor_.get(), images->images_.get(), result.ToBeAssigned()));
-
-  OrtxTensor* pixel_values = nullptr;
-  CheckResult(OrtxTensorResultGetAt(result.get(), 0, &pixel_values));
+  // The only tensor of each image is pixel_values
+  const auto results = image_processors_.PreProcess(*images);
 
-  auto [input_ids, token_type_ids, num_img_tokens] = ProcessImagePrompt(tokenizer, prompt, pixel_values, allocator);
+  auto [input_ids, token_type_ids, num_img_tokens] = ProcessImagePrompt(tokenizer, prompt, static_cast<int64_t>(images->num_images_), allocator);
   named_tensors->emplace(std::string(Config::Defaults::InputIdsName), std::make_shared<Tensor>(std::move(input_ids)));
   named_tensors->emplace(std::string(Config::Defaults::TokenTypeIdsName), std::make_shared<Tensor>(std::move(token_type_ids)));
 
   if (pixel_values_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
     named_tensors->emplace(std::string(Config::Defaults::PixelValuesName),
-                           std::make_shared<Tensor>(ProcessTensor<float>(pixel_values, allocator)));
+                           std::make_shared<Tensor>(StackTensors<float>(results, 0, allocator)));
   } else {
     named_tensors->emplace(std::string(Config::Defaults::PixelValuesName),
-                           std::make_shared<Tensor>(ProcessTensor<Ort::Float16_t>(pixel_values, allocator)));
+                           std::make_shared<Tensor>(StackTensors<float, Ort::Float16_t>(results, 0, allocator)));
   }
 
   named_tensors->emplace(std::string(Config::Defaults::NumImageTokens), std::make_shared<Tensor>(std::move(num_img_tokens)));
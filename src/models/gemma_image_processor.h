@@ -12,7 +12,7 @@ struct GemmaImageProcessor : Processor {
   virtual std::unique_ptr<NamedTensors> Process(const Tokenizer& tokenizer, const Payload& payload) const override;
 
  private:
-  ort_extensions::OrtxObjectPtr<OrtxProcessor> processor_;
+  ImageProcessorPool image_processors_;
 
   ONNXTensorElementDataType pixel_values_type_;
 };
@@ -0,0 +1,126 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include "../generators.h"
+#include "image_features_cache.h"
+
+namespace Generators {
+
+namespace {
+
+constexpr uint64_t RotateLeft(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+// Two independent 64-bit lanes over 8 byte words, enough to make a collision between different images negligible
+struct Hasher {
+  uint64_t lanes[2]{0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL};
+
+  void Add(uint64_t word) {
+    lanes[0] = RotateLeft(lanes[0] ^ (word * 0x87C37B91114253D5ULL), 31) * 0x4CF5AD432745937FULL;
+    lanes[1] = RotateLeft(lanes[1] + (word * 0x52DCE729ULL), 27) * 0x9E3779B185EBCA87ULL + 0x38495AB5ULL;
+  }
+
+  void Add(std::span<const uint8_t> bytes) {
+    Add(bytes.size());
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t)) {
+      uint64_t word;
+      std::memcpy(&word, bytes.data() + i, sizeof(word));
+      Add(word);
+    }
+    uint64_t tail = 0;
+    if (i < bytes.size())
+      std::memcpy(&tail, bytes.data() + i, bytes.size() - i);
+    Add(tail);
+  }
+
+  static uint64_t Finish(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ULL;
+    return value ^ (value >> 33);
+  }
+};
+
+size_t GetByteCount(OrtValue& value) {
+  auto type_info = value.GetTensorTypeAndShapeInfo();
+  return type_info->GetElementCount() * Ort::SizeOf(type_info->GetElementType());
+}
+
+}  // namespace
+
+ImageFeaturesCache::ImageFeaturesCache(DeviceInterface& device, size_t max_bytes)
+    : device_{device}, max_bytes_{max_bytes} {}
+
+ImageFeaturesCache::Key::Key(std::span<const OrtValue* const> inputs) {
+  auto append = [this](const void* data, size_t size) {
+    bytes.insert(bytes.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+  };
+  for (const auto* input : inputs) {
+    auto type_info = input->GetTensorTypeAndShapeInfo();
+    const auto type = static_cast<uint64_t>(type_info->GetElementType());
+    const auto shape = type_info->GetShape();
+    const uint64_t rank = shape.size();
+    append(&type, sizeof(type));
+    append(&rank, sizeof(rank));
+    append(shape.data(), shape.size() * sizeof(int64_t));
+    append(input->GetTensorRawData(), type_info->GetElementCount() * Ort::SizeOf(type_info->GetElementType()));
+  }
+
+  Hasher hasher;
+  hasher.Add(bytes);
+  hash[0] = Hasher::Finish(hasher.lanes[0]);
+  hash[1] = Hasher::Finish(hasher.lanes[1]);
+}
+
+bool ImageFeaturesCache::Find(const Key& key, OrtValue& features) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  auto it = index_.find({key.hash[0], key.hash[1]});
+  if (it == index_.end())
+    return false;
+
+  auto& entry = *it->second;
+  if (entry.key_bytes != key.bytes ||
+      entry.features->GetTensorTypeAndShapeInfo()->GetShape() != features.GetTensorTypeAndShapeInfo()->GetShape())
+    return false;
+
+  ByteWrapTensor(device_, features).CopyFrom(ByteWrapTensor(device_, *entry.features));
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return true;
+}
+
+void ImageFeaturesCache::Insert(Key key, OrtValue& features) {
+  const auto bytes = GetByteCount(features) + key.bytes.size();
+  if (bytes > max_bytes_)
+    return;
+
+  auto type_info = features.GetTensorTypeAndShapeInfo();
+  auto copy = OrtValue::CreateTensor(device_.GetAllocator(), type_info->GetShape(), type_info->GetElementType());
+  ByteWrapTensor(device_, *copy).CopyFrom(ByteWrapTensor(device_, features));
+
+  const Hash hash{key.hash[0], key.hash[1]};
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (auto it = index_.find(hash); it != index_.end())
+    Erase(it->second);
+
+  while (!entries_.empty() && bytes_ + bytes > max_bytes_)
+    Erase(std::prev(entries_.end()));
+
+  entries_.push_front({hash, std::move(key.bytes), std::move(copy), bytes});
+  index_.emplace(hash, entries_.begin());
+  bytes_ += bytes;
+}
+
+size_t ImageFeaturesCache::GetBytes() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return bytes_;
+}
+
+void ImageFeaturesCache::Erase(std::list<Entry>::iterator entry) {
+  bytes_ -= entry->bytes;
+  index_.erase(entry->hash);
+  entries_.erase(entry);
+}
+
+}  // namespace Generators
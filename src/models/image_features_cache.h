@@ -0,0 +1,60 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include <list>
+
+namespace Generators {
+
+// Image features produced by the vision model for recent images, keyed by the vision model inputs of each image, so an
+// image that comes back in a later request or chat turn skips the vision model even when it comes with new images.
+// Entries are copies held in device memory along with the inputs they were made from, the least recently used ones are
+// evicted to stay within the byte budget. Shared by every generator of a model.
+struct ImageFeaturesCache {
+  ImageFeaturesCache(DeviceInterface& device, size_t max_bytes);
+
+  // The type, shape and contents of the vision model inputs of one image, which must be in CPU memory
+  struct Key {
+    explicit Key(std::span<const OrtValue* const> inputs);
+
+    uint64_t hash[2];
+    std::vector<uint8_t> bytes;  // What was hashed, compared on a hit so a hash collision can't return another image
+  };
+
+  // Copies the cached features into features and returns true, or returns false when the key is not cached
+  bool Find(const Key& key, OrtValue& features);
+
+  // Caches a copy of the features, unless they and the key are larger than the whole budget
+  void Insert(Key key, OrtValue& features);
+
+  size_t GetBytes();  // Held by the entries, the features and the inputs they were made from
+
+ private:
+  struct Hash {
+    uint64_t value[2];
+    bool operator==(const Hash& other) const { return value[0] == other.value[0] && value[1] == other.value[1]; }
+  };
+
+  struct HashHash {
+    size_t operator()(const Hash& hash) const { return static_cast<size_t>(hash.value[0]); }
+  };
+
+  struct Entry {
+    Hash hash;
+    std::vector<uint8_t> key_bytes;
+    std::unique_ptr<OrtValue> features;
+    size_t bytes;
+  };
+
+  void Erase(std::list<Entry>::iterator entry);
+
+  DeviceInterface& device_;
+  const size_t max_bytes_;
+
+  std::mutex mutex_;
+  size_t bytes_{};
+  std::list<Entry> entries_;  // Most recently used first
+  std::unordered_map<Hash, std::list<Entry>::iterator, HashHash> index_;
+};
+
+}  // namespace Generators
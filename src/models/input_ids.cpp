@@ -72,10 +72,12 @@ void DefaultInputIDs::Update(DeviceSpan<int32_t> new_tokens) {
   if (is_prompt_ && state_.params_->search.num_beams > 1)
     sequence_length = static_cast<size_t>(new_tokens.size()) / state_.params_->search.batch_size;
 
+  bool value_replaced = false;
   if (static_cast<size_t>(shape_[1]) != sequence_length) {
     shape_[1] = sequence_length;
-    value_->CreateTensor(shape_, state_.params_->use_graph_capture && shape_[1] == 1);
-    state_.inputs_[input_index_] = value_->GetOrtTensor();
+    value_->CreateTensor(shape_, state_.params_->UseStaticBuffers() && shape_[1] == 1);
+    state_.SetInput(input_index_, value_->GetOrtTensor());
+    value_replaced = true;
   }
 
   // Update input_ids with next tokens
@@ -94,10 +96,14 @@ void DefaultInputIDs::Update(DeviceSpan<int32_t> new_tokens) {
   }
 
   if (type_ == Ort::TypeToTensorType<int64_t>) {
-    if (!cast_value_->ort_tensor_ || static_cast<size_t>(cast_value_->GetShape()[1]) != sequence_length)
-      cast_value_->CreateTensor(shape_, state_.params_->use_graph_capture && shape_[1] == 1);
+    // The input only changes when a tensor is recreated, the cast writes into the existing one
+    if (!cast_value_->ort_tensor_ || static_cast<size_t>(cast_value_->GetShape()[1]) != sequence_length) {
+      cast_value_->CreateTensor(shape_, state_.params_->UseStaticBuffers() && shape_[1] == 1);
+      value_replaced = true;
+    }
     Cast(*value_->GetOrtTensor(), cast_value_->ort_tensor_, *model_.p_device_inputs_, type_);
-    state_.inputs_[input_index_] = cast_value_->GetOrtTensor();
+    if (value_replaced)
+      state_.SetInput(input_index_, cast_value_->GetOrtTensor());
   }
 
   is_prompt_ = false;
@@ -183,6 +189,7 @@ void WindowedInputIDs::Update(DeviceSpan<int32_t> new_tokens) {
     // window_size = 3, num_windows = 2, pad_token = 0
     // window_index = 0, value_ -> [0, a, b]
     std::copy_n(new_tokens.Span().begin(), window_size_, value_->GetTensorMutableData<int32_t>());
+    num_tokens_ += window_size_;
 
     if (past_sequence_length_)
       *past_sequence_length_->GetTensorMutableData<int32_t>() += static_cast<int32_t>(window_size_);
@@ -191,6 +198,7 @@ void WindowedInputIDs::Update(DeviceSpan<int32_t> new_tokens) {
     // window_size = 3, num_windows = 2
     // window_index = 1, value_ -> [c, d, e]
     std::copy_n(new_tokens.Span().begin() + window_index_ * window_size_, window_size_, value_->GetTensorMutableData<int32_t>());
+    num_tokens_ += window_size_;
 
     if (past_sequence_length_)
       *past_sequence_length_->GetTensorMutableData<int32_t>() += static_cast<int32_t>(window_size_);
@@ -214,17 +222,40 @@ void WindowedInputIDs::Update(DeviceSpan<int32_t> new_tokens) {
     }
 
     value_->GetTensorMutableData<int32_t>()[0] = new_tokens.Span()[0];
+    num_tokens_ += 1;
   }
 
-  state_.inputs_[input_index_] = value_.get();
+  state_.SetInput(input_index_, value_.get());
 
   if (type_ == Ort::TypeToTensorType<int64_t>) {
     Cast(*value_, cast_value_, *model_.p_device_inputs_, type_);
-    state_.inputs_[input_index_] = cast_value_.get();
+    state_.SetInput(input_index_, cast_value_.get());
   }
   window_index_++;
 }
 
+void WindowedInputIDs::RewindTo(size_t index) {
+  if (index != 0) {
+    const auto num_tokens_to_drop = static_cast<int32_t>(num_tokens_ - std::min(index, num_tokens_));
+    if (past_sequence_length_ && shape_[1] == 1) {
+      *past_sequence_length_->GetTensorMutableData<int32_t>() -= num_tokens_to_drop;
+    } else {
+      // The first token generation update starts past_sequence_length from the prompt length
+      initial_num_tokens_ -= std::min(num_tokens_to_drop, initial_num_tokens_);
+    }
+    num_tokens_ = index;
+    return;
+  }
+
+  window_index_ = 0;
+  num_tokens_ = 0;
+  num_windows_ = 0;
+  initial_num_tokens_ = 0;
+  shape_[1] = static_cast<int64_t>(window_size_);
+  if (past_sequence_length_)
+    *past_sequence_length_->GetTensorMutableData<int32_t>() = -1;
+}
+
 std::unique_ptr<InputIDs> CreateInputIDs(State& state) {
   if (state.model_.config_->model.decoder.sliding_window.has_value()) {
     return std::make_unique<WindowedInputIDs>(state);
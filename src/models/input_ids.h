@@ -7,6 +7,7 @@ struct InputIDs {
   virtual void Add() = 0;
   virtual std::array<int64_t, 2> GetShape() const = 0;
   virtual void Update(DeviceSpan<int32_t> next_tokens) = 0;
+  virtual void RewindTo(size_t /*index*/) {}
 };
 
 struct DefaultInputIDs : InputIDs {
@@ -56,6 +57,9 @@ struct WindowedInputIDs : public InputIDs {
 
   void Add() override;
   void Update(DeviceSpan<int32_t> next_tokens) override;
+  // Rewinding to 0 restores the initial state so that the next tokens are processed as a new prompt,
+  // other lengths only move past_sequence_length back
+  void RewindTo(size_t index) override;
   std::array<int64_t, 2> GetShape() const override { return shape_; }
 
  private:
@@ -74,6 +78,7 @@ struct WindowedInputIDs : public InputIDs {
   std::unique_ptr<OrtValue> total_sequence_length_;
   std::unique_ptr<OrtValue> past_sequence_length_;
   int32_t initial_num_tokens_{};
+  size_t num_tokens_{};  // Processed so far, including the padding of the prompt
 };
 
 std::unique_ptr<InputIDs> CreateInputIDs(State& state);
@@ -54,14 +54,14 @@ void CombinedKeyValueCache::Update(DeviceSpan<int32_t> beam_indices, int total_l
       } else {
         PickPastState(beam_indices, i);
       }
-      state_.inputs_[input_index_ + i] = pasts_[i].get();
+      state_.SetInput(input_index_ + i, pasts_[i].get());
     }
   }
 
   shape_[3] = total_length;
   for (int i = 0; i < layer_count_; i++) {
     presents_[i] = OrtValue::CreateTensor(Allocator(), shape_, type_);
-    state_.outputs_[output_index_ + i] = presents_[i].get();
+    state_.SetOutput(output_index_ + i, presents_[i].get());
   }
 
   is_first_update_ = false;
@@ -76,7 +76,7 @@ void CombinedKeyValueCache::RewindTo(size_t index) {
   if (index == 0) {
     for (int i = 0; i < layer_count_; i++) {
       pasts_[i] = nullptr;
-      state_.inputs_[input_index_ + i] = empty_past_.get();
+      state_.SetInput(input_index_ + i, empty_past_.get());
     }
   } else if (type_ == Ort::TypeToTensorType<float>) {
     RewindPastTensorsTo<float>(index);
@@ -107,7 +107,7 @@ void CombinedKeyValueCache::RewindPastTensorsTo(size_t index) {
       past_data.CopyFrom(present_data);
     }
     pasts_[i] = std::move(past);
-    state_.inputs_[input_index_ + i] = pasts_[i].get();
+    state_.SetInput(input_index_ + i, pasts_[i].get());
   }
 }
 
@@ -169,9 +169,9 @@ DefaultKeyValueCache::DefaultKeyValueCache(State& state)
   type_ = model_.session_info_.GetInputDataType(input_name_strings_[0]);
   empty_past_ = OrtValue::CreateTensor(Allocator(), shape_, type_);
 
-  if (state_.params_->use_graph_capture && !past_present_share_buffer_) {
-    // share buffer is a precondition for graph capture
-    throw std::runtime_error("Graph capture is not supported with past_present_share_buffer set to false.");
+  if (state_.params_->UseStaticBuffers() && !past_present_share_buffer_) {
+    // share buffer is a precondition for graph capture and static io
+    throw std::runtime_error("Graph capture and static_io are not supported with past_present_share_buffer set to false.");
   }
 
   // Set the size after empty_past_ has been created with 0 for this field
@@ -222,7 +222,7 @@ void DefaultKeyValueCache::Add() {
   // For shared_past_present, the past & presents never change, so set the inputs to the present values (outputs are already set above)
   if (past_present_share_buffer_) {
     for (int i = 0; i < layer_count_ * 2; ++i) {
-      state_.inputs_[input_index_ + i] = presents_[i].get();
+      state_.SetInput(input_index_ + i, presents_[i].get());
     }
   }
 }
@@ -239,14 +239,14 @@ void DefaultKeyValueCache::Update(DeviceSpan<int32_t> beam_indices, int total_le
       } else {
         PickPastState(beam_indices, i);
       }
-      state_.inputs_[input_index_ + i] = pasts_[i].get();
+      state_.SetInput(input_index_ + i, pasts_[i].get());
     }
   }
 
   shape_[2] = total_length;
   for (int i = 0; i < layer_count_ * 2; i++) {
     presents_[i] = OrtValue::CreateTensor(Allocator(), shape_, type_);
-    state_.outputs_[output_index_ + i] = presents_[i].get();
+    state_.SetOutput(output_index_ + i, presents_[i].get());
   }
 
   is_first_update_ = false;
@@ -263,7 +263,7 @@ void DefaultKeyValueCache::RewindTo(size_t index) {
   if (index == 0) {
     for (int i = 0; i < layer_count_ * 2; i++) {
       pasts_[i] = nullptr;
-      state_.inputs_[input_index_ + i] = empty_past_.get();
+      state_.SetInput(input_index_ + i, empty_past_.get());
     }
   } else if (type_ == Ort::TypeToTensorType<float>) {
     RewindPastTensorsTo<float>(index);
@@ -295,7 +295,7 @@ void DefaultKeyValueCache::RewindPastTensorsTo(size_t index) {
       past_data.CopyFrom(present_data);
     }
     pasts_[i] = std::move(past);
-    state_.inputs_[input_index_ + i] = pasts_[i].get();
+    state_.SetInput(input_index_ + i, pasts_[i].get());
   }
 }
 
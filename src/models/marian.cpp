@@ -7,8 +7,10 @@ namespace Generators {
 
 MarianModel::MarianModel(std::unique_ptr<Config> config, OrtEnv& ort_env)
     : Model{std::move(config)} {
-  session_encoder_ = OrtSession::Create(ort_env, (config_->config_path / fs::path(config_->model.encoder.filename)).c_str(), session_options_.get());
-  session_decoder_ = OrtSession::Create(ort_env, (config_->config_path / fs::path(config_->model.decoder.filename)).c_str(), session_options_.get());
+  CreateSessionsConcurrently(*config_, {
+      [&] { session_encoder_ = CreateSession(ort_env, config_->model.encoder.filename, session_options_.get()); },
+      [&] { session_decoder_ = CreateSession(ort_env, config_->model.decoder.filename, session_options_.get()); },
+  });
 
   session_info_.Add(*session_decoder_);
   session_info_.Add(*session_encoder_);
@@ -56,8 +58,8 @@ void MarianLogits::Update(const DeviceSpan<int32_t>& next_tokens, size_t new_kv_
     return;
   }
 
-  output_raw_->CreateTensor(shape_, state_.params_->use_graph_capture);
-  state_.outputs_[output_index_] = output_raw_->GetOrtTensor();
+  output_raw_->CreateTensor(shape_, state_.params_->UseStaticBuffers());
+  state_.SetOutput(output_index_, output_raw_->GetOrtTensor());
 }
 
 void MarianLogits::Add() {
@@ -85,18 +87,22 @@ void MarianInputIDs::Add() {
 }
 
 void MarianInputIDs::Update(DeviceSpan<int32_t> new_tokens) {
-  value_->CreateTensor(shape_, state_.params_->use_graph_capture);
-  state_.inputs_[input_index_] = value_->GetOrtTensor();
+  // The shape is the same every step, so the tensors are created once and overwritten
+  if (!value_->GetOrtTensor()) {
+    value_->CreateTensor(shape_, state_.params_->UseStaticBuffers());
+    state_.SetInput(input_index_, value_->GetOrtTensor());
+  }
 
   // Update input_ids with next tokens
   auto data_span = value_->GetDeviceSpan<int32_t>();
   data_span.CopyFrom(new_tokens);
 
   if (type_ == Ort::TypeToTensorType<int64_t>) {
-    if (!cast_value_->GetOrtTensor())
-      cast_value_->CreateTensor(shape_, state_.params_->use_graph_capture);
+    if (!cast_value_->GetOrtTensor()) {
+      cast_value_->CreateTensor(shape_, state_.params_->UseStaticBuffers());
+      state_.SetInput(input_index_, cast_value_->GetOrtTensor());
+    }
     Cast(*value_->GetOrtTensor(), cast_value_->ort_tensor_, *model_.p_device_inputs_, type_);
-    state_.inputs_[input_index_] = cast_value_->GetOrtTensor();
   }
 }
 
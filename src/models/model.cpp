@@ -4,6 +4,8 @@
 // Modifications Copyright(C) 2024-2025 Advanced Micro Devices, Inc. All rights reserved.
 #include <algorithm>
 #include <climits>
+#include <limits>
+#include <numeric>
 #include <random>
 #include <set>
 #include <string>
@@ -12,7 +14,9 @@
 #include "../generators.h"
 #include "../search.h"
 #include "../tracing.h"
+#include "../cpu/pooled_allocator.h"
 #include "model.h"
+#include "shared_initializers.h"
 #include "gpt.h"
 #include "decoder_only.h"
 #include "whisper.h"
@@ -20,6 +24,8 @@
 #include "marian.h"
 #include "decoder_only_pipeline.h"
 #include "../dml/interface.h"
+#include "threadpool.h"
+#include "../model_data.h"
 
 namespace Generators {
 
@@ -84,8 +90,11 @@ void State::Run(OrtSession& session, bool graph_capture_this_run) {
     ep_dynamic_options_next_run_.clear();
   }
 
-  session.Run(run_options_.get(), input_names_.data(), inputs_.data(), input_names_.size(),
-              output_names_.data(), outputs_.data(), output_names_.size());
+  if (CanRunWithBinding())
+    RunWithBinding(session);
+  else
+    session.Run(run_options_.get(), input_names_.data(), inputs_.data(), input_names_.size(),
+                output_names_.data(), outputs_.data(), output_names_.size());
 
   extra_outputs_.RegisterOutputs();
 
@@ -96,6 +105,48 @@ void State::Run(OrtSession& session, bool graph_capture_this_run) {
   }
 }
 
+bool State::CanRunWithBinding() const {
+  // Outputs left for the session to allocate are only returned through the outputs_ of a regular Run
+  return params_->use_static_io && std::none_of(outputs_.begin(), outputs_.end(), [](const OrtValue* value) { return value == nullptr; });
+}
+
+void State::RunWithBinding(OrtSession& session) {
+  if (!io_binding_ || io_binding_session_ != &session) {
+    io_binding_ = OrtIoBinding::Create(session);
+    io_binding_session_ = &session;
+    inputs_replaced_ = outputs_replaced_ = true;
+  }
+
+  // With static buffers the values only change when the sequence length does (prompt to first decode step)
+  if (inputs_replaced_ || bound_input_count_ != inputs_.size()) {
+    io_binding_->ClearBoundInputs();
+    for (size_t i = 0; i < inputs_.size(); i++)
+      io_binding_->BindInput(input_names_[i], *inputs_[i]);
+    bound_input_count_ = inputs_.size();
+    inputs_replaced_ = false;
+  }
+
+  if (outputs_replaced_ || bound_output_count_ != outputs_.size()) {
+    io_binding_->ClearBoundOutputs();
+    for (size_t i = 0; i < outputs_.size(); i++)
+      io_binding_->BindOutput(output_names_[i], *outputs_[i]);
+    bound_output_count_ = outputs_.size();
+    outputs_replaced_ = false;
+  }
+
+  session.Run(run_options_.get(), *io_binding_);
+}
+
+void State::SetInput(size_t index, OrtValue* value) {
+  inputs_[index] = value;
+  inputs_replaced_ = true;
+}
+
+void State::SetOutput(size_t index, OrtValue* value) {
+  outputs_[index] = value;
+  outputs_replaced_ = true;
+}
+
 void State::SetTerminate() {
   session_terminated_ = true;
   run_options_->SetTerminate();
@@ -131,6 +182,7 @@ void State::ClearIO() {
   output_names_.clear();
   inputs_.clear();
   outputs_.clear();
+  inputs_replaced_ = outputs_replaced_ = true;
 }
 
 void State::SetActiveAdapter(Adapters* adapters, const std::string& adapter_name) {
@@ -182,6 +234,46 @@ std::vector<int32_t> PadInputs(std::span<std::span<const int32_t>> sequences, in
   return result;
 }
 
+BatchPlan PlanBatchesByLength(std::span<const size_t> lengths, size_t max_batch_size, size_t max_batch_tokens) {
+  const size_t count = lengths.size();
+  if (max_batch_size == 0)
+    max_batch_size = std::max<size_t>(count, 1);
+
+  // Sorted by length, the best batches are contiguous runs and each one is padded to its last (longest) sequence
+  std::vector<size_t> order(count);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return lengths[a] < lengths[b]; });
+
+  // best[i] is the cheapest split of the first i sorted sequences, comparing the batch count first and then the pad
+  // tokens, and batch_start[i] is where its last batch starts
+  using Cost = std::pair<size_t, size_t>;
+  std::vector<Cost> best(count + 1, {std::numeric_limits<size_t>::max(), 0});
+  std::vector<size_t> batch_start(count + 1);
+  best[0] = {0, 0};
+  for (size_t end = 1; end <= count; end++) {
+    const size_t longest = lengths[order[end - 1]];
+    size_t tokens = 0;
+    for (size_t rows = 1; rows <= std::min(max_batch_size, end); rows++) {
+      if (rows > 1 && max_batch_tokens != 0 && rows * longest > max_batch_tokens)
+        break;
+      tokens += lengths[order[end - rows]];
+      Cost cost{best[end - rows].first + 1, best[end - rows].second + rows * longest - tokens};
+      if (cost < best[end]) {
+        best[end] = cost;
+        batch_start[end] = end - rows;
+      }
+    }
+  }
+
+  BatchPlan plan;
+  for (size_t end = count; end > 0; end = batch_start[end]) {
+    auto& batch = plan.emplace_back(order.begin() + batch_start[end], order.begin() + end);
+    std::sort(batch.begin(), batch.end());
+  }
+  std::reverse(plan.begin(), plan.end());
+  return plan;
+}
+
 void CheckResult(extError_t error) {
   if (error != kOrtxOK)
     throw std::runtime_error(OrtxGetLastErrorMessage());
@@ -217,6 +309,27 @@ std::vector<int32_t> Tokenizer::Encode(const char* text) const {
   return {tokens, tokens + count};
 }
 
+std::vector<std::vector<int32_t>> Tokenizer::Encode(std::span<const std::string> texts) const {
+  if (texts.empty())
+    return {};
+
+  std::vector<const char*> c_strings;
+  for (const auto& text : texts)
+    c_strings.push_back(text.c_str());
+
+  OrtxPtr<OrtxTokenId2DArray> ids;
+  CheckResult(OrtxTokenizeWithOptions(tokenizer_, c_strings.data(), c_strings.size(), ids.Address(), false /* add_special_tokens */));
+
+  std::vector<std::vector<int32_t>> sequences(texts.size());
+  for (size_t i = 0; i < texts.size(); i++) {
+    const extTokenId_t* tokens;
+    size_t count;
+    CheckResult(OrtxTokenId2DArrayGetItem(ids, i, &tokens, &count));
+    sequences[i].assign(tokens, tokens + count);
+  }
+  return sequences;
+}
+
 std::string Tokenizer::Decode(std::span<const int32_t> tokens) const {
   OrtxPtr<OrtxStringArray> ortx_string_array;
   CheckResult(OrtxDetokenize1D(tokenizer_, reinterpret_cast<const uint32_t*>(tokens.data()), tokens.size(), ortx_string_array.Address()));
@@ -638,6 +751,14 @@ std::vector<const char*> SessionInfo::GetOutputSymbolicShape(const std::string&
   return type_info->second->GetTensorTypeAndShapeInfo().GetSymbolicDimensions();
 }
 
+void CreateSessionsConcurrently(const Config& config, std::vector<std::function<void()>> create_sessions) {
+  size_t max_thread_count = static_cast<size_t>(config.model.session_creation_threads);
+  if (max_thread_count == 0)
+    max_thread_count = std::max(1U, std::thread::hardware_concurrency());
+
+  RunConcurrently(create_sessions, max_thread_count);
+}
+
 Model::Model(std::unique_ptr<Config> config) : config_{std::move(config)} {
   CreateSessionOptions();
   EnsureDeviceOrtInit(*p_device_, *config_);
@@ -650,9 +771,18 @@ Model::Model(std::unique_ptr<Config> config) : config_{std::move(config)} {
 
   // The kvcache is always allocated in device memory
   p_device_kvcache_ = p_device_;
+
+  if (config_->cpu_allocator_pool.enabled && GetOrtGlobals()->allocator_cpu_pool_) {
+    cpu_allocator_pool_ = GetOrtGlobals()->allocator_cpu_pool_.get();
+    cpu_allocator_pool_->AddUser();
+  }
 }
 
-Model::~Model() = default;
+Model::~Model() {
+  // Derived models have released their sessions and tensors by now, so the last user's trim frees everything cached
+  if (cpu_allocator_pool_)
+    cpu_allocator_pool_->RemoveUser();
+}
 
 void Model::CreateSessionOptionsFromConfig(const Config::SessionOptions& config_session_options,
                                            OrtSessionOptions& session_options,
@@ -780,6 +910,128 @@ void Model::CreateSessionOptions() {
     p_device_ = GetDeviceInterface(DeviceType::CPU);
 }
 
+// What the sessions of one model file share, across every Model in the process
+struct SharedModelFile {
+  std::unique_ptr<OrtPrepackedWeightsContainer> prepacked_weights{OrtPrepackedWeightsContainer::Create()};
+  std::once_flag initializers_loaded;
+  std::unique_ptr<SharedInitializers> initializers;  // Loaded by the first session on the CPU
+  std::once_flag external_data_found;
+  std::vector<std::string> external_data_locations;  // Found by the first session of a Model with model data
+};
+
+namespace {
+
+// Identifies a model file on disk by what it is rather than how it is named: the same file reached through another
+// path has the same key, and a file replaced on disk (another size or modification time) a new one
+std::string GetModelFileKey(const fs::path& model_path) {
+  auto key = model_path.canonical().string();
+  uint64_t size{};
+  int64_t modified_time{};
+  if (model_path.file_status(size, modified_time))
+    key += "|" + std::to_string(size) + "|" + std::to_string(modified_time);
+  return key;
+}
+
+// The shared state of each model file, by key, kept while any Model uses it
+std::shared_ptr<SharedModelFile> GetSharedModelFile(const std::string& key) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, std::weak_ptr<SharedModelFile>> files;
+
+  std::lock_guard<std::mutex> lock{mutex};
+  auto& entry = files[key];
+  auto file = entry.lock();
+  if (!file) {
+    file = std::make_shared<SharedModelFile>();
+    entry = file;
+  }
+  return file;
+}
+
+std::vector<uint8_t> ReadModelFile(const fs::path& path) {
+  std::ifstream file = path.open(std::ios::binary | std::ios::ate);
+  if (!file.is_open())
+    throw std::runtime_error("Error opening " + path.string());
+  std::vector<uint8_t> bytes(static_cast<size_t>(file.tellg()));
+  file.seekg(0, std::ios::beg);
+  if (!file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size())))
+    throw std::runtime_error("Error reading " + path.string());
+  return bytes;
+}
+
+}  // namespace
+
+std::unique_ptr<OrtSession> Model::CreateSession(OrtEnv& ort_env, const std::string& filename, const OrtSessionOptions* session_options) {
+  auto model_path = config_->config_path / fs::path(filename);
+  const auto* model_data = config_->model_data ? config_->model_data->Find(filename) : nullptr;
+
+  // A file in memory is keyed by its address too, the same name may hold different models
+  auto shared_file = GetSharedModelFile(model_data ? model_path.string() + "@" + std::to_string(reinterpret_cast<uintptr_t>(model_data->data()))
+                                                   : GetModelFileKey(model_path));
+  {
+    std::lock_guard<std::mutex> lock{shared_model_files_mutex_};
+    if (std::find(shared_model_files_.begin(), shared_model_files_.end(), shared_file) == shared_model_files_.end())
+      shared_model_files_.push_back(shared_file);
+  }
+
+  std::vector<uint8_t> model_file_bytes;
+  auto get_model_bytes = [&]() -> std::span<const uint8_t> {
+    if (model_data)
+      return *model_data;
+    if (model_file_bytes.empty())
+      model_file_bytes = ReadModelFile(model_path);
+    return model_file_bytes;
+  };
+
+  // When opted in, sessions on the CPU use the initializers loaded once for the file instead of each loading its own copy.
+  // Off by default: it reads the file once more, which only pays off when several sessions load the same file.
+  const bool share_initializers = config_->model.share_initializers && p_device_->GetType() == DeviceType::CPU;
+  if (share_initializers) {
+    std::call_once(shared_file->initializers_loaded, [&] {
+      shared_file->initializers = std::make_unique<SharedInitializers>(get_model_bytes(), config_->config_path, filename, config_->model_data);
+    });
+  }
+
+  // External weights held in memory are referenced in place, registered only for the sessions of the model files that
+  // reference them. They are found by their location in the model, which is relative to the model file.
+  std::vector<fs::path> external_file_names;
+  std::vector<char*> external_buffers;
+  std::vector<size_t> external_lengths;
+  if (config_->model_data) {
+    std::call_once(shared_file->external_data_found, [&] {
+      shared_file->external_data_locations = GetExternalDataLocations(get_model_bytes());
+    });
+    const auto slash = filename.find_last_of("/\\");
+    const std::string model_directory = slash == std::string::npos ? "" : filename.substr(0, slash + 1);
+    for (const auto& location : shared_file->external_data_locations) {
+      if (const auto* data = config_->model_data->Find(model_directory + location)) {
+        external_file_names.emplace_back(location);
+        external_buffers.push_back(reinterpret_cast<char*>(const_cast<uint8_t*>(data->data())));
+        external_lengths.push_back(data->size());
+      }
+    }
+  }
+
+  // The session options are shared by the sessions of other files, so what is specific to this file goes in a copy
+  std::unique_ptr<OrtSessionOptions> file_session_options;
+  if ((share_initializers && shared_file->initializers->Count() != 0) || !external_file_names.empty()) {
+    file_session_options = session_options->Clone();
+    if (share_initializers)
+      shared_file->initializers->AddTo(*file_session_options);
+    if (!external_file_names.empty()) {
+      std::vector<decltype(external_file_names[0].c_str())> file_name_ptrs;
+      for (const auto& file_name : external_file_names)
+        file_name_ptrs.push_back(file_name.c_str());
+      file_session_options->AddExternalInitializersFromFilesInMemory(file_name_ptrs.data(), external_buffers.data(),
+                                                                     external_lengths.data(), external_file_names.size());
+    }
+    session_options = file_session_options.get();
+  }
+
+  if (model_data)
+    return OrtSession::Create(ort_env, model_data->data(), model_data->size(), session_options, *shared_file->prepacked_weights);
+  return OrtSession::Create(ort_env, model_path.c_str(), session_options, *shared_file->prepacked_weights);
+}
+
 OrtSessionOptions* Model::GetSessionOptions(const std::string& model_id) const {
   auto session_options = pipeline_session_options_.find(model_id);
   // Use the pipeline model session options id config defined it.
@@ -807,7 +1059,39 @@ std::shared_ptr<Model> CreateModel(OrtEnv& ort_env, const char* config_path, con
   return CreateModel(ort_env, std::move(config));
 }
 
-std::shared_ptr<Model> CreateModel(OrtEnv& ort_env, std::unique_ptr<Config> config) {
+namespace {
+
+// Generates from synthetic prompts at every configured batch size, growing the arenas to these shapes and running the
+// lazy initialization of every session used by a text-only request
+void WarmUp(const Model& model) {
+  DurationTrace trace{"WarmUp"};
+  const auto& config = *model.config_;
+  if (config.model.type == "whisper" || config.model.type == "marian-ssru")
+    throw std::runtime_error("Warm-up is not supported for model type " + config.model.type + ", it needs encoder inputs");
+  if (config.warmup.prompt_length < 1 || config.warmup.decode_length < 1)
+    throw std::runtime_error("Warm-up prompt_length and decode_length must be 1 or greater");
+
+  // Any token that is not the pad token, so no position is masked out
+  const int32_t token = (config.model.pad_token_id + 1) % std::max(config.model.vocab_size, 2);
+
+  auto batch_sizes = config.warmup.batch_sizes;
+  if (batch_sizes.empty())
+    batch_sizes.push_back(1);
+
+  for (auto batch_size : batch_sizes) {
+    auto params = std::make_shared<GeneratorParams>(model);
+    params->search.batch_size = batch_size;
+    params->search.max_length = config.warmup.prompt_length + config.warmup.decode_length;
+
+    Generator generator{model, *params};
+    std::vector<int32_t> input_ids(static_cast<size_t>(batch_size) * config.warmup.prompt_length, token);
+    generator.AppendTokens(input_ids);
+    for (int i = 0; i < config.warmup.decode_length && !generator.IsDone(); i++)
+      generator.GenerateNextToken();
+  }
+}
+
+std::shared_ptr<Model> CreateModelOfType(OrtEnv& ort_env, std::unique_ptr<Config> config) {
   std::set<std::string> llm_types = {"chatglm", "decoder", "gemma", "gemma2", "gemma3_text",
                                      "granite", "llama", "mistral", "nemotron", "olmo",
                                      "phi", "phimoe", "phi3", "phi3small", "qwen2", "qwen3"};
@@ -831,6 +1115,15 @@ std::shared_ptr<Model> CreateModel(OrtEnv& ort_env, std::unique_ptr<Config> conf
   throw std::runtime_error("Unsupported model_type in config.json: " + config->model.type);
 }
 
+}  // namespace
+
+std::shared_ptr<Model> CreateModel(OrtEnv& ort_env, std::unique_ptr<Config> config) {
+  auto model = CreateModelOfType(ort_env, std::move(config));
+  if (model->config_->warmup.enabled)
+    WarmUp(*model);
+  return model;
+}
+
 std::shared_ptr<GeneratorParams> CreateGeneratorParams(const Model& model) {
   return std::make_shared<GeneratorParams>(model);
 }
@@ -14,6 +14,7 @@
 namespace Generators {
 
 struct Tokenizer;
+struct SharedModelFile;
 
 void Cast(OrtValue& input, std::unique_ptr<OrtValue>& output, DeviceInterface& device, ONNXTensorElementDataType type);
 void CheckResult(extError_t error);
@@ -46,6 +47,11 @@ struct State {
   std::vector<std::string> adapter_names_;
   std::vector<OrtValue*> inputs_, outputs_;
 
+  // Replace an input or output value. Always use these rather than assigning inputs_/outputs_ directly, static io
+  // keeps its binding across runs and only rebinds what was marked as replaced here.
+  void SetInput(size_t index, OrtValue* value);
+  void SetOutput(size_t index, OrtValue* value);
+
   std::vector<std::pair<std::string, std::string>> ep_dynamic_options_next_run_;
 
  protected:
@@ -55,9 +61,19 @@ struct State {
   std::unique_ptr<OrtRunOptions> run_options_;
 
  private:
+  bool CanRunWithBinding() const;
+  void RunWithBinding(OrtSession& session);
+
   std::string graph_id_{};
   std::shared_ptr<Adapters> adapters_;
   ExtraOutputs extra_outputs_;
+
+  // Static io: the binding of the last run, rebound when SetInput/SetOutput replaced a value or values were added.
+  // Pointers are not compared, a freed OrtValue can be reallocated at the same address with another tensor.
+  std::unique_ptr<OrtIoBinding> io_binding_;
+  OrtSession* io_binding_session_{};
+  bool inputs_replaced_{true}, outputs_replaced_{true};
+  size_t bound_input_count_{}, bound_output_count_{};
 };
 
 struct TokenizerStream : LeakChecked<TokenizerStream> {
@@ -75,12 +91,29 @@ struct TokenizerStream : LeakChecked<TokenizerStream> {
 // Sequence length is vector.size()/count
 std::vector<int32_t> PadInputs(std::span<std::span<const int32_t>> sequences, int32_t pad_token_id);
 
+// Indices of the sequences that go in each batch, in original order within a batch
+using BatchPlan = std::vector<std::vector<size_t>>;
+
+// Splits sequences of the given lengths into batches that need as little padding as possible. Sequences of similar
+// length are batched together, and of all the splits into the fewest batches of at most max_batch_size rows
+// (0 means unbounded), the one with the fewest pad tokens is picked. A batch also holds at most max_batch_tokens
+// tokens once padded (0 means unbounded), a single sequence longer than that still gets a batch of its own.
+// Batches are returned shortest first.
+BatchPlan PlanBatchesByLength(std::span<const size_t> lengths, size_t max_batch_size, size_t max_batch_tokens);
+
+// Runs the functions at once on a few threads, used to create the independent sessions of a model concurrently since
+// each creation spends its time optimizing the graph and prepacking weights. model.session_creation_threads in the
+// config bounds the thread count, by default 1 which creates them one after another. If any of them throw, the exception
+// of the first one in the list is rethrown once all have finished, so the error reported does not depend on timing.
+void CreateSessionsConcurrently(const Config& config, std::vector<std::function<void()>> create_sessions);
+
 struct Tokenizer : std::enable_shared_from_this<Tokenizer>, LeakChecked<Tokenizer>, ExternalRefCounted<Tokenizer> {
   Tokenizer(Config& config);
 
   std::unique_ptr<TokenizerStream> CreateStream() const;
 
   std::vector<int32_t> Encode(const char* text) const;
+  std::vector<std::vector<int32_t>> Encode(std::span<const std::string> texts) const;  // One tokenizer call for all texts
   std::string Decode(std::span<const int32_t> tokens) const;
   std::string ApplyChatTemplate(const char* template_str, const char* messages, const char* tools, bool add_generation_prompt) const;
 
@@ -142,6 +175,12 @@ struct Model : std::enable_shared_from_this<Model>, LeakChecked<Model>, External
 
   OrtSessionOptions* GetSessionOptions(const std::string& model_id) const;
 
+  // Creates the session of a model file, from config_->model_data when it holds the file, otherwise from the config
+  // directory. Every session of the same file in the process, from this Model or any other, shares one prepacked weights
+  // container, and with model.share_initializers on the CPU one copy of the initializers, so an extra replica neither
+  // loads nor prepacks its own.
+  std::unique_ptr<OrtSession> CreateSession(OrtEnv& ort_env, const std::string& filename, const OrtSessionOptions* session_options);
+
   std::unique_ptr<Config> config_;
   std::unique_ptr<OrtSessionOptions> session_options_;
 
@@ -162,6 +201,14 @@ struct Model : std::enable_shared_from_this<Model>, LeakChecked<Model>, External
                                       bool disable_graph_capture);
 
   std::map<std::string, std::unique_ptr<OrtSessionOptions>> pipeline_session_options_;
+
+ private:
+  // The prepacked weights containers and initializers the sessions were created with, they have to outlive the sessions
+  // (owned by the derived models)
+  std::mutex shared_model_files_mutex_;
+  std::vector<std::shared_ptr<SharedModelFile>> shared_model_files_;
+
+  PooledAllocator* cpu_allocator_pool_{};  // Set while this model keeps the pool caching (config cpu_allocator_pool)
 };
 
 }  // namespace Generators
@@ -3,6 +3,7 @@
 
 #include "../generators.h"
 #include "multi_modal.h"
+#include "threadpool.h"
 
 namespace Generators {
 
@@ -57,32 +58,101 @@ int64_t GetImageFeatureBatchSize(const std::vector<GeneratorParams::Input>& extr
   return 0;
 }
 
+// A view of the rows [begin, end) of the first dimension of value, sharing its memory
+std::unique_ptr<OrtValue> SliceRows(OrtValue& value, int64_t begin, int64_t end) {
+  auto type_info = value.GetTensorTypeAndShapeInfo();
+  auto shape = type_info->GetShape();
+  const auto row_bytes = ElementCountFromShape(std::span<const int64_t>{shape}.subspan(1)) * Ort::SizeOf(type_info->GetElementType());
+  shape[0] = end - begin;
+  return OrtValue::CreateTensor(value.GetTensorMemoryInfo(), static_cast<uint8_t*>(value.GetTensorMutableRawData()) + begin * row_bytes,
+                                (end - begin) * row_bytes, shape, type_info->GetElementType());
+}
+
+// Runs the vision model on the slices of the inputs and image features of some of the images
+struct VisionBatchState : State {
+  VisionBatchState(const MultiModalLanguageModel& model, const GeneratorParams& params)
+      : State{params, model},
+        model_{model} {}
+
+  DeviceSpan<float> Run(int current_length, DeviceSpan<int32_t>& next_tokens, DeviceSpan<int32_t> next_indices = {}) override {
+    State::Run(*model_.vision_session_);
+    return {};
+  }
+
+  const MultiModalLanguageModel& model_;
+};
+
 }  // namespace
 
+std::optional<ImageLayout> GetImageLayout(const Config::Model::Vision& config, std::span<const char* const> input_names,
+                                          std::span<OrtValue* const> inputs, OrtValue& image_features,
+                                          const OrtValue* num_img_tokens, int64_t num_images) {
+  if (num_images <= 0)
+    return std::nullopt;
+
+  ImageLayout layout;
+  const auto features_shape = image_features.GetTensorTypeAndShapeInfo()->GetShape();
+  layout.feature_rows.resize(num_images + 1);
+  if (features_shape.size() == 3) {
+    std::iota(layout.feature_rows.begin(), layout.feature_rows.end(), 0LL);
+  } else {
+    if (!num_img_tokens || num_img_tokens->GetTensorTypeAndShapeInfo()->GetElementCount() != static_cast<size_t>(num_images))
+      return std::nullopt;
+    const auto* tokens = num_img_tokens->GetTensorData<int64_t>();
+    std::partial_sum(tokens, tokens + num_images, layout.feature_rows.begin() + 1);
+  }
+  if (features_shape.empty() || layout.feature_rows.back() != features_shape[0])
+    return std::nullopt;
+
+  layout.per_image.resize(inputs.size());
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (!inputs[i])
+      return std::nullopt;
+    const std::string_view name{input_names[i]};
+    layout.per_image[i] = name == config.inputs.pixel_values || name == config.inputs.image_sizes ||
+                          name == config.inputs.attention_mask;
+    if (!layout.per_image[i])
+      continue;
+    const auto shape = inputs[i]->GetTensorTypeAndShapeInfo()->GetShape();
+    if (shape.empty() || shape[0] != num_images)
+      return std::nullopt;
+  }
+  return layout;
+}
+
 MultiModalLanguageModel::MultiModalLanguageModel(std::unique_ptr<Config> config, OrtEnv& ort_env, bool vision, bool speech)
     : Model(std::move(config)) {
+  // The session options are set up first, then the sessions are created concurrently as they are independent
+  std::vector<std::function<void()>> create_sessions;
+
   // The non-decoder models don't support graph capture because of control flow nodes, so disable graph capture for them
+  std::unique_ptr<OrtSessionOptions> vision_session_options, speech_session_options;
   if (vision) {
-    auto vision_session_options = OrtSessionOptions::Create();
+    vision_session_options = OrtSessionOptions::Create();
     CreateSessionOptionsFromConfig(config_->model.decoder.session_options, *vision_session_options, true, true);
-    vision_session_ = OrtSession::Create(
-        ort_env, (config_->config_path / fs::path(config_->model.vision.filename)).c_str(), vision_session_options.get());
+    create_sessions.emplace_back([&] {
+      vision_session_ = CreateSession(ort_env, config_->model.vision.filename, vision_session_options.get());
+    });
   }
 
   if (speech) {
-    auto speech_session_options = OrtSessionOptions::Create();
+    speech_session_options = OrtSessionOptions::Create();
     CreateSessionOptionsFromConfig(config_->model.decoder.session_options, *speech_session_options, true, true);
-    speech_session_ = OrtSession::Create(
-        ort_env, (config_->config_path / fs::path(config_->model.speech.filename)).c_str(), speech_session_options.get());
+    create_sessions.emplace_back([&] {
+      speech_session_ = CreateSession(ort_env, config_->model.speech.filename, speech_session_options.get());
+    });
   }
 
   auto embedding_session_options = OrtSessionOptions::Create();
   CreateSessionOptionsFromConfig(config_->model.decoder.session_options, *embedding_session_options, true, true);
 
-  embedding_session_ = OrtSession::Create(
-      ort_env, (config_->config_path / fs::path(config_->model.embedding.filename)).c_str(), embedding_session_options.get());
-  decoder_session_ = OrtSession::Create(
-      ort_env, (config_->config_path / fs::path(config_->model.decoder.filename)).c_str(), session_options_.get());
+  create_sessions.emplace_back([&] {
+    embedding_session_ = CreateSession(ort_env, config_->model.embedding.filename, embedding_session_options.get());
+  });
+  create_sessions.emplace_back([&] {
+    decoder_session_ = CreateSession(ort_env, config_->model.decoder.filename, session_options_.get());
+  });
+  CreateSessionsConcurrently(*config_, std::move(create_sessions));
 
   session_info_.Add(*decoder_session_);
   session_info_.Add(*embedding_session_);
@@ -91,6 +161,8 @@ MultiModalLanguageModel::MultiModalLanguageModel(std::unique_ptr<Config> config,
   }
   if (vision) {
     session_info_.Add(*vision_session_);
+    if (config_->model.vision.feature_cache_bytes > 0)
+      image_features_cache_ = std::make_unique<ImageFeaturesCache>(*p_device_, config_->model.vision.feature_cache_bytes);
   }
 }
 
@@ -116,6 +188,54 @@ DeviceSpan<float> VisionState::Run(int current_length, DeviceSpan<int32_t>& next
   return {};
 }
 
+std::optional<ImageLayout> VisionState::GetImageLayout() {
+  if (output_names_.size() != 1)
+    return std::nullopt;
+  auto num_img_tokens = std::find_if(params_->extra_inputs.begin(), params_->extra_inputs.end(),
+                                     [](const auto& input) { return input.name == Config::Defaults::NumImageTokens; });
+  return Generators::GetImageLayout(model_.config_->model.vision, input_names_, inputs_, *image_features_->Get(),
+                                    num_img_tokens != params_->extra_inputs.end() ? num_img_tokens->tensor->ort_tensor_.get() : nullptr,
+                                    num_images_);
+}
+
+void VisionState::RunImages(const ImageLayout& layout, int64_t begin, int64_t end) {
+  // A state of its own, so runs of different images can go at the same time
+  VisionBatchState batch{model_, *params_};
+  std::vector<std::unique_ptr<OrtValue>> views;
+  for (size_t i = 0; i < inputs_.size(); i++) {
+    batch.input_names_.push_back(input_names_[i]);
+    if (layout.per_image[i]) {
+      views.push_back(SliceRows(*inputs_[i], begin, end));
+      batch.inputs_.push_back(views.back().get());
+    } else {
+      batch.inputs_.push_back(inputs_[i]);
+    }
+  }
+  auto output = SliceRows(*image_features_->Get(), layout.feature_rows[begin], layout.feature_rows[end]);
+  batch.output_names_.push_back(output_names_[0]);
+  batch.outputs_.push_back(output.get());
+
+  DeviceSpan<int32_t> next_tokens;
+  batch.Run(0, next_tokens);
+}
+
+bool VisionState::RunBatches(size_t batch_count) {
+  const auto layout = GetImageLayout();
+  if (!layout)
+    return false;
+
+  std::vector<std::function<void()>> runs;
+  for (size_t batch = 0; batch < batch_count; batch++) {
+    const auto begin = num_images_ * static_cast<int64_t>(batch) / static_cast<int64_t>(batch_count);
+    const auto end = num_images_ * static_cast<int64_t>(batch + 1) / static_cast<int64_t>(batch_count);
+    if (begin != end)
+      runs.emplace_back([this, &layout, begin, end] { RunImages(*layout, begin, end); });
+  }
+
+  RunConcurrently(runs, runs.size());
+  return true;
+}
+
 SpeechState::SpeechState(const MultiModalLanguageModel& model, const GeneratorParams& params, const int64_t num_audio_tokens)
     : State{params, model},
       model_{model},
@@ -231,12 +351,15 @@ DeviceSpan<float> MultiModalPipelineState::Run(int current_length, DeviceSpan<in
   decoder_state_->UpdateInputsOutputs(next_tokens, current_length, next_indices);
 
   if (is_prompt_) {
+    // The vision and speech models are independent of each other, so they can run concurrently
+    std::vector<std::function<void()>> encoders;
     if (num_image_tokens_ > 0 && vision_state_) {
-      vision_state_->Run(current_length, next_tokens, next_indices);
+      encoders.emplace_back([&] { RunVision(current_length, next_tokens, next_indices); });
     }
     if (num_audio_tokens_ > 0 && speech_state_) {
-      speech_state_->Run(current_length, next_tokens, next_indices);
+      encoders.emplace_back([&] { speech_state_->Run(current_length, next_tokens, next_indices); });
     }
+    RunConcurrently(encoders, RunsConcurrently() ? encoders.size() : 1);
     if (vision_state_) embedding_state_->image_features_->ReuseFeaturesBuffer(*vision_state_->image_features_);
     if (speech_state_) embedding_state_->audio_features_->ReuseFeaturesBuffer(speech_state_->audio_features_);
     embedding_state_->inputs_embeds_.ReuseEmbeddingsBuffer(decoder_state_->inputs_embeds_);
@@ -256,6 +379,93 @@ DeviceSpan<float> MultiModalPipelineState::Run(int current_length, DeviceSpan<in
   return decoder_state_->Run(current_length, next_tokens, next_indices);
 }
 
+void MultiModalPipelineState::RunVision(int current_length, DeviceSpan<int32_t>& next_tokens, DeviceSpan<int32_t> next_indices) {
+  auto& cache = model_.image_features_cache_;
+  const auto layout = cache ? vision_state_->GetImageLayout() : std::nullopt;
+  auto keys = layout ? MakeImageKeys(*layout) : std::vector<ImageFeaturesCache::Key>{};
+  if (keys.empty()) {
+    RunVisionModel(current_length, next_tokens, next_indices);
+    return;
+  }
+
+  // Images found in the cache get their features copied in, the vision model runs on the others
+  auto& image_features = *vision_state_->image_features_->Get();
+  auto image_rows = [&](int64_t image) {
+    return SliceRows(image_features, layout->feature_rows[image], layout->feature_rows[image + 1]);
+  };
+  std::vector<bool> cached(num_images_);
+  for (int64_t image = 0; image < num_images_; image++)
+    cached[image] = cache->Find(keys[image], *image_rows(image));
+
+  const auto cached_count = std::count(cached.begin(), cached.end(), true);
+  if (cached_count == num_images_)
+    return;
+  if (cached_count == 0) {
+    RunVisionModel(current_length, next_tokens, next_indices);
+  } else {
+    for (int64_t begin = 0; begin < num_images_;) {
+      if (cached[begin]) {
+        begin++;
+        continue;
+      }
+      auto end = begin + 1;
+      while (end < num_images_ && !cached[end])
+        end++;
+      vision_state_->RunImages(*layout, begin, end);
+      begin = end;
+    }
+  }
+
+  for (int64_t image = 0; image < num_images_; image++) {
+    if (!cached[image])
+      cache->Insert(std::move(keys[image]), *image_rows(image));
+  }
+}
+
+void MultiModalPipelineState::RunVisionModel(int current_length, DeviceSpan<int32_t>& next_tokens, DeviceSpan<int32_t> next_indices) {
+  const auto batch_count = std::min<int64_t>(model_.config_->model.vision.parallel_batches, num_images_);
+  if (!RunsConcurrently() || batch_count <= 1 || !vision_state_->RunBatches(static_cast<size_t>(batch_count)))
+    vision_state_->Run(current_length, next_tokens, next_indices);
+}
+
+bool MultiModalPipelineState::RunsConcurrently() const {
+  // Only validated with the CPU, where each run uses its own intra-op threads
+  return model_.config_->model.concurrent_encoders && model_.p_device_->GetType() == DeviceType::CPU;
+}
+
+std::vector<ImageFeaturesCache::Key> MultiModalPipelineState::MakeImageKeys(const ImageLayout& layout) {
+  // The keys cover every vision model input. Inputs not in CPU memory can't be hashed cheaply, and without inputs there
+  // is nothing to tell images apart, so those requests always run the vision model.
+  std::vector<OrtValue*> inputs;
+  for (const auto* name : vision_state_->input_names_) {
+    auto input = std::find_if(params_->extra_inputs.begin(), params_->extra_inputs.end(),
+                              [name](const auto& input) { return input.name == name; });
+    if (input == params_->extra_inputs.end() || !input->tensor->ort_tensor_ ||
+        input->tensor->ort_tensor_->GetTensorMemoryInfo().GetDeviceType() != OrtMemoryInfoDeviceType_CPU)
+      return {};
+    inputs.push_back(input->tensor->ort_tensor_.get());
+  }
+  if (inputs.empty() || inputs.size() != layout.per_image.size())
+    return {};
+
+  // Inputs with a row per image are keyed by the image's row, the others (shared by every image) as a whole
+  std::vector<ImageFeaturesCache::Key> keys;
+  for (int64_t image = 0; image < num_images_; image++) {
+    std::vector<std::unique_ptr<OrtValue>> views;
+    std::vector<const OrtValue*> image_inputs;
+    for (size_t i = 0; i < inputs.size(); i++) {
+      if (layout.per_image[i]) {
+        views.push_back(SliceRows(*inputs[i], image, image + 1));
+        image_inputs.push_back(views.back().get());
+      } else {
+        image_inputs.push_back(inputs[i]);
+      }
+    }
+    keys.emplace_back(image_inputs);
+  }
+  return keys;
+}
+
 OrtValue* MultiModalPipelineState::GetInput(const char* name) {
   if (vision_state_) {
     // Check if input name is in vision state's inputs
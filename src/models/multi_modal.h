@@ -10,6 +10,7 @@
 #include "logits.h"
 #include "kv_cache.h"
 #include "position_inputs.h"
+#include "image_features_cache.h"
 
 namespace Generators {
 
@@ -24,8 +25,25 @@ struct MultiModalLanguageModel : Model {
   std::unique_ptr<OrtSession> speech_session_;     // audio_embeds, audio_sizes, audio_projection_mode -> audio_features
   std::unique_ptr<OrtSession> embedding_session_;  // input_ids, image_features, audio_features -> inputs_embeds
   std::unique_ptr<OrtSession> decoder_session_;    // inputs_embeds, attention_mask, kv_cache -> logits
+
+  std::unique_ptr<ImageFeaturesCache> image_features_cache_;  // Null unless vision.feature_cache_bytes is set
+};
+
+// How the images split the vision model inputs and the image features: the first row of the image features of each
+// image (and the row count at the end), and which inputs have a row per image, the others are given whole to every run.
+struct ImageLayout {
+  std::vector<int64_t> feature_rows;
+  std::vector<bool> per_image;  // By input
 };
 
+// The inputs with a row per image are the ones the vision config names as such (pixel_values, image_sizes and the image
+// attention mask), whatever the shape of the others. The image features are either [num_images, tokens, hidden] or
+// [tokens of all images, hidden], split by num_img_tokens. Returns nothing when a per-image input doesn't have a row
+// per image or the image features can't be split that way.
+std::optional<ImageLayout> GetImageLayout(const Config::Model::Vision& config, std::span<const char* const> input_names,
+                                          std::span<OrtValue* const> inputs, OrtValue& image_features,
+                                          const OrtValue* num_img_tokens, int64_t num_images);
+
 struct VisionState : State {
   VisionState(const MultiModalLanguageModel& model, const GeneratorParams& params,
               const int64_t num_images, const int64_t num_image_tokens);
@@ -34,6 +52,16 @@ struct VisionState : State {
 
   DeviceSpan<float> Run(int current_length, DeviceSpan<int32_t>& next_tokens, DeviceSpan<int32_t> next_indices = {}) override;
 
+  // Returns nothing when the model's inputs or outputs can't be sliced per image
+  std::optional<ImageLayout> GetImageLayout();
+
+  // Runs the vision model on images [begin, end) alone, writing only their rows of the image features
+  void RunImages(const ImageLayout& layout, int64_t begin, int64_t end);
+
+  // Splits the images into batch_count concurrent vision model runs, each on a slice of the inputs and image features.
+  // Returns false without running anything when the model's inputs or outputs can't be sliced per image.
+  bool RunBatches(size_t batch_count);
+
  private:
   friend struct MultiModalPipelineState;
 
@@ -121,6 +149,14 @@ struct MultiModalPipelineState : State {
  private:
   void UpdateInputsOutputs(const DeviceSpan<int32_t>& next_tokens, DeviceSpan<int32_t> next_indices,
                            int current_length);
+  void RunVision(int current_length, DeviceSpan<int32_t>& next_tokens, DeviceSpan<int32_t> next_indices);
+  void RunVisionModel(int current_length, DeviceSpan<int32_t>& next_tokens, DeviceSpan<int32_t> next_indices);
+
+  // Whether the encoders, and the vision model runs of parallel_batches, run at the same time
+  bool RunsConcurrently() const;
+
+  // The image features cache key of each image, or none when the vision inputs can't be keyed per image
+  std::vector<ImageFeaturesCache::Key> MakeImageKeys(const ImageLayout& layout);
 
   const MultiModalLanguageModel& model_;
   int64_t num_image_tokens_{};
@@ -63,7 +63,7 @@ void MultiModalFeatures::Update(bool is_prompt) {
   if (!is_prompt && shape_[shape_.size() - 2] > 0) {  // if num_image_tokens > 0
     shape_[shape_.size() - 2] = 0;
     features_ = OrtValue::CreateTensor(model_.p_device_->GetAllocator(), shape_, type_);
-    state_.inputs_[index_] = features_.get();
+    state_.SetInput(index_, features_.get());
   }
 }
 
@@ -74,7 +74,7 @@ void MultiModalFeatures::ReuseFeaturesBuffer(MultiModalFeatures& other) {
 
   // Share the output MultiModalFeatures OrtValue* from other with the input MultiModalFeatures for this.
   features_ = std::move(other.features_);
-  state_.inputs_[index_] = other.state_.outputs_[other.index_];
+  state_.SetInput(index_, other.state_.outputs_[other.index_]);
 }
 
 }  // namespace Generators
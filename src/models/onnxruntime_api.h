@@ -585,6 +585,7 @@ struct OrtSessionOptions {
   OrtSessionOptions& AddConfigEntry(const char* config_key, const char* config_value);                                                          ///< Wraps OrtApi::AddSessionConfigEntry
   OrtSessionOptions& AddInitializer(const char* name, const OrtValue& ort_val);                                                                 ///< Wraps OrtApi::AddInitializer
   OrtSessionOptions& AddExternalInitializers(const std::vector<std::string>& names, const std::vector<std::unique_ptr<OrtValue>>& ort_values);  ///< Wraps OrtApi::AddExternalInitializers
+  OrtSessionOptions& AddExternalInitializersFromFilesInMemory(const ORTCHAR_T* const* file_names, char* const* buffers, const size_t* lengths, size_t count);  ///< Wraps OrtApi::AddExternalInitializersFromFilesInMemory
 
   OrtSessionOptions& AppendExecutionProvider_CUDA(const OrtCUDAProviderOptions& provider_options);               ///< Wraps OrtApi::SessionOptionsAppendExecutionProvider_CUDA
   OrtSessionOptions& AppendExecutionProvider_CUDA_V2(const OrtCUDAProviderOptionsV2& provider_options);          ///< Wraps OrtApi::SessionOptionsAppendExecutionProvider_CUDA_V2
@@ -1236,6 +1237,16 @@ struct OrtArenaCfg {
   Ort::Abstract make_abstract;
 };
 
+/*! \struct OrtPrepackedWeightsContainer
+ * \brief Holds the prepacked weights of the sessions created with it, so identical weights are prepacked and stored once
+ */
+struct OrtPrepackedWeightsContainer {
+  static std::unique_ptr<OrtPrepackedWeightsContainer> Create();  ///< Wraps OrtApi::CreatePrepackedWeightsContainer
+
+  static void operator delete(void* p) { Ort::api->ReleasePrepackedWeightsContainer(reinterpret_cast<OrtPrepackedWeightsContainer*>(p)); }
+  Ort::Abstract make_abstract;
+};
+
 //
 // Custom OPs (only needed to implement custom OPs)
 //
@@ -316,6 +316,12 @@ inline std::unique_ptr<OrtArenaCfg> OrtArenaCfg::Create(size_t max_mem, int aren
   return std::unique_ptr<OrtArenaCfg>{p};
 }
 
+inline std::unique_ptr<OrtPrepackedWeightsContainer> OrtPrepackedWeightsContainer::Create() {
+  OrtPrepackedWeightsContainer* p;
+  Ort::ThrowOnError(Ort::api->CreatePrepackedWeightsContainer(&p));
+  return std::unique_ptr<OrtPrepackedWeightsContainer>{p};
+}
+
 inline void OrtCommonEnvInit(OrtEnv& v, _In_ const char* logid) {
   if (strcmp(logid, "onnxruntime-node") == 0) {
     Ort::ThrowOnError(Ort::api->SetLanguageProjection(&v, OrtLanguageProjection::ORT_PROJECTION_NODEJS));
@@ -641,6 +647,12 @@ inline OrtSessionOptions& OrtSessionOptions::AddExternalInitializers(const std::
   return *this;
 }
 
+inline OrtSessionOptions& OrtSessionOptions::AddExternalInitializersFromFilesInMemory(const ORTCHAR_T* const* file_names, char* const* buffers,
+                                                                                      const size_t* lengths, size_t count) {
+  Ort::ThrowOnError(Ort::api->AddExternalInitializersFromFilesInMemory(this, file_names, buffers, lengths, count));
+  return *this;
+}
+
 inline OrtSessionOptions& OrtSessionOptions::AppendExecutionProvider_CUDA(const OrtCUDAProviderOptions& provider_options) {
   Ort::ThrowOnError(Ort::api->SessionOptionsAppendExecutionProvider_CUDA(this, &provider_options));
   return *this;
@@ -10,47 +10,33 @@ namespace Generators {
 
 namespace {
 
+// Matches the image tags "<|image_<number>|>" of a prompt, where <number> is the image id. Compiled once.
+const std::regex& ImageTagPattern() {
+  static const std::regex pattern{"<\\|image_(\\d+)\\|>"};
+  return pattern;
+}
+
 std::unique_ptr<OrtValue> ProcessImagePrompt(const Generators::Tokenizer& tokenizer, const std::string& prompt,
-                                             OrtxTensor* num_img_tokens, Ort::Allocator& allocator) {
-  const int64_t *num_img_tokens_data{}, *num_img_tokens_shape{};
-  size_t num_img_tokens_num_dims{};
-  if (num_img_tokens) {
-    CheckResult(OrtxGetTensorData(num_img_tokens, reinterpret_cast<const void**>(&num_img_tokens_data),
-                                  &num_img_tokens_shape, &num_img_tokens_num_dims));
-  }
-  const int64_t num_images = num_img_tokens_data
-                                 ? std::accumulate(num_img_tokens_shape,
-                                                   num_img_tokens_shape + num_img_tokens_num_dims,
-                                                   1LL, std::multiplies<int64_t>())
+                                             const OrtValue* num_img_tokens, Ort::Allocator& allocator) {
+  const int64_t* num_img_tokens_data = num_img_tokens ? num_img_tokens->GetTensorData<int64_t>() : nullptr;
+  const int64_t num_images = num_img_tokens
+                                 ? static_cast<int64_t>(num_img_tokens->GetTensorTypeAndShapeInfo()->GetElementCount())
                                  : 0LL;
 
-  // Split the prompt string based on the occurrences of the pattern "<|image_<number>|>"
-  // Here the <number> represents the image id.
-  const std::regex pattern("<\\|image_\\d+\\|>");
-  const std::vector<std::string> prompt_chunks(
-      std::sregex_token_iterator(prompt.begin(), prompt.end(), pattern, -1),
-      std::sregex_token_iterator());
-
-  // Each chunk of the prompt string obtained after splitting is then tokenized using the tokenizer.
-  std::vector<std::vector<int32_t>> input_ids_chunks(prompt_chunks.size());
-  for (size_t i = 0; i < prompt_chunks.size(); ++i) {
-    input_ids_chunks[i] = tokenizer.Encode(prompt_chunks[i].c_str());
+  // Split the prompt string on the image tags and extract the image ids from the tags in the same pass
+  std::vector<std::string> prompt_chunks;
+  std::vector<int32_t> image_ids;
+  auto chunk_begin = prompt.cbegin();
+  for (auto it = std::sregex_iterator(prompt.begin(), prompt.end(), ImageTagPattern()); it != std::sregex_iterator(); ++it) {
+    prompt_chunks.emplace_back(chunk_begin, (*it)[0].first);
+    image_ids.push_back(std::stoi((*it)[1].str()));
+    chunk_begin = (*it)[0].second;
   }
+  if (chunk_begin != prompt.cend())
+    prompt_chunks.emplace_back(chunk_begin, prompt.cend());
 
-  // Extract the image tags from the prompt string.
-  // Here the image tags are of the form "<|image_<number>|>"
-  const std::vector<std::string> image_tags(
-      std::sregex_token_iterator(prompt.begin(), prompt.end(), pattern),
-      std::sregex_token_iterator());
-
-  // Extract the image ids from the image tags.
-  std::vector<int32_t> image_ids(image_tags.size());
-  constexpr size_t image_id_position_begin = 8;  // <|image_ : Character at idx 8 is the beginning of the image_id
-  for (size_t i = 0; i < image_tags.size(); ++i) {
-    const size_t image_id_position_end = image_tags[i].size() - 2;  // |> : Character at idx size() - 2 is '|' which marks the end of the image_id
-    image_ids[i] = std::stoi(image_tags[i].substr(image_id_position_begin,
-                                                  image_id_position_end - image_id_position_begin));
-  }
+  // All of the chunks of the prompt are tokenized in a single call to the tokenizer.
+  const std::vector<std::vector<int32_t>> input_ids_chunks = tokenizer.Encode(prompt_chunks);
 
   if (static_cast<int64_t>(std::set<int32_t>(image_ids.begin(), image_ids.end()).size()) != num_images) {
     throw std::runtime_error("Number of unique image tags does not match the number of images.");
@@ -85,9 +71,8 @@ std::unique_ptr<OrtValue> ProcessImagePrompt(const Generators::Tokenizer& tokeni
 }  // namespace
 
 PhiImageProcessor::PhiImageProcessor(Config& config, const SessionInfo& session_info)
-    : pixel_values_type_{session_info.GetInputDataType(config.model.vision.inputs.pixel_values)} {
-  auto processor_config = (config.config_path / fs::path(config.model.vision.config_filename)).string();
-  CheckResult(OrtxCreateProcessor(processor_.ToBeAssigned(), processor_config.c_str()));
+    : image_processors_{(config.config_path / fs::path(config.model.vision.config_filename)).string()},
+      pixel_values_type_{session_info.GetInputDataType(config.model.vision.inputs.pixel_values)} {
 
   config.AddMapping(std::string(Config::Defaults::InputIdsName), config.model.embedding.inputs.input_ids);
   config.AddMapping(std::string(Config::Defaults::PixelValuesName), config.model.vision.inputs.pixel_values);
@@ -106,31 +91,23 @@ std::unique_ptr<NamedTensors> PhiImageProcessor::Process(const Tokenizer& tokeni
     return named_tensors;
   }
 
-  ort_extensions::OrtxObjectPtr<OrtxTensorResult> result;
-  CheckResult(OrtxImagePreProcess(processor_.get(), images->images_.get(), result.ToBeAssigned()));
-
-  OrtxTensor* pixel_values = nullptr;
-  CheckResult(OrtxTensorResultGetAt(result.get(), 0, &pixel_values));
-
-  OrtxTensor* image_sizes = nullptr;
-  CheckResult(OrtxTensorResultGetAt(result.get(), 1, &image_sizes));
-
-  OrtxTensor* num_img_tokens = nullptr;
-  CheckResult(OrtxTensorResultGetAt(result.get(), 2, &num_img_tokens));
+  // The tensors of each image are pixel_values, image_sizes and num_img_tokens
+  const auto results = image_processors_.PreProcess(*images);
+  auto num_img_tokens = StackTensors<int64_t>(results, 2, allocator);
 
   named_tensors->emplace(std::string(Config::Defaults::InputIdsName),
-                         std::make_shared<Tensor>(ProcessImagePrompt(tokenizer, prompt, num_img_tokens, allocator)));
+                         std::make_shared<Tensor>(ProcessImagePrompt(tokenizer, prompt, num_img_tokens.get(), allocator)));
   if (pixel_values_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
     named_tensors->emplace(std::string(Config::Defaults::PixelValuesName),
-                           std::make_shared<Tensor>(ProcessTensor<float>(pixel_values, allocator)));
+                           std::make_shared<Tensor>(StackTensors<float>(results, 0, allocator)));
   } else {
     named_tensors->emplace(std::string(Config::Defaults::PixelValuesName),
-                           std::make_shared<Tensor>(ProcessTensor<Ort::Float16_t>(pixel_values, allocator)));
+                           std::make_shared<Tensor>(StackTensors<float, Ort::Float16_t>(results, 0, allocator)));
   }
   named_tensors->emplace(std::string(Config::Defaults::ImageSizesName),
-                         std::make_shared<Tensor>(ProcessTensor<int64_t>(image_sizes, allocator)));
+                         std::make_shared<Tensor>(StackTensors<int64_t>(results, 1, allocator)));
   named_tensors->emplace(Config::Defaults::NumImageTokens,
-                         std::make_shared<Tensor>(ProcessTensor<int64_t>(num_img_tokens, allocator)));
+                         std::make_shared<Tensor>(std::move(num_img_tokens)));
 
   return named_tensors;
 }
@@ -10,20 +10,26 @@ namespace Generators {
 
 namespace {
 
+// The image and audio tags "<|image_<number>|>" and "<|audio_<number>|>" of a prompt, compiled once
+const std::regex& ImageTagPattern() {
+  static const std::regex pattern{"<\\|image_\\d+\\|>"};
+  return pattern;
+}
+
+const std::regex& AudioTagPattern() {
+  static const std::regex pattern{"<\\|audio_\\d+\\|>"};
+  return pattern;
+}
+
 std::tuple<std::unique_ptr<OrtValue>, std::unique_ptr<OrtValue>>
 ProcessImageAudioPrompt(const Generators::Tokenizer& tokenizer, const std::string& prompt,
-                        OrtxTensor* num_img_tokens, OrtxTensor* audio_sizes,
+                        const OrtValue* num_img_tokens, OrtxTensor* audio_sizes,
                         Ort::Allocator& allocator) {
   const int64_t* num_img_tokens_data{};
   int64_t num_images{};
   if (num_img_tokens) {
-    const int64_t* num_img_tokens_shape{};
-    size_t num_img_tokens_num_dims;
-    CheckResult(OrtxGetTensorData(num_img_tokens, reinterpret_cast<const void**>(&num_img_tokens_data),
-                                  &num_img_tokens_shape, &num_img_tokens_num_dims));
-    num_images = std::accumulate(num_img_tokens_shape,
-                                 num_img_tokens_shape + num_img_tokens_num_dims,
-                                 1LL, std::multiplies<int64_t>());
+    num_img_tokens_data = num_img_tokens->GetTensorData<int64_t>();
+    num_images = static_cast<int64_t>(num_img_tokens->GetTensorTypeAndShapeInfo()->GetElementCount());
   }
 
   const float* audio_sizes_data{};
@@ -49,10 +55,8 @@ ProcessImageAudioPrompt(const Generators::Tokenizer& tokenizer, const std::strin
     audio_projection_mode_value->GetTensorMutableData<int64_t>()[0] = 3;  // Vision, speech, language
   }
 
-  const std::regex image_pattern("<\\|image_\\d+\\|>");
-  const std::regex audio_pattern("<\\|audio_\\d+\\|>");
-  std::string processed_prompt = std::regex_replace(prompt, image_pattern, "<|endoftext10|>");
-  processed_prompt = std::regex_replace(processed_prompt, audio_pattern, "<|endoftext11|>");
+  std::string processed_prompt = std::regex_replace(prompt, ImageTagPattern(), "<|endoftext10|>");
+  processed_prompt = std::regex_replace(processed_prompt, AudioTagPattern(), "<|endoftext11|>");
 
   const std::vector<int32_t> input_ids = tokenizer.Encode(processed_prompt.c_str());
   std::vector<int32_t> processed_input_ids;
@@ -102,13 +106,11 @@ ProcessImageAudioPrompt(const Generators::Tokenizer& tokenizer, const std::strin
 }  // namespace
 
 PhiMultiModalProcessor::PhiMultiModalProcessor(Config& config, const SessionInfo& session_info)
-    : pixel_values_type_{session_info.GetInputDataType(config.model.vision.inputs.pixel_values)},
+    : image_processors_{(config.config_path / fs::path(config.model.vision.config_filename)).string()},
+      pixel_values_type_{session_info.GetInputDataType(config.model.vision.inputs.pixel_values)},
       attention_mask_type_{session_info.GetInputDataType(config.model.vision.inputs.attention_mask)},
       audio_features_type_{session_info.GetInputDataType(config.model.speech.inputs.audio_embeds)},
       audio_sizes_type_{session_info.GetInputDataType(config.model.speech.inputs.audio_sizes)} {
-  const auto image_processor_config = (config.config_path / fs::path(config.model.vision.config_filename)).string();
-  CheckResult(OrtxCreateProcessor(image_processor_.ToBeAssigned(), image_processor_config.c_str()));
-
   const auto audio_processor_config = (config.config_path / fs::path(config.model.speech.config_filename)).string();
   CheckResult(OrtxCreateSpeechFeatureExtractor(audio_processor_.ToBeAssigned(), audio_processor_config.c_str()));
 
@@ -127,15 +129,12 @@ std::unique_ptr<NamedTensors> PhiMultiModalProcessor::Process(const Tokenizer& t
   Ort::Allocator& allocator{Ort::Allocator::GetWithDefaultOptions()};
   auto named_tensors = std::make_unique<NamedTensors>();
 
-  ort_extensions::OrtxObjectPtr<OrtxTensorResult> image_result;
-  OrtxTensor *pixel_values{}, *image_sizes{}, *image_attention_mask{}, *num_img_tokens{};
+  // The tensors of each image are pixel_values, image_sizes, image_attention_mask and num_img_tokens
+  ImageResults image_results;
+  std::unique_ptr<OrtValue> num_img_tokens;
   if (payload.images) {
-    CheckResult(OrtxImagePreProcess(image_processor_.get(), payload.images->images_.get(), image_result.ToBeAssigned()));
-
-    CheckResult(OrtxTensorResultGetAt(image_result.get(), 0, &pixel_values));
-    CheckResult(OrtxTensorResultGetAt(image_result.get(), 1, &image_sizes));
-    CheckResult(OrtxTensorResultGetAt(image_result.get(), 2, &image_attention_mask));
-    CheckResult(OrtxTensorResultGetAt(image_result.get(), 3, &num_img_tokens));
+    image_results = image_processors_.PreProcess(*payload.images);
+    num_img_tokens = StackTensors<int64_t>(image_results, 3, allocator);
   }
 
   ort_extensions::OrtxObjectPtr<OrtxTensorResult> audio_result;
@@ -148,31 +147,31 @@ std::unique_ptr<NamedTensors> PhiMultiModalProcessor::Process(const Tokenizer& t
     CheckResult(OrtxTensorResultGetAt(audio_result.get(), 2, &audio_sizes));
   }
 
-  auto [input_ids, audio_projection_mode] = ProcessImageAudioPrompt(tokenizer, payload.prompt, num_img_tokens, audio_sizes, allocator);
+  auto [input_ids, audio_projection_mode] = ProcessImageAudioPrompt(tokenizer, payload.prompt, num_img_tokens.get(), audio_sizes, allocator);
   named_tensors->emplace(Config::Defaults::InputIdsName, std::make_shared<Tensor>(std::move(input_ids)));
   named_tensors->emplace(Config::Defaults::AudioProjectionModeName, std::make_shared<Tensor>(std::move(audio_projection_mode)));
 
   if (payload.images) {
     if (pixel_values_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
       named_tensors->emplace(std::string(Config::Defaults::PixelValuesName),
-                             std::make_shared<Tensor>(ProcessTensor<float>(pixel_values, allocator)));
+                             std::make_shared<Tensor>(StackTensors<float>(image_results, 0, allocator)));
     } else {
       named_tensors->emplace(std::string(Config::Defaults::PixelValuesName),
-                             std::make_shared<Tensor>(ProcessTensor<Ort::Float16_t>(pixel_values, allocator)));
+                             std::make_shared<Tensor>(StackTensors<float, Ort::Float16_t>(image_results, 0, allocator)));
     }
 
     named_tensors->emplace(std::string(Config::Defaults::ImageSizesName),
-                           std::make_shared<Tensor>(ProcessTensor<int64_t>(image_sizes, allocator)));
+                           std::make_shared<Tensor>(StackTensors<int64_t>(image_results, 1, allocator)));
     if (attention_mask_type_ == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
       named_tensors->emplace(std::string(Config::Defaults::AttentionMaskName),
-                             std::make_shared<Tensor>(ProcessTensor<float>(image_attention_mask, allocator)));
+                             std::make_shared<Tensor>(StackTensors<float>(image_results, 2, allocator)));
     } else {
       named_tensors->emplace(std::string(Config::Defaults::ImageAttentionMaskName),
-                             std::make_shared<Tensor>(ProcessTensor<Ort::Float16_t>(image_attention_mask, allocator)));
+                             std::make_shared<Tensor>(StackTensors<float, Ort::Float16_t>(image_results, 2, allocator)));
     }
 
     named_tensors->emplace(Config::Defaults::NumImageTokens,
-                           std::make_shared<Tensor>(ProcessTensor<int64_t>(num_img_tokens, allocator)));
+                           std::make_shared<Tensor>(std::move(num_img_tokens)));
   }
 
   if (payload.audios) {
@@ -12,7 +12,7 @@ struct PhiMultiModalProcessor : Processor {
   virtual std::unique_ptr<NamedTensors> Process(const Tokenizer& tokenizer, const Payload& payload) const override;
 
  private:
-  ort_extensions::OrtxObjectPtr<OrtxProcessor> image_processor_;
+  ImageProcessorPool image_processors_;
   ort_extensions::OrtxObjectPtr<OrtxFeatureExtractor> audio_processor_;
 
   ONNXTensorElementDataType pixel_values_type_;
@@ -118,7 +118,7 @@ void DefaultPositionInputs::CreateNextPositionIDsTensor() {
     position_ids_ = std::move(position_ids_next_);
     position_ids_next_ = nullptr;
   } else {
-    position_ids_->CreateTensor(position_ids_shape_, state_.params_->use_graph_capture && position_ids_shape_[1] == 1);
+    position_ids_->CreateTensor(position_ids_shape_, state_.params_->UseStaticBuffers() && position_ids_shape_[1] == 1);
   }
 }
 
@@ -130,7 +130,7 @@ void DefaultPositionInputs::UpdatePositionIDs(int total_length, int new_kv_lengt
   if (position_ids_shape_[1] != new_kv_length) {
     position_ids_shape_[1] = new_kv_length;
     CreateNextPositionIDsTensor();
-    state_.inputs_[posid_input_index_] = position_ids_->GetOrtTensor();
+    state_.SetInput(posid_input_index_, position_ids_->GetOrtTensor());
   }
   // Try to update position ids on the device. If it fails, copy to CPU, update there, and copy back to device.
   if (!model_.p_device_inputs_->UpdatePositionIds(position_ids_->GetMutableRawData(), static_cast<int>(position_ids_shape_[0]), total_length, new_kv_length, type_)) {
@@ -141,7 +141,7 @@ void DefaultPositionInputs::UpdatePositionIDs(int total_length, int new_kv_lengt
 }
 
 void DefaultPositionInputs::CreateNextAttentionMaskTensor(int total_length) {
-  if (state_.params_->use_graph_capture)
+  if (state_.params_->UseStaticBuffers())
     return;
   attention_mask_shape_[1] = total_length;
   attention_mask_next_->CreateTensor(attention_mask_shape_);
@@ -154,28 +154,28 @@ void DefaultPositionInputs::UpdateAttentionMask(int total_length, int new_kv_len
   CreateNextAttentionMaskTensor(total_length);
 
   // Update the attention mask on the device. If it fails, copy to CPU, update there, and copy back to device.
-  if (!model_.p_device_inputs_->UpdateAttentionMask(state_.params_->use_graph_capture ? nullptr : attention_mask_next_->GetMutableRawData(),
+  if (!model_.p_device_inputs_->UpdateAttentionMask(state_.params_->UseStaticBuffers() ? nullptr : attention_mask_next_->GetMutableRawData(),
                                                     attention_mask_->GetMutableRawData(),
                                                     static_cast<int>(attention_mask_shape_[0]),
                                                     new_kv_length,
                                                     total_length,
                                                     state_.params_->search.max_length,
-                                                    state_.params_->use_graph_capture,
+                                                    state_.params_->UseStaticBuffers(),
                                                     type_)) {
-    // auto* attention_mask_next_span = state_.params_->use_graph_capture ? &attention_mask_next_->GetByteSpan() : nullptr;
+    // auto* attention_mask_next_span = state_.params_->UseStaticBuffers() ? &attention_mask_next_->GetByteSpan() : nullptr;
     DeviceSpan<uint8_t> attention_mask_next_span;
-    if (!state_.params_->use_graph_capture)
+    if (!state_.params_->UseStaticBuffers())
       attention_mask_next_span = attention_mask_next_->GetByteSpan();
     auto attention_mask_span = attention_mask_->GetByteSpan();
-    GetDeviceInterface(DeviceType::CPU)->UpdateAttentionMask(state_.params_->use_graph_capture ? nullptr : attention_mask_next_span.CopyDeviceToCpu().data(), attention_mask_span.CopyDeviceToCpu().data(), static_cast<int>(attention_mask_shape_[0]), new_kv_length, total_length, state_.params_->search.max_length, state_.params_->use_graph_capture, type_);
-    if (!state_.params_->use_graph_capture)
+    GetDeviceInterface(DeviceType::CPU)->UpdateAttentionMask(state_.params_->UseStaticBuffers() ? nullptr : attention_mask_next_span.CopyDeviceToCpu().data(), attention_mask_span.CopyDeviceToCpu().data(), static_cast<int>(attention_mask_shape_[0]), new_kv_length, total_length, state_.params_->search.max_length, state_.params_->UseStaticBuffers(), type_);
+    if (!state_.params_->UseStaticBuffers())
       attention_mask_next_span.CopyCpuToDevice();
     attention_mask_span.CopyCpuToDevice();
   }
 
-  if (!state_.params_->use_graph_capture) {
+  if (!state_.params_->UseStaticBuffers()) {
     attention_mask_->ort_tensor_ = std::move(attention_mask_next_->ort_tensor_);
-    state_.inputs_[mask_input_index_] = attention_mask_->GetOrtTensor();
+    state_.SetInput(mask_input_index_, attention_mask_->GetOrtTensor());
   }
 }
 
@@ -204,10 +204,10 @@ void DefaultPositionInputs::CreateAndInitializePositionIDs(DeviceSpan<int32_t> n
   // Move tensors to appropriate device and expand by num_beams
   position_ids_->ort_tensor_ = model_.ExpandInputs(position_ids, state_.params_->search.num_beams);
   position_ids_next_->ort_tensor_ = model_.ExpandInputs(position_ids_next, state_.params_->search.num_beams);
-  if (state_.params_->use_graph_capture)
+  if (state_.params_->UseStaticBuffers())
     position_ids_next_->MakeStatic();
   position_ids_shape_[0] *= state_.params_->search.num_beams;
-  state_.inputs_[posid_input_index_] = position_ids_->GetOrtTensor();
+  state_.SetInput(posid_input_index_, position_ids_->GetOrtTensor());
 }
 
 // Initialize a static attention mask of size max_length and expanded by num_beams
@@ -256,14 +256,14 @@ void DefaultPositionInputs::CreateAndInitializeAttentionMask(DeviceSpan<int32_t>
     }
   }
 
-  if (state_.params_->use_graph_capture) {
+  if (state_.params_->UseStaticBuffers()) {
     InitializeStaticMask<T>(*attention_mask);
   } else {
     attention_mask = model_.ExpandInputs(attention_mask, state_.params_->search.num_beams);
     attention_mask_->ort_tensor_ = std::move(attention_mask);
     attention_mask_shape_[0] *= state_.params_->search.num_beams;
   }
-  state_.inputs_[mask_input_index_] = attention_mask_->GetOrtTensor();
+  state_.SetInput(mask_input_index_, attention_mask_->GetOrtTensor());
 }
 
 template <typename T>
@@ -274,7 +274,7 @@ void DefaultPositionInputs::InitializeSequenceLengths(std::array<int64_t, 2> sha
 }
 
 void DefaultPositionInputs::RewindMask(size_t index) {
-  if (state_.params_->use_graph_capture) {
+  if (state_.params_->UseStaticBuffers()) {
     throw std::runtime_error("PositionInputs::RewindMask - Static buffer is not supported for continuous decoding.");
 #if 0  // TODO: Fix implementation, cudaMemsetAsync of 1 is setting bytes of 1 vs int32's of 1
     int past_length = static_cast<int>(index);
@@ -306,6 +306,9 @@ WindowedPositionInputs::WindowedPositionInputs(State& state)
     if (window_size_ == 0) {
       throw std::runtime_error("Window size must be greater than 0");
     }
+
+    ring_buffer_ = model_.config_->model.decoder.sliding_window->ring_buffer &&
+                   model_.config_->model.decoder.sliding_window->slide_key_value_cache;
   }
 
   if (has_posid_input_) {
@@ -381,6 +384,9 @@ void WindowedPositionInputs::Update(DeviceSpan<int32_t> next_tokens, int total_l
           break;
         }
       }
+      cache_length_ = attention_mask_shape_[1] - window_size_;
+      cache_ring_head_ = 0;
+      skip_next_move_ = false;
     }
   } else if (window_index_ < num_windows_) {
     if (has_posid_input_) {
@@ -394,7 +400,9 @@ void WindowedPositionInputs::Update(DeviceSpan<int32_t> next_tokens, int total_l
       std::iota(position_ids_data, position_ids_data + window_size_, last_position + 1);
     }
 
-    if (has_mask_input_) {
+    if (has_mask_input_ && ring_buffer_) {
+      MoveWindowIntoCacheMask();
+    } else if (has_mask_input_) {
       // next_tokens will always be padded so that it's size is a multiple of window_size_
       // next_tokens -> [0, a, b, c, d, e]
       // window_size = 3, num_windows = 2, pad_token = 0
@@ -416,7 +424,9 @@ void WindowedPositionInputs::Update(DeviceSpan<int32_t> next_tokens, int total_l
       position_ids_->GetTensorMutableData<int32_t>()[0] = last_position + 1;
     }
 
-    if (has_mask_input_) {
+    if (has_mask_input_ && ring_buffer_) {
+      MoveWindowIntoCacheMask();
+    } else if (has_mask_input_) {
       // next_tokens -> [f]
       // attention_mask_ -> ([0] * context_length - (2 * window_size_) - 1) + [0, 1, 1, 1, 1, 1, 1]
       attention_mask_->GetTensorMutableData<int32_t>()[attention_mask_backward_offset_] = 1;
@@ -427,16 +437,117 @@ void WindowedPositionInputs::Update(DeviceSpan<int32_t> next_tokens, int total_l
   }
 
   if (has_posid_input_) {
-    state_.inputs_[position_ids_index_] = position_ids_.get();
+    state_.SetInput(position_ids_index_, position_ids_.get());
   }
 
   if (has_mask_input_) {
-    state_.inputs_[attention_mask_index_] = attention_mask_.get();
+    state_.SetInput(attention_mask_index_, attention_mask_.get());
   }
 
+  num_tokens_ = static_cast<size_t>(total_length);
   window_index_++;
 }
 
+void WindowedPositionInputs::MoveWindowIntoCacheMask() {
+  if (skip_next_move_) {
+    skip_next_move_ = false;
+    return;
+  }
+
+  auto* attention_mask_data = attention_mask_->GetTensorMutableData<int32_t>();
+  const auto attention_mask_length = static_cast<size_t>(attention_mask_shape_[1]);
+
+  if (window_index_ < num_windows_) {
+    // Prompt processing: the previous window was written at cache_ring_head_, the next window is fully valid
+    // window_size = 3, cache_length = 6, cache_ring_head = 4
+    // attention_mask_ -> [0, 0, 0, 0, 0, 0] + [0, 1, 1]  =>  [1, 0, 0, 0, 0, 1] + [1, 1, 1]
+    for (size_t i = 0; i < window_size_; i++) {
+      attention_mask_data[(cache_ring_head_ + i) % cache_length_] = attention_mask_data[cache_length_ + i];
+    }
+    cache_ring_head_ = (cache_ring_head_ + window_size_) % cache_length_;
+    std::fill_n(attention_mask_data + cache_length_, window_size_, 1);
+  } else if (cache_length_ != attention_mask_length - 1) {
+    // Transition to token generation: WindowedKeyValueCache lays the cache out from oldest to newest,
+    // dropping the oldest position and appending the last window.
+    std::vector<int32_t> cache_mask;
+    cache_mask.reserve(attention_mask_length - 1);
+    for (size_t i = 1; i < cache_length_; i++) {
+      cache_mask.push_back(attention_mask_data[(cache_ring_head_ + i) % cache_length_]);
+    }
+    cache_mask.insert(cache_mask.end(), attention_mask_data + cache_length_, attention_mask_data + attention_mask_length);
+    std::copy(cache_mask.begin(), cache_mask.end(), attention_mask_data);
+    attention_mask_data[attention_mask_length - 1] = 1;
+    cache_length_ = attention_mask_length - 1;
+    cache_ring_head_ = 0;
+  } else {
+    // Token generation: the previous token was written at cache_ring_head_
+    attention_mask_data[cache_ring_head_] = attention_mask_data[attention_mask_length - 1];
+    cache_ring_head_ = (cache_ring_head_ + 1) % cache_length_;
+  }
+}
+
+void WindowedPositionInputs::RewindTo(size_t index) {
+  if (index == 0) {
+    window_index_ = 0;
+    num_windows_ = 0;
+    num_tokens_ = 0;
+    position_ids_shape_[1] = static_cast<int64_t>(window_size_);
+    attention_mask_backward_offset_ = ~0U;
+    cache_length_ = 0;
+    cache_ring_head_ = 0;
+    skip_next_move_ = false;
+    return;
+  }
+
+  if (index > num_tokens_) {
+    throw std::runtime_error("Requested length of rewind is greater than the current length.");
+  }
+
+  const size_t num_tokens_to_drop = num_tokens_ - index;
+
+  if (has_mask_input_ && ring_buffer_) {
+    // Mirror WindowedKeyValueCache::RewindTo, which moves the outputs of the last run into the cache first
+    MoveWindowIntoCacheMask();
+    if (num_tokens_to_drop > cache_length_) {
+      throw std::runtime_error(MakeString("Cannot rewind by ", num_tokens_to_drop, " tokens, the sliding window only holds the last ",
+                                          cache_length_, " tokens."));
+    }
+    auto* attention_mask_data = attention_mask_->GetTensorMutableData<int32_t>();
+    for (size_t i = 0; i < num_tokens_to_drop; i++) {
+      cache_ring_head_ = (cache_ring_head_ + cache_length_ - 1) % cache_length_;
+      attention_mask_data[cache_ring_head_] = 0;
+    }
+    skip_next_move_ = true;
+  } else if (has_mask_input_) {
+    // The sliding layout keeps the valid positions packed at the end of the mask, the last position being the
+    // token of the last run: attention_mask_ -> [0, 0, 1, 1, 1] + [1]
+    // WindowedKeyValueCache moves that token into the cache and drops the newest num_tokens_to_drop tokens, then the
+    // next update marks one more cache position valid. So leave one position less than the tokens kept in the cache.
+    auto* attention_mask_data = attention_mask_->GetTensorMutableData<int32_t>();
+    const auto cache_length = static_cast<size_t>(attention_mask_shape_[1]) - 1;
+    if (num_tokens_to_drop > cache_length) {
+      throw std::runtime_error(MakeString("Cannot rewind by ", num_tokens_to_drop, " tokens, the sliding window only holds the last ",
+                                          cache_length, " tokens."));
+    }
+    const auto cached_tokens = std::min<size_t>(std::count(attention_mask_data, attention_mask_data + cache_length, 1) + 1, cache_length);
+    const auto kept_tokens = cached_tokens - std::min(num_tokens_to_drop, cached_tokens);
+    const auto valid_positions = kept_tokens > 0 ? kept_tokens - 1 : 0;
+    // attention_mask_ -> [0, 0, 1, 1, 1] + [1], drop 2 -> [0, 0, 0, 0, 1] + [1] with the next update marking position 3
+    std::fill_n(attention_mask_data, cache_length - valid_positions, 0);
+    std::fill_n(attention_mask_data + cache_length - valid_positions, valid_positions, 1);
+    attention_mask_backward_offset_ = cache_length - kept_tokens;
+    attention_mask_data[cache_length] = 1;
+  }
+
+  if (has_posid_input_) {
+    // The next update continues from the last position that was kept
+    auto& last_position = position_ids_->GetTensorMutableData<int32_t>()[position_ids_shape_[1] - 1];
+    last_position = std::max(last_position - static_cast<int32_t>(num_tokens_to_drop), -1);
+  }
+
+  num_tokens_ = index;
+}
+
 std::unique_ptr<PositionInputs> CreatePositionInputs(State& state, DeviceSpan<int32_t> sequence_lengths, const std::string& attention_mask_name_) {
   if (state.model_.config_->model.decoder.sliding_window.has_value()) {
     return std::make_unique<WindowedPositionInputs>(state);
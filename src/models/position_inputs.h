@@ -76,11 +76,14 @@ struct WindowedPositionInputs : PositionInputs {
 
   void Add() override;
   void Update(DeviceSpan<int32_t> next_tokens, int total_length, int new_length) override;
-  void RewindTo(size_t index) override {
-    throw std::runtime_error("WindowedPositionInputs does not support RewindTo.");
-  };
+  // Rewinding to 0 restores the initial state, other lengths drop the newest tokens as long as the window still holds them.
+  void RewindTo(size_t index) override;
 
  private:
+  // With the ring buffer layout, the attention mask positions covering the key-value cache mirror the positions
+  // written by WindowedKeyValueCache. This moves the mask of the last processed window into those positions.
+  void MoveWindowIntoCacheMask();
+
   State& state_;
   const Model& model_{state_.model_};
 
@@ -101,6 +104,12 @@ struct WindowedPositionInputs : PositionInputs {
   size_t window_size_{};
   size_t num_windows_{};
   size_t window_index_{};
+
+  bool ring_buffer_{};
+  size_t cache_length_{};      // Number of attention_mask positions covering the key-value cache (ring buffer only)
+  size_t cache_ring_head_{};   // Next attention_mask position of the key-value cache to be written (ring buffer only)
+  size_t num_tokens_{};        // Total number of tokens processed so far
+  bool skip_next_move_{};      // Set by a rewind, the mask of the last window was already moved into the cache positions
 };
 
 std::unique_ptr<PositionInputs> CreatePositionInputs(State& state, DeviceSpan<int32_t> sequence_lengths, const std::string& attention_mask_name_);
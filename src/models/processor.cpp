@@ -3,9 +3,35 @@
 
 #include "../generators.h"
 #include "model.h"
+#include "threadpool.h"
 
 namespace Generators {
 
+namespace {
+
+// A mono 32-bit float WAV file of the samples, which is how ort-extensions takes decoded audio from memory
+std::vector<uint8_t> MakeWav(std::span<const float> samples, int sample_rate) {
+  const auto data_bytes = static_cast<uint32_t>(samples.size_bytes());
+  std::vector<uint8_t> wav(44 + data_bytes);
+  auto put = [&](size_t offset, auto value) { std::memcpy(wav.data() + offset, &value, sizeof(value)); };
+  std::memcpy(wav.data(), "RIFF", 4);
+  put(4, static_cast<uint32_t>(36 + data_bytes));
+  std::memcpy(wav.data() + 8, "WAVEfmt ", 8);
+  put(16, uint32_t{16});                               // Format chunk size
+  put(20, uint16_t{3});                                // IEEE float
+  put(22, uint16_t{1});                                // Channels
+  put(24, static_cast<uint32_t>(sample_rate));         // Sample rate
+  put(28, static_cast<uint32_t>(sample_rate * 4));     // Bytes per second
+  put(32, uint16_t{4});                                // Bytes per sample frame
+  put(34, uint16_t{32});                               // Bits per sample
+  std::memcpy(wav.data() + 36, "data", 4);
+  put(40, data_bytes);
+  std::memcpy(wav.data() + 44, samples.data(), data_bytes);
+  return wav;
+}
+
+}  // namespace
+
 std::unique_ptr<Images> LoadImages(std::span<const char* const> image_paths) {
   if (image_paths.empty())
     throw std::runtime_error("No images provided");
@@ -15,11 +41,13 @@ std::unique_ptr<Images> LoadImages(std::span<const char* const> image_paths) {
       throw std::runtime_error("Image path does not exist: " + std::string(image_path));
     }
   }
-  ort_extensions::OrtxObjectPtr<OrtxRawImages> images;
-  size_t num_images{};
-  CheckResult(OrtxLoadImages(images.ToBeAssigned(), const_cast<const char**>(image_paths.data()), image_paths.size(), &num_images));
+  std::vector<ort_extensions::OrtxObjectPtr<OrtxRawImages>> images(image_paths.size());
+  for (size_t i = 0; i < image_paths.size(); ++i) {
+    size_t num_images{};
+    CheckResult(OrtxLoadImages(images[i].ToBeAssigned(), const_cast<const char**>(&image_paths[i]), 1, &num_images));
+  }
 
-  return std::make_unique<Images>(std::move(images), num_images);
+  return std::make_unique<Images>(std::move(images));
 }
 
 std::unique_ptr<Images> LoadImagesFromBuffers(std::span<const void*> image_data,
@@ -33,10 +61,11 @@ std::unique_ptr<Images> LoadImagesFromBuffers(std::span<const void*> image_data,
   for (size_t i = 0; i < image_data_sizes.size(); ++i)
     sizes.push_back(image_data_sizes[i]);
 
-  ort_extensions::OrtxObjectPtr<OrtxRawImages> images;
-  CheckResult(OrtxCreateRawImages(images.ToBeAssigned(), image_data.data(), sizes.data(), image_data.size()));
+  std::vector<ort_extensions::OrtxObjectPtr<OrtxRawImages>> images(image_data.size());
+  for (size_t i = 0; i < image_data.size(); ++i)
+    CheckResult(OrtxCreateRawImages(images[i].ToBeAssigned(), &image_data[i], &sizes[i], 1));
 
-  return std::make_unique<Images>(std::move(images), image_data.size());
+  return std::make_unique<Images>(std::move(images));
 }
 
 std::unique_ptr<Audios> LoadAudios(const std::span<const char* const>& audio_paths) {
@@ -68,6 +97,18 @@ std::unique_ptr<Audios> LoadAudiosFromBuffers(std::span<const void*> audio_data,
   return std::make_unique<Audios>(std::move(audios), audio_data.size());
 }
 
+std::unique_ptr<Audios> LoadAudiosFromSamples(std::span<const std::span<const float>> samples, int sample_rate) {
+  std::vector<std::vector<uint8_t>> wavs;
+  std::vector<const void*> wav_data;
+  std::vector<size_t> wav_sizes;
+  for (const auto& audio : samples) {
+    wavs.push_back(MakeWav(audio, sample_rate));
+    wav_data.push_back(wavs.back().data());
+    wav_sizes.push_back(wavs.back().size());
+  }
+  return LoadAudiosFromBuffers(wav_data, wav_sizes);
+}
+
 template <typename T>
 std::unique_ptr<OrtValue> ProcessTensor(OrtxTensor* tensor, Ort::Allocator& allocator) {
   const T* tensor_data{};
@@ -158,6 +199,125 @@ std::unique_ptr<OrtValue> ProcessTensor<float, int64_t>(OrtxTensor* tensor, Ort:
   return tensor_value;
 }
 
+namespace {
+
+template <typename SrcT, typename DstT>
+void ConvertElements(const SrcT* src, DstT* dst, size_t count) {
+  if constexpr (std::is_same_v<SrcT, float> && std::is_same_v<DstT, Ort::Float16_t>)
+    FastFloat32ToFloat16(std::span<const float>{src, count}, std::span<uint16_t>{reinterpret_cast<uint16_t*>(dst), count});
+  else
+    std::copy(src, src + count, dst);
+}
+
+// Copies src into the start of dst along every dimension, both are row major and of the same rank
+template <typename SrcT, typename DstT>
+void CopyPadded(const SrcT* src, std::span<const int64_t> src_shape, DstT* dst, std::span<const int64_t> dst_shape) {
+  if (src_shape.size() == 1 || std::equal(src_shape.begin() + 1, src_shape.end(), dst_shape.begin() + 1)) {
+    ConvertElements(src, dst, static_cast<size_t>(ElementCountFromShape(src_shape)));
+    return;
+  }
+
+  const auto src_stride = ElementCountFromShape(src_shape.subspan(1));
+  const auto dst_stride = ElementCountFromShape(dst_shape.subspan(1));
+  for (int64_t i = 0; i < src_shape[0]; ++i)
+    CopyPadded(src + i * src_stride, src_shape.subspan(1), dst + i * dst_stride, dst_shape.subspan(1));
+}
+
+}  // namespace
+
+ImageProcessorPool::ImageProcessorPool(const std::string& config_path) : config_path_{config_path} {
+  // Created up front so a bad config fails here rather than on the first images
+  Release(Acquire());
+}
+
+ort_extensions::OrtxObjectPtr<OrtxProcessor> ImageProcessorPool::Acquire() const {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (!idle_.empty()) {
+      auto processor = std::move(idle_.back());
+      idle_.pop_back();
+      return processor;
+    }
+  }
+  ort_extensions::OrtxObjectPtr<OrtxProcessor> processor;
+  CheckResult(OrtxCreateProcessor(processor.ToBeAssigned(), config_path_.c_str()));
+  return processor;
+}
+
+void ImageProcessorPool::Release(ort_extensions::OrtxObjectPtr<OrtxProcessor> processor) const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  idle_.push_back(std::move(processor));
+}
+
+ImageResults ImageProcessorPool::PreProcess(const Images& images) const {
+  ImageResults results(images.images_.size());
+  std::vector<std::function<void()>> tasks;
+  for (size_t i = 0; i < images.images_.size(); ++i) {
+    tasks.emplace_back([&, i] {
+      auto processor = Acquire();
+      CheckResult(OrtxImagePreProcess(processor.get(), images.images_[i].get(), results[i].ToBeAssigned()));
+      Release(std::move(processor));
+    });
+  }
+  RunOnSharedPool(tasks);
+  return results;
+}
+
+template <typename SrcT, typename DstT>
+std::unique_ptr<OrtValue> StackTensors(const ImageResults& results, size_t index, Ort::Allocator& allocator) {
+  struct Source {
+    const SrcT* data;
+    std::span<const int64_t> shape;
+  };
+  std::vector<Source> sources(results.size());
+  std::vector<int64_t> shape;
+  for (size_t i = 0; i < results.size(); ++i) {
+    OrtxTensor* tensor{};
+    CheckResult(OrtxTensorResultGetAt(results[i].get(), index, &tensor));
+    const int64_t* tensor_shape{};
+    size_t tensor_num_dims{};
+    CheckResult(OrtxGetTensorData(tensor, reinterpret_cast<const void**>(&sources[i].data), &tensor_shape, &tensor_num_dims));
+    sources[i].shape = {tensor_shape, tensor_num_dims};
+
+    if (i == 0)
+      shape.assign(tensor_shape, tensor_shape + tensor_num_dims);
+    else if (tensor_num_dims != shape.size() || tensor_num_dims == 0)
+      throw std::runtime_error("Images were preprocessed into tensors of different ranks");
+    else {
+      shape[0] += tensor_shape[0];
+      for (size_t j = 1; j < tensor_num_dims; ++j)
+        shape[j] = std::max(shape[j], tensor_shape[j]);
+    }
+  }
+
+  auto tensor_value = OrtValue::CreateTensor<DstT>(allocator, shape);
+  auto* data = tensor_value->template GetTensorMutableData<DstT>();
+  const bool padded = std::any_of(sources.begin(), sources.end(), [&](const Source& source) {
+    return !std::equal(source.shape.begin() + 1, source.shape.end(), shape.begin() + 1);
+  });
+  if (padded)
+    std::fill_n(data, ElementCountFromShape(shape), DstT{});
+
+  // Small tensors like the image sizes are not worth a thread per image
+  constexpr int64_t min_parallel_element_count = 1 << 20;
+  const auto stride = ElementCountFromShape(std::span<const int64_t>{shape}.subspan(1));
+  std::vector<std::function<void()>> tasks;
+  int64_t offset = 0;
+  for (auto& source : sources) {
+    tasks.emplace_back([&, offset] { CopyPadded(source.data, source.shape, data + offset * stride, shape); });
+    offset += source.shape[0];
+  }
+  if (ElementCountFromShape(shape) >= min_parallel_element_count)
+    RunOnSharedPool(tasks);
+  else
+    RunConcurrently(tasks, 1);
+  return tensor_value;
+}
+
+template std::unique_ptr<OrtValue> StackTensors<float>(const ImageResults& results, size_t index, Ort::Allocator& allocator);
+template std::unique_ptr<OrtValue> StackTensors<float, Ort::Float16_t>(const ImageResults& results, size_t index, Ort::Allocator& allocator);
+template std::unique_ptr<OrtValue> StackTensors<int64_t>(const ImageResults& results, size_t index, Ort::Allocator& allocator);
+
 template std::unique_ptr<OrtValue> ProcessTensor<float>(OrtxTensor* tensor, Ort::Allocator& allocator);
 template std::unique_ptr<OrtValue> ProcessTensor<Ort::Float16_t>(OrtxTensor* tensor, Ort::Allocator& allocator);
 template std::unique_ptr<OrtValue> ProcessTensor<int64_t>(OrtxTensor* tensor, Ort::Allocator& allocator);
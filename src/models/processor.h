@@ -13,10 +13,10 @@ namespace Generators {
 
 struct Images {
   Images() = delete;
-  Images(ort_extensions::OrtxObjectPtr<OrtxRawImages> images, size_t num_images)
-      : images_(std::move(images)), num_images_{num_images} {}
+  Images(std::vector<ort_extensions::OrtxObjectPtr<OrtxRawImages>> images)
+      : images_(std::move(images)), num_images_{images_.size()} {}
 
-  ort_extensions::OrtxObjectPtr<OrtxRawImages> images_;
+  std::vector<ort_extensions::OrtxObjectPtr<OrtxRawImages>> images_;  // One per image, so they are preprocessed in parallel
   size_t num_images_{};
 };
 
@@ -37,6 +37,8 @@ struct Audios {
 
 std::unique_ptr<Audios> LoadAudios(const std::span<const char* const>& audio_paths);
 std::unique_ptr<Audios> LoadAudiosFromBuffers(std::span<const void*> audio_data, std::span<const size_t> audio_data_sizes);
+// Mono samples in [-1, 1], one span per audio
+std::unique_ptr<Audios> LoadAudiosFromSamples(std::span<const std::span<const float>> samples, int sample_rate);
 
 struct Payload {
   const std::string& prompt;
@@ -52,6 +54,33 @@ std::unique_ptr<OrtValue> ProcessTensor(OrtxTensor* tensor, Ort::Allocator& allo
 
 template <typename SrcT, typename DstT>
 std::unique_ptr<OrtValue> ProcessTensor(OrtxTensor* tensor, Ort::Allocator& allocator);
+
+using ImageResults = std::vector<ort_extensions::OrtxObjectPtr<OrtxTensorResult>>;
+
+// ort-extensions image processors created from one processor config. Each is used by one thread at a time, so images
+// are preprocessed concurrently without sharing a processor between threads. Processors are created when all are in
+// use and kept for reuse, so there are as many as images were ever preprocessed at once.
+struct ImageProcessorPool {
+  explicit ImageProcessorPool(const std::string& config_path);
+
+  // Preprocesses the images on the shared thread pool, one image per task, and returns the result of each image
+  ImageResults PreProcess(const Images& images) const;
+
+ private:
+  ort_extensions::OrtxObjectPtr<OrtxProcessor> Acquire() const;
+  void Release(ort_extensions::OrtxObjectPtr<OrtxProcessor> processor) const;
+
+  const std::string config_path_;
+  mutable std::mutex mutex_;
+  mutable std::vector<ort_extensions::OrtxObjectPtr<OrtxProcessor>> idle_;
+};
+
+// Stacks the tensor at index of every image result along the first dimension, padding the other dimensions with zeros to
+// the largest image (like images split into different numbers of crops). Each image is converted and written straight
+// into its slice of the returned tensor.
+template <typename SrcT, typename DstT = SrcT>
+std::unique_ptr<OrtValue> StackTensors(const ImageResults& results, size_t index, Ort::Allocator& allocator);
+
 struct Processor {
   Processor() = default;
   Processor(const Processor&) = delete;
@@ -0,0 +1,300 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include "../generators.h"
+#include "../model_data.h"
+#include "shared_initializers.h"
+
+namespace Generators {
+
+namespace {
+
+std::atomic<size_t> g_loaded_bytes{};
+
+// Reads the protobuf wire format, just enough to walk the fields of the ONNX messages
+struct ProtoReader {
+  explicit ProtoReader(std::span<const uint8_t> data) : data_{data} {}
+
+  // Reads the key of the next field, returns false at the end of the message
+  bool Next() {
+    if (AtEnd())
+      return false;
+    const auto key = ReadVarint();
+    field_ = static_cast<uint32_t>(key >> 3);
+    wire_type_ = static_cast<uint32_t>(key & 7);
+    return true;
+  }
+
+  bool AtEnd() const { return position_ == data_.size(); }
+  uint32_t Field() const { return field_; }
+  uint32_t WireType() const { return wire_type_; }
+
+  uint64_t ReadVarint() {
+    uint64_t value{};
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (position_ == data_.size())
+        throw std::runtime_error("Truncated ONNX model");
+      const uint8_t byte = data_[position_++];
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0)
+        return value;
+    }
+    throw std::runtime_error("Invalid varint in ONNX model");
+  }
+
+  std::span<const uint8_t> ReadBytes() {
+    const auto size = ReadVarint();
+    if (size > data_.size() - position_)
+      throw std::runtime_error("Truncated ONNX model");
+    auto bytes = data_.subspan(position_, static_cast<size_t>(size));
+    position_ += static_cast<size_t>(size);
+    return bytes;
+  }
+
+  void Skip() {
+    switch (wire_type_) {
+      case 0:
+        ReadVarint();
+        break;
+      case 1:
+        Advance(8);
+        break;
+      case 2:
+        ReadBytes();
+        break;
+      case 5:
+        Advance(4);
+        break;
+      default:
+        throw std::runtime_error("Unsupported protobuf wire type in ONNX model: " + std::to_string(wire_type_));
+    }
+  }
+
+ private:
+  void Advance(size_t count) {
+    if (count > data_.size() - position_)
+      throw std::runtime_error("Truncated ONNX model");
+    position_ += count;
+  }
+
+  std::span<const uint8_t> data_;
+  size_t position_{};
+  uint32_t field_{};
+  uint32_t wire_type_{};
+};
+
+std::string ToString(std::span<const uint8_t> bytes) {
+  return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+}
+
+// ONNX TensorProto data types have the same values as ONNXTensorElementDataType. Returns 0 for the types not shared
+// (strings, and the sub-byte types whose size is not a whole number of bytes per element).
+size_t GetElementSize(int32_t data_type) {
+  switch (data_type) {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:
+      return 1;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16:
+      return 2;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32:
+      return 4;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_COMPLEX64:
+      return 8;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_COMPLEX128:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+// The fields of a TensorProto needed to load it
+struct TensorProto {
+  std::string name;
+  std::vector<int64_t> dims;
+  int32_t data_type{};
+  std::optional<std::span<const uint8_t>> raw_data;
+  bool external{};
+  std::string location;  // Of the external data file, relative to the model directory
+  uint64_t offset{};
+  std::optional<uint64_t> length;
+};
+
+TensorProto ReadTensorProto(std::span<const uint8_t> bytes) {
+  TensorProto tensor;
+  ProtoReader reader{bytes};
+  while (reader.Next()) {
+    switch (reader.Field()) {
+      case 1:  // dims, packed or not
+        if (reader.WireType() == 2) {
+          ProtoReader packed{reader.ReadBytes()};
+          while (!packed.AtEnd())
+            tensor.dims.push_back(static_cast<int64_t>(packed.ReadVarint()));
+        } else
+          tensor.dims.push_back(static_cast<int64_t>(reader.ReadVarint()));
+        break;
+      case 2:
+        tensor.data_type = static_cast<int32_t>(reader.ReadVarint());
+        break;
+      case 8:
+        tensor.name = ToString(reader.ReadBytes());
+        break;
+      case 9:
+        tensor.raw_data = reader.ReadBytes();
+        break;
+      case 13: {  // external_data, a list of key value pairs
+        std::string key, value;
+        ProtoReader entry{reader.ReadBytes()};
+        while (entry.Next()) {
+          if (entry.Field() == 1)
+            key = ToString(entry.ReadBytes());
+          else if (entry.Field() == 2)
+            value = ToString(entry.ReadBytes());
+          else
+            entry.Skip();
+        }
+        if (key == "location")
+          tensor.location = value;
+        else if (key == "offset")
+          tensor.offset = std::stoull(value);
+        else if (key == "length")
+          tensor.length = std::stoull(value);
+        break;
+      }
+      case 14:
+        tensor.external = reader.ReadVarint() == 1;  // DataLocation EXTERNAL
+        break;
+      default:
+        reader.Skip();
+    }
+  }
+  return tensor;
+}
+
+// The serialized TensorProto of each initializer of the main graph
+std::vector<std::span<const uint8_t>> ReadGraphInitializers(std::span<const uint8_t> model_bytes) {
+  std::vector<std::span<const uint8_t>> initializers;
+  ProtoReader model{model_bytes};
+  while (model.Next()) {
+    if (model.Field() != 7) {  // ModelProto.graph
+      model.Skip();
+      continue;
+    }
+    ProtoReader graph{model.ReadBytes()};
+    while (graph.Next()) {
+      if (graph.Field() == 5)  // GraphProto.initializer
+        initializers.push_back(graph.ReadBytes());
+      else
+        graph.Skip();
+    }
+  }
+  return initializers;
+}
+
+}  // namespace
+
+std::vector<std::string> GetExternalDataLocations(std::span<const uint8_t> model_bytes) {
+  std::vector<std::string> locations;
+  for (auto initializer : ReadGraphInitializers(model_bytes)) {
+    auto tensor = ReadTensorProto(initializer);
+    if (tensor.external && !tensor.location.empty() &&
+        std::find(locations.begin(), locations.end(), tensor.location) == locations.end())
+      locations.push_back(std::move(tensor.location));
+  }
+  return locations;
+}
+
+SharedInitializers::SharedInitializers(std::span<const uint8_t> model_bytes, const fs::path& config_path,
+                                       const std::string& filename, std::shared_ptr<const ModelData> model_data)
+    : model_data_{std::move(model_data)} {
+  // External data locations are relative to the model file
+  const auto slash = filename.find_last_of("/\\");
+  const std::string model_directory = slash == std::string::npos ? "" : filename.substr(0, slash + 1);
+
+  const auto initializers = ReadGraphInitializers(model_bytes);
+  auto memory_info = OrtMemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
+  std::unordered_map<std::string, std::ifstream> external_files;
+
+  for (auto initializer : initializers) {
+    auto tensor = ReadTensorProto(initializer);
+    const auto element_size = GetElementSize(tensor.data_type);
+    if (tensor.name.empty() || element_size == 0)
+      continue;
+    size_t byte_count = element_size;
+    for (auto dim : tensor.dims)
+      byte_count = dim < 0 ? 0 : byte_count * static_cast<size_t>(dim);
+    if (byte_count == 0)
+      continue;
+
+    const uint8_t* data{};
+    if (tensor.external) {
+      if (tensor.length && *tensor.length != byte_count)
+        continue;
+
+      const auto location = model_directory + tensor.location;
+      const auto* in_memory = model_data_ ? model_data_->Find(location) : nullptr;
+      if (in_memory) {
+        if (tensor.offset > in_memory->size() || byte_count > in_memory->size() - tensor.offset)
+          throw std::runtime_error("External data of initializer " + tensor.name + " is outside of " + tensor.location);
+        // Referenced in place when suitably aligned, the model data outlives this
+        data = in_memory->data() + tensor.offset;
+        if (reinterpret_cast<uintptr_t>(data) % alignof(std::max_align_t) != 0)
+          data = nullptr;
+      }
+
+      if (!data) {
+        auto& buffer = buffers_.emplace_back(std::make_unique<uint8_t[]>(byte_count));
+        if (in_memory) {
+          std::memcpy(buffer.get(), in_memory->data() + tensor.offset, byte_count);
+        } else {
+          auto& file = external_files[location];
+          if (!file.is_open()) {
+            file = (config_path / fs::path(location)).open(std::ios::binary);
+            if (!file.is_open())
+              throw std::runtime_error("Could not open the external data file " + tensor.location);
+          }
+          file.seekg(static_cast<std::streamoff>(tensor.offset));
+          if (!file.read(reinterpret_cast<char*>(buffer.get()), static_cast<std::streamsize>(byte_count)))
+            throw std::runtime_error("Could not read initializer " + tensor.name + " from " + tensor.location);
+        }
+        data = buffer.get();
+        loaded_bytes_ += byte_count;
+      }
+    } else if (tensor.raw_data && tensor.raw_data->size() == byte_count) {
+      // Copied out of the model bytes, which are not kept and give raw_data no alignment
+      auto& buffer = buffers_.emplace_back(std::make_unique<uint8_t[]>(byte_count));
+      std::memcpy(buffer.get(), tensor.raw_data->data(), byte_count);
+      data = buffer.get();
+      loaded_bytes_ += byte_count;
+    } else
+      continue;
+
+    values_.push_back(OrtValue::CreateTensor(*memory_info, const_cast<uint8_t*>(data), byte_count, tensor.dims,
+                                             static_cast<ONNXTensorElementDataType>(tensor.data_type)));
+    names_.push_back(std::move(tensor.name));
+  }
+
+  g_loaded_bytes += loaded_bytes_;
+}
+
+SharedInitializers::~SharedInitializers() {
+  g_loaded_bytes -= loaded_bytes_;
+}
+
+void SharedInitializers::AddTo(OrtSessionOptions& session_options) const {
+  for (size_t i = 0; i < names_.size(); i++)
+    session_options.AddInitializer(names_[i].c_str(), *values_[i]);
+}
+
+size_t SharedInitializers::GetLoadedBytes() {
+  return g_loaded_bytes;
+}
+
+}  // namespace Generators
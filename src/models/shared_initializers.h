@@ -0,0 +1,43 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+namespace Generators {
+
+struct ModelData;
+
+// The initializers of the main graph of an ONNX model, read once and given to every session created from the model
+// through OrtSessionOptions::AddInitializer, so sessions of the same file share one copy of the weights instead of each
+// loading its own. Initializers held in raw_data or in external data files are loaded, the few stored in typed fields
+// (and string tensors) are left for the session to load.
+struct SharedInitializers {
+  // model_bytes is the serialized ModelProto of filename, relative to config_path. External data files are taken from
+  // model_data when it holds them, otherwise read from the directory of the model file.
+  SharedInitializers(std::span<const uint8_t> model_bytes, const fs::path& config_path, const std::string& filename,
+                     std::shared_ptr<const ModelData> model_data);
+  ~SharedInitializers();
+
+  SharedInitializers(const SharedInitializers&) = delete;
+  SharedInitializers& operator=(const SharedInitializers&) = delete;
+
+  // Adds every loaded initializer, the session options must not outlive this
+  void AddTo(OrtSessionOptions& session_options) const;
+
+  size_t Count() const { return names_.size(); }
+
+  // The bytes held by every SharedInitializers alive in the process, weights referenced in place in model_data excluded
+  static size_t GetLoadedBytes();
+
+ private:
+  std::shared_ptr<const ModelData> model_data_;  // Kept for the weights referenced in place
+  std::vector<std::string> names_;
+  std::vector<std::unique_ptr<OrtValue>> values_;
+  std::vector<std::unique_ptr<uint8_t[]>> buffers_;
+  size_t loaded_bytes_{};
+};
+
+// The external data files referenced by the initializers of the main graph of a serialized ModelProto, as written in
+// the model (relative to the model file)
+std::vector<std::string> GetExternalDataLocations(std::span<const uint8_t> model_bytes);
+
+}  // namespace Generators
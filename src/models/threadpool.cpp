@@ -3,8 +3,90 @@
 
 #include "threadpool.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+
 namespace Generators {
 
+namespace {
+
+// Threads running posted jobs for the lifetime of the process
+struct SharedPool {
+  explicit SharedPool(size_t thread_count) {
+    for (size_t i = 0; i < thread_count; ++i)
+      std::thread{[this] { Work(); }}.detach();
+    thread_count_ = thread_count;
+  }
+
+  size_t ThreadCount() const { return thread_count_; }
+
+  void Post(std::function<void()> job) {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      jobs_.push_back(std::move(job));
+    }
+    wake_.notify_one();
+  }
+
+ private:
+  void Work() {
+    std::unique_lock<std::mutex> lock{mutex_};
+    while (true) {
+      wake_.wait(lock, [this] { return !jobs_.empty(); });
+      auto job = std::move(jobs_.front());
+      jobs_.pop_front();
+      lock.unlock();
+      job();
+      lock.lock();
+    }
+  }
+
+  size_t thread_count_{};
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<std::function<void()>> jobs_;
+};
+
+SharedPool& GetSharedPool() {
+  // Never destroyed, joining threads while the process exits can deadlock (like under the Windows loader lock)
+  static auto* pool = new SharedPool{std::max(1U, std::thread::hardware_concurrency()) - 1};
+  return *pool;
+}
+
+// One call of RunOnSharedPool, shared with the jobs it posts, which may only start once the call has returned
+struct SharedRun {
+  SharedRun(const std::vector<std::function<void()>>& tasks) : tasks{&tasks}, count{tasks.size()}, errors(tasks.size()) {}
+
+  void TakeTasks() {
+    for (size_t i; (i = next_index++) < count;) {
+      try {
+        (*tasks)[i]();
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock{mutex};
+      if (++finished_count == count)
+        finished.notify_all();
+    }
+  }
+
+  const std::vector<std::function<void()>>* tasks;  // Only used while tasks are left, so while the call waits
+  const size_t count;
+  std::atomic<size_t> next_index{};
+  std::vector<std::exception_ptr> errors;
+
+  std::mutex mutex;
+  std::condition_variable finished;
+  size_t finished_count{};
+};
+
+}  // namespace
+
 ThreadPool::ThreadPool(size_t num_threads) : num_threads_{num_threads} {}
 
 void ThreadPool::Compute(const std::function<void(size_t)>& func) {
@@ -19,4 +101,52 @@ void ThreadPool::Compute(const std::function<void(size_t)>& func) {
   threads_.clear();
 }
 
-}  // namespace Generators
\ No newline at end of file
+void RunConcurrently(const std::vector<std::function<void()>>& tasks, size_t max_thread_count) {
+  const auto thread_count = std::min(tasks.size(), max_thread_count);
+  if (thread_count <= 1) {
+    for (auto& task : tasks)
+      task();
+    return;
+  }
+
+  std::vector<std::exception_ptr> errors(tasks.size());
+  std::atomic<size_t> next_index{};
+  ThreadPool{thread_count}.Compute([&](size_t) {
+    for (size_t i; (i = next_index++) < tasks.size();) {
+      try {
+        tasks[i]();
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }
+  });
+
+  for (auto& error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+
+void RunOnSharedPool(const std::vector<std::function<void()>>& tasks) {
+  auto& pool = GetSharedPool();
+  if (tasks.size() <= 1 || pool.ThreadCount() == 0) {
+    RunConcurrently(tasks, 1);
+    return;
+  }
+
+  auto run = std::make_shared<SharedRun>(tasks);
+  for (size_t i = 0; i < std::min(tasks.size() - 1, pool.ThreadCount()); ++i)
+    pool.Post([run] { run->TakeTasks(); });
+  run->TakeTasks();
+  {
+    std::unique_lock<std::mutex> lock{run->mutex};
+    run->finished.wait(lock, [&] { return run->finished_count == run->count; });
+  }
+
+  for (auto& error : run->errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+
+}  // namespace Generators
@@ -1,5 +1,6 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
+#pragma once
 
 #include <functional>
 #include <vector>
@@ -17,4 +18,14 @@ struct ThreadPool {
   std::vector<std::thread> threads_;
 };
 
+// Runs the tasks on up to max_thread_count threads, one after another when that is 1. If any of them throw, the
+// exception of the first one in the list is rethrown once all have finished, so the error does not depend on timing.
+void RunConcurrently(const std::vector<std::function<void()>>& tasks, size_t max_thread_count);
+
+// Runs the tasks on a pool of threads shared by the whole process, with the calling thread taking tasks too. The pool
+// has a thread per core less one, so concurrent callers share those threads instead of each starting its own, and a
+// task may call this again. If any of them throw, the exception of the first one in the list is rethrown once all
+// have finished.
+void RunOnSharedPool(const std::vector<std::function<void()>>& tasks);
+
 }  // namespace Generators
@@ -109,4 +109,10 @@ uint16_t FastFloat32ToFloat16(float v) {
   return static_cast<uint16_t>((b & 0x80000000) >> 16 | (e > 112) * ((((e - 112) << 10) & 0x7C00) | m >> 13) | ((e < 113) & (e > 101)) * ((((0x007FF000 + m) >> (125 - e)) + 1) >> 1) | (e > 143) * 0x7FFF);  // sign : normalized : denormalized : saturate
 }
 
+void FastFloat32ToFloat16(std::span<const float> input, std::span<uint16_t> output) {
+  assert(input.size() == output.size());
+  for (size_t i = 0; i < input.size(); i++)
+    output[i] = FastFloat32ToFloat16(input[i]);
+}
+
 }  // namespace Generators
\ No newline at end of file
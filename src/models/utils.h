@@ -37,4 +37,8 @@ inline float ToFloat32(Ort::BFloat16_t v) { return BFloat16ToFloat32(v); }
 float FastFloat16ToFloat32(const uint16_t x);
 uint16_t FastFloat32ToFloat16(float v);
 
+// Converts a whole buffer, the branchless conversion is inlined into its loop so compilers can vectorize it on targets
+// with per lane shifts (AVX2, NEON)
+void FastFloat32ToFloat16(std::span<const float> input, std::span<uint16_t> output);
+
 }  // namespace Generators
\ No newline at end of file
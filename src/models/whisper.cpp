@@ -8,8 +8,10 @@ namespace Generators {
 
 Whisper_Model::Whisper_Model(std::unique_ptr<Config> config, OrtEnv& ort_env)
     : Model{std::move(config)} {
-  session_encoder_ = OrtSession::Create(ort_env, (config_->config_path / fs::path(config_->model.encoder.filename)).c_str(), session_options_.get());
-  session_decoder_ = OrtSession::Create(ort_env, (config_->config_path / fs::path(config_->model.decoder.filename)).c_str(), session_options_.get());
+  CreateSessionsConcurrently(*config_, {
+      [&] { session_encoder_ = CreateSession(ort_env, config_->model.encoder.filename, session_options_.get()); },
+      [&] { session_decoder_ = CreateSession(ort_env, config_->model.decoder.filename, session_options_.get()); },
+  });
 
   session_info_.Add(*session_decoder_);
   session_info_.Add(*session_encoder_);
@@ -92,7 +94,7 @@ Whisper_State::Whisper_State(const Whisper_Model& model, DeviceSpan<int32_t> seq
     for (int i = 0; i < layer_count * 2; i++) {
       init_presents_.emplace_back(OrtValue::CreateTensor(model_.p_device_->GetAllocator(), shape, type));
       presents_.emplace_back(outputs_[kv_cache_indices + i]);
-      outputs_[kv_cache_indices + i] = init_presents_.back().get();
+      SetOutput(kv_cache_indices + i, init_presents_.back().get());
     }
   }
 }
@@ -320,7 +322,7 @@ void Whisper_State::UpdateInputsOutputs(DeviceSpan<int32_t>& next_tokens, Device
     // No need to update cache indirection and cross QK search buffers
     // when preparing to run decoder for the first time.
     if (cache_indirection_)
-      inputs_[cache_indirection_index_] = cache_indirection_.get();
+      SetInput(cache_indirection_index_, cache_indirection_.get());
     return;
   }
 
@@ -348,7 +350,7 @@ void Whisper_State::UpdateInputsOutputs(DeviceSpan<int32_t>& next_tokens, Device
                                                model_.cuda_stream_);
 
     cache_indirection_ = std::move(new_cache_indirection);
-    inputs_[cache_indirection_index_] = cache_indirection_.get();
+    SetInput(cache_indirection_index_, cache_indirection_.get());
 #endif
   }
 
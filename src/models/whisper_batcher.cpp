@@ -0,0 +1,179 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include "../generators.h"
+#include "model.h"
+#include "whisper_batcher.h"
+
+namespace Generators {
+
+size_t WhisperRequests::Add(std::vector<float> samples, std::vector<int32_t> decoder_prompt) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  queue_.push_back({next_id_, std::move(samples), std::move(decoder_prompt)});
+  return next_id_++;
+}
+
+std::vector<WhisperRequests::Request> WhisperRequests::StartBatch(size_t max_batch_size) {
+  std::vector<Request> batch;
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (!queue_.empty()) {
+      // The rows of a batch start decoding together, so the oldest request picks the decoder prompt length for the batch
+      const auto prompt_length = queue_.front().decoder_prompt.size();
+      for (auto it = queue_.begin(); it != queue_.end() && batch.size() < max_batch_size;) {
+        if (it->decoder_prompt.size() == prompt_length) {
+          batch.push_back(std::move(*it));
+          it = queue_.erase(it);
+        } else
+          ++it;
+      }
+    }
+  }
+
+  row_ids_.clear();
+  for (const auto& request : batch)
+    row_ids_.push_back(request.id);
+  row_finished_.assign(batch.size(), false);
+  running_count_ = batch.size();
+  return batch;
+}
+
+size_t WhisperRequests::FinishRow(size_t row) {
+  if (row_finished_[row])
+    throw std::runtime_error("Row " + std::to_string(row) + " of the batch already finished");
+  row_finished_[row] = true;
+  running_count_--;
+  return row_ids_[row];
+}
+
+std::vector<size_t> WhisperRequests::FailBatch() {
+  std::vector<size_t> ids;
+  for (size_t row = 0; row < row_ids_.size(); row++) {
+    if (!row_finished_[row])
+      ids.push_back(FinishRow(row));
+  }
+  return ids;
+}
+
+size_t WhisperRequests::GetQueuedCount() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return queue_.size();
+}
+
+WhisperBatcher::WhisperBatcher(const Model& model, const GeneratorParams& params, size_t max_batch_size)
+    : model_{model.shared_from_this()},
+      processor_{model.CreateMultiModalProcessor()},
+      search_{params.search},
+      max_batch_size_{max_batch_size},
+      end_of_text_token_id_{processor_->tokenizer_->TokenToTokenId("<|endoftext|>")} {
+  if (model.config_->model.type != "whisper")
+    throw std::runtime_error("Batched transcription is only supported for whisper models, not " + model.config_->model.type);
+  if (max_batch_size_ == 0)
+    throw std::runtime_error("max_batch_size must be at least 1");
+  // Only the greedy search on the CPU tells when a row of the batch is done before the whole batch is
+  if (search_.num_beams > 1)
+    throw std::runtime_error("Batched transcription only supports greedy search, num_beams is " + std::to_string(search_.num_beams));
+  if (params.p_device->GetType() != DeviceType::CPU)
+    throw std::runtime_error("Batched transcription only supports search on the CPU, not " + to_string(params.p_device->GetType()));
+}
+
+size_t WhisperBatcher::Add(std::span<const float> samples, std::span<const int32_t> decoder_prompt) {
+  if (samples.empty())
+    throw std::runtime_error("The utterance has no samples");
+  if (samples.size() > 30 * sample_rate)
+    throw std::runtime_error("The utterance is longer than whisper's 30 second window, use a WhisperStream to transcribe it");
+  if (decoder_prompt.empty())
+    throw std::runtime_error("The decoder prompt is empty");
+  if (decoder_prompt.size() >= static_cast<size_t>(search_.max_length))
+    throw std::runtime_error("The decoder prompt is not shorter than max_length");
+
+  return requests_.Add({samples.begin(), samples.end()}, {decoder_prompt.begin(), decoder_prompt.end()});
+}
+
+void WhisperBatcher::StartBatch() {
+  const auto batch = requests_.StartBatch(max_batch_size_);
+  if (batch.empty())
+    return;
+  prompt_length_ = batch.front().decoder_prompt.size();
+
+  // One feature extraction and one encoder run for the whole batch
+  std::vector<std::span<const float>> samples;
+  for (const auto& request : batch)
+    samples.emplace_back(request.samples);
+  auto audios = LoadAudiosFromSamples(samples, sample_rate);
+  auto inputs = processor_->Process(std::string{}, nullptr, audios.get());
+
+  const auto batch_size = static_cast<int64_t>(batch.size());
+  auto input_ids = OrtValue::CreateTensor<int32_t>(Ort::Allocator::GetWithDefaultOptions(), std::array<int64_t, 2>{batch_size, static_cast<int64_t>(prompt_length_)});
+  auto* input_ids_data = input_ids->GetTensorMutableData<int32_t>();
+  for (const auto& request : batch)
+    input_ids_data = std::copy(request.decoder_prompt.begin(), request.decoder_prompt.end(), input_ids_data);
+  inputs->emplace(std::string(Config::Defaults::InputIdsName), std::make_shared<Tensor>(std::move(input_ids)));
+
+  auto params = CreateGeneratorParams(*model_);
+  params->search = search_;
+  params->search.batch_size = static_cast<int>(batch_size);
+  params->SetInputs(*inputs);
+  generator_ = CreateGenerator(*model_, *params);
+}
+
+void WhisperBatcher::FinishRow(size_t row) {
+  // The row finished on this step, so its sequence ends with the EOS (if it hit one) and has no padding yet
+  const auto sequence = generator_->GetSequence(row).CopyDeviceToCpu();
+  Result result{};
+  result.tokens.assign(sequence.begin() + std::min(prompt_length_, sequence.size()), sequence.end());
+  if (!result.tokens.empty() && contains(model_->config_->model.eos_token_id, result.tokens.back()))
+    result.tokens.pop_back();
+
+  std::vector<int32_t> text_tokens;
+  std::copy_if(result.tokens.begin(), result.tokens.end(), std::back_inserter(text_tokens),
+               [this](int32_t token) { return token < end_of_text_token_id_; });
+  result.text = processor_->tokenizer_->Decode(text_tokens);
+  result.id = requests_.FinishRow(row);  // Last, so a row that fails here is failed with the rest of the batch
+  results_.push_back(std::move(result));
+}
+
+const std::vector<WhisperBatcher::Result>& WhisperBatcher::Step() {
+  results_.clear();
+  try {
+    if (!generator_)
+      StartBatch();
+    if (!generator_)
+      return results_;
+
+    generator_->GenerateNextToken();
+    for (size_t row = 0; row < requests_.GetRowCount(); row++) {
+      if (!requests_.IsRowFinished(row) && generator_->IsRowDone(row))
+        FinishRow(row);
+    }
+  } catch (const std::exception& e) {
+    // The requests of a failed batch are returned failed, the batcher goes on with the queue
+    generator_.reset();
+    for (auto id : requests_.FailBatch())
+      results_.push_back(Result{id, {}, {}, e.what()});
+    return results_;
+  }
+
+  if (requests_.GetRunningCount() == 0)
+    generator_.reset();
+  return results_;
+}
+
+const WhisperBatcher::Result& WhisperBatcher::GetResult(size_t index) const {
+  if (index >= results_.size())
+    throw std::runtime_error("Result index " + std::to_string(index) + " is out of range, the last step has " + std::to_string(results_.size()) + " results");
+  return results_[index];
+}
+
+bool WhisperBatcher::IsDone() const {
+  return !generator_ && GetQueuedCount() == 0;
+}
+
+size_t WhisperBatcher::GetQueuedCount() const {
+  return requests_.GetQueuedCount();
+}
+
+size_t WhisperBatcher::GetRunningCount() const {
+  return requests_.GetRunningCount();
+}
+
+}  // namespace Generators
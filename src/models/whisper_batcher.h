@@ -0,0 +1,96 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+#include <deque>
+
+namespace Generators {
+
+// The utterances of a WhisperBatcher, queued and in the running batch, kept apart from the model runs
+struct WhisperRequests {
+  struct Request {
+    size_t id;
+    std::vector<float> samples;
+    std::vector<int32_t> decoder_prompt;
+  };
+
+  // Returns the id of the request. Can be called from any thread, the rest only from the thread running the batches.
+  size_t Add(std::vector<float> samples, std::vector<int32_t> decoder_prompt);
+
+  // Takes the oldest queued request and, in the order they were added, the next ones with the same decoder prompt length,
+  // up to max_batch_size of them. Their ids become the rows of the running batch. Empty when nothing is queued.
+  std::vector<Request> StartBatch(size_t max_batch_size);
+
+  bool IsRowFinished(size_t row) const { return row_finished_[row]; }
+  size_t FinishRow(size_t row);  // Returns the id of the row
+  std::vector<size_t> FailBatch();  // Ends the running batch, returns the ids of its unfinished rows
+
+  size_t GetRowCount() const { return row_ids_.size(); }
+  size_t GetQueuedCount() const;
+  size_t GetRunningCount() const { return running_count_; }  // Unfinished rows of the running batch
+
+ private:
+  mutable std::mutex mutex_;  // Guards the queue, which Add fills from other threads
+  std::deque<Request> queue_;
+  size_t next_id_{};
+
+  std::vector<size_t> row_ids_;
+  std::vector<bool> row_finished_;
+  size_t running_count_{};
+};
+
+// Transcribes independent utterances queued by many requests with batched model runs, for serving whisper. When no batch
+// is running, Step takes the oldest queued utterances (up to max_batch_size of them, all with the same decoder prompt
+// length), extracts their features and runs the encoder once for all of them, so each row of the batch has its own slice
+// of the cross attention cache. Every Step then decodes one token for the whole batch. A request is returned by the Step
+// that finishes its row, without waiting for the rest of the batch, and the slots of finished rows are filled from the
+// queue when the next batch starts. Rows can not join a running batch, since the decoder's past length is shared by all
+// of its rows.
+struct WhisperBatcher {
+  static constexpr int sample_rate = 16000;
+
+  // The search options of params are used for every batch, except batch_size. Only greedy search (or sampling) on the
+  // CPU is supported, rows finish on their own only there.
+  WhisperBatcher(const Model& model, const GeneratorParams& params, size_t max_batch_size);
+
+  // Queues an utterance of 16 kHz mono samples in [-1, 1], at most 30 seconds long. decoder_prompt is its task prompt
+  // (like <|startoftranscript|><|en|><|transcribe|><|notimestamps|>). Returns the id of its result. Can be called from
+  // any thread, also while another thread runs Step.
+  size_t Add(std::span<const float> samples, std::span<const int32_t> decoder_prompt);
+
+  struct Result {
+    size_t id;
+    std::vector<int32_t> tokens;  // The generated tokens, without the decoder prompt and the EOS
+    std::string text;             // The text tokens decoded, special and timestamp tokens are left out
+    std::string error;            // Why the request failed, empty if it succeeded (tokens and text are empty then)
+  };
+
+  // Starts a batch if none is running and utterances are queued, then generates the next token of the batch. Returns
+  // the requests that finished during this step, valid until the next Step. If the batch fails, its unfinished requests
+  // are returned failed with the error and the next Step starts a batch from the queue.
+  const std::vector<Result>& Step();
+  const Result& GetResult(size_t index) const;  // Of the results the last Step returned
+
+  bool IsDone() const;  // Nothing is queued and no batch is running
+  size_t GetQueuedCount() const;
+  size_t GetRunningCount() const;  // Unfinished rows of the running batch
+
+ private:
+  void StartBatch();
+  void FinishRow(size_t row);
+
+  std::shared_ptr<const Model> model_;
+  std::shared_ptr<MultiModalProcessor> processor_;
+  Config::Search search_;
+  const size_t max_batch_size_;
+  int32_t end_of_text_token_id_;  // Whisper's special tokens (timestamps too) all come after it
+
+  WhisperRequests requests_;
+
+  // The running batch, only used by the thread calling Step
+  std::unique_ptr<Generator> generator_;
+  size_t prompt_length_{};
+  std::vector<Result> results_;  // Finished by the last Step
+};
+
+}  // namespace Generators
@@ -0,0 +1,156 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include "../generators.h"
+#include "model.h"
+#include "whisper_stream.h"
+
+namespace Generators {
+
+AudioChunker::AudioChunker(size_t chunk_samples, size_t overlap_samples)
+    : chunk_samples_{chunk_samples},
+      overlap_samples_{overlap_samples} {
+  if (overlap_samples_ >= chunk_samples_)
+    throw std::runtime_error("The overlap of audio chunks must be shorter than the chunks");
+}
+
+void AudioChunker::Append(std::span<const float> samples) {
+  samples_.insert(samples_.end(), samples.begin(), samples.end());
+}
+
+std::span<const float> AudioChunker::NextChunk() const {
+  if (samples_.size() < chunk_samples_)
+    return {};
+  return {samples_.data(), chunk_samples_};
+}
+
+void AudioChunker::PopChunk() {
+  if (samples_.size() < chunk_samples_)
+    throw std::runtime_error("No complete audio chunk to pop");
+  samples_.erase(samples_.begin(), samples_.begin() + (chunk_samples_ - overlap_samples_));
+  new_samples_begin_ = overlap_samples_;
+}
+
+void AudioChunker::Clear() {
+  samples_.clear();
+  new_samples_begin_ = 0;
+}
+
+size_t FindTokenOverlap(std::span<const int32_t> previous_tokens, std::span<const int32_t> tokens, size_t min_length) {
+  for (size_t length = std::min(tokens.size(), previous_tokens.size()); length > 0 && length >= min_length; length--) {
+    if (std::equal(tokens.begin(), tokens.begin() + length, previous_tokens.end() - length))
+      return length;
+  }
+  return 0;
+}
+
+WhisperStream::WhisperStream(const Model& model, const GeneratorParams& params, std::span<const int32_t> decoder_prompt)
+    : model_{model.shared_from_this()},
+      processor_{model.CreateMultiModalProcessor()},
+      search_{params.search},
+      decoder_prompt_{decoder_prompt.begin(), decoder_prompt.end()},
+      start_of_prev_token_id_{processor_->tokenizer_->TokenToTokenId("<|startofprev|>")},
+      end_of_text_token_id_{processor_->tokenizer_->TokenToTokenId("<|endoftext|>")},
+      text_{processor_->tokenizer_->CreateStream()} {
+  if (model.config_->model.type != "whisper")
+    throw std::runtime_error("Streaming transcription is only supported for whisper models, not " + model.config_->model.type);
+  if (decoder_prompt_.empty())
+    throw std::runtime_error("The decoder prompt is empty");
+  search_.batch_size = 1;
+}
+
+void WhisperStream::SetChunking(double chunk_seconds, double overlap_seconds) {
+  if (chunk_seconds <= 0 || chunk_seconds > 30)
+    throw std::runtime_error("chunk_seconds must be more than 0 and at most 30, is " + std::to_string(chunk_seconds));
+  if (overlap_seconds < 0 || overlap_seconds >= chunk_seconds)
+    throw std::runtime_error("overlap_seconds must be at least 0 and less than chunk_seconds, is " + std::to_string(overlap_seconds));
+  if (!chunker_.Buffered().empty())
+    throw std::runtime_error("Chunking can only be changed before audio is appended or after Flush");
+
+  chunker_ = AudioChunker{static_cast<size_t>(chunk_seconds * sample_rate), static_cast<size_t>(overlap_seconds * sample_rate)};
+}
+
+void WhisperStream::AppendAudio(std::span<const float> samples) {
+  chunker_.Append(samples);
+}
+
+std::string WhisperStream::Process() {
+  std::string text;
+  for (auto chunk = chunker_.NextChunk(); !chunk.empty(); chunk = chunker_.NextChunk()) {
+    text += AddChunk(Transcribe(chunk));
+    chunker_.PopChunk();
+  }
+  return text;
+}
+
+std::string WhisperStream::ProcessPartial() {
+  if (!chunker_.HasNewSamples())
+    return {};
+  const auto tokens = Transcribe(chunker_.Buffered());
+  const auto overlap_length = chunker_.Overlaps() ? FindTokenOverlap(previous_tokens_, tokens, min_overlap_tokens) : 0;
+  return processor_->tokenizer_->Decode(std::span<const int32_t>{tokens}.subspan(overlap_length));
+}
+
+std::string WhisperStream::Flush() {
+  std::string text;
+  if (chunker_.HasNewSamples())
+    text = AddChunk(Transcribe(chunker_.Buffered()));
+
+  chunker_.Clear();
+  previous_tokens_.clear();
+  context_tokens_.clear();
+  text_ = processor_->tokenizer_->CreateStream();
+  return text;
+}
+
+std::vector<int32_t> WhisperStream::Transcribe(std::span<const float> samples) {
+  auto audios = LoadAudiosFromSamples(std::span<const std::span<const float>>{&samples, 1}, sample_rate);
+  auto inputs = processor_->Process(std::string{}, nullptr, audios.get());
+
+  // The decoder prompt is the end of the transcript so far as context, then the task prompt. Like whisper's own
+  // long-form transcription, the context takes at most half of the decoder's length.
+  std::vector<int32_t> prompt;
+  const auto max_context_length = search_.max_length / 2 - static_cast<int>(decoder_prompt_.size()) - 1;
+  if (!context_tokens_.empty() && max_context_length > 0) {
+    const auto context_length = std::min(context_tokens_.size(), static_cast<size_t>(max_context_length));
+    prompt.push_back(start_of_prev_token_id_);
+    prompt.insert(prompt.end(), context_tokens_.end() - context_length, context_tokens_.end());
+  }
+  prompt.insert(prompt.end(), decoder_prompt_.begin(), decoder_prompt_.end());
+
+  auto input_ids = OrtValue::CreateTensor<int32_t>(Ort::Allocator::GetWithDefaultOptions(), std::array<int64_t, 2>{1, static_cast<int64_t>(prompt.size())});
+  std::copy(prompt.begin(), prompt.end(), input_ids->GetTensorMutableData<int32_t>());
+  inputs->emplace(std::string(Config::Defaults::InputIdsName), std::make_shared<Tensor>(std::move(input_ids)));
+
+  auto params = CreateGeneratorParams(*model_);
+  params->search = search_;
+  params->SetInputs(*inputs);
+  auto generator = CreateGenerator(*model_, *params);
+  while (!generator->IsDone())
+    generator->GenerateNextToken();
+
+  // The text tokens of the chunk, without the prompt and the special (including timestamp) tokens
+  const auto sequence = generator->GetSequence(0).CopyDeviceToCpu();
+  std::vector<int32_t> tokens;
+  std::copy_if(sequence.begin() + std::min(prompt.size(), sequence.size()), sequence.end(), std::back_inserter(tokens),
+               [this](int32_t token) { return token < end_of_text_token_id_; });
+  return tokens;
+}
+
+std::string WhisperStream::AddChunk(std::vector<int32_t> tokens) {
+  // The start of this chunk transcribes the overlap again, so drop the start that repeats the last chunk's end
+  const auto overlap_length = chunker_.Overlaps() ? FindTokenOverlap(previous_tokens_, tokens, min_overlap_tokens) : 0;
+
+  std::string text;
+  for (auto it = tokens.begin() + overlap_length; it != tokens.end(); ++it) {
+    context_tokens_.push_back(*it);
+    text += text_->Decode(*it);
+  }
+  previous_tokens_ = std::move(tokens);
+
+  // Only the end of the transcript is ever used as context
+  if (context_tokens_.size() > static_cast<size_t>(search_.max_length))
+    context_tokens_.erase(context_tokens_.begin(), context_tokens_.end() - search_.max_length);
+  return text;
+}
+
+}  // namespace Generators
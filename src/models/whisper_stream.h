@@ -0,0 +1,88 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+namespace Generators {
+
+// Cuts audio appended over time into chunks, each starting overlap_samples before the end of the chunk before it
+struct AudioChunker {
+  // overlap_samples is less than chunk_samples
+  AudioChunker(size_t chunk_samples, size_t overlap_samples);
+
+  void Append(std::span<const float> samples);
+
+  // The next complete chunk, empty until enough audio is appended
+  std::span<const float> NextChunk() const;
+
+  // Drops the audio of the chunk returned by NextChunk, except its overlap which starts the next chunk
+  void PopChunk();
+
+  // The audio not popped yet, shorter than a chunk once every complete chunk is popped
+  std::span<const float> Buffered() const { return samples_; }
+
+  // Whether some of the buffered audio was not part of a popped chunk
+  bool HasNewSamples() const { return samples_.size() > new_samples_begin_; }
+
+  bool Overlaps() const { return overlap_samples_ > 0; }
+
+  void Clear();
+
+ private:
+  size_t chunk_samples_;
+  size_t overlap_samples_;
+  std::vector<float> samples_;  // From the start of the next chunk
+  size_t new_samples_begin_{};  // Samples before this were part of the last chunk (its overlap)
+};
+
+// The length of the longest start of tokens that repeats the end of previous_tokens, 0 if shorter than min_length. A
+// chunk transcribes the overlap with the chunk before it again, but a short match is as likely a word said twice.
+size_t FindTokenOverlap(std::span<const int32_t> previous_tokens, std::span<const int32_t> tokens, size_t min_length);
+
+// Transcribes audio that arrives over time, like a live stream or a recording too long for whisper's 30 second window.
+// The audio is cut into overlapping chunks as it is appended, each chunk is transcribed by its own generator with the
+// text of the chunks before it as the decoder prompt context (<|startofprev|>), and the words repeated in the overlap
+// are dropped so the text of each chunk continues the text before it.
+struct WhisperStream {
+  static constexpr int sample_rate = 16000;
+  static constexpr size_t min_overlap_tokens = 3;  // Shortest repeat dropped at the start of a chunk
+
+  // The search options of params are used for every chunk, decoder_prompt is the task prompt
+  // (like <|startoftranscript|><|en|><|transcribe|><|notimestamps|>)
+  WhisperStream(const Model& model, const GeneratorParams& params, std::span<const int32_t> decoder_prompt);
+
+  // chunk_seconds is at most 30, overlap_seconds is less than chunk_seconds
+  void SetChunking(double chunk_seconds, double overlap_seconds);
+
+  void AppendAudio(std::span<const float> samples);  // 16 kHz mono samples in [-1, 1]
+
+  // Transcribes every complete chunk of the audio appended so far and returns the text they add
+  std::string Process();
+
+  // Transcribes the audio appended after the last complete chunk and returns its text. The text is not final and is
+  // not added to the transcript, the chunk that audio ends up in is transcribed again by Process or Flush.
+  std::string ProcessPartial();
+
+  // Transcribes the audio that is left, then the stream starts over with no context
+  std::string Flush();
+
+ private:
+  // The text tokens of the transcription of samples, with the transcript so far as the prompt context
+  std::vector<int32_t> Transcribe(std::span<const float> samples);
+
+  // Adds the tokens of a chunk to the transcript, but for its start that repeats the last chunk, and returns their text
+  std::string AddChunk(std::vector<int32_t> tokens);
+
+  std::shared_ptr<const Model> model_;
+  std::shared_ptr<MultiModalProcessor> processor_;
+  Config::Search search_;
+  std::vector<int32_t> decoder_prompt_;
+  int32_t start_of_prev_token_id_;
+  int32_t end_of_text_token_id_;  // Whisper's special tokens (timestamps too) all come after it
+
+  AudioChunker chunker_{30 * sample_rate, 5 * sample_rate};
+  std::vector<int32_t> previous_tokens_;   // Text tokens of the last chunk, to find the overlap of the next one
+  std::vector<int32_t> context_tokens_;    // Text tokens of the transcript so far, the tail is the next prompt context
+  std::unique_ptr<TokenizerStream> text_;  // Decodes the transcript tokens one at a time
+};
+
+}  // namespace Generators
@@ -21,6 +21,31 @@ std::vector<size_t> MakeAllLayerIndices(size_t layer_count) {
   return v;
 }
 
+// Writes count elements of element_size bytes from src into the ring buffer dst of the given capacity,
+// starting at head and wrapping around to the beginning of dst.
+void WriteToRing(uint8_t* dst, size_t capacity, size_t head, const uint8_t* src, size_t count, size_t element_size) {
+  const size_t first_count = std::min(count, capacity - head);
+  std::copy_n(src, first_count * element_size, dst + head * element_size);
+  std::copy_n(src + first_count * element_size, (count - first_count) * element_size, dst);
+}
+
+// Copies the ring buffer src of the given capacity into dst from oldest to newest element, skipping the skip_count oldest elements.
+// head is the position of the oldest element in src.
+void LinearizeRing(uint8_t* dst, const uint8_t* src, size_t capacity, size_t head, size_t skip_count, size_t element_size) {
+  const size_t begin = (head + skip_count) % capacity;
+  const size_t count = capacity - skip_count;
+  const size_t first_count = std::min(count, capacity - begin);
+  std::copy_n(src + begin * element_size, first_count * element_size, dst);
+  std::copy_n(src, (count - first_count) * element_size, dst + first_count * element_size);
+}
+
+// Fills count elements of the ring buffer dst of the given capacity with value, starting at begin and wrapping around.
+void FillRing(uint8_t* dst, size_t capacity, size_t begin, size_t count, size_t element_size, uint8_t value) {
+  const size_t first_count = std::min(count, capacity - begin);
+  std::fill_n(dst + begin * element_size, first_count * element_size, value);
+  std::fill_n(dst, (count - first_count) * element_size, value);
+}
+
 }  // namespace
 
 std::vector<WindowedKeyValueCache::LayerState> WindowedKeyValueCache::MakeInitialPerLayerStates(
@@ -49,6 +74,7 @@ std::vector<WindowedKeyValueCache::LayerState> WindowedKeyValueCache::MakeInitia
 WindowedKeyValueCache::WindowedKeyValueCache(State& state)
     : state_{state},
       layer_count_{narrow<size_t>(model_.config_->model.decoder.num_hidden_layers)},
+      ring_buffer_{model_.config_->model.decoder.sliding_window->ring_buffer},
       all_layer_indices_(MakeAllLayerIndices(layer_count_)) {
   if (layer_count_ == 0) {
     throw std::runtime_error("Expected there to be at least 1 layer in the model. Actual: " +
@@ -82,6 +108,7 @@ WindowedKeyValueCache::WindowedKeyValueCache(State& state)
   per_layer_states_ = MakeInitialPerLayerStates(layer_count_, static_cast<size_t>(initial_window_size),
                                                 initial_key_cache_shape_in, initial_key_cache_shape_out,
                                                 initial_value_cache_shape_in, initial_value_cache_shape_out);
+  initial_layer_state_ = per_layer_states_.front();
 
   for (int i = 0; i < static_cast<int>(layer_count_); ++i) {
     input_name_strings_.emplace_back(ComposeKeyValueName(model_.config_->model.decoder.inputs.past_key_names, i));
@@ -97,23 +124,43 @@ WindowedKeyValueCache::WindowedKeyValueCache(State& state)
                              std::to_string(type_));
   }
 
+  if (ring_buffer_ && model_.session_info_.HasInput(model_.config_->model.decoder.inputs.past_sequence_length)) {
+    throw std::runtime_error("sliding_window.ring_buffer requires the model to locate cached tokens through the attention_mask, "
+                             "but the model has a past_sequence_length input.");
+  }
+
+  key_caches_in_.resize(layer_count_);
+  value_caches_in_.resize(layer_count_);
+  key_caches_out_.resize(layer_count_);
+  value_caches_out_.resize(layer_count_);
   for (size_t i = 0; i < layer_count_; ++i) {
-    key_caches_in_.push_back(
-        OrtValue::CreateTensor(Allocator(), initial_key_cache_shape_in, type_));
-    std::fill_n(key_caches_in_[i]->GetTensorMutableData<uint8_t>(),
-                ElementCountFromShape(initial_key_cache_shape_in),
-                static_cast<uint8_t>(model_.config_->model.decoder.sliding_window->pad_value));
-
-    value_caches_in_.push_back(
-        OrtValue::CreateTensor(Allocator(), initial_value_cache_shape_in, type_));
-    std::fill_n(value_caches_in_[i]->GetTensorMutableData<uint8_t>(),
-                ElementCountFromShape(initial_value_cache_shape_in),
-                static_cast<uint8_t>(model_.config_->model.decoder.sliding_window->pad_value));
-
-    key_caches_out_.push_back(
-        OrtValue::CreateTensor(Allocator(), initial_key_cache_shape_out, type_));
-    value_caches_out_.push_back(
-        OrtValue::CreateTensor(Allocator(), initial_value_cache_shape_out, type_));
+    ResetLayer(i);
+  }
+}
+
+void WindowedKeyValueCache::ResetLayer(size_t layer_idx) {
+  auto& layer_state = per_layer_states_[layer_idx];
+  layer_state = initial_layer_state_;
+
+  key_caches_in_[layer_idx] = OrtValue::CreateTensor(Allocator(), layer_state.key_cache_shape_in, type_);
+  std::fill_n(key_caches_in_[layer_idx]->GetTensorMutableData<uint8_t>(),
+              ElementCountFromShape(layer_state.key_cache_shape_in),
+              static_cast<uint8_t>(model_.config_->model.decoder.sliding_window->pad_value));
+
+  value_caches_in_[layer_idx] = OrtValue::CreateTensor(Allocator(), layer_state.value_cache_shape_in, type_);
+  std::fill_n(value_caches_in_[layer_idx]->GetTensorMutableData<uint8_t>(),
+              ElementCountFromShape(layer_state.value_cache_shape_in),
+              static_cast<uint8_t>(model_.config_->model.decoder.sliding_window->pad_value));
+
+  key_caches_out_[layer_idx] = OrtValue::CreateTensor(Allocator(), layer_state.key_cache_shape_out, type_);
+  value_caches_out_[layer_idx] = OrtValue::CreateTensor(Allocator(), layer_state.value_cache_shape_out, type_);
+
+  // Before Add() is called there is nothing registered with the state yet
+  if (input_index_ != ~0U) {
+    state_.SetInput(input_index_ + 2 * layer_idx, key_caches_in_[layer_idx].get());
+    state_.SetInput(input_index_ + 2 * layer_idx + 1, value_caches_in_[layer_idx].get());
+    state_.SetOutput(output_index_ + 2 * layer_idx, key_caches_out_[layer_idx].get());
+    state_.SetOutput(output_index_ + 2 * layer_idx + 1, value_caches_out_[layer_idx].get());
   }
 }
 
@@ -189,6 +236,39 @@ void WindowedKeyValueCache::SlideLayer(size_t layer_idx) {
   }
 }
 
+void WindowedKeyValueCache::WriteLayerToRing(size_t layer_idx) {
+  // Instead of shifting the whole cache by window_size, the output window is written in place at ring_head.
+  // The attention_mask (see WindowedPositionInputs) marks which positions of the cache hold valid tokens,
+  // so the order of the positions along the sequence dimension does not matter to the model.
+  auto& layer_state = per_layer_states_[layer_idx];
+
+  const auto window_size = layer_state.window_size;
+  const auto& key_cache_shape_in = layer_state.key_cache_shape_in;
+  const auto& value_cache_shape_in = layer_state.value_cache_shape_in;
+  const auto key_cache_capacity = static_cast<size_t>(key_cache_shape_in[3]);
+  const auto value_cache_capacity = static_cast<size_t>(value_cache_shape_in[2]);
+  const auto head_size = static_cast<size_t>(value_cache_shape_in[3]);
+
+  uint8_t* key_cache_in_data = key_caches_in_[layer_idx]->GetTensorMutableData<uint8_t>();
+  const uint8_t* key_cache_out_data = key_caches_out_[layer_idx]->GetTensorData<uint8_t>();
+
+  const int64_t num_key_cache_chunks = key_cache_shape_in[0] * key_cache_shape_in[2];
+  for (int64_t j = 0; j < num_key_cache_chunks; ++j) {
+    WriteToRing(key_cache_in_data + j * key_cache_capacity, key_cache_capacity, layer_state.ring_head,
+                key_cache_out_data + j * window_size, window_size, 1);
+  }
+
+  uint8_t* value_cache_in_data = value_caches_in_[layer_idx]->GetTensorMutableData<uint8_t>();
+  const uint8_t* value_cache_out_data = value_caches_out_[layer_idx]->GetTensorData<uint8_t>();
+
+  for (int64_t j = 0; j < value_cache_shape_in[0]; ++j) {
+    WriteToRing(value_cache_in_data + j * value_cache_capacity * head_size, value_cache_capacity, layer_state.ring_head,
+                value_cache_out_data + j * window_size * head_size, window_size, head_size);
+  }
+
+  layer_state.ring_head = (layer_state.ring_head + window_size) % key_cache_capacity;
+}
+
 void WindowedKeyValueCache::TransitionLayerToTokenGeneration(size_t layer_idx) {
   // Transition from prompt processing to token generation.
   // Concatenate the last window_size elements to the end of the cache
@@ -238,7 +318,11 @@ void WindowedKeyValueCache::TransitionLayerToTokenGeneration(size_t layer_idx) {
 
   int64_t num_key_cache_chunks = updated_key_cache_shape_in[0] * updated_key_cache_shape_in[2];
   for (int64_t j = 0; j < num_key_cache_chunks; ++j) {
-    {
+    if (ring_buffer_) {
+      // Lay the ring out from oldest to newest so that the token generation cache starts with ring_head at 0
+      LinearizeRing(key_cache_data + j * updated_key_cache_shape_in[3], key_cache_in_data + j * key_cache_shape_in[3],
+                    static_cast<size_t>(key_cache_shape_in[3]), layer_state.ring_head, updated_window_size, 1);
+    } else {
       cpu_span<uint8_t> key_cache_dst(key_cache_data + j * updated_key_cache_shape_in[3],
                                       updated_key_cache_shape_in[3] - updated_window_size);
       cpu_span<uint8_t> key_cache_src(key_cache_in_data + j * key_cache_shape_in[3] + updated_window_size,
@@ -265,7 +349,12 @@ void WindowedKeyValueCache::TransitionLayerToTokenGeneration(size_t layer_idx) {
   uint8_t* value_cache_out_data = value_caches_out_[layer_idx]->GetTensorMutableData<uint8_t>();
 
   for (int64_t j = 0; j < updated_value_cache_shape_in[0]; ++j) {
-    {
+    if (ring_buffer_) {
+      LinearizeRing(value_cache_data + (j * updated_value_cache_shape_in[2] * updated_value_cache_shape_in[3]),
+                    value_cache_in_data + (j * value_cache_shape_in[2] * value_cache_shape_in[3]),
+                    static_cast<size_t>(value_cache_shape_in[2]), layer_state.ring_head, updated_window_size,
+                    static_cast<size_t>(value_cache_shape_in[3]));
+    } else {
       cpu_span<uint8_t> value_cache_dst(value_cache_data + (j * updated_value_cache_shape_in[2] * updated_value_cache_shape_in[3]),
                                         (value_cache_shape_in[2] - updated_window_size) * updated_value_cache_shape_in[3]);
       cpu_span<uint8_t> value_cache_src(value_cache_in_data + (j * value_cache_shape_in[2] * value_cache_shape_in[3]) +
@@ -287,16 +376,18 @@ void WindowedKeyValueCache::TransitionLayerToTokenGeneration(size_t layer_idx) {
   value_caches_out_[layer_idx] = OrtValue::CreateTensor(Allocator(), updated_value_cache_shape_out, type_);
 
   // update values in per-layer state
+  // The cache is now laid out from oldest to newest and completely filled, so the oldest entry is at position 0
+  layer_state.ring_head = 0;
   layer_state.window_size = updated_window_size;
   layer_state.key_cache_shape_in = updated_key_cache_shape_in;
   layer_state.value_cache_shape_in = updated_value_cache_shape_in;
   layer_state.key_cache_shape_out = updated_key_cache_shape_out;
   layer_state.value_cache_shape_out = updated_value_cache_shape_out;
 
-  state_.inputs_[input_index_ + 2 * layer_idx] = key_caches_in_[layer_idx].get();
-  state_.inputs_[input_index_ + 2 * layer_idx + 1] = value_caches_in_[layer_idx].get();
-  state_.outputs_[output_index_ + 2 * layer_idx] = key_caches_out_[layer_idx].get();
-  state_.outputs_[output_index_ + 2 * layer_idx + 1] = value_caches_out_[layer_idx].get();
+  state_.SetInput(input_index_ + 2 * layer_idx, key_caches_in_[layer_idx].get());
+  state_.SetInput(input_index_ + 2 * layer_idx + 1, value_caches_in_[layer_idx].get());
+  state_.SetOutput(output_index_ + 2 * layer_idx, key_caches_out_[layer_idx].get());
+  state_.SetOutput(output_index_ + 2 * layer_idx + 1, value_caches_out_[layer_idx].get());
 }
 
 void WindowedKeyValueCache::UpdateLayer(DeviceSpan<int32_t> /*beam_indices*/, int total_length, size_t layer_idx) {
@@ -311,8 +402,19 @@ void WindowedKeyValueCache::UpdateLayer(DeviceSpan<int32_t> /*beam_indices*/, in
     return;
   }
 
+  if (layer_state.skip_next_update) {
+    layer_state.skip_next_update = false;
+    return;
+  }
+
+  layer_state.num_tokens += layer_state.window_size;
+
   if (layer_state.window_size == 1 || layer_state.window_index < layer_state.num_windows) {
-    SlideLayer(layer_idx);
+    if (ring_buffer_) {
+      WriteLayerToRing(layer_idx);
+    } else {
+      SlideLayer(layer_idx);
+    }
     ++layer_state.window_index;
     return;
   }
@@ -320,6 +422,70 @@ void WindowedKeyValueCache::UpdateLayer(DeviceSpan<int32_t> /*beam_indices*/, in
   TransitionLayerToTokenGeneration(layer_idx);
 }
 
+void WindowedKeyValueCache::RewindLayer(size_t layer_idx, size_t index) {
+  auto& layer_state = per_layer_states_[layer_idx];
+
+  if (index > layer_state.num_tokens) {
+    throw std::runtime_error("Requested length of rewind is greater than the current length.");
+  }
+
+  const auto capacity = static_cast<size_t>(layer_state.key_cache_shape_in[3]);
+  const size_t num_tokens_to_drop = layer_state.num_tokens - index;
+  if (num_tokens_to_drop > capacity) {
+    throw std::runtime_error(MakeString("Cannot rewind by ", num_tokens_to_drop, " tokens, the sliding window key-value cache only holds the last ",
+                                        capacity, " tokens."));
+  }
+
+  layer_state.num_tokens = index;
+  layer_state.skip_next_update = true;
+
+  // Restore the pad value for the dropped positions, as if they had never been written
+  const auto pad_value = static_cast<uint8_t>(model_.config_->model.decoder.sliding_window->pad_value);
+  const auto& key_cache_shape_in = layer_state.key_cache_shape_in;
+  const auto& value_cache_shape_in = layer_state.value_cache_shape_in;
+  const auto head_size = static_cast<size_t>(value_cache_shape_in[3]);
+
+  uint8_t* key_cache_in_data = key_caches_in_[layer_idx]->GetTensorMutableData<uint8_t>();
+  uint8_t* value_cache_in_data = value_caches_in_[layer_idx]->GetTensorMutableData<uint8_t>();
+  const int64_t num_key_cache_chunks = key_cache_shape_in[0] * key_cache_shape_in[2];
+
+  if (ring_buffer_) {
+    layer_state.ring_head = (layer_state.ring_head + capacity - num_tokens_to_drop) % capacity;
+
+    for (int64_t j = 0; j < num_key_cache_chunks; ++j) {
+      FillRing(key_cache_in_data + j * capacity, capacity, layer_state.ring_head, num_tokens_to_drop, 1, pad_value);
+    }
+    for (int64_t j = 0; j < value_cache_shape_in[0]; ++j) {
+      FillRing(value_cache_in_data + j * capacity * head_size, capacity, layer_state.ring_head, num_tokens_to_drop, head_size, pad_value);
+    }
+    return;
+  }
+
+  // The sliding layout keeps the newest token last, so dropping tokens shifts the cache back to the right
+  // key_cache_in -> [p, a, b, c, d], drop 2 -> [p, p, p, a, b]
+  for (int64_t j = 0; j < num_key_cache_chunks; ++j) {
+    uint8_t* key_cache = key_cache_in_data + j * capacity;
+    std::copy_backward(key_cache, key_cache + capacity - num_tokens_to_drop, key_cache + capacity);
+    std::fill_n(key_cache, num_tokens_to_drop, pad_value);
+  }
+  for (int64_t j = 0; j < value_cache_shape_in[0]; ++j) {
+    uint8_t* value_cache = value_cache_in_data + j * capacity * head_size;
+    std::copy_backward(value_cache, value_cache + (capacity - num_tokens_to_drop) * head_size, value_cache + capacity * head_size);
+    std::fill_n(value_cache, num_tokens_to_drop * head_size, pad_value);
+  }
+}
+
+void WindowedKeyValueCache::RewindTo(size_t index) {
+  // The caller must make sure the outputs of the last run have been moved into the input cache before rewinding.
+  for (size_t layer_idx = 0; layer_idx < layer_count_; ++layer_idx) {
+    if (index == 0) {
+      ResetLayer(layer_idx);
+    } else {
+      RewindLayer(layer_idx, index);
+    }
+  }
+}
+
 void WindowedKeyValueCache::Update(DeviceSpan<int32_t> beam_indices, int current_length) {
   PartialUpdate(beam_indices, current_length, all_layer_indices_);
 }
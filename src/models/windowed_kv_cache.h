@@ -22,9 +22,8 @@ struct WindowedKeyValueCache : KeyValueCache {
   void PartialUpdate(DeviceSpan<int32_t> beam_indices, int total_length,
                      std::span<const size_t> layer_indices_to_update) override;
 
-  void RewindTo(size_t index) override {
-    throw std::runtime_error("WindowedKeyValueCache does not support RewindTo.");
-  }
+  // Rewinding to 0 restores the initial state, other lengths drop the newest tokens as long as the cache still holds them.
+  void RewindTo(size_t index) override;
 
  private:
   using CacheTensorShape = std::array<int64_t, 4>;
@@ -35,6 +34,10 @@ struct WindowedKeyValueCache : KeyValueCache {
     size_t num_windows{};
     bool is_first_update{true};
 
+    size_t ring_head{0};      // Next position along the sequence dimension of the input cache to write (ring buffer only)
+    size_t num_tokens{0};     // Number of tokens whose key-value entries have been moved into the input cache
+    bool skip_next_update{};  // Set by a rewind, the outputs of the last run have already been moved into the input cache
+
     CacheTensorShape key_cache_shape_in{}, key_cache_shape_out{};
     CacheTensorShape value_cache_shape_in{}, value_cache_shape_out{};
   };
@@ -47,8 +50,11 @@ struct WindowedKeyValueCache : KeyValueCache {
                                                            const CacheTensorShape& initial_value_cache_shape_out);
 
   void SlideLayer(size_t layer_idx);
+  void WriteLayerToRing(size_t layer_idx);
   void TransitionLayerToTokenGeneration(size_t layer_idx);
   void UpdateLayer(DeviceSpan<int32_t> beam_indices, int total_length, size_t layer_idx);
+  void RewindLayer(size_t layer_idx, size_t index);
+  void ResetLayer(size_t layer_idx);
 
   DeviceInterface& Device() { return *model_.p_device_kvcache_; }
   Ort::Allocator& Allocator() { return model_.p_device_kvcache_->GetAllocator(); }
@@ -60,8 +66,10 @@ struct WindowedKeyValueCache : KeyValueCache {
   State& state_;
   const Model& model_{state_.model_};
   const size_t layer_count_;
+  const bool ring_buffer_;
 
   std::vector<LayerState> per_layer_states_;
+  LayerState initial_layer_state_;
 
   size_t input_index_{~0U}, output_index_{~0U};
 
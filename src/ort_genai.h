@@ -156,6 +156,28 @@ struct OgaRuntimeSettings : OgaAbstract {
   static void operator delete(void* p) { OgaDestroyRuntimeSettings(reinterpret_cast<OgaRuntimeSettings*>(p)); }
 };
 
+struct OgaModelData : OgaAbstract {
+  static std::unique_ptr<OgaModelData> Create() {
+    OgaModelData* p;
+    OgaCheckResult(OgaCreateModelData(&p));
+    return std::unique_ptr<OgaModelData>(p);
+  }
+
+  // Memory maps an uncompressed tar archive of model files
+  static std::unique_ptr<OgaModelData> CreateFromArchive(const char* archive_path) {
+    OgaModelData* p;
+    OgaCheckResult(OgaCreateModelDataFromArchive(archive_path, &p));
+    return std::unique_ptr<OgaModelData>(p);
+  }
+
+  // data is not copied and must outlive the models created from it
+  void AddFile(const char* filename, const void* data, size_t length) {
+    OgaCheckResult(OgaModelDataAddFile(this, filename, data, length));
+  }
+
+  static void operator delete(void* p) { OgaDestroyModelData(reinterpret_cast<OgaModelData*>(p)); }
+};
+
 struct OgaConfig : OgaAbstract {
   static std::unique_ptr<OgaConfig> Create(const char* config_path) {
     OgaConfig* p;
@@ -163,6 +185,13 @@ struct OgaConfig : OgaAbstract {
     return std::unique_ptr<OgaConfig>(p);
   }
 
+  // Files held by model_data are read from memory, the others from config_path
+  static std::unique_ptr<OgaConfig> Create(const char* config_path, const OgaModelData& model_data) {
+    OgaConfig* p;
+    OgaCheckResult(OgaCreateConfigFromModelData(config_path, &model_data, &p));
+    return std::unique_ptr<OgaConfig>(p);
+  }
+
   void ClearProviders() {
     OgaCheckResult(OgaConfigClearProviders(this));
   }
@@ -256,6 +285,40 @@ struct OgaSequences : OgaAbstract {
   static void operator delete(void* p) { OgaDestroySequences(reinterpret_cast<OgaSequences*>(p)); }
 };
 
+struct OgaBatchPlan : OgaAbstract {
+  static std::unique_ptr<OgaBatchPlan> Create(const OgaSequences& sequences, size_t max_batch_size, size_t max_batch_tokens = 0) {
+    OgaBatchPlan* p;
+    OgaCheckResult(OgaCreateBatchPlan(&sequences, max_batch_size, max_batch_tokens, &p));
+    return std::unique_ptr<OgaBatchPlan>(p);
+  }
+
+  size_t BatchCount() const {
+    return OgaBatchPlanGetBatchCount(this);
+  }
+
+  size_t BatchSize(size_t batch_index) const {
+    return OgaBatchPlanGetBatchSize(this, batch_index);
+  }
+
+  const size_t* BatchIndices(size_t batch_index) const {
+    return OgaBatchPlanGetBatchIndices(this, batch_index);
+  }
+
+  std::unique_ptr<OgaSequences> GetBatchSequences(const OgaSequences& sequences, size_t batch_index) const {
+    OgaSequences* p;
+    OgaCheckResult(OgaBatchPlanGetBatchSequences(this, &sequences, batch_index, &p));
+    return std::unique_ptr<OgaSequences>(p);
+  }
+
+#if OGA_USE_SPAN
+  std::span<const size_t> GetBatch(size_t batch_index) const {
+    return {BatchIndices(batch_index), BatchSize(batch_index)};
+  }
+#endif
+
+  static void operator delete(void* p) { OgaDestroyBatchPlan(reinterpret_cast<OgaBatchPlan*>(p)); }
+};
+
 struct OgaTokenizer : OgaAbstract {
   static std::unique_ptr<OgaTokenizer> Create(const OgaModel& model) {
     OgaTokenizer* p;
@@ -350,6 +413,24 @@ struct OgaGeneratorParams : OgaAbstract {
     OgaCheckResult(OgaGeneratorParamsSetSearchBool(this, name, value));
   }
 
+  void SetRowSearchOption(size_t row, const char* name, double value) {
+    OgaCheckResult(OgaGeneratorParamsSetRowSearchNumber(this, row, name, value));
+  }
+
+  void SetRowSearchOptionBool(size_t row, const char* name, bool value) {
+    OgaCheckResult(OgaGeneratorParamsSetRowSearchBool(this, row, name, value));
+  }
+
+  void AddStopSequence(const int32_t* tokens, size_t token_count) {
+    OgaCheckResult(OgaGeneratorParamsAddStopSequence(this, tokens, token_count));
+  }
+
+#if OGA_USE_SPAN
+  void AddStopSequence(std::span<const int32_t> tokens) {
+    OgaCheckResult(OgaGeneratorParamsAddStopSequence(this, tokens.data(), tokens.size()));
+  }
+#endif
+
   void SetModelInput(const char* name, OgaTensor& tensor) {
     OgaCheckResult(OgaGeneratorParamsSetModelInput(this, name, &tensor));
   }
@@ -369,6 +450,23 @@ struct OgaGeneratorParams : OgaAbstract {
   static void operator delete(void* p) { OgaDestroyGeneratorParams(reinterpret_cast<OgaGeneratorParams*>(p)); }
 };
 
+struct OgaGeneratorMetrics : OgaAbstract {
+  // Times are in seconds, GetNames lists every metric
+  double GetValue(const char* name) const {
+    double value;
+    OgaCheckResult(OgaGeneratorMetricsGetValue(this, name, &value));
+    return value;
+  }
+
+  std::unique_ptr<OgaStringArray> GetNames() const {
+    OgaStringArray* p;
+    OgaCheckResult(OgaGeneratorMetricsGetNames(this, &p));
+    return std::unique_ptr<OgaStringArray>(p);
+  }
+
+  static void operator delete(void* p) { OgaDestroyGeneratorMetrics(reinterpret_cast<OgaGeneratorMetrics*>(p)); }
+};
+
 struct OgaGenerator : OgaAbstract {
   static std::unique_ptr<OgaGenerator> Create(const OgaModel& model, OgaGeneratorParams& params) {
     OgaGenerator* p;
@@ -419,6 +517,25 @@ struct OgaGenerator : OgaAbstract {
     OgaCheckResult(OgaGenerator_SetRuntimeOption(this, key, value));
   }
 
+  // tokenizer can be null when the callback only needs the tokens
+  void GenerateAsync(const OgaTokenizer* tokenizer, OgaGenerateCallback callback, void* user_data) {
+    OgaCheckResult(OgaGenerator_GenerateAsync(this, tokenizer, callback, user_data));
+  }
+
+  void GenerateAsyncBatched(const OgaTokenizer* tokenizer, size_t steps_per_callback, OgaGenerateBatchCallback callback, void* user_data) {
+    OgaCheckResult(OgaGenerator_GenerateAsyncBatched(this, tokenizer, steps_per_callback, callback, user_data));
+  }
+
+  void WaitForGenerate() {
+    OgaCheckResult(OgaGenerator_WaitForGenerate(this));
+  }
+
+  std::unique_ptr<OgaGeneratorMetrics> GetMetrics() const {
+    OgaGeneratorMetrics* p;
+    OgaCheckResult(OgaGenerator_GetMetrics(this, &p));
+    return std::unique_ptr<OgaGeneratorMetrics>(p);
+  }
+
   size_t GetSequenceCount(size_t index) const {
     return OgaGenerator_GetSequenceCount(this, index);
   }
@@ -443,12 +560,36 @@ struct OgaGenerator : OgaAbstract {
     OgaCheckResult(OgaGenerator_SetLogits(this, &tensor));
   }
 
+  std::unique_ptr<OgaTensor> GetTokenLogProbs() {
+    OgaTensor* out;
+    OgaCheckResult(OgaGenerator_GetTokenLogProbs(this, 0, &out, nullptr, nullptr));
+    return std::unique_ptr<OgaTensor>(out);
+  }
+
+  void GetTokenLogProbs(size_t top_n, std::unique_ptr<OgaTensor>& logprobs,
+                        std::unique_ptr<OgaTensor>& top_ids, std::unique_ptr<OgaTensor>& top_logprobs) {
+    OgaTensor *logprobs_out, *top_ids_out, *top_logprobs_out;
+    OgaCheckResult(OgaGenerator_GetTokenLogProbs(this, top_n, &logprobs_out, &top_ids_out, &top_logprobs_out));
+    logprobs.reset(logprobs_out);
+    top_ids.reset(top_ids_out);
+    top_logprobs.reset(top_logprobs_out);
+  }
+
 #if OGA_USE_SPAN
   std::span<const int32_t> GetSequence(size_t index) const {
     return {GetSequenceData(index), GetSequenceCount(index)};
   }
 #endif
 
+  void GetSequenceLogProbs(size_t index, std::unique_ptr<OgaTensor>& logprobs,
+                           std::unique_ptr<OgaTensor>& top_ids, std::unique_ptr<OgaTensor>& top_logprobs) const {
+    OgaTensor *logprobs_out, *top_ids_out, *top_logprobs_out;
+    OgaCheckResult(OgaGenerator_GetSequenceLogProbs(this, index, &logprobs_out, &top_ids_out, &top_logprobs_out));
+    logprobs.reset(logprobs_out);
+    top_ids.reset(top_ids_out);
+    top_logprobs.reset(top_logprobs_out);
+  }
+
   void SetActiveAdapter(OgaAdapters& adapters, const char* adapter_name) {
     OgaCheckResult(OgaSetActiveAdapter(this, &adapters, adapter_name));
   }
@@ -639,6 +780,122 @@ struct OgaMultiModalProcessor : OgaAbstract {
   static void operator delete(void* p) { OgaDestroyMultiModalProcessor(reinterpret_cast<OgaMultiModalProcessor*>(p)); }
 };
 
+struct OgaWhisperStream : OgaAbstract {
+  static std::unique_ptr<OgaWhisperStream> Create(const OgaModel& model, const OgaGeneratorParams& params,
+                                                  const int32_t* decoder_prompt, size_t decoder_prompt_count) {
+    OgaWhisperStream* p;
+    OgaCheckResult(OgaCreateWhisperStream(&model, &params, decoder_prompt, decoder_prompt_count, &p));
+    return std::unique_ptr<OgaWhisperStream>(p);
+  }
+
+#if OGA_USE_SPAN
+  static std::unique_ptr<OgaWhisperStream> Create(const OgaModel& model, const OgaGeneratorParams& params,
+                                                  std::span<const int32_t> decoder_prompt) {
+    return Create(model, params, decoder_prompt.data(), decoder_prompt.size());
+  }
+#endif
+
+  void SetChunking(double chunk_seconds, double overlap_seconds) {
+    OgaCheckResult(OgaWhisperStreamSetChunking(this, chunk_seconds, overlap_seconds));
+  }
+
+  // 16 kHz mono samples in [-1, 1]
+  void AppendAudio(const float* samples, size_t sample_count) {
+    OgaCheckResult(OgaWhisperStreamAppendAudio(this, samples, sample_count));
+  }
+
+#if OGA_USE_SPAN
+  void AppendAudio(std::span<const float> samples) {
+    AppendAudio(samples.data(), samples.size());
+  }
+#endif
+
+  // Returns the text added by the chunks completed so far
+  OgaString Process() {
+    const char* p;
+    OgaCheckResult(OgaWhisperStreamProcess(this, &p));
+    return p;
+  }
+
+  // Returns the text of the audio after the last complete chunk, which is not final
+  OgaString ProcessPartial() {
+    const char* p;
+    OgaCheckResult(OgaWhisperStreamProcessPartial(this, &p));
+    return p;
+  }
+
+  // Returns the text of the rest of the audio, then starts over
+  OgaString Flush() {
+    const char* p;
+    OgaCheckResult(OgaWhisperStreamFlush(this, &p));
+    return p;
+  }
+
+  static void operator delete(void* p) { OgaDestroyWhisperStream(reinterpret_cast<OgaWhisperStream*>(p)); }
+};
+
+struct OgaWhisperBatcher : OgaAbstract {
+  static std::unique_ptr<OgaWhisperBatcher> Create(const OgaModel& model, const OgaGeneratorParams& params, size_t max_batch_size) {
+    OgaWhisperBatcher* p;
+    OgaCheckResult(OgaCreateWhisperBatcher(&model, &params, max_batch_size, &p));
+    return std::unique_ptr<OgaWhisperBatcher>(p);
+  }
+
+  // 16 kHz mono samples in [-1, 1], returns the id of the utterance's result
+  size_t Add(const float* samples, size_t sample_count, const int32_t* decoder_prompt, size_t decoder_prompt_count) {
+    size_t id;
+    OgaCheckResult(OgaWhisperBatcherAdd(this, samples, sample_count, decoder_prompt, decoder_prompt_count, &id));
+    return id;
+  }
+
+#if OGA_USE_SPAN
+  size_t Add(std::span<const float> samples, std::span<const int32_t> decoder_prompt) {
+    return Add(samples.data(), samples.size(), decoder_prompt.data(), decoder_prompt.size());
+  }
+#endif
+
+  // Returns the number of utterances that finished during this step
+  size_t Step() {
+    size_t count;
+    OgaCheckResult(OgaWhisperBatcherStep(this, &count));
+    return count;
+  }
+
+  bool IsDone() const {
+    return OgaWhisperBatcherIsDone(this);
+  }
+
+  size_t GetResultId(size_t index) const {
+    size_t id;
+    OgaCheckResult(OgaWhisperBatcherGetResultId(this, index, &id));
+    return id;
+  }
+
+#if OGA_USE_SPAN
+  std::span<const int32_t> GetResultTokens(size_t index) const {
+    const int32_t* tokens;
+    size_t count;
+    OgaCheckResult(OgaWhisperBatcherGetResultTokens(this, index, &tokens, &count));
+    return {tokens, count};
+  }
+#endif
+
+  OgaString GetResultText(size_t index) const {
+    const char* p;
+    OgaCheckResult(OgaWhisperBatcherGetResultText(this, index, &p));
+    return p;
+  }
+
+  // Empty if the utterance was transcribed
+  OgaString GetResultError(size_t index) const {
+    const char* p;
+    OgaCheckResult(OgaWhisperBatcherGetResultError(this, index, &p));
+    return p;
+  }
+
+  static void operator delete(void* p) { OgaDestroyWhisperBatcher(reinterpret_cast<OgaWhisperBatcher*>(p)); }
+};
+
 struct OgaAdapters : OgaAbstract {
   static std::unique_ptr<OgaAdapters> Create(const OgaModel& model) {
     OgaAdapters* p;
@@ -655,6 +912,16 @@ struct OgaAdapters : OgaAbstract {
     OgaCheckResult(OgaUnloadAdapter(this, adapter_name));
   }
 
+  void SetMaxLoadedAdapters(size_t max_loaded_adapters) {
+    OgaCheckResult(OgaSetMaxLoadedAdapters(this, max_loaded_adapters));
+  }
+
+  bool IsAdapterLoaded(const char* adapter_name) {
+    bool out;
+    OgaCheckResult(OgaIsAdapterLoaded(this, adapter_name, &out));
+    return out;
+  }
+
   static void operator delete(void* p) { OgaDestroyAdapters(reinterpret_cast<OgaAdapters*>(p)); }
 };
 
@@ -680,6 +947,14 @@ inline void SetLogCallback(void (*callback)(const char* string, size_t length))
   OgaCheckResult(OgaSetLogCallback(callback));
 }
 
+inline void SetTracingEnabled(bool enabled) {
+  OgaCheckResult(OgaSetTracingEnabled(enabled));
+}
+
+inline void TrimCpuAllocatorPool() {
+  OgaCheckResult(OgaTrimCpuAllocatorPool());
+}
+
 inline void SetCurrentGpuDeviceId(int device_id) {
   OgaCheckResult(OgaSetCurrentGpuDeviceId(device_id));
 }
@@ -10,8 +10,13 @@
 #include "models/model.h"
 #include "constrained_logits_processor.h"
 #include "runtime_settings.h"
+#include "model_data.h"
+#include "models/whisper_batcher.h"
+#include "models/whisper_stream.h"
 #include "search.h"
 #include "smartptrs.h"
+#include "tracing.h"
+#include "cpu/pooled_allocator.h"
 
 namespace Generators {
 
@@ -43,11 +48,14 @@ struct OgaAbstract {
 // But do not use reinterpret_cast!
 struct OgaAdapters : Generators::Adapters, OgaAbstract {};
 struct OgaAudios : Generators::Audios, OgaAbstract {};
+struct OgaBatchPlan : Generators::BatchPlan, OgaAbstract {};
 struct OgaConfig : Generators::Config, OgaAbstract {};
 struct OgaGenerator : Generators::Generator, OgaAbstract {};
+struct OgaGeneratorMetrics : Generators::GeneratorMetrics, OgaAbstract {};
 struct OgaGeneratorParams : Generators::GeneratorParams, OgaAbstract {};
 struct OgaImages : Generators::Images, OgaAbstract {};
 struct OgaModel : Generators::Model, OgaAbstract {};
+struct OgaModelData : Generators::ModelData, OgaAbstract {};
 struct OgaMultiModalProcessor : Generators::MultiModalProcessor, OgaAbstract {};
 struct OgaNamedTensors : Generators::NamedTensors, OgaAbstract {};
 struct OgaResult : Generators::Result, OgaAbstract {};
@@ -57,6 +65,8 @@ struct OgaStringArray : std::vector<std::string>, OgaAbstract {};
 struct OgaTensor : Generators::Tensor, OgaAbstract {};
 struct OgaTokenizer : Generators::Tokenizer, OgaAbstract {};
 struct OgaTokenizerStream : Generators::TokenizerStream, OgaAbstract {};
+struct OgaWhisperBatcher : Generators::WhisperBatcher, OgaAbstract {};
+struct OgaWhisperStream : Generators::WhisperStream, OgaAbstract {};
 
 // Helper function to return a shared pointer as a raw pointer. It won't compile if the types are wrong.
 // Exposed types that are internally owned by shared_ptrs inherit from ExternalRefCounted. Then we
@@ -114,6 +124,21 @@ OgaResult* OGA_API_CALL OgaSetLogCallback(void (*callback)(const char* string, s
   OGA_CATCH
 }
 
+OgaResult* OGA_API_CALL OgaSetTracingEnabled(bool enabled) {
+  OGA_TRY
+  Generators::DefaultTracerInstance().SetEnabled(enabled);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaTrimCpuAllocatorPool() {
+  OGA_TRY
+  if (auto& globals = Generators::GetOrtGlobals(); globals && globals->allocator_cpu_pool_)
+    globals->allocator_cpu_pool_->Trim();
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OGA_API_CALL OgaCreateSequences(OgaSequences** out) {
   OGA_TRY
   *out = ReturnUnique<OgaSequences>(std::make_unique<Generators::TokenSequences>());
@@ -159,6 +184,44 @@ const int32_t* OGA_API_CALL OgaSequencesGetSequenceData(const OgaSequences* p, s
   return (*p)[sequence].data();
 }
 
+OgaResult* OGA_API_CALL OgaCreateBatchPlan(const OgaSequences* sequences, size_t max_batch_size, size_t max_batch_tokens, OgaBatchPlan** out) {
+  OGA_TRY
+  std::vector<size_t> lengths;
+  lengths.reserve(sequences->size());
+  for (const auto& sequence : *sequences)
+    lengths.push_back(sequence.size());
+  *out = ReturnUnique<OgaBatchPlan>(std::make_unique<Generators::BatchPlan>(Generators::PlanBatchesByLength(lengths, max_batch_size, max_batch_tokens)));
+  return nullptr;
+  OGA_CATCH
+}
+
+size_t OGA_API_CALL OgaBatchPlanGetBatchCount(const OgaBatchPlan* p) {
+  return p->size();
+}
+
+size_t OGA_API_CALL OgaBatchPlanGetBatchSize(const OgaBatchPlan* p, size_t batch_index) {
+  return (*p)[batch_index].size();
+}
+
+const size_t* OGA_API_CALL OgaBatchPlanGetBatchIndices(const OgaBatchPlan* p, size_t batch_index) {
+  return (*p)[batch_index].data();
+}
+
+OgaResult* OGA_API_CALL OgaBatchPlanGetBatchSequences(const OgaBatchPlan* p, const OgaSequences* sequences, size_t batch_index, OgaSequences** out) {
+  OGA_TRY
+  if (batch_index >= p->size())
+    throw std::runtime_error("Batch index " + std::to_string(batch_index) + " is out of range, the plan has " + std::to_string(p->size()) + " batches");
+  auto batch_sequences = std::make_unique<Generators::TokenSequences>();
+  for (auto index : (*p)[batch_index]) {
+    if (index >= sequences->size())
+      throw std::runtime_error("The sequences do not match the batch plan");
+    batch_sequences->push_back((*sequences)[index]);
+  }
+  *out = ReturnUnique<OgaSequences>(std::move(batch_sequences));
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OGA_API_CALL OgaLoadImage(const char* image_path, OgaImages** images) {
   OGA_TRY
   const std::vector<const char*> image_paths_vector{image_path};
@@ -231,6 +294,37 @@ OgaResult* OGA_API_CALL OgaCreateConfig(const char* config_path, OgaConfig** out
   OGA_CATCH
 }
 
+OgaResult* OGA_API_CALL OgaCreateModelData(OgaModelData** out) {
+  OGA_TRY
+  auto model_data = std::make_shared<Generators::ModelData>();
+  *out = ReturnShared<OgaModelData>(model_data);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaCreateModelDataFromArchive(const char* archive_path, OgaModelData** out) {
+  OGA_TRY
+  auto model_data = Generators::ModelData::MapArchive(fs::path(archive_path));
+  *out = ReturnShared<OgaModelData>(model_data);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaModelDataAddFile(OgaModelData* model_data, const char* filename, const void* data, size_t length) {
+  OGA_TRY
+  model_data->Add(filename, {static_cast<const uint8_t*>(data), length});
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaCreateConfigFromModelData(const char* config_path, const OgaModelData* model_data, OgaConfig** out) {
+  OGA_TRY
+  *out = ReturnUnique<OgaConfig>(std::make_unique<Generators::Config>(fs::path(config_path), std::string_view{},
+                                                                       const_cast<OgaModelData*>(model_data)->shared_from_this()));
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OGA_API_CALL OgaConfigClearProviders(OgaConfig* config) {
   OGA_TRY
   Generators::ClearProviders(*config);
@@ -315,6 +409,27 @@ OgaResult* OGA_API_CALL OgaGeneratorParamsSetSearchBool(OgaGeneratorParams* gene
   OGA_CATCH
 }
 
+OgaResult* OGA_API_CALL OgaGeneratorParamsSetRowSearchNumber(OgaGeneratorParams* generator_params, size_t row, const char* name, double value) {
+  OGA_TRY
+  generator_params->SetRowSearchNumber(row, name, value);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGeneratorParamsSetRowSearchBool(OgaGeneratorParams* generator_params, size_t row, const char* name, bool value) {
+  OGA_TRY
+  generator_params->SetRowSearchBool(row, name, value);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGeneratorParamsAddStopSequence(OgaGeneratorParams* generator_params, const int32_t* tokens, size_t token_count) {
+  OGA_TRY
+  generator_params->AddStopSequence(std::span<const int32_t>(tokens, token_count));
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OGA_API_CALL OgaGeneratorParamsTryGraphCaptureWithMaxBatchSize(OgaGeneratorParams* generator_params, int32_t max_batch_size) {
   OGA_TRY
   printf("TryGraphCaptureWithMaxBatchSize is deprecated and will be removed in a future release\n");
@@ -422,6 +537,94 @@ OgaResult* OGA_API_CALL OgaGenerator_SetRuntimeOption(OgaGenerator* generator, c
   OGA_CATCH
 }
 
+OgaResult* OGA_API_CALL OgaGenerator_GenerateAsync(OgaGenerator* generator, const OgaTokenizer* tokenizer, OgaGenerateCallback callback, void* user_data) {
+  OGA_TRY
+  if (!callback)
+    throw std::runtime_error("OgaGenerator_GenerateAsync callback is null");
+
+  // One stream per sequence as each keeps the partial characters of its own sequence
+  std::vector<std::shared_ptr<Generators::TokenizerStream>> streams;
+  if (tokenizer) {
+    for (int i = 0; i < generator->search_->params_->BatchBeamSize(); i++)
+      streams.push_back(tokenizer->CreateStream());
+  }
+  std::vector<const char*> texts(streams.size());
+
+  generator->GenerateAsync(1, [streams = std::move(streams), texts = std::move(texts), callback, user_data](std::span<const int32_t> tokens, size_t) mutable {
+    for (size_t i = 0; i < streams.size(); i++)
+      texts[i] = streams[i]->Decode(tokens[i]).c_str();
+    return callback(tokens.data(), tokens.size(), streams.empty() ? nullptr : texts.data(), user_data);
+  });
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGenerator_GenerateAsyncBatched(OgaGenerator* generator, const OgaTokenizer* tokenizer, size_t steps_per_callback,
+                                                         OgaGenerateBatchCallback callback, void* user_data) {
+  OGA_TRY
+  if (!callback)
+    throw std::runtime_error("OgaGenerator_GenerateAsyncBatched callback is null");
+
+  const auto sequence_count = static_cast<size_t>(generator->search_->params_->BatchBeamSize());
+  std::vector<std::shared_ptr<Generators::TokenizerStream>> streams;
+  if (tokenizer) {
+    for (size_t i = 0; i < sequence_count; i++)
+      streams.push_back(tokenizer->CreateStream());
+  }
+  std::vector<std::string> text_strings(streams.size());
+  std::vector<const char*> texts(streams.size());
+
+  generator->GenerateAsync(steps_per_callback, [streams = std::move(streams), text_strings = std::move(text_strings), texts = std::move(texts),
+                                                sequence_count, callback, user_data](std::span<const int32_t> tokens, size_t step_count) mutable {
+    // The text of a sequence is the decoded text of its tokens in all the steps
+    for (size_t i = 0; i < streams.size(); i++) {
+      text_strings[i].clear();
+      for (size_t step = 0; step < step_count; step++)
+        text_strings[i] += streams[i]->Decode(tokens[step * sequence_count + i]);
+      texts[i] = text_strings[i].c_str();
+    }
+    return callback(tokens.data(), step_count, sequence_count, streams.empty() ? nullptr : texts.data(), user_data);
+  });
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGenerator_WaitForGenerate(OgaGenerator* generator) {
+  OGA_TRY
+  generator->WaitForGenerate();
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGenerator_GetMetrics(const OgaGenerator* generator, OgaGeneratorMetrics** out) {
+  OGA_TRY
+  *out = ReturnUnique<OgaGeneratorMetrics>(std::make_unique<Generators::GeneratorMetrics>(generator->GetMetrics()));
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGeneratorMetricsGetValue(const OgaGeneratorMetrics* metrics, const char* name, double* out) {
+  OGA_TRY
+  for (const auto& [metric_name, value] : metrics->GetValues()) {
+    if (std::strcmp(metric_name, name) == 0) {
+      *out = value;
+      return nullptr;
+    }
+  }
+  throw std::runtime_error(std::string("Unknown generator metric: ") + name);
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGeneratorMetricsGetNames(const OgaGeneratorMetrics* metrics, OgaStringArray** out) {
+  OGA_TRY
+  auto names = std::make_unique<std::vector<std::string>>();
+  for (const auto& [name, value] : metrics->GetValues())
+    names->push_back(name);
+  *out = ReturnUnique<OgaStringArray>(std::move(names));
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OGA_API_CALL OgaGenerator_GetOutput(const OgaGenerator* generator, const char* name, OgaTensor** out) {
   OGA_TRY
   auto* ortvalue_output = generator->state_->GetOutput(name);
@@ -456,6 +659,32 @@ OgaResult* OGA_API_CALL OgaGenerator_GetLogits(OgaGenerator* generator, OgaTenso
   OGA_CATCH
 }
 
+OgaResult* OGA_API_CALL OgaGenerator_GetTokenLogProbs(OgaGenerator* generator, size_t top_n, OgaTensor** logprobs,
+                                                     OgaTensor** top_ids, OgaTensor** top_logprobs) {
+  OGA_TRY
+  auto result = generator->GetTokenLogProbs(top_n);
+  *logprobs = ReturnShared<OgaTensor>(result.logprobs);
+  if (top_ids)
+    *top_ids = result.top_ids ? ReturnShared<OgaTensor>(result.top_ids) : nullptr;
+  if (top_logprobs)
+    *top_logprobs = result.top_logprobs ? ReturnShared<OgaTensor>(result.top_logprobs) : nullptr;
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaGenerator_GetSequenceLogProbs(const OgaGenerator* generator, size_t index, OgaTensor** logprobs,
+                                                        OgaTensor** top_ids, OgaTensor** top_logprobs) {
+  OGA_TRY
+  auto result = generator->GetSequenceLogProbs(index);
+  *logprobs = ReturnShared<OgaTensor>(result.logprobs);
+  if (top_ids)
+    *top_ids = result.top_ids ? ReturnShared<OgaTensor>(result.top_ids) : nullptr;
+  if (top_logprobs)
+    *top_logprobs = result.top_logprobs ? ReturnShared<OgaTensor>(result.top_logprobs) : nullptr;
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OGA_API_CALL OgaGenerator_SetLogits(OgaGenerator* generator, OgaTensor* tensor) {
   OGA_TRY
   auto logits = generator->search_->GetLogits();
@@ -710,6 +939,108 @@ OgaResult* OGA_API_CALL OgaProcessorProcessAudios(const OgaMultiModalProcessor*
   OGA_CATCH
 }
 
+OgaResult* OGA_API_CALL OgaCreateWhisperStream(const OgaModel* model, const OgaGeneratorParams* params,
+                                               const int32_t* decoder_prompt, size_t decoder_prompt_count,
+                                               OgaWhisperStream** out) {
+  OGA_TRY
+  *out = ReturnUnique<OgaWhisperStream>(std::make_unique<Generators::WhisperStream>(*model, *params, std::span<const int32_t>(decoder_prompt, decoder_prompt_count)));
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaWhisperStreamSetChunking(OgaWhisperStream* stream, double chunk_seconds, double overlap_seconds) {
+  OGA_TRY
+  stream->SetChunking(chunk_seconds, overlap_seconds);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaWhisperStreamAppendAudio(OgaWhisperStream* stream, const float* samples, size_t sample_count) {
+  OGA_TRY
+  stream->AppendAudio(std::span<const float>(samples, sample_count));
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaWhisperStreamProcess(OgaWhisperStream* stream, const char** out_string) {
+  OGA_TRY
+  *out_string = AllocOgaString(stream->Process());
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaWhisperStreamProcessPartial(OgaWhisperStream* stream, const char** out_string) {
+  OGA_TRY
+  *out_string = AllocOgaString(stream->ProcessPartial());
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaWhisperStreamFlush(OgaWhisperStream* stream, const char** out_string) {
+  OGA_TRY
+  *out_string = AllocOgaString(stream->Flush());
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaCreateWhisperBatcher(const OgaModel* model, const OgaGeneratorParams* params,
+                                                size_t max_batch_size, OgaWhisperBatcher** out) {
+  OGA_TRY
+  *out = ReturnUnique<OgaWhisperBatcher>(std::make_unique<Generators::WhisperBatcher>(*model, *params, max_batch_size));
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaWhisperBatcherAdd(OgaWhisperBatcher* batcher, const float* samples, size_t sample_count,
+                                             const int32_t* decoder_prompt, size_t decoder_prompt_count, size_t* out_id) {
+  OGA_TRY
+  *out_id = batcher->Add(std::span<const float>(samples, sample_count), std::span<const int32_t>(decoder_prompt, decoder_prompt_count));
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaWhisperBatcherStep(OgaWhisperBatcher* batcher, size_t* out_result_count) {
+  OGA_TRY
+  *out_result_count = batcher->Step().size();
+  return nullptr;
+  OGA_CATCH
+}
+
+bool OGA_API_CALL OgaWhisperBatcherIsDone(const OgaWhisperBatcher* batcher) {
+  return batcher->IsDone();
+}
+
+OgaResult* OGA_API_CALL OgaWhisperBatcherGetResultId(const OgaWhisperBatcher* batcher, size_t index, size_t* out_id) {
+  OGA_TRY
+  *out_id = batcher->GetResult(index).id;
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaWhisperBatcherGetResultTokens(const OgaWhisperBatcher* batcher, size_t index,
+                                                         const int32_t** out_tokens, size_t* out_token_count) {
+  OGA_TRY
+  const auto& tokens = batcher->GetResult(index).tokens;
+  *out_tokens = tokens.data();
+  *out_token_count = tokens.size();
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaWhisperBatcherGetResultText(const OgaWhisperBatcher* batcher, size_t index, const char** out_string) {
+  OGA_TRY
+  *out_string = AllocOgaString(batcher->GetResult(index).text);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OGA_API_CALL OgaWhisperBatcherGetResultError(const OgaWhisperBatcher* batcher, size_t index, const char** out_string) {
+  OGA_TRY
+  *out_string = AllocOgaString(batcher->GetResult(index).error);
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OGA_API_CALL OgaProcessorProcessImagesAndAudios(const OgaMultiModalProcessor* processor, const char* prompt, const OgaImages* images,
                                                            const OgaAudios* audios, OgaNamedTensors** input_tensors) {
   OGA_TRY
@@ -781,6 +1112,20 @@ OgaResult* OgaUnloadAdapter(OgaAdapters* adapters, const char* adapter_name) {
   OGA_CATCH
 }
 
+OgaResult* OgaSetMaxLoadedAdapters(OgaAdapters* adapters, size_t max_loaded_adapters) {
+  OGA_TRY
+  adapters->SetMaxLoadedAdapters(max_loaded_adapters);
+  return nullptr;
+  OGA_CATCH
+}
+
+OgaResult* OgaIsAdapterLoaded(OgaAdapters* adapters, const char* adapter_name, bool* out) {
+  OGA_TRY
+  *out = adapters->IsAdapterLoaded(adapter_name);
+  return nullptr;
+  OGA_CATCH
+}
+
 OgaResult* OgaSetActiveAdapter(OgaGenerator* generator, OgaAdapters* adapters, const char* adapter_name) {
   OGA_TRY
   generator->state_->SetActiveAdapter(adapters, adapter_name);
@@ -792,12 +1137,17 @@ void OGA_API_CALL OgaDestroyStringArray(OgaStringArray* string_array) { delete s
 void OGA_API_CALL OgaDestroyResult(OgaResult* p) { delete p; }
 void OGA_API_CALL OgaDestroyString(const char* p) { delete p; }
 void OGA_API_CALL OgaDestroySequences(OgaSequences* p) { delete p; }
+void OGA_API_CALL OgaDestroyBatchPlan(OgaBatchPlan* p) { delete p; }
 void OGA_API_CALL OgaDestroyConfig(OgaConfig* p) { delete p; }
 void OGA_API_CALL OgaDestroyModel(OgaModel* p) { p->ExternalRelease(); }
+void OGA_API_CALL OgaDestroyModelData(OgaModelData* p) { p->ExternalRelease(); }
 void OGA_API_CALL OgaDestroyGeneratorParams(OgaGeneratorParams* p) { p->ExternalRelease(); }
 void OGA_API_CALL OgaDestroyGenerator(OgaGenerator* p) { delete p; }
+void OGA_API_CALL OgaDestroyGeneratorMetrics(OgaGeneratorMetrics* p) { delete p; }
 void OGA_API_CALL OgaDestroyTokenizer(OgaTokenizer* p) { p->ExternalRelease(); }
 void OGA_API_CALL OgaDestroyTokenizerStream(OgaTokenizerStream* p) { delete p; }
+void OGA_API_CALL OgaDestroyWhisperStream(OgaWhisperStream* p) { delete p; }
+void OGA_API_CALL OgaDestroyWhisperBatcher(OgaWhisperBatcher* p) { delete p; }
 void OGA_API_CALL OgaDestroyTensor(OgaTensor* p) { p->ExternalRelease(); }
 void OGA_API_CALL OgaDestroyMultiModalProcessor(OgaMultiModalProcessor* p) { p->ExternalRelease(); }
 void OGA_API_CALL OgaDestroyImages(OgaImages* p) { delete p; }
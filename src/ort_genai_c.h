@@ -78,6 +78,38 @@ typedef struct OgaNamedTensors OgaNamedTensors;
 typedef struct OgaMultiModalProcessor OgaMultiModalProcessor;
 typedef struct OgaAudios OgaAudios;
 typedef struct OgaStringArray OgaStringArray;
+// OgaBatchPlan splits the sequences of an OgaSequences into batches that need little padding, see OgaCreateBatchPlan.
+typedef struct OgaBatchPlan OgaBatchPlan;
+// OgaGeneratorMetrics is a snapshot of the timings and counters of an OgaGenerator, see OgaGenerator_GetMetrics.
+typedef struct OgaGeneratorMetrics OgaGeneratorMetrics;
+// OgaModelData holds model files in memory, so a model can be created without reading them from disk, see OgaCreateConfigFromModelData.
+typedef struct OgaModelData OgaModelData;
+// OgaWhisperStream transcribes audio with a whisper model as it arrives, in overlapping chunks, see OgaCreateWhisperStream.
+typedef struct OgaWhisperStream OgaWhisperStream;
+// OgaWhisperBatcher transcribes utterances queued by independent requests in shared batches, see OgaCreateWhisperBatcher.
+typedef struct OgaWhisperBatcher OgaWhisperBatcher;
+
+/**
+ * \brief Called by OgaGenerator_GenerateAsync on its worker thread after every generated token.
+ * \param[in] tokens The next token of every sequence, token_count is the batch size. Only valid during the call.
+ * \param[in] texts When a tokenizer was given, the decoded text of each token (token_count null terminated strings), otherwise null.
+ *                  Only valid during the call.
+ * \param[in] user_data The user_data given to OgaGenerator_GenerateAsync.
+ * \return true to continue generating, false to stop.
+ */
+typedef bool(OGA_API_CALL* OgaGenerateCallback)(const int32_t* tokens, size_t token_count, const char* const* texts, void* user_data);
+
+/**
+ * \brief Called by OgaGenerator_GenerateAsyncBatched on its worker thread with the tokens of several steps at once.
+ * \param[in] tokens The next tokens of step_count steps as [step_count, sequence_count], step by step. Only valid during the call.
+ * \param[in] step_count The steps in this call, the steps_per_callback given, or fewer for the last call.
+ * \param[in] sequence_count The tokens per step, the batch size times the number of beams.
+ * \param[in] texts When a tokenizer was given, the decoded text of the step_count tokens of each sequence (sequence_count
+ *                  null terminated strings), otherwise null. Only valid during the call.
+ * \param[in] user_data The user_data given to OgaGenerator_GenerateAsyncBatched.
+ * \return true to continue generating, false to stop.
+ */
+typedef bool(OGA_API_CALL* OgaGenerateBatchCallback)(const int32_t* tokens, size_t step_count, size_t sequence_count, const char* const* texts, void* user_data);
 typedef struct OgaAdapters OgaAdapters;
 
 //! @}
@@ -119,6 +151,24 @@ OGA_EXPORT OgaResult* OGA_API_CALL OgaSetLogString(const char* name, const char*
  */
 OGA_EXPORT OgaResult* OGA_API_CALL OgaSetLogCallback(void (*callback)(const char* string, size_t length));
 
+/**
+ * \brief Switches tracing on or off. Traced durations, counters and request spans are written in Chrome tracing format
+ *        (viewable with Perfetto UI) to the file named by the ORTGENAI_TRACE_FILE_PATH environment variable, or
+ *        ortgenai_trace.log. The file is created the first time tracing is switched on. Recording is lock free and
+ *        costs close to nothing while tracing is off, so it can be switched on in production to capture an incident.
+ * \param[in] enabled True to record events, false to stop.
+ * \return OgaResult containing the error message when the trace file could not be created, else nullptr.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaSetTracingEnabled(bool enabled);
+
+/**
+ * \brief Releases the CPU tensor blocks cached for reuse by models that enable cpu_allocator_pool in their genai_config.
+ *        The cache is also released when the last of those models is destroyed, this frees it sooner, e.g. when a
+ *        server goes idle. Blocks still in use are not affected.
+ * \return OgaResult containing the error message if the trim failed, else nullptr.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaTrimCpuAllocatorPool();
+
 /**
  * \param[in] result OgaResult to be destroyed.
  */
@@ -177,6 +227,53 @@ OGA_EXPORT size_t OGA_API_CALL OgaSequencesGetSequenceCount(const OgaSequences*
  */
 OGA_EXPORT const int32_t* OGA_API_CALL OgaSequencesGetSequenceData(const OgaSequences* sequences, size_t sequence_index);
 
+/**
+ * \brief Splits the sequences into batches that need as little padding as possible. Sequences of similar length
+ *        are batched together. Of the splits into the fewest batches, the one with the fewest pad tokens is used.
+ *        Batches are ordered shortest first; outputs go back to their original order through OgaBatchPlanGetBatchIndices.
+ * \param[in] sequences The sequences to split, such as prompts encoded by OgaTokenizerEncode.
+ * \param[in] max_batch_size The most sequences in one batch. 0 means no limit.
+ * \param[in] max_batch_tokens The most tokens in one batch once padded. 0 means no limit. A sequence longer than this
+ *            still gets a batch of its own.
+ * \param[out] out The created batch plan. Must be destroyed with OgaDestroyBatchPlan.
+ * \return OgaResult containing the error message if the creation failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaCreateBatchPlan(const OgaSequences* sequences, size_t max_batch_size, size_t max_batch_tokens, OgaBatchPlan** out);
+
+/**
+ * \param[in] batch_plan OgaBatchPlan to be destroyed.
+ */
+OGA_EXPORT void OGA_API_CALL OgaDestroyBatchPlan(OgaBatchPlan* batch_plan);
+
+/**
+ * \brief Returns the number of batches in the batch plan.
+ */
+OGA_EXPORT size_t OGA_API_CALL OgaBatchPlanGetBatchCount(const OgaBatchPlan* batch_plan);
+
+/**
+ * \brief Returns the number of sequences in the batch at the given index.
+ */
+OGA_EXPORT size_t OGA_API_CALL OgaBatchPlanGetBatchSize(const OgaBatchPlan* batch_plan, size_t batch_index);
+
+/**
+ * \brief Returns the indices into the planned OgaSequences of the sequences in the batch at the given index, in
+ *        ascending order. Row i of the batch is sequence indices[i]. The number of indices is given by
+ *        OgaBatchPlanGetBatchSize.
+ * \return The pointer to the indices. The pointer is valid until the OgaBatchPlan is destroyed.
+ */
+OGA_EXPORT const size_t* OGA_API_CALL OgaBatchPlanGetBatchIndices(const OgaBatchPlan* batch_plan, size_t batch_index);
+
+/**
+ * \brief Copies the sequences of the batch at the given index into a new OgaSequences, ready for
+ *        OgaGenerator_AppendTokenSequences on a generator with a matching batch_size.
+ * \param[in] batch_plan The batch plan.
+ * \param[in] sequences The same sequences the batch plan was created from.
+ * \param[in] batch_index Index of the batch.
+ * \param[out] out The sequences of the batch. Must be destroyed with OgaDestroySequences.
+ * \return OgaResult containing the error message if the batch index is out of range or the sequences do not match.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaBatchPlanGetBatchSequences(const OgaBatchPlan* batch_plan, const OgaSequences* sequences, size_t batch_index, OgaSequences** out);
+
 OGA_EXPORT OgaResult* OGA_API_CALL OgaLoadImage(const char* image_path, OgaImages** images);
 OGA_EXPORT OgaResult* OGA_API_CALL OgaLoadImages(const OgaStringArray* image_paths, OgaImages** images);
 
@@ -237,6 +334,52 @@ OGA_EXPORT OgaResult* OGA_API_CALL OgaRuntimeSettingsSetHandle(OgaRuntimeSetting
  */
 OGA_EXPORT OgaResult* OGA_API_CALL OgaCreateConfig(const char* config_path, OgaConfig** out);
 
+/**
+ * \brief Creates an empty OgaModelData, add the model files to it with OgaModelDataAddFile.
+ * \param[out] out The created model data.
+ * \return OgaResult containing the error message if the creation failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaCreateModelData(OgaModelData** out);
+
+/**
+ * \brief Memory maps an uncompressed tar archive of model files (genai_config.json, the ONNX models and their external
+ *        data). The files are named by their path inside the archive, which should match their path relative to the
+ *        config directory. The mapping stays open while the OgaModelData or any model created from it exists.
+ * \param[in] archive_path The path of the tar archive. The path is expected to be encoded in UTF-8.
+ * \param[out] out The created model data.
+ * \return OgaResult containing the error message if the archive could not be mapped or read.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaCreateModelDataFromArchive(const char* archive_path, OgaModelData** out);
+
+/**
+ * \brief Adds a model file held in memory. The data is not copied, it must stay valid while any model created from this
+ *        OgaModelData exists. Files must be added before the config is created.
+ * \param[in] model_data The model data to add the file to.
+ * \param[in] filename The name of the file relative to the config directory, like "model.onnx" or "model.onnx.data".
+ * \param[in] data The contents of the file.
+ * \param[in] length The length of the contents in bytes.
+ * \return OgaResult containing the error message if the file could not be added.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaModelDataAddFile(OgaModelData* model_data, const char* filename, const void* data, size_t length);
+
+/**
+ * \brief Destroys the given OgaModelData. Models and configs created from it keep the data they need.
+ * \param[in] model_data OgaModelData to be destroyed.
+ */
+OGA_EXPORT void OGA_API_CALL OgaDestroyModelData(OgaModelData* model_data);
+
+/**
+ * \brief Creates an OgaConfig whose files are read from the given model data when it holds them, including
+ *        genai_config.json, and from the configuration directory otherwise. ONNX models are loaded from memory and their
+ *        external data is referenced in place. Files that are not in the model data, like the tokenizer files, are
+ *        still read from the configuration directory.
+ * \param[in] config_path The path to the configuration directory. The path is expected to be encoded in UTF-8.
+ * \param[in] model_data The model files held in memory.
+ * \param[out] out The created config.
+ * \return OgaResult containing the error message if the creation of the config failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaCreateConfigFromModelData(const char* config_path, const OgaModelData* model_data, OgaConfig** out);
+
 /**
  * \brief Clear the list of providers in the given config
  * \param[in] config The config to clear the providers from.
@@ -340,6 +483,33 @@ OGA_EXPORT void OGA_API_CALL OgaDestroyGeneratorParams(OgaGeneratorParams* gener
 
 OGA_EXPORT OgaResult* OGA_API_CALL OgaGeneratorParamsSetSearchNumber(OgaGeneratorParams* generator_params, const char* name, double value);
 OGA_EXPORT OgaResult* OGA_API_CALL OgaGeneratorParamsSetSearchBool(OgaGeneratorParams* generator_params, const char* name, bool value);
+
+/**
+ * \brief Overrides a search option for a single row of the batch, so rows with different sampling settings can share a batch.
+ *        Only do_sample, top_k, top_p, temperature, repetition_penalty, min_length, max_length and random_seed can be set
+ *        per row. A row's max_length cannot exceed the batch max_length. Only supported by the CPU greedy search, creating a
+ *        generator with per row options for beam search or another device fails.
+ * \param[in] generator_params The generator params to set the option on.
+ * \param[in] row The index of the row in the batch, must be less than batch_size when the generator is created.
+ * \param[in] name The name of the search option.
+ * \param[in] value The value of the search option.
+ * \return OgaResult containing the error message if the option can not be set per row.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGeneratorParamsSetRowSearchNumber(OgaGeneratorParams* generator_params, size_t row, const char* name, double value);
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGeneratorParamsSetRowSearchBool(OgaGeneratorParams* generator_params, size_t row, const char* name, bool value);
+/**
+ * \brief Adds a stop sequence. A row is finished as soon as it generates these tokens in order, the same as when it
+ *        generates an EOS token. Any number of stop sequences can be added, they are all matched together as tokens are
+ *        generated, including matches spread over several steps. Tokens appended by the user are never matched.
+ *        A stop string can tokenize differently depending on the text around it, so add each tokenization to catch.
+ *        In beam search a beam that completes a stop sequence becomes a finished hypothesis, which keeps the stop tokens.
+ *        Only supported by the CPU search, creating a generator with stop sequences on another device fails.
+ * \param[in] generator_params The generator params to add the stop sequence to.
+ * \param[in] tokens The token ids of the stop sequence.
+ * \param[in] token_count The number of tokens in the stop sequence, must be greater than 0.
+ * \return OgaResult containing the error message if the stop sequence is empty.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGeneratorParamsAddStopSequence(OgaGeneratorParams* generator_params, const int32_t* tokens, size_t token_count);
 OGA_EXPORT OgaResult* OGA_API_CALL OgaGeneratorParamsTryGraphCaptureWithMaxBatchSize(OgaGeneratorParams* generator_params, int32_t max_batch_size);
 
 OGA_EXPORT OgaResult* OGA_API_CALL OgaGeneratorParamsSetInputs(OgaGeneratorParams* generator_params, const OgaNamedTensors* named_tensors);
@@ -422,6 +592,73 @@ OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GetNextTokens(const OgaGenerator
 
 OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_SetRuntimeOption(OgaGenerator* generator, const char* key, const char* value);
 
+/**
+ * \brief Generates tokens on an internal worker thread until the generator is done, calling the callback with the tokens
+ *        of every step. Returns immediately. Generation stops early when the callback returns false or when the session is
+ *        terminated with OgaGenerator_SetRuntimeOption(generator, "terminate_session", "1").
+ *        Other than OgaGenerator_SetRuntimeOption, the generator must not be used until OgaGenerator_WaitForGenerate returns.
+ * \param[in] generator The generator to generate with. Its input must have been appended already.
+ * \param[in] tokenizer Optional, when not null each token is also decoded with a tokenizer stream per sequence.
+ * \param[in] callback The callback, see OgaGenerateCallback.
+ * \param[in] user_data Passed unchanged to the callback.
+ * \return OgaResult containing the error message if generation could not be started.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GenerateAsync(OgaGenerator* generator, const OgaTokenizer* tokenizer, OgaGenerateCallback callback, void* user_data);
+
+/**
+ * \brief Like OgaGenerator_GenerateAsync, but calls the callback once every steps_per_callback steps with the tokens of
+ *        all those steps, so a binding crosses into its own runtime once per chunk instead of once per token. The tokens
+ *        of the steps left when generation ends are passed in a last, shorter call, unless the callback stopped it.
+ * \param[in] generator The generator to generate with. Its input must have been appended already.
+ * \param[in] tokenizer Optional, when not null the tokens are also decoded with a tokenizer stream per sequence.
+ * \param[in] steps_per_callback The steps to collect before each call, at least 1.
+ * \param[in] callback The callback, see OgaGenerateBatchCallback.
+ * \param[in] user_data Passed unchanged to the callback.
+ * \return OgaResult containing the error message if generation could not be started.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GenerateAsyncBatched(OgaGenerator* generator, const OgaTokenizer* tokenizer, size_t steps_per_callback,
+                                                                    OgaGenerateBatchCallback callback, void* user_data);
+
+/**
+ * \brief Waits for the generation started by OgaGenerator_GenerateAsync or OgaGenerator_GenerateAsyncBatched to finish.
+ * \param[in] generator The generator given to OgaGenerator_GenerateAsync.
+ * \return OgaResult containing the error message if generation failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_WaitForGenerate(OgaGenerator* generator);
+
+/**
+ * \brief Takes a snapshot of the metrics the generator has collected since it was created: token counts, time to first
+ *        token, prefill and decode times, time spent running the model and in the search, and the kv cache size.
+ *        Times are in seconds. When using OgaGenerator_GenerateAsync, call this after OgaGenerator_WaitForGenerate.
+ * \param[in] generator The generator to get the metrics of.
+ * \param[out] out The snapshot, destroy it with OgaDestroyGeneratorMetrics.
+ * \return OgaResult containing the error message if the metrics could not be read.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GetMetrics(const OgaGenerator* generator, OgaGeneratorMetrics** out);
+
+/**
+ * \brief Destroys the given OgaGeneratorMetrics.
+ * \param[in] metrics OgaGeneratorMetrics to be destroyed.
+ */
+OGA_EXPORT void OGA_API_CALL OgaDestroyGeneratorMetrics(OgaGeneratorMetrics* metrics);
+
+/**
+ * \brief Gets the value of a metric by name, like "time_to_first_token" or "tokens_per_second".
+ * \param[in] metrics The metrics to read.
+ * \param[in] name The name of the metric, OgaGeneratorMetricsGetNames lists them.
+ * \param[out] out The value of the metric.
+ * \return OgaResult containing the error message if there is no metric with that name.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGeneratorMetricsGetValue(const OgaGeneratorMetrics* metrics, const char* name, double* out);
+
+/**
+ * \brief Gets the names of every metric.
+ * \param[in] metrics The metrics to read.
+ * \param[out] out The names, destroy it with OgaDestroyStringArray.
+ * \return OgaResult containing the error message if the names could not be returned.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGeneratorMetricsGetNames(const OgaGeneratorMetrics* metrics, OgaStringArray** out);
+
 /**
  * \brief Rewinds the generator to the given length. This is useful when the user wants to rewind the generator to a specific length
  *        and continue generating from that point.
@@ -450,6 +687,37 @@ OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GetOutput(const OgaGenerator* ge
  */
 OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GetLogits(OgaGenerator* generator, OgaTensor** out);
 
+/**
+ * \brief Scores the appended sequences: returns the log probability of every token given the tokens before it, all computed
+ *        from a single forward pass. Append the whole prompt + continuation with one AppendTokens/AppendTokenSequences call on
+ *        a new generator (or after rewinding to 0), then call this before generating any token. A sequence spans from its
+ *        first to its last token that is not the pad token. Its first token and the padding around it are not scored: their
+ *        log probability is 0 and their top ids are -1. Pad tokens within the sequence are scored.
+ * \param[in] generator The generator to score.
+ * \param[in] top_n The number of most likely tokens to also return for each position. 0 to only return the log probabilities.
+ * \param[out] logprobs float32 OgaTensor on CPU of shape [batch_size, sequence_length].
+ * \param[out] top_ids int32 OgaTensor on CPU of shape [batch_size, sequence_length, top_n], best first. Can be null if top_n is 0.
+ * \param[out] top_logprobs float32 OgaTensor on CPU matching top_ids. Can be null if top_n is 0.
+ * \return OgaResult containing the error message if the scoring failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GetTokenLogProbs(OgaGenerator* generator, size_t top_n, OgaTensor** logprobs,
+                                                                 OgaTensor** top_ids, OgaTensor** top_logprobs);
+
+/**
+ * \brief Returns the log probabilities the search recorded while generating the given sequence. Requires the "logprobs" or
+ *        "top_logprobs" search option to be set before the generator is created (CPU search only). Positions that were not
+ *        generated (prompt or appended tokens) have a log probability of 0 and top ids of -1. For beam search the index is
+ *        the index of a finalized sequence as in OgaGenerator_GetSequenceData, and like it this finalizes the search.
+ * \param[in] generator The generator that generated the sequence.
+ * \param[in] index The index of the sequence.
+ * \param[out] logprobs float32 OgaTensor on CPU of shape [1, sequence_length] with the log probability of each selected token.
+ * \param[out] top_ids int32 OgaTensor on CPU of shape [1, sequence_length, top_logprobs], best first. Null if top_logprobs is 0.
+ * \param[out] top_logprobs float32 OgaTensor on CPU matching top_ids. Null if top_logprobs is 0.
+ * \return OgaResult containing the error message if the logprobs were not recorded.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaGenerator_GetSequenceLogProbs(const OgaGenerator* generator, size_t index, OgaTensor** logprobs,
+                                                                    OgaTensor** top_ids, OgaTensor** top_logprobs);
+
 /**
  * \brief Sets the logits to the generator. This is useful when the user wants to set the logits to a specific value
  *        for example when doing guided generation.
@@ -523,6 +791,138 @@ OGA_EXPORT OgaResult* OGA_API_CALL OgaProcessorProcessImagesAndAudios(const OgaM
 OGA_EXPORT OgaResult* OGA_API_CALL OgaTokenizerDecode(const OgaTokenizer*, const int32_t* tokens, size_t token_count, const char** out_string);
 OGA_EXPORT OgaResult* OGA_API_CALL OgaProcessorDecode(const OgaMultiModalProcessor*, const int32_t* tokens, size_t token_count, const char** out_string);
 
+/**
+ * \brief Creates a stream that transcribes audio with a whisper model as it is appended. The audio is cut into
+ *        overlapping chunks (30 seconds with 5 seconds of overlap by default), each chunk is decoded with the end of
+ *        the transcript so far as its prompt context, and the text repeated in the overlap is dropped.
+ * \param[in] model The whisper model.
+ * \param[in] params The search options used for every chunk. The batch size is always 1.
+ * \param[in] decoder_prompt The task prompt tokens, like <|startoftranscript|><|en|><|transcribe|><|notimestamps|>.
+ * \param[in] decoder_prompt_count The number of decoder prompt tokens.
+ * \param[out] out The created stream.
+ * \return OgaResult containing the error message if the stream could not be created.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaCreateWhisperStream(const OgaModel* model, const OgaGeneratorParams* params,
+                                                          const int32_t* decoder_prompt, size_t decoder_prompt_count,
+                                                          OgaWhisperStream** out);
+
+/**
+ * \brief Sets the length of the chunks and how much consecutive chunks overlap. Shorter chunks give text sooner at
+ *        some cost in accuracy. Only allowed before audio is appended or right after OgaWhisperStreamFlush.
+ * \param[in] stream The stream.
+ * \param[in] chunk_seconds The length of a chunk, more than 0 and at most 30.
+ * \param[in] overlap_seconds The audio at the end of a chunk that starts the next one again, less than chunk_seconds.
+ * \return OgaResult containing the error message if the values are out of range.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaWhisperStreamSetChunking(OgaWhisperStream* stream, double chunk_seconds, double overlap_seconds);
+
+/**
+ * \brief Appends audio to the stream, it is transcribed by the next OgaWhisperStreamProcess or OgaWhisperStreamFlush.
+ * \param[in] stream The stream.
+ * \param[in] samples 16 kHz mono samples in [-1, 1].
+ * \param[in] sample_count The number of samples.
+ * \return OgaResult containing the error message if the audio could not be appended.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaWhisperStreamAppendAudio(OgaWhisperStream* stream, const float* samples, size_t sample_count);
+
+/**
+ * \brief Transcribes every complete chunk of the audio appended so far.
+ * \param[in] stream The stream.
+ * \param[out] out_string The text the chunks add to the transcript, empty if no chunk was complete. Must be freed with OgaDestroyString.
+ * \return OgaResult containing the error message if the transcription failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaWhisperStreamProcess(OgaWhisperStream* stream, const char** out_string);
+
+/**
+ * \brief Transcribes the audio appended after the last complete chunk, so a live stream gets text before a whole chunk
+ *        is buffered. The text is not final and is not added to the transcript: the chunk that audio ends up in is
+ *        transcribed again by OgaWhisperStreamProcess or OgaWhisperStreamFlush, whose text replaces it.
+ * \param[in] stream The stream.
+ * \param[out] out_string The text of the audio after the last complete chunk, empty if there is none. Must be freed with OgaDestroyString.
+ * \return OgaResult containing the error message if the transcription failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaWhisperStreamProcessPartial(OgaWhisperStream* stream, const char** out_string);
+
+/**
+ * \brief Transcribes the rest of the audio appended, at the end of a recording or utterance. The stream then starts
+ *        over with no prompt context.
+ * \param[in] stream The stream.
+ * \param[out] out_string The text the rest of the audio adds to the transcript. Must be freed with OgaDestroyString.
+ * \return OgaResult containing the error message if the transcription failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaWhisperStreamFlush(OgaWhisperStream* stream, const char** out_string);
+
+OGA_EXPORT void OGA_API_CALL OgaDestroyWhisperStream(OgaWhisperStream* stream);
+
+/**
+ * \brief Creates a batcher that transcribes utterances of independent requests with a whisper model in shared batches.
+ *        A batch takes the oldest queued utterances with the same decoder prompt length and runs the feature extraction
+ *        and the encoder once for all of them. Each utterance is returned as soon as its row finishes, and the slots of
+ *        finished rows are filled from the queue when the next batch starts.
+ * \param[in] model The whisper model.
+ * \param[in] params The search options used for every batch. The batch size is ignored. Only greedy search on the CPU
+ *            is supported.
+ * \param[in] max_batch_size The most utterances in one batch, at least 1.
+ * \param[out] out The created batcher.
+ * \return OgaResult containing the error message if the batcher could not be created.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaCreateWhisperBatcher(const OgaModel* model, const OgaGeneratorParams* params,
+                                                           size_t max_batch_size, OgaWhisperBatcher** out);
+
+/**
+ * \brief Queues an utterance. Can be called from any thread, also while another thread runs OgaWhisperBatcherStep.
+ * \param[in] batcher The batcher.
+ * \param[in] samples 16 kHz mono samples in [-1, 1], at most 30 seconds of them.
+ * \param[in] sample_count The number of samples.
+ * \param[in] decoder_prompt The task prompt tokens, like <|startoftranscript|><|en|><|transcribe|><|notimestamps|>.
+ * \param[in] decoder_prompt_count The number of decoder prompt tokens.
+ * \param[out] out_id The id the utterance's result will have.
+ * \return OgaResult containing the error message if the utterance is empty or too long.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaWhisperBatcherAdd(OgaWhisperBatcher* batcher, const float* samples, size_t sample_count,
+                                                        const int32_t* decoder_prompt, size_t decoder_prompt_count, size_t* out_id);
+
+/**
+ * \brief Starts a batch if none is running and utterances are queued, then generates the next token of the batch.
+ *        The results of the utterances that finished are read with OgaWhisperBatcherGetResult*, until the next step.
+ * \param[in] batcher The batcher.
+ * \param[out] out_result_count The number of utterances that finished during this step. When the batch fails, its
+ *             unfinished utterances are among them, with the error given by OgaWhisperBatcherGetResultError.
+ * \return OgaResult containing the error message if the step failed.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaWhisperBatcherStep(OgaWhisperBatcher* batcher, size_t* out_result_count);
+
+/**
+ * \brief Returns true when no utterance is queued and no batch is running.
+ */
+OGA_EXPORT bool OGA_API_CALL OgaWhisperBatcherIsDone(const OgaWhisperBatcher* batcher);
+
+/**
+ * \brief Returns the id, given by OgaWhisperBatcherAdd, of a result of the last step.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaWhisperBatcherGetResultId(const OgaWhisperBatcher* batcher, size_t index, size_t* out_id);
+
+/**
+ * \brief Returns the tokens generated for a result of the last step, without the decoder prompt and the EOS.
+ * \param[out] out_tokens The tokens. The pointer is valid until the next step.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaWhisperBatcherGetResultTokens(const OgaWhisperBatcher* batcher, size_t index,
+                                                                    const int32_t** out_tokens, size_t* out_token_count);
+
+/**
+ * \brief Returns the text of a result of the last step, the special and timestamp tokens are left out.
+ * \param[out] out_string The text. Must be freed with OgaDestroyString.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaWhisperBatcherGetResultText(const OgaWhisperBatcher* batcher, size_t index, const char** out_string);
+
+/**
+ * \brief Returns why a result of the last step failed, its tokens and text are empty then.
+ * \param[out] out_string The error message, empty if the utterance was transcribed. Must be freed with OgaDestroyString.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaWhisperBatcherGetResultError(const OgaWhisperBatcher* batcher, size_t index, const char** out_string);
+
+OGA_EXPORT void OGA_API_CALL OgaDestroyWhisperBatcher(OgaWhisperBatcher* batcher);
+
 /**
  * @brief Applies a chat template to input messages
  *
@@ -700,6 +1100,23 @@ OGA_EXPORT OgaResult* OGA_API_CALL OgaLoadAdapter(OgaAdapters* adapters, const c
  */
 OGA_EXPORT OgaResult* OGA_API_CALL OgaUnloadAdapter(OgaAdapters* adapters, const char* adapter_name);
 
+/**
+ * \brief Limits the number of adapters kept resident in memory by the OgaAdapters object.
+          Adapters that are not active on any generator are evicted in least recently used order and are
+          transparently reloaded from their file the next time they are set as active.
+ * \param[in] adapters The OgaAdapters object.
+ * \param[in] max_loaded_adapters The maximum number of resident adapters. 0 means no limit (default).
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaSetMaxLoadedAdapters(OgaAdapters* adapters, size_t max_loaded_adapters);
+
+/**
+ * \brief Returns whether the adapter with the given name is currently resident in memory.
+ * \param[in] adapters The OgaAdapters object.
+ * \param[in] adapter_name The name of the adapter.
+ * \param[out] out True if the adapter is registered and resident.
+ */
+OGA_EXPORT OgaResult* OGA_API_CALL OgaIsAdapterLoaded(OgaAdapters* adapters, const char* adapter_name, bool* out);
+
 /**
  * \brief Sets the adapter with the given adapter name as active for the given OgaGenerator object.
  * \param[in] generator The OgaGenerator object to set the active adapter.
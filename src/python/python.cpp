@@ -7,6 +7,7 @@
 #include "../models/onnxruntime_api.h"
 #include "../ort_genai.h"
 #include <iostream>
+#include <map>
 
 using namespace pybind11::literals;
 
@@ -201,6 +202,24 @@ struct PyGeneratorParams {
     }
   }
 
+  void SetRowSearchOptions(size_t row, const pybind11::kwargs& dict) {
+    for (auto& entry : dict) {
+      auto name = entry.first.cast<std::string>();
+      if (pybind11::isinstance<pybind11::float_>(entry.second)) {
+        params_->SetRowSearchOption(row, name.c_str(), entry.second.cast<double>());
+      } else if (pybind11::isinstance<pybind11::bool_>(entry.second)) {
+        params_->SetRowSearchOptionBool(row, name.c_str(), entry.second.cast<bool>());
+      } else if (pybind11::isinstance<pybind11::int_>(entry.second)) {
+        params_->SetRowSearchOption(row, name.c_str(), entry.second.cast<int>());
+      } else
+        throw std::runtime_error("Unknown search option type, can be float/bool/int:" + name);
+    }
+  }
+
+  void AddStopSequence(pybind11::array_t<int32_t> tokens) {
+    params_->AddStopSequence(ToSpan(tokens));
+  }
+
   void TryGraphCaptureWithMaxBatchSize(pybind11::int_ max_batch_size) {
     std::cerr << "TryGraphCaptureWithMaxBatchSize is deprecated and will be removed in a future release" << std::endl;
   }
@@ -217,6 +236,12 @@ struct PyGenerator {
     generator_ = OgaGenerator::Create(model, *params.params_);
   }
 
+  ~PyGenerator() {
+    // Destroying the generator waits for a generate_async still running, whose callback needs the GIL
+    pybind11::gil_scoped_release release;
+    generator_.reset();
+  }
+
   pybind11::array_t<int32_t> GetNextTokens() {
     return ToPython(generator_->GetNextTokens());
   }
@@ -241,6 +266,22 @@ struct PyGenerator {
     return ToNumpy(*generator_->GetLogits());
   }
 
+  pybind11::tuple GetTokenLogProbs(size_t top_n) {
+    std::unique_ptr<OgaTensor> logprobs, top_ids, top_logprobs;
+    generator_->GetTokenLogProbs(top_n, logprobs, top_ids, top_logprobs);
+    if (top_n == 0)
+      return pybind11::make_tuple(ToNumpy(*logprobs), pybind11::none(), pybind11::none());
+    return pybind11::make_tuple(ToNumpy(*logprobs), ToNumpy(*top_ids), ToNumpy(*top_logprobs));
+  }
+
+  pybind11::tuple GetSequenceLogProbs(size_t index) {
+    std::unique_ptr<OgaTensor> logprobs, top_ids, top_logprobs;
+    generator_->GetSequenceLogProbs(index, logprobs, top_ids, top_logprobs);
+    if (!top_ids)
+      return pybind11::make_tuple(ToNumpy(*logprobs), pybind11::none(), pybind11::none());
+    return pybind11::make_tuple(ToNumpy(*logprobs), ToNumpy(*top_ids), ToNumpy(*top_logprobs));
+  }
+
   void SetLogits(pybind11::array_t<float> new_logits) {
     generator_->SetLogits(*ToOgaTensor(new_logits, false));
   }
@@ -249,6 +290,47 @@ struct PyGenerator {
     generator_->GenerateNextToken();
   }
 
+  // Generates up to max_new_tokens tokens per sequence (0 for no limit) without holding the GIL, so other Python threads
+  // keep running. Returns the next tokens of every step as a [step_count, batch_size] array, empty once done.
+  pybind11::array_t<int32_t> Generate(size_t max_new_tokens) {
+    std::vector<int32_t> tokens;
+    size_t step_count = 0, token_count = 0;
+    {
+      pybind11::gil_scoped_release release;
+      while (!generator_->IsDone() && (max_new_tokens == 0 || step_count < max_new_tokens)) {
+        generator_->GenerateNextToken();
+        auto next_tokens = generator_->GetNextTokens();
+        tokens.insert(tokens.end(), next_tokens.begin(), next_tokens.end());
+        token_count = next_tokens.size();
+        step_count++;
+      }
+    }
+    return pybind11::array_t<int32_t>({step_count, token_count}, tokens.data());
+  }
+
+  // Generates on a worker thread and returns immediately. Every tokens_per_callback steps, callback(tokens, texts) is
+  // called with the next tokens of those steps as a [step_count, batch_size] array and, given a tokenizer, the decoded
+  // text of each sequence (None otherwise). The callback returns False to stop. Other than through the callback, the
+  // generator must not be used until wait_for_generate returns.
+  void GenerateAsync(pybind11::function callback, size_t tokens_per_callback, const OgaTokenizer* tokenizer) {
+    // Started first, as it throws while a generation is running and that one's callback and error must be kept. The
+    // worker only reads the members below while holding the GIL, so not before this returns.
+    generator_->GenerateAsyncBatched(tokenizer, tokens_per_callback, &PyGenerator::OnGeneratedTokens, this);
+    generate_callback_ = std::move(callback);
+    generate_error_.clear();
+  }
+
+  // Rethrows the error that stopped generate_async, including one raised by the callback
+  void WaitForGenerate() {
+    {
+      pybind11::gil_scoped_release release;
+      generator_->WaitForGenerate();
+    }
+    generate_callback_ = {};
+    if (!generate_error_.empty())
+      throw std::runtime_error(generate_error_);
+  }
+
   void RewindTo(size_t new_length) {
     generator_->RewindTo(new_length);
   }
@@ -257,12 +339,63 @@ struct PyGenerator {
     return generator_->IsDone();
   }
 
+  // Metric name to value, times are in seconds
+  std::map<std::string, double> GetMetrics() const {
+    auto metrics = generator_->GetMetrics();
+    auto names = metrics->GetNames();
+    std::map<std::string, double> values;
+    for (size_t i = 0; i < names->Count(); i++)
+      values[names->Get(i)] = metrics->GetValue(names->Get(i));
+    return values;
+  }
+
   void SetActiveAdapter(OgaAdapters& adapters, const std::string& adapter_name) {
     generator_->SetActiveAdapter(adapters, adapter_name.c_str());
   }
 
  private:
+  static bool OGA_API_CALL OnGeneratedTokens(const int32_t* tokens, size_t step_count, size_t sequence_count, const char* const* texts, void* user_data) {
+    auto& self = *static_cast<PyGenerator*>(user_data);
+    pybind11::gil_scoped_acquire gil;
+    try {
+      pybind11::object text_list = pybind11::none();
+      if (texts) {
+        pybind11::list list;
+        for (size_t i = 0; i < sequence_count; i++)
+          list.append(pybind11::str(texts[i]));
+        text_list = std::move(list);
+      }
+      auto result = self.generate_callback_(pybind11::array_t<int32_t>({step_count, sequence_count}, tokens), text_list);
+      return result.is_none() || result.cast<bool>();
+    } catch (const std::exception& e) {
+      // An exception must not cross the C callback, it stops the generation and is raised by wait_for_generate
+      self.generate_error_ = e.what();
+      return false;
+    }
+  }
+
   std::unique_ptr<OgaGenerator> generator_;
+  pybind11::function generate_callback_;  // Set from generate_async until wait_for_generate
+  std::string generate_error_;
+};
+
+// Python iterator over the tokens of a generator, each item is the [step_count, batch_size] array of up to chunk_size steps
+struct PyGenerateStream {
+  PyGenerateStream(PyGenerator& generator, size_t chunk_size) : generator_{generator}, chunk_size_{chunk_size} {
+    if (chunk_size_ == 0)
+      throw std::runtime_error("chunk_size must be 1 or greater");
+  }
+
+  pybind11::array_t<int32_t> Next() {
+    auto tokens = generator_.Generate(chunk_size_);
+    if (tokens.shape(0) == 0)
+      throw pybind11::stop_iteration();
+    return tokens;
+  }
+
+ private:
+  PyGenerator& generator_;
+  size_t chunk_size_;
 };
 
 void SetLogOptions(const pybind11::kwargs& dict) {
@@ -322,6 +455,8 @@ PYBIND11_MODULE(onnxruntime_genai, m) {
       .def("set_model_input", &PyGeneratorParams::SetModelInput)
       .def("try_graph_capture_with_max_batch_size", &PyGeneratorParams::TryGraphCaptureWithMaxBatchSize)
       .def("set_search_options", &PyGeneratorParams::SetSearchOptions)  // See config.h 'struct Search' for the options
+      .def("set_row_search_options", &PyGeneratorParams::SetRowSearchOptions)
+      .def("add_stop_sequence", &PyGeneratorParams::AddStopSequence)
       .def("set_guidance", &PyGeneratorParams::SetGuidance);
 
   pybind11::class_<OgaTokenizerStream>(m, "TokenizerStream")
@@ -400,6 +535,10 @@ PYBIND11_MODULE(onnxruntime_genai, m) {
           "device_type", [](const OgaModel& model) -> std::string { return model.GetDeviceType().p_; }, "The device type the model is running on")
       .def("create_multimodal_processor", [](const OgaModel& model) { return OgaMultiModalProcessor::Create(model); });
 
+  pybind11::class_<PyGenerateStream>(m, "GenerateStream")
+      .def("__iter__", [](pybind11::object self) { return self; })
+      .def("__next__", &PyGenerateStream::Next);
+
   pybind11::class_<PyGenerator>(m, "Generator")
       .def(pybind11::init<const OgaModel&, PyGeneratorParams&>())
       .def("is_done", &PyGenerator::IsDone)
@@ -407,11 +546,21 @@ PYBIND11_MODULE(onnxruntime_genai, m) {
       .def("append_tokens", pybind11::overload_cast<pybind11::array_t<int32_t>&>(&PyGenerator::AppendTokens))
       .def("append_tokens", pybind11::overload_cast<OgaTensor&>(&PyGenerator::AppendTokens))
       .def("get_logits", &PyGenerator::GetLogits)
+      .def("get_token_logprobs", &PyGenerator::GetTokenLogProbs, pybind11::arg("top_n") = 0)
+      .def("get_sequence_logprobs", &PyGenerator::GetSequenceLogProbs)
       .def("set_logits", &PyGenerator::SetLogits)
       .def("generate_next_token", &PyGenerator::GenerateNextToken)
+      .def("generate", &PyGenerator::Generate, pybind11::arg("max_new_tokens") = 0)
+      .def(
+          "generate_stream", [](PyGenerator& generator, size_t chunk_size) { return PyGenerateStream(generator, chunk_size); },
+          pybind11::arg("chunk_size") = 1, pybind11::keep_alive<0, 1>())
+      .def("generate_async", &PyGenerator::GenerateAsync, pybind11::arg("callback"), pybind11::arg("tokens_per_callback") = 1,
+           pybind11::arg("tokenizer") = nullptr)
+      .def("wait_for_generate", &PyGenerator::WaitForGenerate)
       .def("rewind_to", &PyGenerator::RewindTo)
       .def("get_next_tokens", &PyGenerator::GetNextTokens)
       .def("get_sequence", &PyGenerator::GetSequence)
+      .def("get_metrics", &PyGenerator::GetMetrics)
       .def("set_active_adapter", &PyGenerator::SetActiveAdapter);
 
   pybind11::class_<OgaImages>(m, "Images")
@@ -488,15 +637,77 @@ PYBIND11_MODULE(onnxruntime_genai, m) {
         return processor.Decode(ToSpan(tokens)).p_;
       });
 
+  pybind11::class_<OgaWhisperStream>(m, "WhisperStream")
+      .def(pybind11::init([](const OgaModel& model, const PyGeneratorParams& params, pybind11::array_t<int32_t> decoder_prompt) {
+        return OgaWhisperStream::Create(model, params, ToSpan(decoder_prompt));
+      }))
+      .def("set_chunking", &OgaWhisperStream::SetChunking, pybind11::arg("chunk_seconds"), pybind11::arg("overlap_seconds"))
+      .def("append_audio", [](OgaWhisperStream& stream, pybind11::array_t<float> samples) {
+        stream.AppendAudio(ToSpan(samples));
+      })
+      .def("process", [](OgaWhisperStream& stream) -> std::string { return stream.Process().p_; })
+      .def("process_partial", [](OgaWhisperStream& stream) -> std::string { return stream.ProcessPartial().p_; })
+      .def("flush", [](OgaWhisperStream& stream) -> std::string { return stream.Flush().p_; });
+
+  pybind11::class_<OgaWhisperBatcher>(m, "WhisperBatcher")
+      .def(pybind11::init([](const OgaModel& model, const PyGeneratorParams& params, size_t max_batch_size) {
+        return OgaWhisperBatcher::Create(model, params, max_batch_size);
+      }))
+      .def("add", [](OgaWhisperBatcher& batcher, pybind11::array_t<float> samples, pybind11::array_t<int32_t> decoder_prompt) {
+        return batcher.Add(ToSpan(samples), ToSpan(decoder_prompt));
+      })
+      .def("is_done", &OgaWhisperBatcher::IsDone)
+      // Returns the utterances that finished during this step as a list of (id, tokens, text, error), error is None
+      // unless the utterance failed. Other threads can add utterances while the step runs.
+      .def("step", [](OgaWhisperBatcher& batcher) {
+        size_t count;
+        {
+          pybind11::gil_scoped_release release;
+          count = batcher.Step();
+        }
+        pybind11::list results;
+        for (size_t i = 0; i < count; i++) {
+          auto tokens = batcher.GetResultTokens(i);
+          std::string error = batcher.GetResultError(i).p_;
+          results.append(pybind11::make_tuple(batcher.GetResultId(i),
+                                              pybind11::array_t<int32_t>(tokens.size(), tokens.data()),
+                                              std::string(batcher.GetResultText(i).p_),
+                                              error.empty() ? pybind11::none() : pybind11::object(pybind11::str(error))));
+        }
+        return results;
+      });
+
   pybind11::class_<OgaAdapters>(m, "Adapters")
       .def(pybind11::init([](OgaModel& model) {
         return OgaAdapters::Create(model);
       }))
       .def("unload", &OgaAdapters::UnloadAdapter)
-      .def("load", &OgaAdapters::LoadAdapter);
+      .def("load", &OgaAdapters::LoadAdapter)
+      .def("set_max_loaded", &OgaAdapters::SetMaxLoadedAdapters)
+      .def("is_loaded", [](OgaAdapters& adapters, const std::string& adapter_name) {
+        return adapters.IsAdapterLoaded(adapter_name.c_str());
+      });
+
+  pybind11::class_<OgaBatchPlan>(m, "BatchPlan")
+      .def(pybind11::init([](const std::vector<pybind11::array_t<int32_t>>& sequences, size_t max_batch_size, size_t max_batch_tokens) {
+             auto oga_sequences = OgaSequences::Create();
+             for (const auto& sequence : sequences)
+               oga_sequences->Append(ToSpan(sequence));
+             return OgaBatchPlan::Create(*oga_sequences, max_batch_size, max_batch_tokens);
+           }),
+           pybind11::arg("sequences"), pybind11::arg("max_batch_size") = 0, pybind11::arg("max_batch_tokens") = 0)
+      .def("__len__", &OgaBatchPlan::BatchCount)
+      .def("__getitem__", [](const OgaBatchPlan& plan, size_t batch_index) {
+        if (batch_index >= plan.BatchCount())
+          throw pybind11::index_error();
+        auto batch = plan.GetBatch(batch_index);
+        return pybind11::array_t<size_t>(batch.size(), batch.data());
+      });
 
   m.def("set_log_options", &SetLogOptions);
   m.def("set_log_callback", &SetLogCallback);
+  m.def("set_tracing_enabled", [](bool enabled) { Oga::SetTracingEnabled(enabled); });
+  m.def("trim_cpu_allocator_pool", []() { Oga::TrimCpuAllocatorPool(); });
 
   m.def("is_cuda_available", []() { return USE_CUDA != 0; });
   m.def("is_dml_available", []() { return USE_DML != 0; });
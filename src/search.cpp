@@ -2,30 +2,120 @@
 #include "softmax.h"
 #include "search.h"
 #include "beam_search_scorer.h"
+#include "constrained_logits_processor.h"
 #include "cpu/interface.h"
 #include <queue>
 #include <algorithm>
 
 namespace Generators {
 
+LogProbRecords::LogProbRecords(size_t sequence_count, size_t top_n)
+    : sequence_count_{sequence_count},
+      top_n_{top_n},
+      heads_(sequence_count, -1) {}
+
+void LogProbRecords::Record(size_t sequence, size_t position, std::span<const float> scores, float log_sum_exp, int32_t token) {
+  heads_[sequence] = Append(heads_[sequence], position, scores, log_sum_exp, token);
+}
+
+int32_t LogProbRecords::Append(int32_t parent, size_t position, std::span<const float> scores, float log_sum_exp, int32_t token) {
+  const size_t index = entries_.size();
+  entries_.push_back({parent, position, scores[token] - log_sum_exp});
+  top_ids_.resize((index + 1) * top_n_);
+  top_logprobs_.resize((index + 1) * top_n_);
+  TopLogProbs(scores, log_sum_exp, std::span<int32_t>(top_ids_).subspan(index * top_n_, top_n_),
+              std::span<float>(top_logprobs_).subspan(index * top_n_, top_n_));
+  return static_cast<int32_t>(index);
+}
+
+void LogProbRecords::Reorder(std::span<const int32_t> source_sequences) {
+  auto heads = heads_;
+  for (size_t i = 0; i < source_sequences.size(); i++)
+    heads_[i] = heads[source_sequences[i]];
+}
+
+void LogProbRecords::Clear(size_t from_position) {
+  int32_t last = -1;
+  for (auto& head : heads_) {
+    while (head >= 0 && entries_[head].position >= from_position)
+      head = entries_[head].parent;
+    last = std::max(last, head);
+  }
+
+  // A record comes after its parent, so nothing past the latest head is reachable anymore
+  const size_t count = static_cast<size_t>(last + 1);
+  entries_.resize(count);
+  top_ids_.resize(count * top_n_);
+  top_logprobs_.resize(count * top_n_);
+}
+
+void LogProbRecords::Copy(int32_t head, std::span<float> logprobs, std::span<int32_t> top_ids, std::span<float> top_logprobs) const {
+  std::fill(logprobs.begin(), logprobs.end(), 0.0f);
+  std::fill(top_ids.begin(), top_ids.end(), -1);
+  std::fill(top_logprobs.begin(), top_logprobs.end(), 0.0f);
+  for (; head >= 0; head = entries_[head].parent) {
+    const auto& entry = entries_[head];
+    if (entry.position >= logprobs.size())
+      continue;
+    logprobs[entry.position] = entry.logprob;
+    if (top_ids.empty())
+      continue;
+    std::copy_n(top_ids_.begin() + head * top_n_, top_n_, top_ids.begin() + entry.position * top_n_);
+    std::copy_n(top_logprobs_.begin() + head * top_n_, top_n_, top_logprobs.begin() + entry.position * top_n_);
+  }
+}
+
 Search_Cpu::Search_Cpu(const GeneratorParams& params)
     : Search{params},
       cpu_device_{*GetCpuInterface()} {
   auto batch_beam_size = params.BatchBeamSize();
 
   sequence_lengths_ = cpu_device_.Allocate<int32_t>(batch_beam_size);
+
+  if (!params.row_search_options.empty())
+    row_search_ = params.GetRowSearch();
+
+  if (params.search.logprobs || params.search.top_logprobs > 0) {
+    if (params.search.top_logprobs < 0 || params.search.top_logprobs > params.config.model.vocab_size)
+      throw std::runtime_error("top_logprobs must be between 0 and vocab_size, is " + std::to_string(params.search.top_logprobs));
+    logprob_records_ = std::make_unique<LogProbRecords>(batch_beam_size, params.search.top_logprobs);
+  }
+
+  if (!params.stop_sequences.empty())
+    stop_sequences_ = std::make_unique<StopSequenceMatcher>(params.stop_sequences, batch_beam_size);
 }
 
-GreedySearch_Cpu::GreedySearch_Cpu(const GeneratorParams& params)
-    : Search_Cpu(params) {
-  if (params_->search.random_seed != -1)
-    gen_.seed(params_->search.random_seed);
+const LogProbRecords& Search_Cpu::GetLogProbRecords() const {
+  if (!logprob_records_)
+    throw std::runtime_error("logprobs were not recorded. Set the logprobs or top_logprobs search option before creating the generator");
+  return *logprob_records_;
+}
+
+namespace {
+
+void SeedRandomGenerator(std::mt19937& gen, int random_seed) {
+  if (random_seed != -1)
+    gen.seed(random_seed);
   else {
     std::random_device rd;
-    std::array<uint32_t, decltype(gen_)::state_size> data;
+    std::array<uint32_t, std::mt19937::state_size> data;
     std::generate(std::begin(data), std::end(data), std::ref(rd));
     std::seed_seq seq(data.begin(), data.end());
-    gen_.seed(seq);
+    gen.seed(seq);
+  }
+}
+
+}  // namespace
+
+GreedySearch_Cpu::GreedySearch_Cpu(const GeneratorParams& params)
+    : Search_Cpu(params) {
+  SeedRandomGenerator(gen_, params_->search.random_seed);
+
+  // Rows with their own seed draw from their own generator so their samples don't depend on the other rows
+  if (std::any_of(row_search_.begin(), row_search_.end(), [&](const Config::Search& search) { return search.random_seed != params_->search.random_seed; })) {
+    row_gens_.resize(row_search_.size());
+    for (size_t i = 0; i < row_search_.size(); i++)
+      SeedRandomGenerator(row_gens_[i], row_search_[i].random_seed);
   }
 
   next_tokens_ptr_ = cpu_device_.Allocate<int32_t>(params.search.batch_size);
@@ -79,6 +169,11 @@ void BeamSearch_Cpu::SelectTop() {
 
   auto beam_scores = beam_scorer_->GetNextScores().Span();
 
+  // The beam scores are added to the normalized scores below, and overwritten when they are processed
+  std::vector<float> previous_beam_scores;
+  if (logprob_records_)
+    previous_beam_scores.assign(beam_scores.begin(), beam_scores.end());
+
   // Add beam score to next token scores. Corresponding python code is like:
   //    next_token_scores = next_token_scores + beam_scores[:, None].expand_as(next_token_scores)
   // TODO(aciddelgado): use thread pool to parallel
@@ -135,104 +230,200 @@ void BeamSearch_Cpu::SelectTop() {
   DumpSpan(std::cout, next_scores_);
 #endif
 
-  beam_scorer_->Process(sequences_, next_scores, next_tokens, next_indices);
+  // Flag the candidates that complete a stop sequence, and find the logprob records of the hypothesis each candidate ends
+  const size_t position = sequences_.GetSequenceLength();
+  std::vector<uint8_t> next_stops;
+  std::vector<int32_t> next_logprob_heads;
+  if (stop_sequences_ || logprob_records_) {
+    next_stops.resize(next_tokens.size());
+    next_logprob_heads.resize(next_tokens.size(), -1);
+    for (size_t i = 0; i < next_tokens.size(); i++) {
+      const int source = static_cast<int>(i / top_k) * params_->search.num_beams + next_indices[i];
+      const bool is_eos = contains(params_->config.model.eos_token_id, next_tokens[i]);
+      next_stops[i] = !is_eos && stop_sequences_ && stop_sequences_->Completes(source, next_tokens[i]);
+      if (!logprob_records_)
+        continue;
+      if (next_stops[i])  // The hypothesis keeps the stop token, but EOS is left out
+        next_logprob_heads[i] = logprob_records_->Append(logprob_records_->GetHead(source), position, GetScores(source), previous_beam_scores[source], next_tokens[i]);
+      else if (is_eos)
+        next_logprob_heads[i] = logprob_records_->GetHead(source);
+    }
+  }
+
+  beam_scorer_->Process(sequences_, next_scores, next_tokens, next_indices, next_stops, next_logprob_heads);
   next_tokens_ = cpu_span<int32_t>(beam_scorer_->GetNextTokens().Span());
+  auto beam_indices = beam_scorer_->GetNextIndices().Span();
+
+  if (stop_sequences_)
+    stop_sequences_->AdvanceFrom(beam_indices, next_tokens_);
+
+  if (logprob_records_) {
+    // Each beam continues the records of the beam it was selected from. The scores of that beam are its log softmax
+    // shifted by its previous beam score, so that score is the normalizer.
+    logprob_records_->Reorder(beam_indices);
+    for (size_t i = 0; i < beam_indices.size(); i++) {
+      int source = beam_indices[i];
+      logprob_records_->Record(i, position, GetScores(source), previous_beam_scores[source], next_tokens_[i]);
+    }
+  }
 
   AppendNextTokensToSequences();
 }
 
 void GreedySearch_Cpu::SelectTop() {
-  // next_tokens = torch.argmax(scores, dim=-1)
+  for (size_t batch_id = 0; batch_id < params_->search.batch_size; batch_id++)
+    SelectTopRow(batch_id);
+
+  AppendNextTokensToSequences();
+}
+
+void GreedySearch_Cpu::SampleTopK(int k, float temperature) {
+  for (size_t batch_id = 0; batch_id < params_->search.batch_size; batch_id++)
+    SampleTopKRow(batch_id, k, temperature);
+
+  AppendNextTokensToSequences();
+}
+
+void GreedySearch_Cpu::SampleTopP(float p, float temperature) {
+  for (size_t batch_id = 0; batch_id < params_->search.batch_size; batch_id++)
+    SampleTopPRow(batch_id, p, temperature);
+
+  AppendNextTokensToSequences();
+}
+
+void GreedySearch_Cpu::SampleTopKTopP(int k, float p, float temperature) {
+  for (size_t batch_id = 0; batch_id < params_->search.batch_size; batch_id++)
+    SampleTopKTopPRow(batch_id, k, p, temperature);
+
+  AppendNextTokensToSequences();
+}
+
+void GreedySearch_Cpu::SampleRows() {
   for (size_t batch_id = 0; batch_id < params_->search.batch_size; batch_id++) {
-    if (PadIfAlreadyEOS(batch_id)) {
+    const auto& search = row_search_[batch_id];
+    if (!search.do_sample || search.top_k == 1 || search.temperature == 0) {
+      SelectTopRow(batch_id);
       continue;
     }
 
-    std::span<float> const scores = next_token_scores_.CpuSpan().subspan(batch_id * params_->config.model.vocab_size, params_->config.model.vocab_size);
-    auto const token = static_cast<int32_t>(std::distance(scores.begin(), std::max_element(scores.begin(), scores.end())));
-    SetNextToken(batch_id, token);
+    if (search.top_p < 0.0f || search.top_p > 1.0f)
+      throw std::runtime_error("top_p must be between 0.0 and 1.0");
+    if (search.top_k < 0)
+      throw std::runtime_error("top_k must be 0 or greater");
+
+    if (search.top_p > 0.0f && search.top_p < 1.0f && search.top_k > 1)
+      SampleTopKTopPRow(batch_id, search.top_k, search.top_p, search.temperature);
+    else if (search.top_k > 1)
+      SampleTopKRow(batch_id, search.top_k, search.temperature);
+    else
+      SampleTopPRow(batch_id, search.top_p, search.temperature);
   }
 
   AppendNextTokensToSequences();
-}
 
-void GreedySearch_Cpu::SampleTopK(int k, float temperature) {
+  // Rows that reached their own max_length are finished just like rows that hit EOS
   for (size_t batch_id = 0; batch_id < params_->search.batch_size; batch_id++) {
-    std::span<float> const scores = next_token_scores_.CpuSpan().subspan(batch_id * params_->config.model.vocab_size, params_->config.model.vocab_size);
-    // Find the top K scores
-    std::vector<int> indices(scores.size());
-    std::iota(indices.begin(), indices.end(), 0);
-    std::partial_sort(indices.begin(), indices.begin() + k, indices.end(), [scores = scores.data()](int i, int j) { return scores[i] > scores[j]; });
-    std::vector<float> top_k_scores(k);
-    for (int i = 0; i < k; i++)
-      top_k_scores[i] = scores[indices[i]];
-    // Sample a token from the top K
-    Softmax(top_k_scores, temperature);
-    std::discrete_distribution<> dis(top_k_scores.begin(), top_k_scores.end());
-    SetNextToken(batch_id, indices[dis(gen_)]);
+    if (eos_seen_[batch_id] || sequences_.GetSequenceLength() < row_search_[batch_id].max_length)
+      continue;
+    eos_seen_[batch_id] = true;
+    if (--not_done_count_ == 0)
+      done_ = true;
   }
-  AppendNextTokensToSequences();
 }
 
-void GreedySearch_Cpu::SampleTopP(float p, float temperature) {
+void GreedySearch_Cpu::SelectTopRow(size_t batch_id) {
+  if (PadIfAlreadyEOS(batch_id))
+    return;
+
+  // next_tokens = torch.argmax(scores, dim=-1)
+  std::span<float> const scores = GetScores(static_cast<int>(batch_id));
+  auto const token = static_cast<int32_t>(std::distance(scores.begin(), std::max_element(scores.begin(), scores.end())));
+  RecordLogProbs(batch_id, scores, token);
+  SetNextToken(batch_id, token);
+}
+
+void GreedySearch_Cpu::SampleTopKRow(size_t batch_id, int k, float temperature) {
+  // Like the other strategies, a finished row is only padded. Sampling it again could pick EOS a second time, which would
+  // count the row as finished twice and end the batch while other rows are still generating.
+  if (PadIfAlreadyEOS(batch_id))
+    return;
+
+  std::span<float> const scores = GetScores(static_cast<int>(batch_id));
+  // Find the top K scores
+  std::vector<int> indices(scores.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  std::partial_sort(indices.begin(), indices.begin() + k, indices.end(), [scores = scores.data()](int i, int j) { return scores[i] > scores[j]; });
+  std::vector<float> top_k_scores(k);
+  for (int i = 0; i < k; i++)
+    top_k_scores[i] = scores[indices[i]];
+  // Sample a token from the top K
+  Softmax(top_k_scores, temperature);
+  std::discrete_distribution<> dis(top_k_scores.begin(), top_k_scores.end());
+  int32_t token = indices[dis(RandomGenerator(batch_id))];
+  RecordLogProbs(batch_id, scores, token);
+  SetNextToken(batch_id, token);
+}
+
+void GreedySearch_Cpu::SampleTopPRow(size_t batch_id, float p, float temperature) {
+  if (PadIfAlreadyEOS(batch_id))
+    return;
+
   std::uniform_real_distribution<float> dis(0, p);
-  for (size_t batch_id = 0; batch_id < params_->search.batch_size; batch_id++) {
-    if (PadIfAlreadyEOS(batch_id)) {
+  std::span<float> const scores = GetScores(static_cast<int>(batch_id));
+  // The scores are turned into probabilities in place, so keep the raw scores around when they need to be recorded
+  std::vector<float> raw_scores;
+  if (logprob_records_)
+    raw_scores.assign(scores.begin(), scores.end());
+  Softmax(scores, temperature);
+  // Sort an array of indices into the scores
+  std::vector<int32_t> indices(scores.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  std::sort(indices.begin(), indices.end(), [scores = scores.data()](int32_t i, int32_t j) { return scores[i] > scores[j]; });
+  // Sample a probability threshold
+  float threshold = dis(RandomGenerator(batch_id));
+  int32_t token = 0;
+  // Find the first token where the cumulative probability exceeds the threshold
+  for (int i = 0; i < scores.size(); i++) {
+    threshold -= scores[indices[i]];
+    if (threshold > 0) {
       continue;
     }
-    std::span<float> const scores = next_token_scores_.CpuSpan().subspan(batch_id * params_->config.model.vocab_size, params_->config.model.vocab_size);
-    Softmax(scores, temperature);
-    // Sort an array of indices into the scores
-    std::vector<int32_t> indices(scores.size());
-    std::iota(indices.begin(), indices.end(), 0);
-    std::sort(indices.begin(), indices.end(), [scores = scores.data()](int32_t i, int32_t j) { return scores[i] > scores[j]; });
-    // Sample a probability threshold
-    float threshold = dis(gen_);
-    int32_t token = 0;
-    // Find the first token where the cumulative probability exceeds the threshold
-    for (int i = 0; i < scores.size(); i++) {
-      threshold -= scores[indices[i]];
-      if (threshold > 0) {
-        continue;
-      }
-      token = indices[i];
-      break;
-    }
-    SetNextToken(batch_id, token);
+    token = indices[i];
+    break;
   }
-  AppendNextTokensToSequences();
+  RecordLogProbs(batch_id, raw_scores, token);
+  SetNextToken(batch_id, token);
 }
 
-void GreedySearch_Cpu::SampleTopKTopP(int k, float p, float temperature) {
+void GreedySearch_Cpu::SampleTopKTopPRow(size_t batch_id, int k, float p, float temperature) {
+  if (PadIfAlreadyEOS(batch_id))
+    return;
+
   std::uniform_real_distribution<float> dis(0, p);
-  for (size_t batch_id = 0; batch_id < params_->search.batch_size; batch_id++) {
-    if (PadIfAlreadyEOS(batch_id))
+  std::span<float> const scores = GetScores(static_cast<int>(batch_id));
+  // Find the top K scores
+  std::vector<int> indices(scores.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  std::partial_sort(indices.begin(), indices.begin() + k, indices.end(), [scores = scores.data()](int i, int j) { return scores[i] > scores[j]; });
+  std::vector<float> scores_top_k(k, 0.0f);
+  for (int i = 0; i < k; i++) {
+    scores_top_k[i] = scores[indices[i]];
+  }
+  SoftmaxWithMax(scores_top_k, temperature, scores_top_k[0]);
+  // Sample a probability threshold
+  float threshold = dis(RandomGenerator(batch_id));
+  int32_t token = indices[k - 1];
+  // Find the first token where the cumulative probability exceeds the threshold
+  for (int i = 0; i < k - 1; i++) {
+    threshold -= scores_top_k[i];
+    if (threshold > 0) {
       continue;
-    std::span<float> const scores = next_token_scores_.CpuSpan().subspan(batch_id * params_->config.model.vocab_size, params_->config.model.vocab_size);
-    // Find the top K scores
-    std::vector<int> indices(scores.size());
-    std::iota(indices.begin(), indices.end(), 0);
-    std::partial_sort(indices.begin(), indices.begin() + k, indices.end(), [scores = scores.data()](int i, int j) { return scores[i] > scores[j]; });
-    std::vector<float> scores_top_k(k, 0.0f);
-    for (int i = 0; i < k; i++) {
-      scores_top_k[i] = scores[indices[i]];
     }
-    SoftmaxWithMax(scores_top_k, temperature, scores_top_k[0]);
-    // Sample a probability threshold
-    float threshold = dis(gen_);
-    int32_t token = indices[k - 1];
-    // Find the first token where the cumulative probability exceeds the threshold
-    for (int i = 0; i < k - 1; i++) {
-      threshold -= scores_top_k[i];
-      if (threshold > 0) {
-        continue;
-      }
-      token = indices[i];
-      break;
-    }
-    SetNextToken(batch_id, token);
+    token = indices[i];
+    break;
   }
-  AppendNextTokensToSequences();
+  RecordLogProbs(batch_id, scores, token);
+  SetNextToken(batch_id, token);
 }
 
 bool GreedySearch_Cpu::PadIfAlreadyEOS(size_t batch_id) {
@@ -245,12 +436,21 @@ bool GreedySearch_Cpu::PadIfAlreadyEOS(size_t batch_id) {
   return true;
 }
 
+void GreedySearch_Cpu::RecordLogProbs(size_t batch_id, std::span<const float> scores, int32_t token) {
+  if (!logprob_records_)
+    return;
+  logprob_records_->Record(batch_id, sequences_.GetSequenceLength(), scores, LogSumExp(scores), token);
+}
+
 void GreedySearch_Cpu::SetNextToken(size_t batch_id, int32_t token) {
   next_tokens_[batch_id] = token;
-  if (contains(params_->config.model.eos_token_id, token)) {
+  const bool is_eos = contains(params_->config.model.eos_token_id, token);
+  // A completed stop sequence finishes the row just like EOS
+  const bool is_stop = !is_eos && stop_sequences_ && stop_sequences_->Advance(batch_id, token);
+  if (is_eos || is_stop) {
     eos_seen_[batch_id] = true;
     if (g_log.enabled && g_log.hit_eos)
-      Log("hit_eos", "EOS seen on batch " + std::to_string(batch_id));
+      Log("hit_eos", std::string(is_eos ? "EOS" : "Stop sequence") + " seen on batch " + std::to_string(batch_id));
     if (--not_done_count_ == 0) {
       done_ = true;
     }
@@ -292,12 +492,17 @@ void GreedySearch_Cpu::AppendTokens(DeviceSpan<int32_t>& next_tokens) {
   done_ = false;
   not_done_count_ = params_->search.batch_size;
   memset(eos_seen_.data(), 0, eos_seen_.size_bytes());
+  // Stop sequences are only matched in generated tokens, not in user tokens
+  if (stop_sequences_)
+    stop_sequences_->Reset();
 }
 
 void GreedySearch_Cpu::RewindTo(size_t index) {
   done_ = false;
   not_done_count_ = params_->search.batch_size;
   memset(eos_seen_.data(), 0, eos_seen_.size_bytes());
+  if (stop_sequences_)
+    stop_sequences_->Reset();
   // Set next tokens to the last tokens in the sequence
   if (index > 0) {
     for (int i = 0; i < params_->BatchBeamSize(); i++) {
@@ -306,6 +511,8 @@ void GreedySearch_Cpu::RewindTo(size_t index) {
   } else
     memset(next_tokens_.data(), 0, next_tokens_.size_bytes());
   sequences_.RewindTo(index);
+  if (logprob_records_)
+    logprob_records_->Clear(index);
 }
 
 void BeamSearch_Cpu::AppendTokens(DeviceSpan<int32_t>& next_tokens) {
@@ -325,6 +532,9 @@ void BeamSearch_Cpu::AppendTokens(DeviceSpan<int32_t>& next_tokens) {
     copy(source, target);
   }
   sequences_.AfterAppendNextTokens(next_tokens, params_->search.batch_size);  // next_tokens is not expanded
+  // Stop sequences are only matched in generated tokens, not in user tokens
+  if (stop_sequences_)
+    stop_sequences_->Reset();
 }
 
 bool BeamSearch_Cpu::IsDone() const {
@@ -368,7 +578,7 @@ void BeamSearch_Cpu::AppendNextTokensToSequences() {
 void BeamSearch_Cpu::Finalize(size_t num_return_sequences) {
   if (finalized_)
     return;
-  beam_scorer_->Finalize(sequences_, num_return_sequences);
+  beam_scorer_->Finalize(sequences_, num_return_sequences, logprob_records_.get());
   finalized_ = true;
 }
 
@@ -384,47 +594,29 @@ DeviceSpan<int32_t> BeamSearch_Cpu::GetSequence(size_t batch_id, size_t beam_id)
   return beam_scorer_->GetBeamHypotheses(batch_id, beam_id);
 }
 
+int32_t BeamSearch_Cpu::GetSequenceLogProbHead(size_t index) {
+  GetLogProbRecords();  // Throws if the logprobs were not recorded
+  size_t batch_id = index / params_->search.num_return_sequences;
+  size_t beam_id = index % params_->search.num_return_sequences;
+  Finalize(params_->search.num_return_sequences);
+  return beam_scorer_->GetBeamHypothesisLogProbHead(batch_id, beam_id);
+}
+
 std::span<float> Search_Cpu::GetScores(int batch_beam_index) {
   assert(batch_beam_index >= 0 && batch_beam_index < params_->BatchBeamSize());
   return next_token_scores_.CpuSpan().subspan(static_cast<size_t>(batch_beam_index) * params_->config.model.vocab_size, params_->config.model.vocab_size);
 }
 
-void Search_Cpu::ApplyMinLength(int min_length) {
-  if (sequences_.GetSequenceLength() >= min_length) {
-    return;
-  }
-
-  const int batch_beam_size = params_->BatchBeamSize();
-  for (int i = 0; i < batch_beam_size; i++) {
-    std::span<float> const beam_token_scores = GetScores(i);
-    for (auto token_id : params_->config.model.eos_token_id)
-      beam_token_scores[token_id] = std::numeric_limits<float>::lowest();
+void Search_Cpu::ApplyLogitsProcessors(ConstrainedLogitsProcessor* guidance) {
+  // The guidance processor is owned by the generator and lives as long as this search
+  if (logits_processors_.Empty()) {
+    if (guidance)
+      logits_processors_.Add(std::make_unique<GuidanceMaskLogitsProcessor>(*guidance));
+    logits_processors_.Add(std::make_unique<MinLengthLogitsProcessor>(*this));
+    logits_processors_.Add(std::make_unique<RepetitionPenaltyLogitsProcessor>(*this));
   }
-}
-
-void Search_Cpu::ApplyRepetitionPenalty(float penalty) {
-  if (penalty == 1.0f)
-    return;
 
-  const int batch_beam_size = params_->BatchBeamSize();
-  for (int i = 0; i < batch_beam_size; i++) {
-    std::span<float> const beam_token_scores = GetScores(i);
-    std::span<const int32_t> const sequence = sequences_.GetSequence(i).CopyDeviceToCpu();
-
-    // Find unique word IDs in sequence.
-    std::unordered_set<int32_t> unique_word_ids;
-    for (const auto& word_id : sequence) {
-      unique_word_ids.insert(word_id);
-    }
-
-    for (const int32_t word_id : unique_word_ids) {
-      float const score = beam_token_scores[word_id];
-
-      // If score < 0, then repetition penalty > 1.0 has to multiplied to reduce the previous token probability,
-      // This assumes that scores are either positive (like ctrl) or negative (like GPT-2), but not a mixture.
-      beam_token_scores[word_id] = (score < 0 ? score * penalty : score / penalty);
-    }
-  }
+  logits_processors_.Process(next_token_scores_.CpuSpan(), params_->BatchBeamSize(), params_->config.model.vocab_size);
 }
 
 }  // namespace Generators
\ No newline at end of file
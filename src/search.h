@@ -1,10 +1,48 @@
 #include "sequences.h"
 #include <random>
 #include "beam_search_scorer.h"
+#include "logits_processor.h"
+#include "stop_sequences.h"
 #pragma once
 
 namespace Generators {
 
+// Log probability of every selected token and the top candidates it was selected from. A record is added for each
+// generated token and points to the record of the previous generated token of its sequence, so the storage grows with the
+// generated tokens and beams that share a prefix share its records. Positions that were not selected by the search (the
+// prompt and user appended tokens) have a log probability of 0 and top ids of -1.
+struct LogProbRecords {
+  LogProbRecords(size_t sequence_count, size_t top_n);
+
+  // scores are the raw scores of the sequence, log_sum_exp their normalizer
+  void Record(size_t sequence, size_t position, std::span<const float> scores, float log_sum_exp, int32_t token);
+  // Adds a record after parent that no sequence continues (a beam hypothesis ending in a stop sequence), returns it
+  int32_t Append(int32_t parent, size_t position, std::span<const float> scores, float log_sum_exp, int32_t token);
+  // Beam search: sequence i continues the records of sequence source_sequences[i]
+  void Reorder(std::span<const int32_t> source_sequences);
+  // Drops the records from the position on, for rewinding (the records of a beam hypothesis must not be dropped)
+  void Clear(size_t from_position);
+
+  // The latest record of the sequence, -1 if it has none. It stays valid when the sequence is reordered or finalized.
+  int32_t GetHead(size_t sequence) const { return heads_[sequence]; }
+  // Copies the records of the chain ending at head into logprobs [length] and top_ids, top_logprobs [length, top_n]
+  void Copy(int32_t head, std::span<float> logprobs, std::span<int32_t> top_ids, std::span<float> top_logprobs) const;
+
+  const size_t sequence_count_, top_n_;
+
+ private:
+  struct Entry {
+    int32_t parent;  // The previous record of the sequence, -1 if none
+    size_t position;
+    float logprob;
+  };
+
+  std::vector<Entry> entries_;
+  std::vector<int32_t> top_ids_;     // [entries, top_n]
+  std::vector<float> top_logprobs_;  // [entries, top_n]
+  std::vector<int32_t> heads_;       // [sequence_count]
+};
+
 struct Search : LeakChecked<Search> {
   Search(const GeneratorParams& params) : params_{params.shared_from_this()}, sequences_{*params_} {}
   virtual ~Search() = default;
@@ -19,21 +57,34 @@ struct Search : LeakChecked<Search> {
   virtual DeviceSpan<float> GetLogits() const = 0;
   virtual void SetLogits(DeviceSpan<float> logits) = 0;
   virtual bool IsDone() const = 0;
+  // True once the row has hit EOS, a stop sequence or its max_length, the search only pads it from then on
+  virtual bool IsRowDone(size_t /*batch_id*/) const { return IsDone(); }
 
   virtual void SelectTop() = 0;
   virtual void SampleTopP(float /*p*/, float /*temperature*/) { assert(false); }
   virtual void SampleTopK(int /*k*/, float /*temperature*/) { assert(false); }
   virtual void SampleTopKTopP(int /*k*/, float /*p*/, float /*temperature*/) { assert(false); }
+  // Selects the next token of every row with that row's own search options (GeneratorParams::row_search_options)
+  virtual void SampleRows() { throw std::runtime_error("Per row search options are only supported by the CPU greedy search"); }
 
-  // Scoring features
-  virtual void ApplyMinLength(int min_length) = 0;
-  virtual void ApplyRepetitionPenalty(float penalty) = 0;
+  // Applies guidance masking (if any), min length and repetition penalty to the scores before selection, in that order
+  virtual void ApplyLogitsProcessors(ConstrainedLogitsProcessor* guidance) = 0;
 
   // Set user input tokens
   virtual void AppendTokens(DeviceSpan<int32_t>& next_tokens) { assert(false); };
   // To be used for rewind
   virtual void RewindTo(size_t index) { assert(false); };
 
+  // Only available when search.logprobs or search.top_logprobs is set
+  virtual const LogProbRecords& GetLogProbRecords() const { throw std::runtime_error("Recording logprobs is only supported by the CPU search"); }
+  // The latest record of the sequence returned by GetSequence(index)
+  virtual int32_t GetSequenceLogProbHead(size_t index) { return GetLogProbRecords().GetHead(index); }
+
+  // True if rows are finished when they generate one of GeneratorParams::stop_sequences
+  virtual bool SupportsStopSequences() const { return false; }
+  // True if SampleRows is implemented, so GeneratorParams::row_search_options can be used
+  virtual bool SupportsRowSearchOptions() const { return false; }
+
   std::shared_ptr<const GeneratorParams> params_;
   Sequences sequences_;
 };
@@ -47,13 +98,25 @@ struct Search_Cpu : Search {
   DeviceSpan<float> GetLogits() const override;
   void SetLogits(DeviceSpan<float> logits) override;
 
-  void ApplyMinLength(int min_length) override;
-  void ApplyRepetitionPenalty(float penalty) override;
+  // The CPU search reads min_length and repetition_penalty from each row's search options, see GetRowSearch
+  void ApplyLogitsProcessors(ConstrainedLogitsProcessor* guidance) override;
 
   std::span<float> GetScores(int batch_beam_index);
+  const Config::Search& GetRowSearch(size_t batch_beam_index) const {
+    return row_search_.empty() ? params_->search : row_search_[batch_beam_index / params_->search.num_beams];
+  }
+
+  const LogProbRecords& GetLogProbRecords() const override;
+
+  bool SupportsStopSequences() const override { return true; }
 
   DeviceInterface& cpu_device_;
 
+  std::unique_ptr<LogProbRecords> logprob_records_;       // Only set when recording logprobs
+  std::vector<Config::Search> row_search_;                // Only set when rows have their own search options
+  LogitsProcessorChain logits_processors_;                // Built on the first step
+  std::unique_ptr<StopSequenceMatcher> stop_sequences_;  // Only set when there are stop sequences, a row per beam
+
   DeviceSpan<int32_t> sequence_lengths_;  // shape (beam_size*batch_size)
 
   cpu_span<int32_t> next_tokens_;  // shape (beam_size*batch_size)
@@ -69,17 +132,29 @@ struct GreedySearch_Cpu : Search_Cpu {
   DeviceSpan<int32_t> GetNextTokens() override;
   DeviceSpan<int32_t> GetNextIndices() override { return {}; }
 
+  bool IsRowDone(size_t batch_id) const override { return done_ || eos_seen_[batch_id]; }
+
   void SelectTop() override;
   void SampleTopK(int k, float temperature) override;
   void SampleTopP(float p, float temperature) override;
   void SampleTopKTopP(int /*k*/, float /*p*/, float /*temperature*/) override;
+  void SampleRows() override;
+
+  bool SupportsRowSearchOptions() const override { return true; }
 
   // Used by continuous decoding search.
   void AppendTokens(DeviceSpan<int32_t>& next_tokens) override;
   void RewindTo(size_t index) override;
 
  protected:
+  void SelectTopRow(size_t batch_id);
+  void SampleTopKRow(size_t batch_id, int k, float temperature);
+  void SampleTopPRow(size_t batch_id, float p, float temperature);
+  void SampleTopKTopPRow(size_t batch_id, int k, float p, float temperature);
+  std::mt19937& RandomGenerator(size_t batch_id) { return row_gens_.empty() ? gen_ : row_gens_[batch_id]; }
+
   void SetNextToken(size_t batch_id, int32_t token);
+  void RecordLogProbs(size_t batch_id, std::span<const float> scores, int32_t token);
   void AppendNextTokensToSequences();
 
   bool PadIfAlreadyEOS(size_t batch_id);
@@ -92,6 +167,7 @@ struct GreedySearch_Cpu : Search_Cpu {
   int not_done_count_{params_->search.batch_size};  // When zero, every batch entry is done (starts at batch_size_)
 
   std::mt19937 gen_;
+  std::vector<std::mt19937> row_gens_;  // Only used when rows have their own random_seed
 };
 
 struct BeamSearch_Cpu : Search_Cpu {
@@ -103,6 +179,7 @@ struct BeamSearch_Cpu : Search_Cpu {
   // In Beam Search there are batch_size * num_beams sequences. Index is batch_id * num_beams + beam_id... Easier to use the other version.
   DeviceSpan<int32_t> GetSequence(size_t index) override;
   DeviceSpan<int32_t> GetSequence(size_t batch_id, size_t beam_id);
+  int32_t GetSequenceLogProbHead(size_t index) override;
 
   bool IsDone() const override;
 
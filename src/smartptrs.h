@@ -118,6 +118,12 @@ struct DeviceInterface {
 
   virtual bool Cast(void* /*input*/, void* /*output*/, ONNXTensorElementDataType /*input_type*/, ONNXTensorElementDataType /*output_type*/, size_t /*element_count*/) { return false; }
 
+  // For each of position_count rows of logits, writes the log probability of its target token and, when top_n > 0, the
+  // top_n most likely tokens with their log probabilities. Rows with a negative target are skipped. Returns false if
+  // the device does not support it, then the caller scores the logits on the CPU.
+  virtual bool LaunchTokenLogProbs(const float* /*logits*/, const int32_t* /*target_tokens*/, int /*position_count*/, int /*vocab_size*/, int /*top_n*/,
+                                   float* /*logprobs*/, int32_t* /*top_ids*/, float* /*top_logprobs*/) { return false; }
+
   virtual bool UpdatePositionIds(void* /*position_ids*/, int /*batch_beam_size*/, int /*total_length*/, int /*new_kv_length*/, ONNXTensorElementDataType /*type*/) { return false; }
   virtual bool UpdateAttentionMask(void* /*next_mask_data*/, void* /*mask_data*/, int /*batch_beam_size*/, int /*new_kv_length*/, int /*total_length*/, int /*max_length*/, bool /*update_only*/, ONNXTensorElementDataType /*type*/) { return false; }
 
@@ -19,4 +19,38 @@ void log_softmax(std::span<float> values) {
   std::transform(values.begin(), values.end(), values.begin(), [max, log_max](float v) { return v - max - log_max; });
 }
 
+float LogSumExp(std::span<const float> values) {
+  float max = *std::max_element(values.begin(), values.end());
+  float sum = std::accumulate(values.begin(), values.end(), 0.0f, [max](float a, float v) { return a + std::exp(v - max); });
+  return max + std::log(sum);
+}
+
+void TopLogProbs(std::span<const float> logits, float log_sum_exp, std::span<int32_t> top_ids, std::span<float> top_logprobs) {
+  assert(top_ids.size() == top_logprobs.size() && top_ids.size() <= logits.size());
+  const size_t top_n = top_ids.size();
+  if (top_n == 0)
+    return;
+
+  // Min-heap of the best top_n candidates seen so far, so the vocabulary is scanned once without sorting it
+  auto greater = [&logits](int32_t a, int32_t b) { return logits[a] > logits[b]; };
+  std::vector<int32_t> heap;
+  heap.reserve(top_n);
+  for (int32_t i = 0; i < static_cast<int32_t>(logits.size()); i++) {
+    if (heap.size() < top_n) {
+      heap.push_back(i);
+      std::push_heap(heap.begin(), heap.end(), greater);
+    } else if (logits[i] > logits[heap.front()]) {
+      std::pop_heap(heap.begin(), heap.end(), greater);
+      heap.back() = i;
+      std::push_heap(heap.begin(), heap.end(), greater);
+    }
+  }
+  std::sort_heap(heap.begin(), heap.end(), greater);
+
+  for (size_t i = 0; i < top_n; i++) {
+    top_ids[i] = heap[i];
+    top_logprobs[i] = logits[heap[i]] - log_sum_exp;
+  }
+}
+
 }  // namespace Generators
@@ -0,0 +1,81 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#include "generators.h"
+#include "stop_sequences.h"
+#include <algorithm>
+#include <queue>
+
+namespace Generators {
+
+StopSequenceMatcher::StopSequenceMatcher(std::span<const std::vector<int32_t>> stop_sequences, size_t row_count)
+    : nodes_(1), row_nodes_(row_count) {
+  // Build the trie of the stop sequences
+  for (const auto& stop_sequence : stop_sequences) {
+    if (stop_sequence.empty())
+      throw std::runtime_error("Stop sequences cannot be empty");
+
+    int32_t node = 0;
+    for (auto token : stop_sequence) {
+      auto child = FindChild(node, token);
+      if (child < 0) {
+        child = static_cast<int32_t>(nodes_.size());
+        auto& children = nodes_[node].children;
+        children.insert(std::lower_bound(children.begin(), children.end(), std::make_pair(token, 0)), {token, child});
+        nodes_.emplace_back();
+      }
+      node = child;
+    }
+    nodes_[node].match = true;
+  }
+
+  // Breadth first so that the fail link of every shallower node is known before it is needed
+  std::queue<int32_t> pending;
+  for (auto [token, child] : nodes_[0].children)
+    pending.push(child);
+
+  while (!pending.empty()) {
+    auto node = pending.front();
+    pending.pop();
+    for (auto [token, child] : nodes_[node].children) {
+      auto fail = nodes_[node].fail;
+      while (fail != 0 && FindChild(fail, token) < 0)
+        fail = nodes_[fail].fail;
+      auto fail_child = FindChild(fail, token);
+      nodes_[child].fail = fail_child >= 0 ? fail_child : 0;
+      nodes_[child].match |= nodes_[nodes_[child].fail].match;
+      pending.push(child);
+    }
+  }
+}
+
+int32_t StopSequenceMatcher::FindChild(int32_t node, int32_t token) const {
+  const auto& children = nodes_[node].children;
+  auto it = std::lower_bound(children.begin(), children.end(), token, [](const auto& child, int32_t value) { return child.first < value; });
+  return it != children.end() && it->first == token ? it->second : -1;
+}
+
+int32_t StopSequenceMatcher::Next(int32_t node, int32_t token) const {
+  auto child = FindChild(node, token);
+  while (child < 0 && node != 0) {
+    node = nodes_[node].fail;
+    child = FindChild(node, token);
+  }
+  return child >= 0 ? child : 0;
+}
+
+bool StopSequenceMatcher::Advance(size_t row, int32_t token) {
+  row_nodes_[row] = Next(row_nodes_[row], token);
+  return nodes_[row_nodes_[row]].match;
+}
+
+void StopSequenceMatcher::AdvanceFrom(std::span<const int32_t> source_rows, std::span<const int32_t> tokens) {
+  auto row_nodes = row_nodes_;
+  for (size_t i = 0; i < source_rows.size(); i++)
+    row_nodes_[i] = Next(row_nodes[source_rows[i]], tokens[i]);
+}
+
+void StopSequenceMatcher::Reset() {
+  std::fill(row_nodes_.begin(), row_nodes_.end(), 0);
+}
+
+}  // namespace Generators
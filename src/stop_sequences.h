@@ -0,0 +1,38 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+#pragma once
+
+namespace Generators {
+
+// Finds stop sequences in the tokens generated by each row as they are generated. Every stop sequence is matched at
+// once by an Aho-Corasick automaton over token ids, so a step costs about the same however many stop sequences are set,
+// and a match that straddles several steps is still found.
+struct StopSequenceMatcher {
+  StopSequenceMatcher(std::span<const std::vector<int32_t>> stop_sequences, size_t row_count);
+
+  // Feeds the next token of the row, returns true when it completes a stop sequence
+  bool Advance(size_t row, int32_t token);
+
+  // Beam search: true if feeding the token to the row would complete a stop sequence, the row is not advanced
+  bool Completes(size_t row, int32_t token) const { return nodes_[Next(row_nodes_[row], token)].match; }
+  // Beam search: row i continues from row source_rows[i] and is fed tokens[i]
+  void AdvanceFrom(std::span<const int32_t> source_rows, std::span<const int32_t> tokens);
+
+  // Forgets the tokens seen so far by every row
+  void Reset();
+
+ private:
+  struct Node {
+    std::vector<std::pair<int32_t, int32_t>> children;  // (token, node index) sorted by token
+    int32_t fail{};                                     // Longest proper suffix of this node that is also a prefix
+    bool match{};                                       // A stop sequence ends here or at a suffix of here
+  };
+
+  int32_t FindChild(int32_t node, int32_t token) const;  // -1 when there is none
+  int32_t Next(int32_t node, int32_t token) const;       // The node reached by feeding the token
+
+  std::vector<Node> nodes_;         // nodes_[0] is the root (nothing matched)
+  std::vector<int32_t> row_nodes_;  // Current node of each row
+};
+
+}  // namespace Generators
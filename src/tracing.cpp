@@ -3,124 +3,304 @@
 
 #include "tracing.h"
 
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <mutex>
-#include <optional>
-#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include "models/env_utils.h"
 
 namespace Generators {
 
-#if defined(ORTGENAI_ENABLE_TRACING)
-
 namespace {
 
-// Writes trace events to a file in Chrome tracing format.
-// See more details about the format here:
-// https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
-class FileTraceSink : public TraceSink {
- public:
-  FileTraceSink(std::string_view file_path)
-      : ostream_{std::ofstream{file_path.data()}},
-        start_{Clock::now()},
-        insert_event_delimiter_{false} {
-    ostream_ << "[";
-  }
+using Clock = Tracer::Clock;
 
-  ~FileTraceSink() {
-    ostream_ << "]\n";
-  }
+struct TraceEvent {
+  Clock::time_point time;  // The start of a duration
+  uint64_t id;             // Of an async span
+  double value;            // Of a counter, or the microseconds of a duration
+  char phase;              // The Chrome tracing phase type
+  uint8_t name_length;
+  char name[Tracer::max_name_length];
+};
 
-  void BeginDuration(std::string_view label) {
-    LogEvent("B", label);
+std::string GetTraceFileName() {
+  constexpr const char* kTraceFileEnvironmentVariableName = "ORTGENAI_TRACE_FILE_PATH";
+  auto trace_file_name = GetEnv(kTraceFileEnvironmentVariableName);
+  if (trace_file_name.empty()) {
+    trace_file_name = "ortgenai_trace.log";
   }
+  return trace_file_name;
+}
 
-  void EndDuration() {
-    LogEvent("E");
-  }
+// The name of the trace file opened after file_index others, numbered before the extension: trace.log, trace.1.log, ...
+std::string NumberTraceFileName(const std::string& trace_file_name, size_t file_index) {
+  if (file_index == 0)
+    return trace_file_name;
+  auto extension = trace_file_name.find_last_of('.');
+  const auto directory_end = trace_file_name.find_last_of("/\\");
+  if (extension == std::string::npos || (directory_end != std::string::npos && extension < directory_end))
+    extension = trace_file_name.size();
+  return trace_file_name.substr(0, extension) + "." + std::to_string(file_index) + trace_file_name.substr(extension);
+}
 
- private:
-  using Clock = std::chrono::steady_clock;
+}  // namespace
 
-  void LogEvent(std::string_view phase_type, std::optional<std::string_view> label = std::nullopt) {
-    const auto thread_id = std::this_thread::get_id();
-    const auto ts = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_);
+// The events recorded by one thread. Only the thread writes events and advances head, only the writer thread reads
+// events and advances tail, so neither needs a lock. A full buffer drops new events instead of waiting for the writer.
+struct TraceThreadBuffer {
+  static constexpr size_t capacity = 8192;
 
-    std::ostringstream event{};
+  explicit TraceThreadBuffer(uint64_t thread_id) : thread_id{thread_id} {}
 
-    event << "{";
+  const uint64_t thread_id;  // Numbered in the order threads first record an event
+  std::unique_ptr<TraceEvent[]> events{std::make_unique<TraceEvent[]>(capacity)};
+  std::atomic<size_t> head{};  // Count of events written
+  std::atomic<size_t> tail{};  // Count of events read
+  std::atomic<size_t> dropped{};
+  std::atomic<bool> retired{};  // Set when the thread exits, the buffer is removed once it is empty
+};
 
-    if (label.has_value()) {
-      event << "\"name\": \"" << *label << "\", ";
-    }
+// The trace file and the background thread writing it, every 100 ms, on Flush and when tracing is shut down.
+struct TraceOutput {
+  std::mutex mutex;  // Guards the members up to writer
+  std::condition_variable wake;
+  std::vector<std::shared_ptr<TraceThreadBuffer>> buffers;
+  uint64_t next_thread_id{};
+  bool stop{};
+  std::thread writer;  // Running while the trace file is open
+  size_t file_count{};  // Trace files opened so far
 
-    event << "\"cat\": \"perf\", "
-          << "\"ph\": \"" << phase_type << "\", "
-          << "\"pid\": 0, "
-          << "\"tid\": " << thread_id << ", "
-          << "\"ts\": " << ts.count()
-          << "}";
+  // Only used while holding write_mutex, so by one of the writer thread and Flush at a time
+  std::mutex write_mutex;
+  std::ofstream file;
+  bool wrote_event{};
+  size_t retired_dropped{};  // Drops counted by buffers that have been removed
+  size_t reported_dropped{};
+  const Clock::time_point start{Clock::now()};
 
+  void WriteLoop() {
+    std::unique_lock<std::mutex> lock{mutex};
+    while (!stop) {
+      wake.wait_for(lock, std::chrono::milliseconds(100), [this] { return stop; });
+      lock.unlock();
+      WriteEvents();
+      lock.lock();
+    }
+  }
+
+  void WriteEvents() {
+    std::lock_guard<std::mutex> write_lock{write_mutex};
+    std::vector<std::shared_ptr<TraceThreadBuffer>> current_buffers;
     {
-      std::scoped_lock g{output_mutex_};
+      std::lock_guard<std::mutex> lock{mutex};
+      current_buffers = buffers;
+    }
 
-      // add the delimiter only after writing the first event
-      if (insert_event_delimiter_) {
-        ostream_ << ",\n";
-      } else {
-        insert_event_delimiter_ = true;
-      }
+    std::string text;
+    size_t dropped = retired_dropped;
+    for (auto& buffer : current_buffers) {
+      const auto tail = buffer->tail.load(std::memory_order_relaxed);
+      const auto head = buffer->head.load(std::memory_order_acquire);
+      for (auto i = tail; i != head; i++)
+        AppendEvent(text, buffer->events[i % TraceThreadBuffer::capacity], buffer->thread_id);
+      buffer->tail.store(head, std::memory_order_release);
+      dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
 
-      ostream_ << event.str();
+    if (dropped != reported_dropped) {
+      TraceEvent event{Clock::now(), 0, static_cast<double>(dropped), 'C', 0, {}};
+      constexpr std::string_view name{"Dropped trace events"};
+      event.name_length = static_cast<uint8_t>(name.size());
+      std::memcpy(event.name, name.data(), name.size());
+      AppendEvent(text, event, 0);
+      reported_dropped = dropped;
     }
+
+    if (!text.empty()) {
+      file << text;
+      file.flush();
+    }
+
+    // A retired buffer gets no more events, so once it is empty it can go
+    std::lock_guard<std::mutex> lock{mutex};
+    auto removed = std::remove_if(buffers.begin(), buffers.end(), [this](const auto& buffer) {
+      if (!buffer->retired.load(std::memory_order_acquire) ||
+          buffer->tail.load(std::memory_order_relaxed) != buffer->head.load(std::memory_order_acquire))
+        return false;
+      retired_dropped += buffer->dropped.load(std::memory_order_relaxed);
+      return true;
+    });
+    buffers.erase(removed, buffers.end());
   }
 
-  std::ofstream ostream_;
-  const Clock::time_point start_;
-  bool insert_event_delimiter_;
+  // Writes an event in Chrome tracing format, see more details about the format here:
+  // https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+  void AppendEvent(std::string& text, const TraceEvent& event, uint64_t thread_id) {
+    // add the delimiter only after writing the first event
+    text += wrote_event ? ",\n{" : "{";
+    wrote_event = true;
 
-  std::mutex output_mutex_;
+    if (event.name_length) {
+      text += "\"name\": \"";
+      for (size_t i = 0; i < event.name_length; i++) {
+        const char c = event.name[i];
+        if (c == '"' || c == '\\')
+          text += '\\';
+        text += static_cast<unsigned char>(c) < 0x20 ? ' ' : c;
+      }
+      text += "\", ";
+    }
+
+    const auto ts = std::chrono::duration<double, std::micro>(event.time - start).count();
+    char fields[160];
+    int length = std::snprintf(fields, sizeof(fields), "\"cat\": \"perf\", \"ph\": \"%c\", \"pid\": 0, \"tid\": %llu, \"ts\": %.3f",
+                               event.phase, static_cast<unsigned long long>(thread_id), ts);
+    text.append(fields, std::min(static_cast<size_t>(std::max(length, 0)), sizeof(fields) - 1));
+
+    if (event.phase == 'C')
+      length = std::snprintf(fields, sizeof(fields), ", \"args\": {\"value\": %.17g}}", event.value);
+    else if (event.phase == 'b' || event.phase == 'e')
+      length = std::snprintf(fields, sizeof(fields), ", \"id\": \"0x%llx\"}", static_cast<unsigned long long>(event.id));
+    else if (event.phase == 'X')
+      length = std::snprintf(fields, sizeof(fields), ", \"dur\": %.3f}", event.value);
+    else
+      length = std::snprintf(fields, sizeof(fields), "}");
+    text.append(fields, std::min(static_cast<size_t>(std::max(length, 0)), sizeof(fields) - 1));
+  }
 };
 
-std::string GetTraceFileName() {
-  constexpr const char* kTraceFileEnvironmentVariableName = "ORTGENAI_TRACE_FILE_PATH";
-  auto trace_file_name = GetEnv(kTraceFileEnvironmentVariableName);
-  if (trace_file_name.empty()) {
-    trace_file_name = "ortgenai_trace.log";
+namespace {
+
+// The buffers the current thread records into, one per tracer
+struct ThreadBuffers {
+  ~ThreadBuffers() {
+    for (auto& [tracer_id, buffer] : entries)
+      buffer->retired.store(true, std::memory_order_release);
   }
-  return trace_file_name;
-}
 
-}  // namespace
+  std::vector<std::pair<uint64_t, std::shared_ptr<TraceThreadBuffer>>> entries;
+};
 
-#endif  // defined(ORTGENAI_ENABLE_TRACING)
+std::atomic<uint64_t> g_next_tracer_id{};
 
-Tracer::Tracer() {
-#if defined(ORTGENAI_ENABLE_TRACING)
-  const auto trace_file_name = GetTraceFileName();
-  sink_ = std::make_unique<FileTraceSink>(trace_file_name);
-#endif
-}
+}  // namespace
 
-void Tracer::BeginDuration(std::string_view label) {
+Tracer::Tracer() : Tracer{GetTraceFileName()} {
 #if defined(ORTGENAI_ENABLE_TRACING)
-  sink_->BeginDuration(label);
+  bool enabled = true;
 #else
-  static_cast<void>(label);
+  bool enabled = false;
 #endif
+  GetEnv("ORTGENAI_TRACE", enabled);
+  if (enabled)
+    SetEnabled(true);
 }
 
-void Tracer::EndDuration() {
-#if defined(ORTGENAI_ENABLE_TRACING)
-  sink_->EndDuration();
-#endif
+Tracer::Tracer(std::string trace_file_name)
+    : id_{g_next_tracer_id++},
+      trace_file_name_{std::move(trace_file_name)},
+      output_{std::make_unique<TraceOutput>()} {
+}
+
+Tracer::~Tracer() {
+  Shutdown();
+}
+
+void Tracer::SetEnabled(bool enabled) {
+  if (enabled) {
+    std::lock_guard<std::mutex> lock{output_->mutex};
+    if (!output_->writer.joinable()) {
+      // A trace written before Shutdown is kept, the new one goes to the next numbered file
+      const auto trace_file_name = NumberTraceFileName(trace_file_name_, output_->file_count);
+      std::lock_guard<std::mutex> write_lock{output_->write_mutex};
+      output_->file = std::ofstream{trace_file_name};
+      if (!output_->file)
+        throw std::runtime_error("Could not open the trace file " + trace_file_name);
+      output_->file_count++;
+      output_->file << "[";
+      output_->wrote_event = false;
+      output_->stop = false;
+      output_->writer = std::thread{[output = output_.get()] { output->WriteLoop(); }};
+    }
+  }
+  enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+void Tracer::Flush() {
+  {
+    std::lock_guard<std::mutex> lock{output_->mutex};
+    if (!output_->writer.joinable())
+      return;
+  }
+  output_->WriteEvents();
+}
+
+void Tracer::Shutdown() {
+  enabled_.store(false, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock{output_->mutex};
+    if (!output_->writer.joinable())
+      return;
+    output_->stop = true;
+  }
+  output_->wake.notify_one();
+  output_->writer.join();
+
+  output_->WriteEvents();
+  std::lock_guard<std::mutex> write_lock{output_->write_mutex};
+  output_->file << "]\n";
+  output_->file.close();
+}
+
+void Tracer::Record(char phase, std::string_view name, uint64_t id, double value, Clock::time_point time) {
+  auto& buffer = GetThreadBuffer();
+  const auto head = buffer.head.load(std::memory_order_relaxed);
+  if (head - buffer.tail.load(std::memory_order_acquire) == TraceThreadBuffer::capacity) {
+    buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  auto& event = buffer.events[head % TraceThreadBuffer::capacity];
+  const auto now = Clock::now();
+  event.time = phase == 'X' ? time : now;
+  event.id = id;
+  event.value = phase == 'X' ? std::chrono::duration<double, std::micro>(now - time).count() : value;
+  event.phase = phase;
+  event.name_length = static_cast<uint8_t>(std::min(name.size(), sizeof(event.name)));
+  std::memcpy(event.name, name.data(), event.name_length);
+  buffer.head.store(head + 1, std::memory_order_release);
+}
+
+TraceThreadBuffer& Tracer::GetThreadBuffer() {
+  thread_local ThreadBuffers thread_buffers;
+  for (auto& [tracer_id, buffer] : thread_buffers.entries) {
+    if (tracer_id == id_)
+      return *buffer;
+  }
+
+  // The first event of this thread, the only time recording takes a lock
+  std::shared_ptr<TraceThreadBuffer> buffer;
+  {
+    std::lock_guard<std::mutex> lock{output_->mutex};
+    buffer = std::make_shared<TraceThreadBuffer>(output_->next_thread_id++);
+    output_->buffers.push_back(buffer);
+  }
+  thread_buffers.entries.emplace_back(id_, buffer);
+  return *buffer;
 }
 
 Tracer& DefaultTracerInstance() {
-  static auto tracer = Tracer{};
+  static Tracer tracer;
   return tracer;
 }
 
@@ -1,38 +1,79 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
-// Build with CMake option ENABLE_TRACING=ON to enable tracing.
-// To avoid performance overhead, tracing is not enabled by default.
-
-// When tracing is enabled, the trace data will be recorded to a file.
-// The trace file path can be specified with the environment variable ORTGENAI_TRACE_FILE_PATH.
-// The trace file can be viewed with Perfetto UI (https://ui.perfetto.dev/).
+// Tracing records durations, counters and async spans (like the lifetime of a request) into a ring buffer per thread,
+// and a background thread writes them to a file in Chrome tracing format, which Perfetto UI (https://ui.perfetto.dev/)
+// can open. Recording an event is a copy into the thread's own buffer without any lock, and when tracing is off every
+// call returns after one relaxed atomic load, so tracing can stay available in production builds. When a thread records
+// faster than the background thread writes, its events are dropped and counted in the trace. Durations are recorded
+// as one complete event when they end, so a dropped event never leaves the begin or end of a duration unmatched.
+
+// Tracing is off by default. It is switched at runtime with Tracer::SetEnabled (OgaSetTracingEnabled in the C API), or
+// on from the start with the environment variable ORTGENAI_TRACE=1 or the CMake option ENABLE_TRACING=ON.
+// The trace file path can be specified with the environment variable ORTGENAI_TRACE_FILE_PATH. When tracing is enabled
+// again after Shutdown, the new trace goes to a file numbered after it (like ortgenai_trace.1.log) instead of
+// overwriting the earlier one.
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <memory>
+#include <string>
 #include <string_view>
 
 namespace Generators {
 
-// Trace consumer interface.
-class TraceSink {
- public:
-  virtual void BeginDuration(std::string_view label) = 0;
-  virtual void EndDuration() = 0;
-  virtual ~TraceSink() = default;
-};
+struct TraceThreadBuffer;
+struct TraceOutput;
 
 // Main tracing class.
 class Tracer {
  public:
+  using Clock = std::chrono::steady_clock;
+  static constexpr size_t max_name_length = 46;  // Longer names are cut
+
   Tracer();
+  explicit Tracer(std::string trace_file_name);  // Instead of the one from the environment
+  ~Tracer();
 
-  // Begins a traced duration with the given label.
-  void BeginDuration(std::string_view label);
+  bool IsEnabled() const { return enabled_.load(std::memory_order_relaxed); }
 
-  // Ends the traced duration from the most recent call to BeginDuration() in the same thread.
-  void EndDuration();
+  // The trace file is created the first time tracing is enabled, events recorded later are added to it.
+  void SetEnabled(bool enabled);
+
+  // Records a traced duration with the given label, from start until now. Durations of a thread nest by their times.
+  void Duration(std::string_view label, Clock::time_point start) {
+    if (IsEnabled())
+      Record('X', label, 0, 0, start);
+  }
+
+  // Records the current value of a counter, shown as a graph over time.
+  void Counter(std::string_view name, double value) {
+    if (IsEnabled())
+      Record('C', name, 0, value);
+  }
+
+  // Begins and ends a span that is not tied to a thread, like the lifetime of a request. The begin and end of a span
+  // are matched by name and id, so spans of different requests can overlap.
+  void BeginAsync(std::string_view name, uint64_t id) {
+    if (IsEnabled())
+      Record('b', name, id);
+  }
+
+  void EndAsync(std::string_view name, uint64_t id) {
+    if (IsEnabled())
+      Record('e', name, id);
+  }
+
+  // Writes the events recorded so far to the trace file, without waiting for the background thread.
+  void Flush();
+
+  // Stops recording, writes the recorded events and closes the trace file. Enabling tracing again starts a new file.
+  void Shutdown();
 
  private:
   Tracer(const Tracer&) = delete;
@@ -40,9 +81,13 @@ class Tracer {
   Tracer(Tracer&&) = delete;
   Tracer& operator=(Tracer&&) = delete;
 
-#if defined(ORTGENAI_ENABLE_TRACING)
-  std::unique_ptr<TraceSink> sink_;
-#endif
+  void Record(char phase, std::string_view name, uint64_t id = 0, double value = 0, Clock::time_point time = {});
+  TraceThreadBuffer& GetThreadBuffer();
+
+  std::atomic<bool> enabled_{};
+  const uint64_t id_;  // Tells apart the buffers of different tracers in the same thread
+  const std::string trace_file_name_;
+  std::unique_ptr<TraceOutput> output_;
 };
 
 // Gets the default tracer instance.
@@ -56,12 +101,19 @@ class DurationTrace {
   }
 
   [[nodiscard]] DurationTrace(Tracer& tracer, std::string_view label)
-      : tracer_{tracer} {
-    tracer_.BeginDuration(label);
+      : tracer_{tracer}, recorded_{tracer.IsEnabled()} {
+    if (recorded_) {
+      // Copied, the label may be a temporary
+      label_length_ = std::min(label.size(), Tracer::max_name_length);
+      std::memcpy(label_, label.data(), label_length_);
+      start_ = Tracer::Clock::now();
+    }
   }
 
   ~DurationTrace() {
-    tracer_.EndDuration();
+    // Not recorded if tracing was switched off meanwhile
+    if (recorded_)
+      tracer_.Duration({label_, label_length_}, start_);
   }
 
  private:
@@ -71,6 +123,10 @@ class DurationTrace {
   DurationTrace& operator=(DurationTrace&&) = delete;
 
   Tracer& tracer_;
+  const bool recorded_;
+  Tracer::Clock::time_point start_;
+  size_t label_length_{};
+  char label_[Tracer::max_name_length];
 };
 
 }  // namespace Generators
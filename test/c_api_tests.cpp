@@ -1,12 +1,16 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT License.
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>  // for memcmp
+#include <fstream>
 #include <numeric>
 #include <iostream>
 #include <thread>
 #include <vector>
 #include <regex>
+#include <string>
 #include "span.h"
 
 #define OGA_USE_SPAN 1
@@ -173,6 +177,47 @@ TEST(CAPITests, AppendTokensToSequence) {
 #endif
 }
 
+TEST(CAPITests, BatchPlanByLength) {
+  const std::vector<std::vector<int32_t>> input_sequences = {
+      std::vector<int32_t>(5, 1),
+      std::vector<int32_t>(100, 2),
+      std::vector<int32_t>(6, 3),
+      std::vector<int32_t>(98, 4),
+      std::vector<int32_t>(7, 5),
+      std::vector<int32_t>(99, 6),
+  };
+
+  auto sequences = OgaSequences::Create();
+  for (auto& sequence : input_sequences)
+    sequences->Append(sequence);
+
+  // The short and the long sequences are batched separately
+  auto plan = OgaBatchPlan::Create(*sequences, 3);
+  ASSERT_EQ(plan->BatchCount(), 2);
+  const std::vector<size_t> expected_short{0, 2, 4}, expected_long{1, 3, 5};
+  auto short_batch = plan->GetBatch(0);
+  auto long_batch = plan->GetBatch(1);
+  EXPECT_TRUE(std::equal(short_batch.begin(), short_batch.end(), expected_short.begin(), expected_short.end()));
+  EXPECT_TRUE(std::equal(long_batch.begin(), long_batch.end(), expected_long.begin(), expected_long.end()));
+
+  // The batch sequences are the original ones, in the order of the batch indices
+  auto batch_sequences = plan->GetBatchSequences(*sequences, 1);
+  ASSERT_EQ(batch_sequences->Count(), 3);
+  for (size_t i = 0; i < batch_sequences->Count(); i++) {
+    auto sequence = batch_sequences->Get(i);
+    auto& expected = input_sequences[long_batch[i]];
+    EXPECT_TRUE(std::equal(sequence.begin(), sequence.end(), expected.begin(), expected.end()));
+  }
+
+  // A padded batch of the long sequences is over the token limit, so they are split up
+  plan = OgaBatchPlan::Create(*sequences, 3, 150);
+  ASSERT_EQ(plan->BatchCount(), 4);
+  EXPECT_EQ(plan->BatchSize(0), 3);
+  EXPECT_EQ(plan->BatchSize(1) + plan->BatchSize(2) + plan->BatchSize(3), 3);
+
+  EXPECT_THROW(plan->GetBatchSequences(*sequences, 4), std::runtime_error);
+}
+
 TEST(CAPITests, MaxLength) {
   // Batch size 1 case
   std::vector<int32_t> input_ids_0{1, 2, 3, 5, 8};
@@ -362,6 +407,213 @@ TEST(CAPITests, GreedySearchGptFp32CAPI) {
     EXPECT_TRUE(0 == std::memcmp(expected_output_start, sequence_data, sequence_length * sizeof(int32_t)));
   }
 }
+
+TEST(CAPITests, GenerateAsyncGptFp32CAPI) {
+  std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+  std::vector<int32_t> expected_next_tokens{204, 731, 204, 114, 204, 114, 204, 114, 204, 114, 204, 114};  // Both rows, step by step
+
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 10);
+  params->SetSearchOption("batch_size", 2);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  generator->AppendTokens(input_ids.data(), input_ids.size());
+
+  std::vector<int32_t> next_tokens;
+  auto collect = [](const int32_t* tokens, size_t token_count, const char* const* texts, void* user_data) {
+    EXPECT_EQ(texts, nullptr);
+    auto& next_tokens = *static_cast<std::vector<int32_t>*>(user_data);
+    next_tokens.insert(next_tokens.end(), tokens, tokens + token_count);
+    return true;
+  };
+  generator->GenerateAsync(nullptr, collect, &next_tokens);
+  generator->WaitForGenerate();
+
+  EXPECT_TRUE(generator->IsDone());
+  EXPECT_EQ(next_tokens, expected_next_tokens);
+
+  // Returning false from the callback stops after the first step
+  generator->RewindTo(0);
+  generator->AppendTokens(input_ids.data(), input_ids.size());
+  size_t step_count = 0;
+  auto stop = [](const int32_t*, size_t, const char* const*, void* user_data) {
+    ++*static_cast<size_t*>(user_data);
+    return false;
+  };
+  generator->GenerateAsync(nullptr, stop, &step_count);
+  generator->WaitForGenerate();
+  EXPECT_EQ(step_count, 1u);
+  EXPECT_FALSE(generator->IsDone());
+}
+
+TEST(CAPITests, GenerateAsyncBatchedGptFp32CAPI) {
+  std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+  std::vector<int32_t> expected_next_tokens{204, 731, 204, 114, 204, 114, 204, 114, 204, 114, 204, 114};  // Both rows, step by step
+
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  auto tokenizer = OgaTokenizer::Create(*model);
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 10);
+  params->SetSearchOption("batch_size", 2);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  generator->AppendTokens(input_ids.data(), input_ids.size());
+
+  struct Collected {
+    std::vector<int32_t> next_tokens;
+    std::vector<size_t> step_counts;
+    std::string texts[2];
+  } collected;
+  auto collect = [](const int32_t* tokens, size_t step_count, size_t sequence_count, const char* const* texts, void* user_data) {
+    auto& collected = *static_cast<Collected*>(user_data);
+    EXPECT_EQ(sequence_count, 2u);
+    collected.next_tokens.insert(collected.next_tokens.end(), tokens, tokens + step_count * sequence_count);
+    collected.step_counts.push_back(step_count);
+    for (size_t i = 0; i < sequence_count; i++)
+      collected.texts[i] += texts[i];
+    return true;
+  };
+  generator->GenerateAsyncBatched(tokenizer.get(), 4, collect, &collected);
+  generator->WaitForGenerate();
+
+  // 6 steps in calls of 4, the last call gets the 2 steps left
+  EXPECT_TRUE(generator->IsDone());
+  EXPECT_EQ(collected.next_tokens, expected_next_tokens);
+  EXPECT_EQ(collected.step_counts, (std::vector<size_t>{4, 2}));
+  for (size_t i = 0; i < 2; i++) {
+    std::vector<int32_t> row_tokens;
+    for (size_t step = 0; step < 6; step++)
+      row_tokens.push_back(expected_next_tokens[step * 2 + i]);
+    EXPECT_EQ(collected.texts[i], tokenizer->Decode(row_tokens.data(), row_tokens.size()).p_);
+  }
+
+  generator->RewindTo(0);
+  EXPECT_THROW(generator->GenerateAsyncBatched(nullptr, 0, collect, &collected), std::runtime_error);
+}
+
+TEST(CAPITests, GetMetricsCAPI) {
+  std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 10);
+  params->SetSearchOption("batch_size", 2);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  generator->AppendTokens(input_ids.data(), input_ids.size());
+  while (!generator->IsDone()) {
+    generator->GenerateNextToken();
+  }
+
+  auto metrics = generator->GetMetrics();
+  EXPECT_EQ(metrics->GetValue("prompt_token_count"), 8);
+  EXPECT_EQ(metrics->GetValue("step_count"), 6);
+  EXPECT_EQ(metrics->GetValue("generated_token_count"), 12);
+  EXPECT_EQ(metrics->GetValue("model_run_count"), 6);  // The prompt, then every step but the last
+  EXPECT_GT(metrics->GetValue("kv_cache_bytes"), 0);
+  EXPECT_GT(metrics->GetValue("time_to_first_token"), 0);
+  EXPECT_GE(metrics->GetValue("decode_time"), metrics->GetValue("search_time"));
+  EXPECT_GE(metrics->GetValue("max_token_latency") * 6, metrics->GetValue("decode_time"));
+
+  auto names = metrics->GetNames();
+  for (size_t i = 0; i < names->Count(); i++)
+    metrics->GetValue(names->Get(i));
+  EXPECT_THROW(metrics->GetValue("not_a_metric"), std::runtime_error);
+}
+
+TEST(CAPITests, WarmupGptFp32CAPI) {
+  std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+  std::vector<int32_t> expected_output{
+      0, 0, 0, 52, 204, 204, 204, 204, 204, 204,
+      0, 0, 195, 731, 731, 114, 114, 114, 114, 114};
+
+  // The warm-up runs must not leave anything behind that changes what the model generates
+  auto config = OgaConfig::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  config->Overlay(R"({ "warmup": { "enabled": true, "batch_sizes": [1, 2], "prompt_length": 4, "decode_length": 4 } })");
+  auto model = OgaModel::Create(*config);
+
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 10);
+  params->SetSearchOption("batch_size", 2);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  generator->AppendTokens(input_ids.data(), input_ids.size());
+  while (!generator->IsDone()) {
+    generator->GenerateNextToken();
+  }
+
+  for (size_t i = 0; i < 2; i++) {
+    ASSERT_EQ(generator->GetSequenceCount(i), 10u);
+    EXPECT_TRUE(0 == std::memcmp(&expected_output[i * 10], generator->GetSequenceData(i), 10 * sizeof(int32_t)));
+  }
+}
+
+TEST(CAPITests, SessionCreationThreadsConfig) {
+  auto config = OgaConfig::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  EXPECT_THROW(config->Overlay(R"({ "model": { "session_creation_threads": -1 } })"), std::runtime_error);
+  EXPECT_THROW(config->Overlay(R"({ "model": { "session_creation_threads": 1.5 } })"), std::runtime_error);
+  EXPECT_THROW(config->Overlay(R"({ "model": { "session_creation_threads": 1e9 } })"), std::runtime_error);
+
+  // 0 picks one thread per core
+  for (const char* threads : {"0", "1", "4"}) {
+    config->Overlay((std::string{R"({ "model": { "session_creation_threads": )"} + threads + " } }").c_str());
+    auto model = OgaModel::Create(*config);
+    EXPECT_NE(model, nullptr);
+  }
+}
+
+TEST(CAPITests, ConcurrentEncodersConfig) {
+  auto config = OgaConfig::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  config->Overlay(R"({ "model": { "concurrent_encoders": true } })");
+  config->Overlay(R"({ "model": { "concurrent_encoders": false } })");
+  EXPECT_THROW(config->Overlay(R"({ "model": { "concurrent_encoders": 1 } })"), std::runtime_error);
+  EXPECT_THROW(config->Overlay(R"({ "model": { "vision": { "parallel_batches": 0 } } })"), std::runtime_error);
+}
+
+TEST(CAPITests, ShareInitializersConfig) {
+  auto config = OgaConfig::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  config->Overlay(R"({ "model": { "share_initializers": true } })");
+  EXPECT_THROW(config->Overlay(R"({ "model": { "share_initializers": "yes" } })"), std::runtime_error);
+}
+
+TEST(CAPITests, ModelDataGptFp32CAPI) {
+  std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+  std::vector<int32_t> expected_output{
+      0, 0, 0, 52, 204, 204, 204, 204, 204, 204,
+      0, 0, 195, 731, 731, 114, 114, 114, 114, 114};
+
+  auto read_file = [](const char* path) {
+    std::ifstream file{path, std::ios::binary};
+    return std::vector<char>{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+  };
+  auto config_json = read_file(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32/genai_config.json");
+  auto model_onnx = read_file(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32/past.onnx");
+  ASSERT_FALSE(model_onnx.empty());
+
+  // The config directory doesn't have the model files, so they can only come from memory
+  auto model_data = OgaModelData::Create();
+  model_data->AddFile("genai_config.json", config_json.data(), config_json.size());
+  model_data->AddFile("past.onnx", model_onnx.data(), model_onnx.size());
+  auto config = OgaConfig::Create(MODEL_PATH "hf-internal-testing", *model_data);
+  model_data.reset();  // The config keeps what it needs
+  auto model = OgaModel::Create(*config);
+
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 10);
+  params->SetSearchOption("batch_size", 2);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  generator->AppendTokens(input_ids.data(), input_ids.size());
+  while (!generator->IsDone()) {
+    generator->GenerateNextToken();
+  }
+
+  for (size_t i = 0; i < 2; i++) {
+    ASSERT_EQ(generator->GetSequenceCount(i), 10u);
+    EXPECT_TRUE(0 == std::memcmp(&expected_output[i * 10], generator->GetSequenceData(i), 10 * sizeof(int32_t)));
+  }
+}
 #endif
 
 TEST(CAPITests, GetOutputCAPI) {
@@ -467,6 +719,89 @@ TEST(CAPITests, GetLogitsCAPI) {
   }
 }
 
+TEST(CAPITests, GetTokenLogProbsCAPI) {
+  std::vector<int32_t> input_ids{195, 731, 52};
+  size_t top_n = 3;
+
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 10);
+
+  // Score the whole sequence with a single forward pass
+  auto generator = OgaGenerator::Create(*model, *params);
+  generator->AppendTokens(input_ids.data(), input_ids.size());
+  std::unique_ptr<OgaTensor> logprobs, top_ids, top_logprobs;
+  generator->GetTokenLogProbs(top_n, logprobs, top_ids, top_logprobs);
+
+  EXPECT_EQ(logprobs->Shape(), (std::vector<int64_t>{1, 3}));
+  EXPECT_EQ(top_ids->Shape(), (std::vector<int64_t>{1, 3, 3}));
+  auto logprobs_data = reinterpret_cast<float*>(logprobs->Data());
+  auto top_ids_data = reinterpret_cast<int32_t*>(top_ids->Data());
+  auto top_logprobs_data = reinterpret_cast<float*>(top_logprobs->Data());
+
+  // The first token has nothing to be conditioned on
+  EXPECT_EQ(logprobs_data[0], 0.0f);
+  EXPECT_EQ(top_ids_data[0], -1);
+
+  // Each scored token can't be more likely than the best alternative, and alternatives are sorted
+  for (size_t t = 1; t < input_ids.size(); t++) {
+    EXPECT_LE(logprobs_data[t], top_logprobs_data[t * top_n] + 1e-5f);
+    EXPECT_GE(top_logprobs_data[t * top_n], top_logprobs_data[t * top_n + 1]);
+    EXPECT_GE(top_logprobs_data[t * top_n + 1], top_logprobs_data[t * top_n + 2]);
+  }
+
+  // Must match the log softmax of the last token logits when processing the prefix incrementally
+  auto prefix_generator = OgaGenerator::Create(*model, *params);
+  prefix_generator->AppendTokens(input_ids.data(), 2);
+  auto prefix_logits = prefix_generator->GetLogits();
+  auto logits_data = reinterpret_cast<float*>(prefix_logits->Data());
+  size_t vocab_size = prefix_logits->Shape().back();
+  float max_logit = *std::max_element(logits_data, logits_data + vocab_size);
+  float exp_sum = 0.0f;
+  for (size_t i = 0; i < vocab_size; i++)
+    exp_sum += std::exp(logits_data[i] - max_logit);
+  float expected_logprob = logits_data[input_ids[2]] - max_logit - std::log(exp_sum);
+  EXPECT_NEAR(expected_logprob, logprobs_data[2], 0.001f);
+}
+
+TEST(CAPITests, GetTokenLogProbsPaddingCAPI) {
+  // 98 is both the pad and the EOS token of this model. The first row holds it within the sequence, the second row
+  // is padded after its last token.
+  std::vector<int32_t> input_ids{195, 98, 731, 52,
+                                 195, 731, 98, 98};
+  constexpr size_t sequence_length = 4;
+  constexpr size_t top_n = 2;
+
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 10);
+  params->SetSearchOption("batch_size", 2);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  generator->AppendTokens(input_ids.data(), input_ids.size());
+  std::unique_ptr<OgaTensor> logprobs, top_ids, top_logprobs;
+  generator->GetTokenLogProbs(top_n, logprobs, top_ids, top_logprobs);
+
+  EXPECT_EQ(logprobs->Shape(), (std::vector<int64_t>{2, sequence_length}));
+  auto logprobs_data = reinterpret_cast<float*>(logprobs->Data());
+  auto top_ids_data = reinterpret_cast<int32_t*>(top_ids->Data());
+
+  // Every token of the first row after the first one is scored, including the pad token
+  for (size_t t = 1; t < sequence_length; t++) {
+    EXPECT_LT(logprobs_data[t], 0.0f);
+    EXPECT_NE(top_ids_data[t * top_n], -1);
+  }
+
+  // The second row ends at its last token that is not padding
+  EXPECT_LT(logprobs_data[sequence_length + 1], 0.0f);
+  for (size_t t = 2; t < sequence_length; t++) {
+    EXPECT_EQ(logprobs_data[sequence_length + t], 0.0f);
+    EXPECT_EQ(top_ids_data[(sequence_length + t) * top_n], -1);
+  }
+}
+
 TEST(CAPITests, SetLogitsCAPI) {
   std::vector<int64_t> input_ids_shape{2, 4};
   std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
@@ -741,6 +1076,40 @@ TEST(CAPITests, AdaptersTestMultipleAdapters) {
   adapters->UnloadAdapter("adapter_a");
   adapters->UnloadAdapter("adapter_b");
 }
+
+TEST(CAPITests, AdaptersTestMaxLoadedAdapters) {
+  // The python unit tests create the adapter model.
+  // In order to run this test, the python unit test must have been run first.
+  auto model = OgaModel::Create(MODEL_PATH "multiple_adapters");
+  auto adapters = OgaAdapters::Create(*model);
+  adapters->SetMaxLoadedAdapters(1);
+  adapters->LoadAdapter(MODEL_PATH "multiple_adapters/adapter_0.onnx_adapter", "adapter_a");
+  adapters->LoadAdapter(MODEL_PATH "multiple_adapters/adapter_1.onnx_adapter", "adapter_b");
+
+  // adapter_a was least recently used and not active, so it was evicted to make room for adapter_b
+  EXPECT_FALSE(adapters->IsAdapterLoaded("adapter_a"));
+  EXPECT_TRUE(adapters->IsAdapterLoaded("adapter_b"));
+
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 20);
+
+  {
+    auto generator = OgaGenerator::Create(*model, *params);
+    generator->SetActiveAdapter(*adapters, "adapter_a");  // Reloads adapter_a and evicts adapter_b
+    EXPECT_TRUE(adapters->IsAdapterLoaded("adapter_a"));
+    EXPECT_FALSE(adapters->IsAdapterLoaded("adapter_b"));
+
+    // Active adapters are never evicted, even when the limit is exceeded
+    auto generator2 = OgaGenerator::Create(*model, *params);
+    generator2->SetActiveAdapter(*adapters, "adapter_b");
+    EXPECT_TRUE(adapters->IsAdapterLoaded("adapter_a"));
+    EXPECT_TRUE(adapters->IsAdapterLoaded("adapter_b"));
+  }
+
+  EXPECT_EQ(adapters->IsAdapterLoaded("adapter_a") + adapters->IsAdapterLoaded("adapter_b"), 1);
+  adapters->UnloadAdapter("adapter_a");
+  adapters->UnloadAdapter("adapter_b");
+}
 #endif  // TEST_PHI2 && !USE_DML
 
 void CheckResult(OgaResult* result) {
@@ -0,0 +1,107 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "generators.h"
+#include "models/image_features_cache.h"
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+namespace {
+
+struct CpuTensor {
+  CpuTensor(std::vector<float> values, std::vector<int64_t> shape) : values{std::move(values)}, shape{std::move(shape)} {
+    auto memory_info = OrtMemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
+    value = OrtValue::CreateTensor<float>(*memory_info, std::span<float>{this->values}, this->shape);
+  }
+
+  std::vector<float> values;
+  std::vector<int64_t> shape;
+  std::unique_ptr<OrtValue> value;
+};
+
+ImageFeaturesCache::Key MakeKey(const CpuTensor& input) {
+  const OrtValue* inputs[] = {input.value.get()};
+  return ImageFeaturesCache::Key{inputs};
+}
+
+}  // namespace
+
+TEST(ImageFeaturesCacheTest, FindCopiesCachedFeatures) {
+  GetOrtEnv();
+  ImageFeaturesCache cache{*GetDeviceInterface(DeviceType::CPU), 1 << 20};
+
+  CpuTensor image{{1, 2, 3, 4}, {1, 4}};
+  CpuTensor features{{5, 6, 7, 8, 9, 10}, {2, 3}};
+  cache.Insert(MakeKey(image), *features.value);
+
+  CpuTensor found{std::vector<float>(6), {2, 3}};
+  ASSERT_TRUE(cache.Find(MakeKey(image), *found.value));
+  EXPECT_EQ(found.values, features.values);
+
+  // The cached copy doesn't change with the features it was made from
+  features.values[0] = 0;
+  ASSERT_TRUE(cache.Find(MakeKey(image), *found.value));
+  EXPECT_EQ(found.values[0], 5);
+
+  // Other contents or the same contents in another shape are different images
+  CpuTensor other_image{{1, 2, 3, 5}, {1, 4}};
+  EXPECT_FALSE(cache.Find(MakeKey(other_image), *found.value));
+  CpuTensor reshaped_image{{1, 2, 3, 4}, {2, 2}};
+  EXPECT_FALSE(cache.Find(MakeKey(reshaped_image), *found.value));
+
+  // Features of another shape are not copied into
+  CpuTensor wrong_shape{std::vector<float>(6), {3, 2}};
+  EXPECT_FALSE(cache.Find(MakeKey(image), *wrong_shape.value));
+}
+
+TEST(ImageFeaturesCacheTest, HashCollisionIsAMiss) {
+  GetOrtEnv();
+  ImageFeaturesCache cache{*GetDeviceInterface(DeviceType::CPU), 1 << 20};
+
+  CpuTensor image{{1, 2, 3, 4}, {1, 4}};
+  CpuTensor features{{5, 6}, {1, 2}};
+  auto key = MakeKey(image);
+  cache.Insert(std::move(key), *features.value);
+
+  // Another image whose hash collides must not get the cached features
+  CpuTensor other_image{{4, 3, 2, 1}, {1, 4}};
+  auto colliding_key = MakeKey(other_image);
+  const auto cached_key = MakeKey(image);
+  colliding_key.hash[0] = cached_key.hash[0];
+  colliding_key.hash[1] = cached_key.hash[1];
+
+  CpuTensor found{{0, 0}, {1, 2}};
+  EXPECT_FALSE(cache.Find(colliding_key, *found.value));
+  EXPECT_TRUE(cache.Find(cached_key, *found.value));
+}
+
+TEST(ImageFeaturesCacheTest, EvictsLeastRecentlyUsed) {
+  GetOrtEnv();
+
+  CpuTensor images[] = {{{1}, {1, 1}}, {{2}, {1, 1}}, {{3}, {1, 1}}};
+  CpuTensor features{std::vector<float>(64), {64}};
+  const size_t entry_bytes = features.values.size() * sizeof(float) + MakeKey(images[0]).bytes.size();
+
+  ImageFeaturesCache cache{*GetDeviceInterface(DeviceType::CPU), 2 * entry_bytes};
+  cache.Insert(MakeKey(images[0]), *features.value);
+  cache.Insert(MakeKey(images[1]), *features.value);
+  EXPECT_EQ(cache.GetBytes(), 2 * entry_bytes);
+
+  // Using the first image makes the second the least recently used
+  EXPECT_TRUE(cache.Find(MakeKey(images[0]), *features.value));
+  cache.Insert(MakeKey(images[2]), *features.value);
+  EXPECT_EQ(cache.GetBytes(), 2 * entry_bytes);
+  EXPECT_TRUE(cache.Find(MakeKey(images[0]), *features.value));
+  EXPECT_FALSE(cache.Find(MakeKey(images[1]), *features.value));
+  EXPECT_TRUE(cache.Find(MakeKey(images[2]), *features.value));
+
+  // An entry larger than the whole budget is not cached
+  ImageFeaturesCache small_cache{*GetDeviceInterface(DeviceType::CPU), entry_bytes - 1};
+  small_cache.Insert(MakeKey(images[0]), *features.value);
+  EXPECT_EQ(small_cache.GetBytes(), 0u);
+  EXPECT_FALSE(small_cache.Find(MakeKey(images[0]), *features.value));
+}
+
+}  // namespace Generators::test
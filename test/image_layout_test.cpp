@@ -0,0 +1,85 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "generators.h"
+#include "models/multi_modal.h"
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+namespace {
+
+template <typename T>
+struct CpuTensor {
+  CpuTensor(std::vector<int64_t> shape, std::vector<T> values = {}) : shape{std::move(shape)}, values{std::move(values)} {
+    this->values.resize(static_cast<size_t>(ElementCountFromShape(this->shape)));
+    auto memory_info = OrtMemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
+    value = OrtValue::CreateTensor<T>(*memory_info, std::span<T>{this->values}, this->shape);
+  }
+
+  std::vector<int64_t> shape;
+  std::vector<T> values;
+  std::unique_ptr<OrtValue> value;
+};
+
+}  // namespace
+
+TEST(ImageLayoutTest, PerImageInputsComeFromConfig) {
+  GetOrtEnv();
+  Config::Model::Vision config;
+
+  // Three images of 2, 3 and 1 tokens. The extra input has a row per image by chance but isn't one of the configured
+  // per-image inputs, so it is given whole to every run.
+  CpuTensor<float> pixel_values{{3, 2, 4}};
+  CpuTensor<int64_t> image_sizes{{3, 2}};
+  CpuTensor<float> extra{{3, 5}};
+  CpuTensor<float> image_features{{6, 8}};
+  CpuTensor<int64_t> num_img_tokens{{3}, {2, 3, 1}};
+
+  std::vector<const char*> names{"pixel_values", "image_sizes", "extra"};
+  std::vector<OrtValue*> inputs{pixel_values.value.get(), image_sizes.value.get(), extra.value.get()};
+  auto layout = GetImageLayout(config, names, inputs, *image_features.value, num_img_tokens.value.get(), 3);
+  ASSERT_TRUE(layout);
+  EXPECT_EQ(layout->feature_rows, (std::vector<int64_t>{0, 2, 5, 6}));
+  EXPECT_EQ(layout->per_image, (std::vector<bool>{true, true, false}));
+
+  // Renamed inputs are found through the config
+  config.inputs.pixel_values = "images";
+  names[0] = "images";
+  layout = GetImageLayout(config, names, inputs, *image_features.value, num_img_tokens.value.get(), 3);
+  ASSERT_TRUE(layout);
+  EXPECT_EQ(layout->per_image, (std::vector<bool>{true, true, false}));
+
+  // Features with an image dimension are split by image without num_img_tokens
+  CpuTensor<float> batched_features{{3, 4, 8}};
+  layout = GetImageLayout(config, names, inputs, *batched_features.value, nullptr, 3);
+  ASSERT_TRUE(layout);
+  EXPECT_EQ(layout->feature_rows, (std::vector<int64_t>{0, 1, 2, 3}));
+}
+
+TEST(ImageLayoutTest, NoLayoutWhenImagesCantBeSplit) {
+  GetOrtEnv();
+  Config::Model::Vision config;
+
+  CpuTensor<float> pixel_values{{2, 4}};
+  CpuTensor<float> image_features{{5, 8}};
+  CpuTensor<int64_t> num_img_tokens{{2}, {2, 3}};
+  std::vector<const char*> names{"pixel_values"};
+  std::vector<OrtValue*> inputs{pixel_values.value.get()};
+  EXPECT_TRUE(GetImageLayout(config, names, inputs, *image_features.value, num_img_tokens.value.get(), 2));
+
+  // A per-image input without a row per image
+  CpuTensor<float> packed_pixel_values{{1, 4}};
+  std::vector<OrtValue*> packed_inputs{packed_pixel_values.value.get()};
+  EXPECT_FALSE(GetImageLayout(config, names, packed_inputs, *image_features.value, num_img_tokens.value.get(), 2));
+
+  // Token counts missing or not adding up to the image features
+  EXPECT_FALSE(GetImageLayout(config, names, inputs, *image_features.value, nullptr, 2));
+  CpuTensor<int64_t> wrong_tokens{{2}, {2, 2}};
+  EXPECT_FALSE(GetImageLayout(config, names, inputs, *image_features.value, wrong_tokens.value.get(), 2));
+
+  EXPECT_FALSE(GetImageLayout(config, names, inputs, *image_features.value, num_img_tokens.value.get(), 0));
+}
+
+}  // namespace Generators::test
@@ -0,0 +1,92 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "generators.h"
+#include "models/processor.h"
+#include "models/threadpool.h"
+
+#include <gtest/gtest.h>
+
+#ifndef MODEL_PATH
+#define MODEL_PATH "../../test/test_models/"
+#endif
+
+namespace Generators::test {
+
+namespace {
+
+const char* const image_paths[] = {MODEL_PATH "images/australia.jpg", MODEL_PATH "images/sheet.png"};
+const auto processor_config = MODEL_PATH "vision-preprocessing/processor_config.json";
+
+// Preprocesses all the images in one call, the way ort-extensions batches them itself
+ort_extensions::OrtxObjectPtr<OrtxTensorResult> PreProcessBatched() {
+  ort_extensions::OrtxObjectPtr<OrtxProcessor> processor;
+  CheckResult(OrtxCreateProcessor(processor.ToBeAssigned(), processor_config));
+  ort_extensions::OrtxObjectPtr<OrtxRawImages> images;
+  size_t num_images{};
+  CheckResult(OrtxLoadImages(images.ToBeAssigned(), const_cast<const char**>(image_paths), std::size(image_paths), &num_images));
+  ort_extensions::OrtxObjectPtr<OrtxTensorResult> result;
+  CheckResult(OrtxImagePreProcess(processor.get(), images.get(), result.ToBeAssigned()));
+  return result;
+}
+
+template <typename T>
+void ExpectSameTensor(OrtxTensorResult* expected_result, size_t index, OrtValue& actual) {
+  OrtxTensor* tensor{};
+  CheckResult(OrtxTensorResultGetAt(expected_result, index, &tensor));
+  const T* expected{};
+  const int64_t* expected_shape{};
+  size_t expected_num_dims{};
+  CheckResult(OrtxGetTensorData(tensor, reinterpret_cast<const void**>(&expected), &expected_shape, &expected_num_dims));
+
+  const auto shape = actual.GetTensorTypeAndShapeInfo()->GetShape();
+  ASSERT_EQ(shape, std::vector<int64_t>(expected_shape, expected_shape + expected_num_dims));
+  const auto* data = actual.GetTensorData<T>();
+  const auto count = static_cast<size_t>(ElementCountFromShape(shape));
+  EXPECT_TRUE(std::equal(data, data + count, expected));
+}
+
+}  // namespace
+
+TEST(ImagePreProcessingTest, MatchesBatchedPreProcessing) {
+  GetOrtEnv();
+  auto expected = PreProcessBatched();
+
+  // The images are split into different numbers of crops, so stacking pads the smaller ones
+  ImageProcessorPool processors{processor_config};
+  const auto results = processors.PreProcess(*LoadImages(image_paths));
+  ASSERT_EQ(results.size(), std::size(image_paths));
+
+  Ort::Allocator& allocator{Ort::Allocator::GetWithDefaultOptions()};
+  ExpectSameTensor<float>(expected.get(), 0, *StackTensors<float>(results, 0, allocator));
+  ExpectSameTensor<int64_t>(expected.get(), 1, *StackTensors<int64_t>(results, 1, allocator));
+  ExpectSameTensor<int64_t>(expected.get(), 2, *StackTensors<int64_t>(results, 2, allocator));
+
+  // Processors are reused, so preprocessing again gives the same results
+  const auto again = processors.PreProcess(*LoadImages(image_paths));
+  ExpectSameTensor<float>(expected.get(), 0, *StackTensors<float>(again, 0, allocator));
+}
+
+TEST(ImagePreProcessingTest, SharedPoolRethrowsFirstError) {
+  std::vector<int> ran(64);
+  std::vector<std::function<void()>> tasks;
+  for (size_t i = 0; i < ran.size(); ++i) {
+    tasks.emplace_back([&, i] {
+      // Tasks may run more tasks on the pool without waiting on themselves
+      std::vector<std::function<void()>> inner_tasks(4, [&, i] { ran[i]++; });
+      RunOnSharedPool(inner_tasks);
+      if (i % 16 == 3)
+        throw std::runtime_error("Task " + std::to_string(i));
+    });
+  }
+
+  try {
+    RunOnSharedPool(tasks);
+    FAIL() << "The errors of the tasks were not rethrown";
+  } catch (const std::runtime_error& e) {
+    EXPECT_STREQ(e.what(), "Task 3");
+  }
+  EXPECT_TRUE(std::all_of(ran.begin(), ran.end(), [](int count) { return count == 4; }));
+}
+
+}  // namespace Generators::test
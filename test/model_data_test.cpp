@@ -0,0 +1,101 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "generators.h"
+#include "model_data.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+namespace {
+
+constexpr size_t block_size = 512;
+
+// Appends a tar header, the size written by the caller into header[124..136)
+void AppendHeader(std::string& archive, std::string_view name, char type) {
+  const auto offset = archive.size();
+  archive.resize(offset + block_size);
+  auto* header = archive.data() + offset;
+  std::memcpy(header, name.data(), std::min(name.size(), size_t{100}));
+  header[156] = type;
+  std::memcpy(header + 257, "ustar", 6);
+}
+
+void SetOctalSize(std::string& archive, size_t header_offset, size_t size) {
+  std::snprintf(archive.data() + header_offset + 124, 12, "%011zo", size);
+}
+
+void AppendContents(std::string& archive, std::string_view contents) {
+  archive += contents;
+  archive.resize((archive.size() + block_size - 1) / block_size * block_size);
+}
+
+std::string WriteArchive(const std::string& name, std::string archive) {
+  archive.resize(archive.size() + 2 * block_size);  // End of archive
+  const auto path = ::testing::TempDir() + name;
+  std::ofstream{path, std::ios::binary}.write(archive.data(), static_cast<std::streamsize>(archive.size()));
+  return path;
+}
+
+std::string_view AsText(const std::span<const uint8_t>* data) {
+  return data ? std::string_view{reinterpret_cast<const char*>(data->data()), data->size()} : std::string_view{};
+}
+
+}  // namespace
+
+TEST(ModelDataTest, MapArchiveSizes) {
+  std::string archive;
+
+  // An octal size
+  AppendHeader(archive, "./genai_config.json", '0');
+  SetOctalSize(archive, archive.size() - block_size, 2);
+  AppendContents(archive, "{}");
+
+  // A base-256 size, as written for files of 8 GiB and more
+  AppendHeader(archive, "model.onnx", '0');
+  auto* size_field = reinterpret_cast<uint8_t*>(archive.data() + archive.size() - block_size + 124);
+  size_field[0] = 0x80;
+  size_field[11] = 5;
+  AppendContents(archive, "model");
+
+  // A pax header whose size record overrides the header size, which is left at zero
+  const std::string records = "27 path=weights/model.data\n12 size=600\n";
+  AppendHeader(archive, "PaxHeader", 'x');
+  SetOctalSize(archive, archive.size() - block_size, records.size());
+  AppendContents(archive, records);
+  AppendHeader(archive, "model.data", '0');
+  AppendContents(archive, std::string(600, 'w'));
+
+  const auto path = WriteArchive("model_data_sizes.tar", archive);
+  {
+    auto model_data = ModelData::MapArchive(fs::path{path});
+    EXPECT_EQ(model_data->Files().size(), 3u);
+    EXPECT_EQ(AsText(model_data->Find("genai_config.json")), "{}");
+    EXPECT_EQ(AsText(model_data->Find("model.onnx")), "model");
+    EXPECT_EQ(AsText(model_data->Find("weights/model.data")), std::string(600, 'w'));
+  }
+  std::remove(path.c_str());
+}
+
+TEST(ModelDataTest, MapArchiveRejectsBadSizes) {
+  std::string archive;
+  AppendHeader(archive, "model.onnx", '0');
+  SetOctalSize(archive, 0, 4096);  // More than the archive holds
+  AppendContents(archive, "model");
+  auto path = WriteArchive("model_data_truncated.tar", archive);
+  EXPECT_THROW(ModelData::MapArchive(fs::path{path}), std::runtime_error);
+  std::remove(path.c_str());
+
+  archive.clear();
+  AppendHeader(archive, "model.onnx", '0');
+  archive[124] = static_cast<char>(0xff);  // A negative base-256 size
+  path = WriteArchive("model_data_negative.tar", archive);
+  EXPECT_THROW(ModelData::MapArchive(fs::path{path}), std::runtime_error);
+  std::remove(path.c_str());
+}
+
+}  // namespace Generators::test
@@ -0,0 +1,144 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "generators.h"
+#include "cpu/pooled_allocator.h"
+
+#include <cstdlib>
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+namespace {
+
+// Wraps malloc and free, counting the calls that reach it through the pool
+struct CountingAllocator : OrtAllocator {
+  CountingAllocator() : OrtAllocator{} {
+    version = ORT_API_VERSION;
+    OrtAllocator::Alloc = [](OrtAllocator* this_, size_t size) {
+      auto& counting = *static_cast<CountingAllocator*>(this_);
+      counting.alloc_count++;
+      counting.last_alloc_size = size;
+      return std::malloc(size);
+    };
+    OrtAllocator::Free = [](OrtAllocator* this_, void* p) {
+      static_cast<CountingAllocator*>(this_)->free_count++;
+      std::free(p);
+    };
+  }
+
+  size_t alloc_count{};
+  size_t free_count{};
+  size_t last_alloc_size{};
+};
+
+}  // namespace
+
+TEST(PooledAllocatorTest, ReusesFreedBlock) {
+  CountingAllocator counting;
+  PooledAllocator pool{counting};
+  pool.AddUser();
+
+  auto* first = pool.Allocate(1000);
+  pool.Release(first);
+  EXPECT_EQ(pool.GetCachedBytes(), 1024u);
+
+  // Any size in the same size class gets the cached block back
+  auto* second = pool.Allocate(600);
+  EXPECT_EQ(second, first);
+  EXPECT_EQ(counting.alloc_count, 1u);
+  EXPECT_EQ(pool.GetCachedBytes(), 0u);
+
+  pool.Release(second);
+  pool.RemoveUser();
+  EXPECT_EQ(counting.free_count, 1u);
+}
+
+TEST(PooledAllocatorTest, SizeClasses) {
+  CountingAllocator counting;
+  PooledAllocator pool{counting};
+  pool.AddUser();
+
+  // Sizes are rounded up to a power of two, at least the minimum block size, plus the header
+  auto* small = pool.Allocate(1);
+  const auto header_size = counting.last_alloc_size - PooledAllocator::min_block_size_;
+  auto* exact = pool.Allocate(2048);
+  EXPECT_EQ(counting.last_alloc_size, header_size + 2048);
+  auto* rounded = pool.Allocate(2049);
+  EXPECT_EQ(counting.last_alloc_size, header_size + 4096);
+
+  pool.Release(small);
+  pool.Release(exact);
+  pool.Release(rounded);
+  EXPECT_EQ(pool.GetCachedBytes(), PooledAllocator::min_block_size_ + 2048 + 4096);
+
+  // A block of a different size class is not handed out for a request
+  auto* other = pool.Allocate(8192);
+  EXPECT_EQ(counting.alloc_count, 4u);
+  EXPECT_EQ(pool.Allocate(3000), rounded);
+  EXPECT_EQ(pool.Allocate(256), small);
+
+  pool.Release(other);
+  pool.Release(rounded);
+  pool.Release(small);
+}
+
+TEST(PooledAllocatorTest, LargeBlocksPassThrough) {
+  CountingAllocator counting;
+  PooledAllocator pool{counting};
+  pool.AddUser();
+
+  const size_t largest_class = PooledAllocator::min_block_size_ << (PooledAllocator::size_class_count_ - 1);
+  auto* large = pool.Allocate(largest_class + 1);
+  pool.Release(large);
+  EXPECT_EQ(counting.free_count, 1u);
+  EXPECT_EQ(pool.GetCachedBytes(), 0u);
+}
+
+TEST(PooledAllocatorTest, RetentionCap) {
+  CountingAllocator counting;
+  PooledAllocator pool{counting, 4096};
+  pool.AddUser();
+
+  auto* first = pool.Allocate(4096);
+  auto* second = pool.Allocate(4096);
+  auto* small = pool.Allocate(256);
+  pool.Release(first);
+  EXPECT_EQ(pool.GetCachedBytes(), 4096u);
+
+  // The cache is full, so these go back to the wrapped allocator
+  pool.Release(second);
+  pool.Release(small);
+  EXPECT_EQ(counting.free_count, 2u);
+  EXPECT_EQ(pool.GetCachedBytes(), 4096u);
+
+  pool.Trim();
+  EXPECT_EQ(counting.free_count, 3u);
+  EXPECT_EQ(pool.GetCachedBytes(), 0u);
+}
+
+TEST(PooledAllocatorTest, CachesOnlyWithUsers) {
+  CountingAllocator counting;
+  PooledAllocator pool{counting};
+
+  pool.Release(pool.Allocate(1000));
+  EXPECT_EQ(counting.free_count, 1u);
+  EXPECT_EQ(pool.GetCachedBytes(), 0u);
+
+  pool.AddUser();
+  pool.AddUser();
+  pool.Release(pool.Allocate(1000));
+  EXPECT_EQ(pool.GetCachedBytes(), 1024u);
+
+  pool.RemoveUser();
+  EXPECT_EQ(pool.GetCachedBytes(), 1024u);
+
+  // The last user leaving releases the cache
+  pool.RemoveUser();
+  EXPECT_EQ(pool.GetCachedBytes(), 0u);
+  EXPECT_EQ(counting.free_count, 2u);
+  EXPECT_THROW(pool.RemoveUser(), std::runtime_error);
+}
+
+}  // namespace Generators::test
@@ -3,12 +3,14 @@
 
 from __future__ import annotations
 
+import json
 import os
 import sys
 import sysconfig
 from pathlib import Path
 import shutil
 import tempfile
+import threading
 import onnxruntime
 
 import numpy as np
@@ -169,6 +171,136 @@ def test_greedy_search(test_data_path, relative_model_path):
         assert np.array_equal(expected_sequence[i], generator.get_sequence(i))
 
 
+def test_generate(test_data_path):
+    model_path = os.fspath(Path(test_data_path) / "hf-internal-testing" / "tiny-random-gpt2-fp32")
+    model = og.Model(model_path)
+
+    search_params = og.GeneratorParams(model)
+    search_params.set_search_options(do_sample=False, max_length=10, batch_size=2)
+    input_ids = np.array([[0, 0, 0, 52], [0, 0, 195, 731]], dtype=np.int32)
+    expected_tokens = np.array([[204, 204, 204, 204, 204, 204], [731, 114, 114, 114, 114, 114]], dtype=np.int32)
+
+    generator = og.Generator(model, search_params)
+    generator.append_tokens(input_ids)
+    tokens = generator.generate(max_new_tokens=2)
+    assert tokens.shape == (2, 2)
+    tokens = np.concatenate([tokens, generator.generate()])
+    assert generator.is_done()
+    assert np.array_equal(tokens.T, expected_tokens)
+    assert generator.generate().shape[0] == 0
+
+    generator = og.Generator(model, search_params)
+    generator.append_tokens(input_ids)
+    chunks = list(generator.generate_stream(chunk_size=4))
+    assert [chunk.shape[0] for chunk in chunks] == [4, 2]
+    assert np.array_equal(np.concatenate(chunks).T, expected_tokens)
+
+
+def test_get_metrics(test_data_path):
+    model_path = os.fspath(Path(test_data_path) / "hf-internal-testing" / "tiny-random-gpt2-fp32")
+    model = og.Model(model_path)
+
+    search_params = og.GeneratorParams(model)
+    search_params.set_search_options(do_sample=False, max_length=10, batch_size=2)
+    generator = og.Generator(model, search_params)
+    generator.append_tokens(np.array([[0, 0, 0, 52], [0, 0, 195, 731]], dtype=np.int32))
+
+    # The first row picks the EOS token (98) on the first step, so only the second row keeps generating
+    logits = generator.get_logits().copy()
+    logits[0] = 0
+    logits[0, ..., 98] = 100
+    generator.set_logits(logits)
+    while not generator.is_done():
+        generator.generate_next_token()
+
+    metrics = generator.get_metrics()
+    assert metrics["prompt_token_count"] == 8
+    assert metrics["step_count"] == 6
+    assert metrics["generated_token_count"] == 1 + 6
+    assert metrics["time_to_first_token"] > 0
+    assert metrics["decode_time"] >= metrics["search_time"]
+    assert metrics["max_token_latency"] * 6 >= metrics["decode_time"]
+    assert metrics["tokens_per_second"] > 0
+
+
+def test_generate_async(test_data_path):
+    model_path = os.fspath(Path(test_data_path) / "hf-internal-testing" / "tiny-random-gpt2-fp32")
+    model = og.Model(model_path)
+    tokenizer = og.Tokenizer(model)
+
+    search_params = og.GeneratorParams(model)
+    search_params.set_search_options(do_sample=False, max_length=10, batch_size=2)
+    input_ids = np.array([[0, 0, 0, 52], [0, 0, 195, 731]], dtype=np.int32)
+    expected_tokens = np.array([[204, 204, 204, 204, 204, 204], [731, 114, 114, 114, 114, 114]], dtype=np.int32)
+
+    # The tokens arrive 4 steps at a time, the last call gets the 2 steps left
+    chunks, texts = [], []
+
+    def collect(tokens, chunk_texts):
+        chunks.append(tokens)
+        texts.append(chunk_texts)
+        return True
+
+    generator = og.Generator(model, search_params)
+    generator.append_tokens(input_ids)
+    generator.generate_async(collect, tokens_per_callback=4, tokenizer=tokenizer)
+    generator.wait_for_generate()
+    assert generator.is_done()
+    assert [chunk.shape for chunk in chunks] == [(4, 2), (2, 2)]
+    assert np.array_equal(np.concatenate(chunks).T, expected_tokens)
+    for row in range(2):
+        assert "".join(chunk_texts[row] for chunk_texts in texts) == tokenizer.decode(expected_tokens[row])
+
+    # Returning False stops after the first call, an exception in the callback is raised by wait_for_generate
+    chunks = []
+
+    def stop(tokens, chunk_texts):
+        chunks.append(tokens)
+        return False
+
+    generator = og.Generator(model, search_params)
+    generator.append_tokens(input_ids)
+    generator.generate_async(stop, tokens_per_callback=3)
+    generator.wait_for_generate()
+    assert len(chunks) == 1 and chunks[0].shape == (3, 2)
+    assert not generator.is_done()
+
+    def fail(tokens, chunk_texts):
+        raise ValueError("callback failed")
+
+    generator = og.Generator(model, search_params)
+    generator.append_tokens(input_ids)
+    generator.generate_async(fail)
+    with pytest.raises(RuntimeError, match="callback failed"):
+        generator.wait_for_generate()
+
+    # Calling generate_async again while a generation runs fails, and the running one keeps its callback
+    chunks, second_chunks = [], []
+    first_callback_called = threading.Event()
+    second_call_made = threading.Event()
+
+    def first(tokens, chunk_texts):
+        chunks.append(tokens)
+        first_callback_called.set()
+        second_call_made.wait(timeout=10)
+        return True
+
+    def second(tokens, chunk_texts):
+        second_chunks.append(tokens)
+        return True
+
+    generator = og.Generator(model, search_params)
+    generator.append_tokens(input_ids)
+    generator.generate_async(first, tokens_per_callback=1)
+    assert first_callback_called.wait(timeout=10)
+    with pytest.raises(RuntimeError, match="called again before WaitForGenerate"):
+        generator.generate_async(second)
+    second_call_made.set()
+    generator.wait_for_generate()
+    assert not second_chunks
+    assert np.array_equal(np.concatenate(chunks).T, expected_tokens)
+
+
 @pytest.mark.parametrize(
     "relative_model_path",
     (
@@ -921,3 +1053,263 @@ def test_preset_extra_inputs(test_data_path, device, phi2_for, extra_inputs):
 
         while not generator.is_done():
             generator.generate_next_token()
+
+
+@pytest.mark.skipif(
+    sysconfig.get_platform().endswith("arm64"),
+    reason="ONNX is not available on ARM64",
+)
+@pytest.mark.parametrize("ring_buffer", [True, False])
+def test_sliding_window_rewind(tmp_path, ring_buffer):
+    context_length, window_size, vocab_size = 16, 4, 64
+    pad_token_id = vocab_size - 1
+
+    def _make_model(model_path: Path):
+        """A decoder whose next token is the sum of the tokens it attends to (the cache and the window) modulo
+        vocab_size - 1. The cache holds the tokens themselves, so any position that is wrongly kept, dropped or
+        masked after a rewind changes the generated tokens."""
+        helper = onnx.helper
+        TensorProto = onnx.TensorProto
+        inputs = [
+            helper.make_tensor_value_info("input_ids", TensorProto.INT32, [1, "window"]),
+            helper.make_tensor_value_info("attention_mask", TensorProto.INT32, [1, context_length]),
+            helper.make_tensor_value_info("past_key_values.0.key", TensorProto.UINT8, [1, 1, 1, "past"]),
+            helper.make_tensor_value_info("past_key_values.0.value", TensorProto.UINT8, [1, 1, "past", 1]),
+        ]
+        outputs = [
+            helper.make_tensor_value_info("logits", TensorProto.FLOAT, [1, "window", vocab_size]),
+            helper.make_tensor_value_info("present.0.key", TensorProto.UINT8, [1, 1, 1, "window"]),
+            helper.make_tensor_value_info("present.0.value", TensorProto.UINT8, [1, 1, "window", 1]),
+        ]
+        initializers = [
+            helper.make_tensor("key_shape", TensorProto.INT64, [4], [1, 1, 1, -1]),
+            helper.make_tensor("value_shape", TensorProto.INT64, [4], [1, 1, -1, 1]),
+            helper.make_tensor("row_shape", TensorProto.INT64, [2], [1, -1]),
+            helper.make_tensor("zero", TensorProto.INT64, [1], [0]),
+            helper.make_tensor("one", TensorProto.INT64, [1], [1]),
+            helper.make_tensor("end", TensorProto.INT64, [1], [context_length]),
+            helper.make_tensor("modulus", TensorProto.FLOAT, [], [vocab_size - 1]),
+            helper.make_tensor("depth", TensorProto.INT64, [], [vocab_size]),
+            helper.make_tensor("one_hot_values", TensorProto.FLOAT, [2], [0.0, 10.0]),
+        ]
+        nodes = [
+            helper.make_node("Cast", ["input_ids"], ["ids_uint8"], to=TensorProto.UINT8),
+            helper.make_node("Reshape", ["ids_uint8", "key_shape"], ["present.0.key"]),
+            helper.make_node("Reshape", ["ids_uint8", "value_shape"], ["present.0.value"]),
+            # The cache positions come first in the attention mask, the window positions last
+            helper.make_node("Reshape", ["past_key_values.0.key", "row_shape"], ["past_row"]),
+            helper.make_node("Cast", ["past_row"], ["past_float"], to=TensorProto.FLOAT),
+            helper.make_node("Shape", ["past_row"], ["past_length"], start=1, end=2),
+            helper.make_node("Cast", ["attention_mask"], ["mask_float"], to=TensorProto.FLOAT),
+            helper.make_node("Slice", ["mask_float", "zero", "past_length", "one"], ["past_mask"]),
+            helper.make_node("Slice", ["mask_float", "past_length", "end", "one"], ["window_mask"]),
+            helper.make_node("Mul", ["past_float", "past_mask"], ["past_masked"]),
+            helper.make_node("ReduceSum", ["past_masked", "one"], ["past_sum"], keepdims=1),
+            helper.make_node("Cast", ["input_ids"], ["ids_float"], to=TensorProto.FLOAT),
+            helper.make_node("Mul", ["ids_float", "window_mask"], ["window_masked"]),
+            helper.make_node("CumSum", ["window_masked", "one"], ["window_sum"]),
+            helper.make_node("Add", ["window_sum", "past_sum"], ["total"]),
+            helper.make_node("Mod", ["total", "modulus"], ["next_float"], fmod=1),
+            helper.make_node("Cast", ["next_float"], ["next_tokens"], to=TensorProto.INT64),
+            helper.make_node("OneHot", ["next_tokens", "depth", "one_hot_values"], ["logits"], axis=-1),
+        ]
+        graph = helper.make_graph(nodes, "sliding_window_decoder", inputs, outputs, initializers)
+        model = helper.make_model(graph, opset_imports=[helper.make_opsetid("", 17)])
+        onnx.save(model, model_path / "decoder.onnx")
+
+        config = {
+            "model": {
+                "bos_token_id": 1,
+                "context_length": context_length,
+                "decoder": {
+                    "head_size": 1,
+                    "hidden_size": 1,
+                    "num_attention_heads": 1,
+                    "num_hidden_layers": 1,
+                    "num_key_value_heads": 1,
+                    "inputs": {
+                        "input_ids": "input_ids",
+                        "attention_mask": "attention_mask",
+                        "past_key_names": "past_key_values.%d.key",
+                        "past_value_names": "past_key_values.%d.value",
+                    },
+                    "outputs": {
+                        "logits": "logits",
+                        "present_key_names": "present.%d.key",
+                        "present_value_names": "present.%d.value",
+                    },
+                    "sliding_window": {
+                        "window_size": window_size,
+                        "pad_value": 5,
+                        "ring_buffer": ring_buffer,
+                    },
+                    "pipeline": [
+                        {
+                            "decoder": {
+                                "filename": "decoder.onnx",
+                                "inputs": [inp.name for inp in inputs],
+                                "outputs": [out.name for out in outputs],
+                            }
+                        }
+                    ],
+                },
+                "eos_token_id": pad_token_id,
+                "pad_token_id": pad_token_id,
+                "type": "decoder-pipeline",
+                "vocab_size": vocab_size,
+            },
+            "search": {"do_sample": False, "max_length": 40},
+        }
+        with open(model_path / "genai_config.json", "w") as f:
+            json.dump(config, f)
+
+    def _expected_sequence(sequence, first_kept, max_length):
+        # The model attends to the last context_length positions, except those before first_kept: the padding of
+        # the prompt, or tokens that had already left the window when it was rewound
+        sequence = list(sequence)
+        while len(sequence) < max_length:
+            start = max(first_kept, len(sequence) - context_length)
+            sequence.append(sum(sequence[start:]) % (vocab_size - 1))
+        return sequence
+
+    def _generate(generator):
+        while not generator.is_done():
+            generator.generate_next_token()
+        return list(generator.get_sequence(0))
+
+    _make_model(tmp_path)
+    model = og.Model(os.fspath(tmp_path))
+    params = og.GeneratorParams(model)
+    params.set_search_options(max_length=40)
+    generator = og.Generator(model, params)
+
+    # The prompt is padded to two windows, [pad, pad, 3, 9] and [27, 14, 6, 1]
+    prompt = [3, 9, 27, 14, 6, 1]
+    num_pads = 2
+    generator.append_tokens(np.array([prompt], dtype=np.int32))
+    sequence = _generate(generator)
+    assert sequence == _expected_sequence([pad_token_id] * num_pads + prompt, num_pads, 40)
+
+    # The last generated token is not run yet, so the window holds positions 24 to 38. Drop the last tokens and
+    # append several tokens at once, which are processed one at a time.
+    first_kept = 40 - 1 - (context_length - 1)
+    generator.rewind_to(30)
+    generator.append_tokens(np.array([[11, 22]], dtype=np.int32))
+    rewound_sequence = _generate(generator)
+    assert rewound_sequence == _expected_sequence(sequence[:30] + [11, 22], first_kept, 40)
+
+    # Rewind right after appending, the generator then runs the first dropped token again
+    generator.rewind_to(25)
+    generator.append_tokens(np.array([[7, 8]], dtype=np.int32))
+    generator.rewind_to(26)
+    assert _generate(generator) == _expected_sequence(rewound_sequence[:25] + [7, 8], first_kept, 40)
+
+    # The window only holds the last context_length - 1 tokens
+    with pytest.raises(RuntimeError):
+        generator.rewind_to(40 - context_length)
+
+    # Rewinding to 0 processes the next tokens as a new prompt, with the window state back to its initial values
+    generator.rewind_to(0)
+    generator.append_tokens(np.array([prompt], dtype=np.int32))
+    assert _generate(generator) == sequence
+
+
+@pytest.mark.skipif(
+    sysconfig.get_platform().endswith("arm64"),
+    reason="ONNX is not available on ARM64",
+)
+def test_static_io_matches_run(tmp_path):
+    max_length, vocab_size = 24, 61
+
+    def _make_model(model_path: Path, static_io: bool):
+        """A decoder whose next token depends on the last input token and on how many positions the attention mask
+        lets it see, so a step that runs with a stale input_ids or attention_mask binding generates another token."""
+        helper = onnx.helper
+        TensorProto = onnx.TensorProto
+        inputs = [
+            helper.make_tensor_value_info("input_ids", TensorProto.INT32, ["batch", "sequence"]),
+            helper.make_tensor_value_info("attention_mask", TensorProto.INT32, ["batch", "total"]),
+            helper.make_tensor_value_info("past_key_values.0.key", TensorProto.FLOAT, ["batch", 1, max_length, 1]),
+            helper.make_tensor_value_info("past_key_values.0.value", TensorProto.FLOAT, ["batch", 1, max_length, 1]),
+        ]
+        outputs = [
+            helper.make_tensor_value_info("logits", TensorProto.FLOAT, ["batch", "sequence", vocab_size]),
+            helper.make_tensor_value_info("present.0.key", TensorProto.FLOAT, ["batch", 1, max_length, 1]),
+            helper.make_tensor_value_info("present.0.value", TensorProto.FLOAT, ["batch", 1, max_length, 1]),
+        ]
+        initializers = [
+            helper.make_tensor("one", TensorProto.INT64, [1], [1]),
+            helper.make_tensor("seven", TensorProto.FLOAT, [], [7.0]),
+            helper.make_tensor("modulus", TensorProto.FLOAT, [], [vocab_size - 1]),
+            helper.make_tensor("depth", TensorProto.INT64, [], [vocab_size]),
+            helper.make_tensor("one_hot_values", TensorProto.FLOAT, [2], [0.0, 10.0]),
+        ]
+        nodes = [
+            helper.make_node("Identity", ["past_key_values.0.key"], ["present.0.key"]),
+            helper.make_node("Identity", ["past_key_values.0.value"], ["present.0.value"]),
+            helper.make_node("Cast", ["attention_mask"], ["mask_float"], to=TensorProto.FLOAT),
+            helper.make_node("ReduceSum", ["mask_float", "one"], ["seen"], keepdims=1),
+            helper.make_node("Cast", ["input_ids"], ["ids_float"], to=TensorProto.FLOAT),
+            helper.make_node("Mul", ["ids_float", "seven"], ["ids_scaled"]),
+            helper.make_node("Add", ["ids_scaled", "seen"], ["total"]),
+            helper.make_node("Mod", ["total", "modulus"], ["next_float"], fmod=1),
+            helper.make_node("Cast", ["next_float"], ["next_tokens"], to=TensorProto.INT64),
+            helper.make_node("OneHot", ["next_tokens", "depth", "one_hot_values"], ["logits"], axis=-1),
+        ]
+        graph = helper.make_graph(nodes, "static_io_decoder", inputs, outputs, initializers)
+        model = helper.make_model(graph, opset_imports=[helper.make_opsetid("", 17)])
+        model_path.mkdir()
+        onnx.save(model, model_path / "decoder.onnx")
+
+        config = {
+            "model": {
+                "bos_token_id": 1,
+                "context_length": max_length,
+                "decoder": {
+                    "filename": "decoder.onnx",
+                    "head_size": 1,
+                    "hidden_size": 1,
+                    "num_attention_heads": 1,
+                    "num_hidden_layers": 1,
+                    "num_key_value_heads": 1,
+                    "static_io": static_io,
+                    "inputs": {
+                        "input_ids": "input_ids",
+                        "attention_mask": "attention_mask",
+                        "past_key_names": "past_key_values.%d.key",
+                        "past_value_names": "past_key_values.%d.value",
+                    },
+                    "outputs": {
+                        "logits": "logits",
+                        "present_key_names": "present.%d.key",
+                        "present_value_names": "present.%d.value",
+                    },
+                },
+                "eos_token_id": vocab_size - 1,
+                "pad_token_id": vocab_size - 1,
+                "type": "llama",
+                "vocab_size": vocab_size,
+            },
+            "search": {"do_sample": False, "max_length": max_length, "past_present_share_buffer": True},
+        }
+        with open(model_path / "genai_config.json", "w") as f:
+            json.dump(config, f)
+
+    def _generate(model_path: Path):
+        model = og.Model(os.fspath(model_path))
+        params = og.GeneratorParams(model)
+        params.set_search_options(batch_size=2)
+        generator = og.Generator(model, params)
+        generator.append_tokens(np.array([[3, 9, 27], [14, 6, 1]], dtype=np.int32))
+        steps = 0
+        while not generator.is_done():
+            generator.generate_next_token()
+            steps += 1
+        return steps, [list(generator.get_sequence(row)) for row in range(2)]
+
+    _make_model(tmp_path / "run", static_io=False)
+    _make_model(tmp_path / "static_io", static_io=True)
+
+    steps, expected = _generate(tmp_path / "run")
+    assert steps > 2  # The prompt step and several decode steps, which reuse the static io binding
+    assert _generate(tmp_path / "static_io") == (steps, expected)
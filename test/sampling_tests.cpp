@@ -3,9 +3,11 @@
 
 #include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstring>  // for memcmp
 #include <numeric>
 #include <random>
+#include <set>
 #include "span.h"
 #define OGA_USE_SPAN 1
 #include <ort_genai.h>
@@ -77,6 +79,345 @@ TEST(SamplingTests, BatchedSamplingTopKCpu) {
   }
 }
 
+TEST(SamplingTests, GreedyTopLogProbsCpu) {
+  std::vector<float> logits_cpu{0.1f, 0.6f, 0.1f, 0.3f, 0.1f,
+                                2.0f, 0.5f, 1.0f, 0.0f, 0.0f};
+
+  auto config = OgaConfig::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  config->Overlay(R"({ "model": { "vocab_size" : 5 } })");
+
+  auto model = OgaModel::Create(*config);
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 10);
+  params->SetSearchOption("batch_size", 2);
+  params->SetSearchOption("top_logprobs", 2);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  auto logits_tensor = OgaTensor::Create(logits_cpu.data(), std::array<int64_t, 2>{2LL, 5LL});
+  generator->SetLogits(*logits_tensor);
+  generator->GenerateNextToken();
+
+  std::vector<int32_t> expected_top_ids{1, 3, 0, 2};
+  for (size_t b = 0; b < 2; b++) {
+    std::unique_ptr<OgaTensor> logprobs, top_ids, top_logprobs;
+    generator->GetSequenceLogProbs(b, logprobs, top_ids, top_logprobs);
+    EXPECT_EQ(top_ids->Shape(), (std::vector<int64_t>{1, 1, 2}));
+
+    auto row = std::span<const float>(logits_cpu).subspan(b * 5, 5);
+    float exp_sum = 0.0f;
+    for (float logit : row)
+      exp_sum += std::exp(logit);
+    auto top_ids_data = reinterpret_cast<int32_t*>(top_ids->Data());
+    auto top_logprobs_data = reinterpret_cast<float*>(top_logprobs->Data());
+    for (size_t i = 0; i < 2; i++) {
+      EXPECT_EQ(expected_top_ids[b * 2 + i], top_ids_data[i]);
+      EXPECT_NEAR(row[top_ids_data[i]] - std::log(exp_sum), top_logprobs_data[i], 1e-5f);
+    }
+    // Greedy selects the best candidate
+    EXPECT_NEAR(top_logprobs_data[0], reinterpret_cast<float*>(logprobs->Data())[0], 1e-5f);
+  }
+}
+
+TEST(SamplingTests, BeamSearchLogProbsCpu) {
+  std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+  const size_t prompt_length = 4;
+  const size_t top_n = 8;  // A beam continues with one of its 2 * num_beams best tokens
+
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 20);
+  params->SetSearchOption("batch_size", 2);
+  params->SetSearchOption("num_beams", 4);
+  params->SetSearchOption("num_return_sequences", 2);
+  params->SetSearchOption("top_logprobs", top_n);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  generator->AppendTokens(input_ids.data(), input_ids.size());
+  while (!generator->IsDone())
+    generator->GenerateNextToken();
+
+  // The records of each finalized hypothesis follow the beams it was selected from
+  for (size_t i = 0; i < 4; i++) {
+    auto sequence = generator->GetSequence(i);
+    std::unique_ptr<OgaTensor> logprobs, top_ids, top_logprobs;
+    generator->GetSequenceLogProbs(i, logprobs, top_ids, top_logprobs);
+    ASSERT_EQ(logprobs->Shape(), (std::vector<int64_t>{1, static_cast<int64_t>(sequence.size())}));
+
+    auto logprobs_data = reinterpret_cast<float*>(logprobs->Data());
+    auto top_ids_data = reinterpret_cast<int32_t*>(top_ids->Data());
+    auto top_logprobs_data = reinterpret_cast<float*>(top_logprobs->Data());
+    for (size_t t = 0; t < prompt_length; t++) {
+      EXPECT_EQ(logprobs_data[t], 0.0f);
+      EXPECT_EQ(top_ids_data[t * top_n], -1);
+    }
+    for (size_t t = prompt_length; t < sequence.size(); t++) {
+      auto candidates = std::span<const int32_t>(top_ids_data + t * top_n, top_n);
+      auto candidate = std::find(candidates.begin(), candidates.end(), sequence[t]);
+      ASSERT_NE(candidate, candidates.end());
+      EXPECT_NEAR(logprobs_data[t], top_logprobs_data[t * top_n + (candidate - candidates.begin())], 1e-5f);
+    }
+  }
+}
+
+TEST(SamplingTests, PerRowSearchOptionsCpu) {
+  std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 10);
+  params->SetSearchOption("batch_size", 2);
+  // Row 0 is greedy and stops after 2 new tokens, row 1 samples from its top 2 tokens until the batch max_length
+  params->SetRowSearchOption(0, "max_length", 6);
+  params->SetRowSearchOptionBool(1, "do_sample", true);
+  params->SetRowSearchOption(1, "top_k", 2);
+  params->SetRowSearchOption(1, "random_seed", 42);
+  EXPECT_THROW(params->SetRowSearchOption(1, "num_beams", 2), std::runtime_error);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  generator->AppendTokens(input_ids.data(), input_ids.size());
+  while (!generator->IsDone())
+    generator->GenerateNextToken();
+
+  // Row 0 is padded once it reached its own max_length
+  auto row_0 = generator->GetSequence(0);
+  ASSERT_EQ(row_0.size(), 10u);
+  for (size_t i = 6; i < row_0.size(); i++)
+    EXPECT_EQ(row_0[i], 98);  // pad_token_id
+}
+
+TEST(SamplingTests, PerRowSamplingOptionsCpu) {
+  // The same distribution for every row, with token 0 the most likely
+  const std::array<float, 5> probabilities{0.4f, 0.3f, 0.2f, 0.05f, 0.05f};
+  const int batch_size = 4;
+  std::vector<float> logits_cpu;
+  for (int b = 0; b < batch_size; b++)
+    for (float probability : probabilities)
+      logits_cpu.push_back(std::log(probability));
+
+  auto config = OgaConfig::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  config->Overlay(R"({ "model": { "vocab_size" : 5 } })");
+  auto model = OgaModel::Create(*config);
+  auto params = OgaGeneratorParams::Create(*model);
+  const int steps = 50;
+  params->SetSearchOption("max_length", steps);
+  params->SetSearchOption("batch_size", batch_size);
+  params->SetSearchOptionBool("do_sample", true);
+  params->SetSearchOption("top_k", 5);
+  params->SetSearchOption("random_seed", 42);
+  params->SetRowSearchOption(0, "top_k", 2);          // Only tokens 0 and 1
+  params->SetRowSearchOption(1, "top_p", 0.5);        // 0.4 + 0.3 reaches top_p, so only tokens 0 and 1
+  params->SetRowSearchOption(2, "temperature", 0.01);  // Sharpened until only token 0 is left
+  // Row 3 samples from all tokens with the batch options
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  auto logits_tensor = OgaTensor::Create(logits_cpu.data(), std::array<int64_t, 2>{batch_size, 5LL});
+  for (int step = 0; step < steps; step++) {
+    generator->SetLogits(*logits_tensor);
+    generator->GenerateNextToken();
+  }
+
+  auto tokens = [&](size_t row) {
+    auto sequence = generator->GetSequence(row);
+    return std::vector<int32_t>(sequence.begin(), sequence.end());
+  };
+  auto is_token = [](std::vector<int32_t> allowed) {
+    return [allowed = std::move(allowed)](int32_t token) { return std::find(allowed.begin(), allowed.end(), token) != allowed.end(); };
+  };
+
+  for (size_t row : {0, 1}) {
+    auto row_tokens = tokens(row);
+    ASSERT_EQ(row_tokens.size(), static_cast<size_t>(steps));
+    EXPECT_TRUE(std::all_of(row_tokens.begin(), row_tokens.end(), is_token({0, 1})));
+    EXPECT_TRUE(std::any_of(row_tokens.begin(), row_tokens.end(), is_token({1})));
+  }
+  auto row_2 = tokens(2);
+  EXPECT_TRUE(std::all_of(row_2.begin(), row_2.end(), is_token({0})));
+  auto row_3 = tokens(3);
+  EXPECT_TRUE(std::any_of(row_3.begin(), row_3.end(), is_token({2, 3, 4})));
+}
+
+TEST(SamplingTests, PerRowSearchOptionsRejectedByBeamSearchCpu) {
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 10);
+  params->SetSearchOption("num_beams", 2);
+  params->SetRowSearchOption(0, "max_length", 6);
+  EXPECT_THROW(OgaGenerator::Create(*model, *params), std::runtime_error);
+}
+
+TEST(SamplingTests, TopKPadsFinishedRowsCpu) {
+  // Row 0 generates EOS (token 0) on both steps, row 1 never does
+  std::vector<float> logits_cpu{30.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+                                0.0f, 30.0f, 0.0f, 0.0f, 0.0f};
+
+  auto config = OgaConfig::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  config->Overlay(R"({ "model": { "vocab_size" : 5, "eos_token_id" : 0, "pad_token_id" : 4 } })");
+  auto model = OgaModel::Create(*config);
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 10);
+  params->SetSearchOption("batch_size", 2);
+  params->SetSearchOptionBool("do_sample", true);
+  params->SetSearchOption("top_k", 2);
+  params->SetSearchOption("random_seed", 42);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  auto logits_tensor = OgaTensor::Create(logits_cpu.data(), std::array<int64_t, 2>{2LL, 5LL});
+  for (int step = 0; step < 2; step++) {
+    generator->SetLogits(*logits_tensor);
+    generator->GenerateNextToken();
+  }
+
+  // The finished row is padded instead of sampled again, so its second EOS does not finish the batch
+  EXPECT_FALSE(generator->IsDone());
+  auto row_0 = generator->GetSequence(0);
+  EXPECT_EQ(std::vector<int32_t>(row_0.begin(), row_0.end()), (std::vector<int32_t>{0, 4}));
+  auto row_1 = generator->GetSequence(1);
+  EXPECT_EQ(std::vector<int32_t>(row_1.begin(), row_1.end()), (std::vector<int32_t>{1, 1}));
+}
+
+TEST(SamplingTests, LogitsProcessorChainCpu) {
+  const std::vector<float> row_logits{1.0f, 3.0f, 2.0f, 0.5f, -1.0f};
+  std::vector<float> logits_cpu;
+  for (int b = 0; b < 2; b++)
+    logits_cpu.insert(logits_cpu.end(), row_logits.begin(), row_logits.end());
+
+  auto config = OgaConfig::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  config->Overlay(R"({ "model": { "vocab_size" : 5, "eos_token_id" : 2, "pad_token_id" : 4 } })");
+  auto model = OgaModel::Create(*config);
+  auto params = OgaGeneratorParams::Create(*model);
+  params->SetSearchOption("max_length", 10);
+  params->SetSearchOption("batch_size", 2);
+  params->SetSearchOption("top_logprobs", 5);
+  params->SetRowSearchOption(0, "repetition_penalty", 2.0);
+  params->SetRowSearchOption(1, "min_length", 3);
+
+  auto generator = OgaGenerator::Create(*model, *params);
+  auto logits_tensor = OgaTensor::Create(logits_cpu.data(), std::array<int64_t, 2>{2LL, 5LL});
+  for (int step = 0; step < 2; step++) {
+    generator->SetLogits(*logits_tensor);
+    generator->GenerateNextToken();
+  }
+
+  // The unfused path: min length over the row, then the repetition penalty over the row, then log softmax
+  auto expected_logprobs = [&](size_t row, std::span<const int32_t> previous_tokens) {
+    std::vector<float> scores = row_logits;
+    if (row == 1 && previous_tokens.size() < 3)
+      scores[2] = std::numeric_limits<float>::lowest();
+    if (row == 0) {
+      for (int32_t token : std::set<int32_t>(previous_tokens.begin(), previous_tokens.end()))
+        scores[token] = scores[token] < 0 ? scores[token] * 2.0f : scores[token] / 2.0f;
+    }
+    const float max_score = *std::max_element(scores.begin(), scores.end());
+    float exp_sum = 0.0f;
+    for (float score : scores)
+      exp_sum += std::exp(score - max_score);
+    for (float& score : scores)
+      score -= max_score + std::log(exp_sum);
+    return scores;
+  };
+
+  for (size_t row = 0; row < 2; row++) {
+    auto sequence = generator->GetSequence(row);
+    ASSERT_EQ(sequence.size(), 2u);
+    std::unique_ptr<OgaTensor> logprobs, top_ids, top_logprobs;
+    generator->GetSequenceLogProbs(row, logprobs, top_ids, top_logprobs);
+    auto top_ids_data = reinterpret_cast<int32_t*>(top_ids->Data());
+    auto top_logprobs_data = reinterpret_cast<float*>(top_logprobs->Data());
+
+    for (size_t position = 0; position < 2; position++) {
+      auto expected = expected_logprobs(row, std::span<const int32_t>(sequence.data(), position));
+      for (size_t i = 0; i < 5; i++) {
+        const float actual = top_logprobs_data[position * 5 + i];
+        const float expected_logprob = expected[top_ids_data[position * 5 + i]];
+        if (expected_logprob < -1e30f)
+          EXPECT_LT(actual, -1e30f);
+        else
+          EXPECT_NEAR(expected_logprob, actual, 1e-5f);
+      }
+    }
+  }
+}
+
+TEST(SamplingTests, StopSequencesCpu) {
+  std::vector<int32_t> input_ids{0, 0, 0, 52, 0, 0, 195, 731};
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+
+  auto generate = [&](const std::vector<std::vector<int32_t>>& stop_sequences, bool do_sample) {
+    auto params = OgaGeneratorParams::Create(*model);
+    params->SetSearchOption("max_length", 20);
+    if (do_sample) {
+      params->SetSearchOptionBool("do_sample", true);
+      params->SetSearchOption("top_k", 5);
+      params->SetSearchOption("random_seed", 42);
+    }
+    for (const auto& stop_sequence : stop_sequences)
+      params->AddStopSequence(stop_sequence.data(), stop_sequence.size());
+    auto generator = OgaGenerator::Create(*model, *params);
+    generator->AppendTokens(input_ids.data(), input_ids.size());
+    while (!generator->IsDone())
+      generator->GenerateNextToken();
+    auto sequence = generator->GetSequence(0);
+    return std::vector<int32_t>(sequence.begin(), sequence.end());
+  };
+
+  // The same seed samples the same tokens until the stop sequence
+  for (bool do_sample : {false, true}) {
+    auto reference = generate({}, do_sample);
+    ASSERT_GT(reference.size(), input_ids.size() + 4);
+
+    // Stop on the 3rd and 4th generated tokens, the other sequence never completes
+    std::vector<int32_t> stop_sequence{reference[input_ids.size() + 2], reference[input_ids.size() + 3]};
+    auto stopped = generate({{stop_sequence[0], -1}, stop_sequence}, do_sample);
+
+    auto generated_begin = reference.begin() + input_ids.size();
+    auto match = std::search(generated_begin, reference.end(), stop_sequence.begin(), stop_sequence.end());
+    auto expected_length = static_cast<size_t>(match - reference.begin()) + stop_sequence.size();
+    ASSERT_EQ(stopped.size(), expected_length);
+    EXPECT_TRUE(std::equal(stopped.begin(), stopped.end(), reference.begin()));
+  }
+
+  auto params = OgaGeneratorParams::Create(*model);
+  EXPECT_THROW(params->AddStopSequence(input_ids.data(), 0), std::runtime_error);
+}
+
+TEST(SamplingTests, BeamSearchStopSequencesCpu) {
+  std::vector<int32_t> input_ids{0, 0, 0, 52};
+  const int num_beams = 4;
+  auto model = OgaModel::Create(MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+
+  auto generate = [&](const std::vector<int32_t>* stop_sequence) {
+    auto params = OgaGeneratorParams::Create(*model);
+    params->SetSearchOption("max_length", 20);
+    params->SetSearchOption("num_beams", num_beams);
+    params->SetSearchOption("num_return_sequences", num_beams);
+    if (stop_sequence)
+      params->AddStopSequence(stop_sequence->data(), stop_sequence->size());
+    auto generator = OgaGenerator::Create(*model, *params);
+    generator->AppendTokens(input_ids.data(), input_ids.size());
+    while (!generator->IsDone())
+      generator->GenerateNextToken();
+
+    std::vector<std::vector<int32_t>> sequences;
+    for (int i = 0; i < num_beams; i++) {
+      auto sequence = generator->GetSequence(i);
+      sequences.emplace_back(sequence.begin(), sequence.end());
+    }
+    return sequences;
+  };
+
+  auto reference = generate(nullptr)[0];
+  ASSERT_GT(reference.size(), input_ids.size() + 4);
+  std::vector<int32_t> stop_sequence{reference[input_ids.size() + 2], reference[input_ids.size() + 3]};
+
+  // A beam that completes the stop sequence is finished, so no hypothesis goes on past a stop sequence
+  for (const auto& sequence : generate(&stop_sequence)) {
+    auto generated_begin = sequence.begin() + input_ids.size();
+    auto match = std::search(generated_begin, sequence.end(), stop_sequence.begin(), stop_sequence.end());
+    if (match != sequence.end())
+      EXPECT_EQ(match + stop_sequence.size(), sequence.end());
+  }
+}
+
 TEST(SamplingTests, BatchedSamplingTopPAndKCpu) {
   std::vector<int32_t> input_ids{0, 1, 2, 3};
   std::vector<float> logits_cpu{2.0f, 1.5f, 1.25f, 0.25f, 0.25f,
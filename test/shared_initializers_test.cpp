@@ -0,0 +1,161 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "generators.h"
+#include "model_data.h"
+#include "models/model.h"
+#include "models/shared_initializers.h"
+
+#include <cstdio>
+
+#include <gtest/gtest.h>
+
+#ifndef MODEL_PATH
+#define MODEL_PATH "../../test/test_models/"
+#endif
+
+namespace Generators::test {
+
+namespace {
+
+// Writes just enough of the protobuf wire format to build ONNX models by hand
+void AppendVarint(std::string& out, uint64_t value) {
+  for (; value >= 0x80; value >>= 7)
+    out += static_cast<char>((value & 0x7f) | 0x80);
+  out += static_cast<char>(value);
+}
+
+void AppendVarintField(std::string& out, uint32_t field, uint64_t value) {
+  AppendVarint(out, field << 3);
+  AppendVarint(out, value);
+}
+
+void AppendBytesField(std::string& out, uint32_t field, std::string_view bytes) {
+  AppendVarint(out, (field << 3) | 2);
+  AppendVarint(out, bytes.size());
+  out += bytes;
+}
+
+std::string MakeTensor(std::string_view name, std::initializer_list<int64_t> dims, ONNXTensorElementDataType type) {
+  std::string tensor;
+  for (auto dim : dims)
+    AppendVarintField(tensor, 1, static_cast<uint64_t>(dim));
+  AppendVarintField(tensor, 2, type);
+  AppendBytesField(tensor, 8, name);
+  return tensor;
+}
+
+std::string MakeModel(std::initializer_list<std::string> initializers) {
+  std::string graph;
+  AppendBytesField(graph, 2, "graph_name");  // A field that is skipped
+  for (auto& initializer : initializers)
+    AppendBytesField(graph, 5, initializer);
+  std::string model;
+  AppendVarintField(model, 1, 8);  // ir_version
+  AppendBytesField(model, 7, graph);
+  return model;
+}
+
+std::span<const uint8_t> AsBytes(std::string_view text) {
+  return {reinterpret_cast<const uint8_t*>(text.data()), text.size()};
+}
+
+}  // namespace
+
+TEST(SharedInitializersTest, LoadsRawAndExternalData) {
+  GetOrtEnv();
+
+  const std::vector<float> weights{1, 2, 3, 4, 5, 6};
+  auto raw = MakeTensor("raw", {2, 3}, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT);
+  AppendBytesField(raw, 9, {reinterpret_cast<const char*>(weights.data()), weights.size() * sizeof(float)});
+
+  auto external = MakeTensor("external", {4}, ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32);
+  const std::vector<std::pair<std::string_view, std::string_view>> external_data_entries{
+      {"location", "weights.data"}, {"offset", "16"}, {"length", "16"}};
+  for (auto [key, value] : external_data_entries) {
+    std::string entry;
+    AppendBytesField(entry, 1, key);
+    AppendBytesField(entry, 2, value);
+    AppendBytesField(external, 13, entry);
+  }
+  AppendVarintField(external, 14, 1);
+
+  // Strings are left for the session to load
+  auto strings = MakeTensor("strings", {1}, ONNX_TENSOR_ELEMENT_DATA_TYPE_STRING);
+  AppendBytesField(strings, 6, "text");
+
+  const auto model = MakeModel({raw, external, strings});
+  EXPECT_EQ(GetExternalDataLocations(AsBytes(model)), std::vector<std::string>{"weights.data"});
+
+  std::vector<uint8_t> external_data(32);
+  auto model_data = std::make_shared<ModelData>();
+  model_data->Add("weights.data", external_data);
+
+  const auto loaded_bytes = SharedInitializers::GetLoadedBytes();
+  {
+    SharedInitializers initializers{AsBytes(model), fs::path{"."}, "model.onnx", model_data};
+    EXPECT_EQ(initializers.Count(), 2u);
+    // The raw data is copied, the external data in memory is referenced in place
+    EXPECT_EQ(SharedInitializers::GetLoadedBytes(), loaded_bytes + weights.size() * sizeof(float));
+  }
+  EXPECT_EQ(SharedInitializers::GetLoadedBytes(), loaded_bytes);
+
+  // External data that is not where the model says fails to load
+  auto short_data = std::make_shared<ModelData>();
+  short_data->Add("weights.data", std::span<const uint8_t>{external_data}.first(20));
+  EXPECT_THROW((SharedInitializers{AsBytes(model), fs::path{"."}, "model.onnx", short_data}), std::runtime_error);
+
+  const std::string truncated = model.substr(0, model.size() - 3);
+  EXPECT_THROW((SharedInitializers{AsBytes(truncated), fs::path{"."}, "model.onnx", model_data}), std::runtime_error);
+}
+
+TEST(SharedInitializersTest, SecondModelLoadsNoWeights) {
+  const auto loaded_bytes = SharedInitializers::GetLoadedBytes();
+  auto create_replica = [] {
+    auto config = std::make_unique<Config>(fs::path{MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32"},
+                                           R"({ "model": { "share_initializers": true } })");
+    return CreateModel(GetOrtEnv(), std::move(config));
+  };
+
+  // Without the opt-in the session loads its weights itself
+  auto unshared = CreateModel(GetOrtEnv(), MODEL_PATH "hf-internal-testing/tiny-random-gpt2-fp32");
+  EXPECT_EQ(SharedInitializers::GetLoadedBytes(), loaded_bytes);
+  unshared.reset();
+
+  auto model = create_replica();
+  if (model->p_device_->GetType() != DeviceType::CPU)
+    GTEST_SKIP() << "Initializers are only shared by sessions on the CPU";
+  const auto first_model_bytes = SharedInitializers::GetLoadedBytes() - loaded_bytes;
+  EXPECT_GT(first_model_bytes, 0u);
+
+  // The second replica of the model reuses the weights of the first
+  auto replica = create_replica();
+  EXPECT_EQ(SharedInitializers::GetLoadedBytes() - loaded_bytes, first_model_bytes);
+
+  model.reset();
+  EXPECT_EQ(SharedInitializers::GetLoadedBytes() - loaded_bytes, first_model_bytes);
+  replica.reset();
+  EXPECT_EQ(SharedInitializers::GetLoadedBytes(), loaded_bytes);
+}
+
+TEST(SharedInitializersTest, ModelFileIdentity) {
+  // What the shared state of a model file is keyed by: another path to the same file resolves to the same path, and a
+  // file replaced on disk no longer has the same size
+  const fs::path file{::testing::TempDir() + "model_file_identity.onnx"};
+  file.open_for_write() << "1234";
+  EXPECT_EQ((fs::path{::testing::TempDir()} / "." / "model_file_identity.onnx").canonical().string(), file.canonical().string());
+
+  uint64_t size{};
+  int64_t modified_time{};
+  ASSERT_TRUE(file.file_status(size, modified_time));
+  EXPECT_EQ(size, 4u);
+  file.open_for_write() << "123456";
+  ASSERT_TRUE(file.file_status(size, modified_time));
+  EXPECT_EQ(size, 6u);
+
+  std::remove(file.string().c_str());
+  EXPECT_FALSE(file.file_status(size, modified_time));
+  EXPECT_EQ(fs::path{"missing/model.onnx"}.canonical().string(), "missing/model.onnx");
+}
+
+}  // namespace Generators::test
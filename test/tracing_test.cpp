@@ -0,0 +1,149 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "generators.h"
+#include "tracing.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+namespace {
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream file{path};
+  std::stringstream text;
+  text << file.rdbuf();
+  return text.str();
+}
+
+size_t CountOf(const std::string& text, std::string_view pattern) {
+  size_t count = 0;
+  for (auto i = text.find(pattern); i != std::string::npos; i = text.find(pattern, i + pattern.size()))
+    count++;
+  return count;
+}
+
+// The value of the last "Dropped trace events" counter, 0 if nothing was dropped
+double LastDroppedCount(const std::string& text) {
+  const auto event = text.rfind("\"name\": \"Dropped trace events\"");
+  if (event == std::string::npos)
+    return 0;
+  constexpr std::string_view value_field{"\"value\": "};
+  const auto value = text.find(value_field, event);
+  return std::stod(text.substr(value + value_field.size()));
+}
+
+}  // namespace
+
+TEST(TracingTest, BufferWrapsAround) {
+  const auto path = ::testing::TempDir() + "tracing_wraparound.json";
+  {
+    Tracer tracer{path};
+    tracer.SetEnabled(true);
+
+    // Together more events than a buffer holds, but written out before it fills, so the buffer is reused from its start
+    constexpr int half = 6000;
+    for (int i = 0; i < half; i++)
+      tracer.Counter("n", i);
+    tracer.Flush();
+    for (int i = half; i < 2 * half; i++)
+      tracer.Counter("n", i);
+    tracer.Shutdown();
+
+    const auto text = ReadFile(path);
+    EXPECT_EQ(CountOf(text, "\"name\": \"n\""), 2u * half);
+    EXPECT_EQ(CountOf(text, "Dropped trace events"), 0u);
+    EXPECT_NE(text.find("{\"value\": 11999}"), std::string::npos);
+    EXPECT_EQ(text.substr(text.size() - 2), "]\n");
+  }
+  std::remove(path.c_str());
+}
+
+TEST(TracingTest, FullBufferCountsDrops) {
+  const auto path = ::testing::TempDir() + "tracing_drops.json";
+  {
+    Tracer tracer{path};
+    tracer.SetEnabled(true);
+
+    // Faster than the background thread writes, so once the buffer is full events are dropped
+    constexpr size_t total = 4 * 8192;
+    for (size_t i = 0; i < total; i++)
+      tracer.Counter("n", static_cast<double>(i));
+    tracer.Shutdown();
+
+    // Every event is either in the trace or counted as dropped
+    const auto text = ReadFile(path);
+    const auto dropped = LastDroppedCount(text);
+    EXPECT_GT(dropped, 0);
+    EXPECT_EQ(CountOf(text, "\"name\": \"n\"") + static_cast<size_t>(dropped), total);
+  }
+  std::remove(path.c_str());
+}
+
+TEST(TracingTest, NamesAreEscaped) {
+  const auto path = ::testing::TempDir() + "tracing_escaping.json";
+  {
+    Tracer tracer{path};
+    tracer.SetEnabled(true);
+    tracer.Counter("a\"b\\c\nd", 1);
+    tracer.Shutdown();
+
+    // Quotes and backslashes are escaped, control characters become spaces
+    EXPECT_NE(ReadFile(path).find("\"name\": \"a\\\"b\\\\c d\""), std::string::npos);
+  }
+  std::remove(path.c_str());
+}
+
+TEST(TracingTest, DurationsAreCompleteEvents) {
+  const auto path = ::testing::TempDir() + "tracing_durations.json";
+  {
+    Tracer tracer{path};
+    tracer.SetEnabled(true);
+    {
+      DurationTrace outer{tracer, "outer"};
+      DurationTrace inner{tracer, "inner"};
+    }
+    tracer.Shutdown();
+
+    // One event per duration, the inner one ends first
+    const auto text = ReadFile(path);
+    EXPECT_EQ(CountOf(text, "\"ph\": \"X\""), 2u);
+    EXPECT_EQ(CountOf(text, "\"dur\": "), 2u);
+    EXPECT_EQ(CountOf(text, "\"ph\": \"B\""), 0u);
+    EXPECT_EQ(CountOf(text, "\"ph\": \"E\""), 0u);
+    EXPECT_LT(text.find("\"inner\""), text.find("\"outer\""));
+  }
+  std::remove(path.c_str());
+}
+
+TEST(TracingTest, EnablingAgainStartsNewFile) {
+  const auto path = ::testing::TempDir() + "tracing_restart.json";
+  const auto next_path = ::testing::TempDir() + "tracing_restart.1.json";
+  {
+    Tracer tracer{path};
+    tracer.SetEnabled(true);
+    tracer.Counter("first", 1);
+    tracer.Shutdown();
+
+    tracer.SetEnabled(true);
+    tracer.Counter("second", 2);
+    tracer.Shutdown();
+
+    // The first trace is kept as it was
+    const auto first = ReadFile(path);
+    EXPECT_NE(first.find("\"first\""), std::string::npos);
+    EXPECT_EQ(first.find("\"second\""), std::string::npos);
+    const auto second = ReadFile(next_path);
+    EXPECT_NE(second.find("\"second\""), std::string::npos);
+    EXPECT_EQ(second.find("\"first\""), std::string::npos);
+  }
+  std::remove(path.c_str());
+  std::remove(next_path.c_str());
+}
+
+}  // namespace Generators::test
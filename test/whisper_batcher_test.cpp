@@ -0,0 +1,110 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "generators.h"
+#include "models/model.h"
+#include "models/whisper_batcher.h"
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+namespace {
+
+std::vector<size_t> Ids(const std::vector<WhisperRequests::Request>& batch) {
+  std::vector<size_t> ids;
+  for (const auto& request : batch)
+    ids.push_back(request.id);
+  return ids;
+}
+
+}  // namespace
+
+TEST(WhisperRequestsTest, BatchesOldestFirst) {
+  WhisperRequests requests;
+  EXPECT_TRUE(requests.StartBatch(4).empty());
+
+  // Ids 0..5, the decoder prompts of 2 and 4 are longer
+  for (size_t prompt_length : {3, 3, 4, 3, 4, 3})
+    requests.Add({0.5f}, std::vector<int32_t>(prompt_length, 1));
+  EXPECT_EQ(requests.GetQueuedCount(), 6u);
+
+  // The oldest request picks the prompt length, the others of that length follow in the order they were added
+  auto batch = requests.StartBatch(3);
+  EXPECT_EQ(Ids(batch), (std::vector<size_t>{0, 1, 3}));
+  EXPECT_EQ(batch[0].samples, std::vector<float>{0.5f});
+  EXPECT_EQ(requests.GetQueuedCount(), 3u);
+  EXPECT_EQ(requests.GetRowCount(), 3u);
+  EXPECT_EQ(requests.GetRunningCount(), 3u);
+
+  // Requests left behind keep their place
+  EXPECT_EQ(Ids(requests.StartBatch(3)), (std::vector<size_t>{2, 4}));
+  EXPECT_EQ(Ids(requests.StartBatch(3)), (std::vector<size_t>{5}));
+  EXPECT_EQ(requests.GetQueuedCount(), 0u);
+}
+
+TEST(WhisperRequestsTest, RowsFinishOnce) {
+  WhisperRequests requests;
+  for (int i = 0; i < 3; i++)
+    requests.Add({0.0f}, {1, 2});
+  requests.StartBatch(3);
+
+  // Rows finish in any order and are returned by id
+  EXPECT_EQ(requests.FinishRow(1), 1u);
+  EXPECT_TRUE(requests.IsRowFinished(1));
+  EXPECT_FALSE(requests.IsRowFinished(0));
+  EXPECT_EQ(requests.GetRunningCount(), 2u);
+  EXPECT_THROW(requests.FinishRow(1), std::runtime_error);
+
+  EXPECT_EQ(requests.FinishRow(2), 2u);
+  EXPECT_EQ(requests.FinishRow(0), 0u);
+  EXPECT_EQ(requests.GetRunningCount(), 0u);
+}
+
+TEST(WhisperRequestsTest, FailedBatchReturnsUnfinishedIds) {
+  WhisperRequests requests;
+  for (int i = 0; i < 5; i++)
+    requests.Add({0.0f}, {1, 2});
+  requests.StartBatch(3);
+  requests.FinishRow(1);
+
+  // Every request of the batch is either finished or failed, the queue is untouched
+  EXPECT_EQ(requests.FailBatch(), (std::vector<size_t>{0, 2}));
+  EXPECT_EQ(requests.GetRunningCount(), 0u);
+  EXPECT_TRUE(requests.FailBatch().empty());
+  EXPECT_EQ(requests.GetQueuedCount(), 2u);
+  EXPECT_EQ(Ids(requests.StartBatch(3)), (std::vector<size_t>{3, 4}));
+}
+
+TEST(WhisperRequestsTest, AddFromManyThreads) {
+  WhisperRequests requests;
+  constexpr size_t thread_count = 8, adds_per_thread = 100;
+  std::vector<std::thread> threads;
+  std::vector<std::vector<size_t>> ids(thread_count);
+  for (size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back([&, t] {
+      for (size_t i = 0; i < adds_per_thread; i++)
+        ids[t].push_back(requests.Add({static_cast<float>(t)}, {1}));
+    });
+  }
+
+  // The batches are taken while requests are still added
+  std::vector<size_t> batched_ids;
+  while (batched_ids.size() < thread_count * adds_per_thread) {
+    for (auto id : Ids(requests.StartBatch(7)))
+      batched_ids.push_back(id);
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  // Every id is given once and batched once, in the order it was given
+  std::vector<size_t> expected(thread_count * adds_per_thread);
+  std::iota(expected.begin(), expected.end(), size_t{0});
+  EXPECT_EQ(batched_ids, expected);
+  for (auto& thread_ids : ids)
+    EXPECT_TRUE(std::is_sorted(thread_ids.begin(), thread_ids.end()));
+}
+
+}  // namespace Generators::test
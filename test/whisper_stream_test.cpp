@@ -0,0 +1,95 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "generators.h"
+#include "models/model.h"
+#include "models/whisper_stream.h"
+
+#include <gtest/gtest.h>
+
+namespace Generators::test {
+
+namespace {
+
+std::vector<float> Ramp(size_t begin, size_t end) {
+  std::vector<float> samples(end - begin);
+  std::iota(samples.begin(), samples.end(), static_cast<float>(begin));
+  return samples;
+}
+
+std::vector<float> ToVector(std::span<const float> samples) {
+  return {samples.begin(), samples.end()};
+}
+
+}  // namespace
+
+TEST(AudioChunkerTest, ChunksOverlap) {
+  AudioChunker chunker{10, 4};
+  EXPECT_FALSE(chunker.HasNewSamples());
+
+  // Nothing is a chunk until a whole one is appended, the audio so far is there for partial results
+  chunker.Append(Ramp(0, 6));
+  EXPECT_TRUE(chunker.NextChunk().empty());
+  EXPECT_TRUE(chunker.HasNewSamples());
+  EXPECT_EQ(ToVector(chunker.Buffered()), Ramp(0, 6));
+  EXPECT_THROW(chunker.PopChunk(), std::runtime_error);
+
+  // Each chunk starts with the last 4 samples of the one before it
+  chunker.Append(Ramp(6, 23));
+  EXPECT_EQ(ToVector(chunker.NextChunk()), Ramp(0, 10));
+  chunker.PopChunk();
+  EXPECT_EQ(ToVector(chunker.NextChunk()), Ramp(6, 16));
+  chunker.PopChunk();
+  EXPECT_EQ(ToVector(chunker.NextChunk()), Ramp(12, 22));
+  chunker.PopChunk();
+  EXPECT_TRUE(chunker.NextChunk().empty());
+  EXPECT_EQ(ToVector(chunker.Buffered()), Ramp(18, 23));
+  EXPECT_TRUE(chunker.HasNewSamples());
+
+  chunker.Clear();
+  EXPECT_TRUE(chunker.Buffered().empty());
+  EXPECT_FALSE(chunker.HasNewSamples());
+}
+
+TEST(AudioChunkerTest, OverlapAloneIsNotNew) {
+  AudioChunker chunker{10, 4};
+  chunker.Append(Ramp(0, 10));
+  chunker.PopChunk();
+
+  // What is left was all transcribed with the last chunk
+  EXPECT_EQ(ToVector(chunker.Buffered()), Ramp(6, 10));
+  EXPECT_FALSE(chunker.HasNewSamples());
+  chunker.Append(Ramp(10, 11));
+  EXPECT_TRUE(chunker.HasNewSamples());
+
+  AudioChunker no_overlap{10, 0};
+  EXPECT_FALSE(no_overlap.Overlaps());
+  no_overlap.Append(Ramp(0, 10));
+  no_overlap.PopChunk();
+  EXPECT_TRUE(no_overlap.Buffered().empty());
+
+  EXPECT_THROW((AudioChunker{10, 10}), std::runtime_error);
+}
+
+TEST(WhisperStreamTest, FindTokenOverlap) {
+  const std::vector<int32_t> previous{1, 2, 3, 4, 5, 6};
+
+  // The longest start of the chunk that repeats the end of the last one
+  EXPECT_EQ(FindTokenOverlap(previous, std::vector<int32_t>{4, 5, 6, 7, 8}, 3), 3u);
+  EXPECT_EQ(FindTokenOverlap(previous, std::vector<int32_t>{1, 2, 3, 4, 5, 6}, 3), 6u);
+  EXPECT_EQ(FindTokenOverlap(previous, std::vector<int32_t>{3, 4, 5, 6}, 3), 4u);
+
+  // A single token or two in common is more likely a word said again than the overlap
+  EXPECT_EQ(FindTokenOverlap(previous, std::vector<int32_t>{6, 7, 8}, 3), 0u);
+  EXPECT_EQ(FindTokenOverlap(previous, std::vector<int32_t>{5, 6, 7}, 3), 0u);
+  EXPECT_EQ(FindTokenOverlap(previous, std::vector<int32_t>{6, 7, 8}, 1), 1u);
+
+  // The repeat must be at the very start and end
+  EXPECT_EQ(FindTokenOverlap(previous, std::vector<int32_t>{9, 4, 5, 6}, 3), 0u);
+  EXPECT_EQ(FindTokenOverlap(previous, std::vector<int32_t>{3, 4, 5, 9}, 3), 0u);
+
+  EXPECT_EQ(FindTokenOverlap({}, std::vector<int32_t>{1, 2, 3}, 3), 0u);
+  EXPECT_EQ(FindTokenOverlap(previous, {}, 3), 0u);
+}
+
+}  // namespace Generators::test